@@ -25,9 +25,16 @@
 #include <chrono>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <atomic>
 #include <thread>
 #include <memory>
+#include <functional>
+#include <vector>
+
+#if __cplusplus > 201703L && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#define LS_CALL_HAS_COROUTINES 1
+#endif
 
 #include <luna-service2/lunaservice.h>
 
@@ -58,25 +65,153 @@ public:
 
     void continueWith(LSFilterFunc callback, void *context);
 
+    // Continuation invoked for every reply on the GMainContext the handle is
+    // attached to. The reply is only valid during the invocation - take a
+    // reference with LSMessageRef() to keep it.
+    typedef std::function<void(LSMessage *reply)> Continuation;
+
+    // Non-blocking alternative to get(): replies that are already queued are
+    // passed to the continuation right away, the rest as they arrive.
+    void then(Continuation continuation);
+
     LSMessage *get();
 
     LSMessage *get(unsigned long msTimeout);
 
+#ifdef LS_CALL_HAS_COROUTINES
+    // Awaiter for C++20 coroutines: `LSMessage *reply = co_await call;`
+    // The coroutine is resumed from the reply callback, i.e. on the
+    // GMainContext the handle is attached to. As with get(), the caller owns
+    // a reference to the returned reply.
+    class ReplyAwaiter
+    {
+    public:
+        explicit ReplyAwaiter(Call &call) : _call(call), _reply(nullptr), _state(PENDING) {}
+
+        bool await_ready()
+        {
+            _reply = _call.tryGet();
+            return _reply != nullptr;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            LSMessage *reply = _call.thenOnce([this, handle](LSMessage *reply)
+                {
+                    LSMessageRef(reply);
+                    _reply = reply;
+                    // resume only if await_suspend() has suspended already
+                    int expected = PENDING;
+                    if (!_state.compare_exchange_strong(expected, REPLIED, std::memory_order_acq_rel))
+                        handle.resume();
+                });
+            if (reply)
+            {
+                // queued already, the continuation wasn't installed
+                _reply = reply;
+                return false;
+            }
+
+            // From now on the reply may be dispatched and resume the
+            // coroutine, which may destroy this awaiter. The state decides
+            // who is first: if the reply was, don't suspend.
+            int expected = PENDING;
+            return _state.compare_exchange_strong(expected, SUSPENDED, std::memory_order_acq_rel);
+        }
+
+        LSMessage *await_resume() { return _reply; }
+
+    private:
+        enum { PENDING, SUSPENDED, REPLIED };
+
+        Call &_call;
+        LSMessage *_reply;
+        std::atomic<int> _state;
+    };
+
+    ReplyAwaiter operator co_await() { return ReplyAwaiter(*this); }
+#endif
+
 private:
 
+    // Lock-free single-producer/single-consumer queue of replies. The
+    // producer is the reply callback, the consumer is the owner of the call.
+    // Replies that don't fit are spilled to a heap vector, keeping the order.
+    class ReplyRing
+    {
+    public:
+        ReplyRing();
+        ~ReplyRing();
+
+        ReplyRing(const ReplyRing &) = delete;
+        ReplyRing &operator=(const ReplyRing &) = delete;
+
+        void push(LSMessage *reply);
+
+        LSMessage *pop();
+
+    private:
+        static const size_t CAPACITY = 16;
+
+        LSMessage *_slots[CAPACITY];
+        std::atomic<size_t> _head;
+        std::atomic<size_t> _tail;
+        std::atomic<size_t> _overflowSize;
+        std::mutex _overflowMutex;
+        std::vector<LSMessage *> _overflow;
+        size_t _overflowHead;
+    };
+
+    // Context of the reply callback. It stays in place when the call is
+    // moved and is repointed to the new object under its lock, which also
+    // guards the handlers and the producer side of the reply ring.
+    struct ReplyTarget
+    {
+        explicit ReplyTarget(Call *call) : call(call) {}
+
+        std::mutex mutex;
+        Call *call;
+    };
+
+    // Handler of one reply, taken while locked and invoked unlocked
+    struct Handler
+    {
+        LSFilterFunc callCB = nullptr;
+        void *callCtx = nullptr;
+        Continuation once;
+        std::shared_ptr<Continuation> continuation;
+
+        explicit operator bool() const { return callCB || once || continuation; }
+
+        void operator()(LSHandle *sh, LSMessage *reply);
+    };
+
     LSMessageToken _token;
     LSHandle *_sh;
     bool _single;
     LSFilterFunc _callCB;
     void *_callCtx;
-    typedef Call *CallPtr;
-    std::unique_ptr<CallPtr> _context;
+    std::shared_ptr<Continuation> _continuation;
+    Continuation _onceContinuation;
+    std::shared_ptr<ReplyTarget> _target;
+    bool _draining;
+    ReplyRing _replies;
+    std::atomic<bool> _waiting;
     std::mutex _mutex;
     std::condition_variable _cv;
-    std::queue<LSMessage *> _queue;
     GMainContext *_mainloopCtx;
     volatile bool _timeoutExpired;
 
+    void moveFrom(Call &other);
+
+    std::unique_lock<std::mutex> lockHandlers();
+
+    bool hasHandler() const;
+
+    Handler takeHandler();
+
+    void dispatchQueued(std::unique_lock<std::mutex> &lock);
+
     void cleanup();
 
     bool isActive() const;
@@ -89,6 +224,8 @@ private:
 
     LSMessage *tryGet();
 
+    LSMessage *thenOnce(Continuation continuation);
+
     LSMessage *waitOnMainLoop();
 
     LSMessage *waitTimeoutOnMainLoop(unsigned long msTimeout);
@@ -97,7 +234,7 @@ private:
 
     LSMessage *waitTimeout(unsigned long msTimeout);
 
-    bool handleReply(LSHandle *sh, LSMessage *reply);
+    bool handleReply(LSHandle *sh, LSMessage *reply, std::unique_lock<std::mutex> &lock);
 
     static bool replyCallback(LSHandle *sh, LSMessage *reply, void *context);
 
@@ -105,4 +242,12 @@ private:
 
 };
 
+// Invoke `done` once every call in `calls` got its first reply. Replies are
+// passed in the order of `calls` and are only valid during the invocation.
+// Further replies to multi-reply calls are ignored. `calls` must stay alive
+// until `done` is invoked.
+typedef std::function<void(std::vector<LSMessage *> &replies)> AllRepliesCallback;
+
+void whenAll(std::vector<Call> &calls, AllRepliesCallback done);
+
 } //namespace LS;
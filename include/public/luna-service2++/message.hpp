@@ -139,6 +139,11 @@ public:
         return LSMessageIsSubscription(_message);
     }
 
+    bool isBackedUp() const
+    {
+        return LSMessageIsBackedUp(_message);
+    }
+
     void respond(const char *reply_payload);
 
     void reply(Service &service, const char *reply_payload);
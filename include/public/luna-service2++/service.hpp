@@ -22,6 +22,7 @@
 #include <luna-service2/lunaservice-meta.h>
 #include "call.hpp"
 #include "server_status.hpp"
+#include "payload.hpp"
 #include <PmLogLib.h>
 #include <cstring>
 #include <iostream>
@@ -102,6 +103,12 @@ public:
 
     void setPriority(int priority) const;
 
+    void setOutgoingLimits(unsigned int max_messages, unsigned long max_bytes,
+                           LSOutgoingPolicy policy) const;
+
+    void setIncomingBudget(unsigned int max_messages, unsigned long max_bytes,
+                           int dispatch_priority = G_PRIORITY_DEFAULT) const;
+
     void sendSignal(const char *uri, const char *payload, bool typecheck = true) const;
 
     Call callOneReply(const char *uri, const char *payload, const char *appID = NULL);
@@ -124,6 +131,8 @@ public:
 
     ServerStatus registerServerStatus(const char *service_name, const ServerStatusCallback &callback);
 
+    JSONPayload getMetrics() const;
+
 private:
     LSHandle *_handle;
 
@@ -50,7 +50,7 @@ class SubscriptionPoint
     private:
         LS::Message message;
         LS::SubscriptionPoint *parent;
-        LSMessageToken statusToken;
+        void *peerWatch;
 
     };
 
@@ -74,9 +74,15 @@ public:
 
     bool post(const char *payload);
 
+    // Only the latest post matters: a post still queued for a slow
+    // subscriber is replaced by the next one (see LSSubscriptionSetLatestOnly)
+    void setLatestOnly(bool latestOnly);
+
 private:
     Service *_service;
     std::vector<SubscriptionItem *> _subs;
+    bool _latestOnly;
+    std::string _updateKey;
 
     void setCancelNotificationCallback();
 
@@ -85,11 +91,11 @@ private:
 
     static bool subscriberCancelCB(LSHandle *sh, const char *uniqueToken, void *context);
 
-    static bool subscriberDownCB(LSHandle *sh, LSMessage *message, void *context);
+    static bool subscriberDownCB(LSHandle *sh, const char *uniqueName, void *context);
 
     void removeItem(const char *uniqueToken);
 
-    void removeItem(SubscriptionItem *item, LSMessage *message);
+    void removeItem(SubscriptionItem *item);
 
     void cleanItem(SubscriptionItem *item);
 
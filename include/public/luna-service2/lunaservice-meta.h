@@ -64,6 +64,29 @@ bool LSCategorySetDescription(
 	LSError *error
 );
 
+/**
+ * Get a snapshot of built-in handle metrics
+ *
+ * Every handle keeps always-on counters: calls received per method with
+ * handler execution time histograms, calls sent per uri, call to first reply
+ * latency histogram, outgoing queue depth and bytes per connection and the
+ * number of pending QueryName requests. The same object is returned over
+ * the bus by the "/com/palm/luna/private/metrics" method of each service.
+ *
+ * Histograms are arrays of 20 counts: bucket 0 holds samples below 1 us,
+ * bucket i holds samples in [2^(i-1), 2^i) us, the last one everything above.
+ *
+ * @param sh  handle that identifies registered service on bus
+ * @param metrics  output JSON object (ownership transferred to caller)
+ * @param error  ouptut buffer for error description if applicable
+ * @return  false in case of error
+ */
+bool LSGetMetrics(
+	LSHandle *sh,
+	jvalue_ref *metrics,
+	LSError *error
+);
+
 /**
  * @example simpleBiffService.schema
  * Service description example
@@ -416,6 +416,20 @@ typedef void (*LSDisconnectHandler)(LSHandle *sh, void *user_data);
 bool LSSetDisconnectHandler(LSHandle *sh, LSDisconnectHandler disconnect_handler,
                     void *user_data, LSError *lserror);
 
+/**
+ * @brief What happens to a peer's outgoing queue once it reaches its
+ * high-water marks (see LSSetOutgoingLimits())
+ */
+typedef enum {
+	LSOutgoingPolicyQueue = 0,      /**< keep queueing (default) */
+	LSOutgoingPolicyDropOldest,     /**< drop the oldest unsent subscription updates */
+	LSOutgoingPolicyCoalesce,       /**< replace the unsent update of the same subscription */
+	LSOutgoingPolicyDisconnect,     /**< disconnect the peer */
+} LSOutgoingPolicy;
+
+bool LSSetOutgoingLimits(LSHandle *sh, unsigned int max_messages, unsigned long max_bytes,
+                    LSOutgoingPolicy policy, LSError *lserror);
+
 bool LSRegisterCategory(LSHandle *sh, const char *category,
                    LSMethod      *methods,
                    LSSignal      *langis,
@@ -493,6 +507,17 @@ bool LSMessageRespond(LSMessage *message, const char *reply_payload,
 bool LSMessageReply(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
                 LSError *lserror);
 
+bool LSMessageReplyMulti(LSHandle *sh, LSMessage **messages, unsigned int count,
+                const char *replyPayload, LSError *lserror);
+
+bool LSMessageReplyUpdateMulti(LSHandle *sh, LSMessage **messages, unsigned int count,
+                const char *key, bool latest_only,
+                const char *replyPayload, LSError *lserror);
+
+bool LSMessageIsBackedUp(LSMessage *message);
+bool LSMessageGetOutgoingQueueDepth(LSMessage *message, unsigned int *messages,
+                unsigned long *bytes);
+
 /* @} END OF LunaServiceMessage */
 
 /**
@@ -516,6 +541,27 @@ bool LSGmainSetPriority(LSHandle *sh, int priority, LSError *lserror);
 
 bool LSGmainSetPriorityPalmService(LSPalmService *psh, int priority, LSError *lserror);
 
+bool LSGmainSetIncomingBudget(LSHandle *sh, unsigned int max_messages, unsigned long max_bytes,
+                              int dispatch_priority, LSError *lserror);
+
+/**
+* @brief Function callback to pick the worker a method call is dispatched to.
+*
+* Calls with equal keys are handled by the same worker, in the order they
+* were received.
+*
+* @param  sh             service handle
+* @param  message        method call
+* @param  ctx            user data
+*
+* @retval dispatch key
+*/
+typedef unsigned int (*LSDispatchKeyFunc)(LSHandle *sh, LSMessage *message, void *ctx);
+
+bool LSGmainAttachWorkers(LSHandle *sh, GMainContext **contexts, unsigned int count,
+                          LSDispatchKeyFunc key_func, void *ctx, LSError *lserror);
+bool LSGmainDetachWorkers(LSHandle *sh, LSError *lserror);
+
 /* @} END OF LunaServiceMainloop */
 
 /**
@@ -537,6 +583,17 @@ typedef bool (*LSServerStatusFunc) (LSHandle *sh, const char *serviceName,
                                   bool connected,
                                   void *ctx);
 
+/**
+* @brief Function callback to be called when a peer disconnects.
+*
+* @param  sh             service handle
+* @param  uniqueName     unique name of the peer that went down.
+*
+* @retval
+*/
+typedef bool (*LSPeerDownFunc) (LSHandle *sh, const char *uniqueName,
+                                void *ctx);
+
 /**
 * @brief Callback function called on incomming message.
 *
@@ -594,6 +651,10 @@ bool LSCallSetTimeout(
        LSHandle *sh, LSMessageToken token,
        int timeout_ms, LSError *lserror);
 
+bool LSCallSetContext(
+       LSHandle *sh, LSMessageToken token,
+       void *ctx, LSError *lserror);
+
 /* @} END OF LunaServiceClient */
 
 /**
@@ -634,6 +695,9 @@ bool LSSubscriptionPost(LSHandle *sh, const char *category,
         const char *method,
         const char *payload, LSError *lserror);
 
+bool LSSubscriptionSetLatestOnly(LSHandle *sh, const char *key,
+        bool latest_only, LSError *lserror);
+
 /* @} END OF LunaServiceSubscription */
 
 /**
@@ -666,6 +730,12 @@ bool LSRegisterServerStatusEx(LSHandle *sh, const char *serviceName,
 
 bool LSCancelServerStatus(LSHandle *sh, void *cookie, LSError *lserror);
 
+bool LSRegisterPeerDown(LSHandle *sh, const char *uniqueName,
+                        LSPeerDownFunc func, void *ctx,
+                        void **cookie, LSError *lserror);
+
+bool LSCancelPeerDown(LSHandle *sh, void *cookie, LSError *lserror);
+
 /* @} END OF LunaServiceSignals */
 
 
@@ -16,19 +16,86 @@
 //
 // LICENSE@@@
 
+
 #include "call.hpp"
 #include "error.hpp"
 
 namespace LS
 {
 
+Call::ReplyRing::ReplyRing()
+    : _head { 0 },
+      _tail { 0 },
+      _overflowSize { 0 },
+      _overflowHead { 0 }
+{
+}
+
+Call::ReplyRing::~ReplyRing()
+{
+    while (LSMessage *reply = pop())
+    {
+        LSMessageUnref(reply);
+    }
+}
+
+void Call::ReplyRing::push(LSMessage *reply)
+{
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (0 == _overflowSize.load(std::memory_order_acquire) &&
+        tail - _head.load(std::memory_order_acquire) < CAPACITY)
+    {
+        _slots[tail % CAPACITY] = reply;
+        _tail.store(tail + 1, std::memory_order_release);
+        return;
+    }
+
+    // The consumer is behind. Keep spilling until it drains the overflow,
+    // so that replies aren't reordered.
+    std::lock_guard < std::mutex > lockg { _overflowMutex };
+    _overflow.push_back(reply);
+    _overflowSize.store(_overflow.size() - _overflowHead, std::memory_order_release);
+}
+
+LSMessage *Call::ReplyRing::pop()
+{
+    // Replies in the slots are older than the spilled ones, but the slots
+    // may be refilled after the overflow is drained. So look at the overflow
+    // before the slots.
+    size_t overflowSize = _overflowSize.load(std::memory_order_acquire);
+
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head != _tail.load(std::memory_order_acquire))
+    {
+        LSMessage *reply = _slots[head % CAPACITY];
+        _head.store(head + 1, std::memory_order_release);
+        return reply;
+    }
+
+    if (0 == overflowSize)
+        return nullptr;
+
+    std::lock_guard < std::mutex > lockg { _overflowMutex };
+    LSMessage *reply = _overflow[_overflowHead++];
+    if (_overflowHead == _overflow.size())
+    {
+        _overflow.clear();
+        _overflowHead = 0;
+    }
+    _overflowSize.store(_overflow.size() - _overflowHead, std::memory_order_release);
+    return reply;
+}
+
 Call::Call()
     : _token { LSMESSAGE_TOKEN_INVALID },
       _sh { nullptr },
       _single { false },
       _callCB { nullptr },
       _callCtx { nullptr },
-      _context { new CallPtr(this) }
+      _draining { false },
+      _waiting { false },
+      _mainloopCtx { nullptr },
+      _timeoutExpired { false }
 {
 }
 
@@ -38,45 +105,135 @@ Call::~Call()
 }
 
 Call::Call(LS::Call &&other)
-    : _token { other._token },
-      _sh { other._sh },
-      _single { other._single },
-      _callCB { other._callCB },
-      _callCtx { other._callCtx },
-      _context { std::move(other._context) }
-{
-    *_context = this;
-    std::lock_guard < std::mutex > lockg { other._mutex };
-    other._token = LSMESSAGE_TOKEN_INVALID;
-    other._sh = nullptr;
-    other._callCB = nullptr;
-    other._callCtx = nullptr;
-    _queue = std::move(other._queue);
+    : Call()
+{
+    moveFrom(other);
 }
 
 LS::Call &Call::operator=(LS::Call &&other)
 {
     if (this != &other)
     {
-        std::unique_lock < std::mutex > thisLock { _mutex, std::defer_lock };
-        std::unique_lock < std::mutex > thatLock { other._mutex, std::defer_lock };
-        std::lock(thisLock, thatLock);
         cleanup();
-        _token = other._token;
-        _sh = other._sh;
-        _callCB = other._callCB;
-        _callCtx = other._callCtx;
-        _context = std::move(other._context);
-        *_context = this;
-        _queue = std::move(other._queue);
-        other._token = LSMESSAGE_TOKEN_INVALID;
-        other._sh = nullptr;
-        other._callCB = nullptr;
-        other._callCtx = nullptr;
+        moveFrom(other);
     }
     return *this;
 }
 
+void Call::moveFrom(Call &other)
+{
+    // The reply callback context stays in place and is repointed to this
+    // object under its lock, so replies dispatched meanwhile on any thread
+    // find either the old or the new object with all of its handlers.
+    std::unique_lock < std::mutex > lock = other.lockHandlers();
+
+    _token = other._token;
+    _sh = other._sh;
+    _single = other._single;
+    _callCB = other._callCB;
+    _callCtx = other._callCtx;
+    _continuation = std::move(other._continuation);
+    _onceContinuation = std::move(other._onceContinuation);
+    _draining = other._draining;
+    while (LSMessage *reply = other._replies.pop())
+    {
+        _replies.push(reply);
+    }
+    _target = std::move(other._target);
+    if (_target)
+        _target->call = this;
+
+    other._continuation = nullptr;
+    other._onceContinuation = nullptr;
+    other._token = LSMESSAGE_TOKEN_INVALID;
+    other._sh = nullptr;
+    other._callCB = nullptr;
+    other._callCtx = nullptr;
+    other._draining = false;
+}
+
+std::unique_lock < std::mutex > Call::lockHandlers()
+{
+    // A call that wasn't issued yet gets no replies, so there's nothing
+    // to lock
+    if (!_target)
+        return std::unique_lock < std::mutex > ();
+    return std::unique_lock < std::mutex > (_target->mutex);
+}
+
+bool Call::hasHandler() const
+{
+    return _callCB || _onceContinuation || _continuation;
+}
+
+Call::Handler Call::takeHandler()
+{
+    Handler handler;
+    if (_callCB)
+    {
+        handler.callCB = _callCB;
+        handler.callCtx = _callCtx;
+    }
+    else if (_onceContinuation)
+    {
+        handler.once = std::move(_onceContinuation);
+        _onceContinuation = nullptr;
+    }
+    else if (_continuation)
+    {
+        // keep the continuation alive even if it replaces itself
+        handler.continuation = _continuation;
+    }
+    return handler;
+}
+
+void Call::Handler::operator()(LSHandle *sh, LSMessage *reply)
+{
+    if (callCB)
+        callCB(sh, reply, callCtx);
+    else if (once)
+        once(reply);
+    else if (continuation)
+        (*continuation)(reply);
+}
+
+void Call::dispatchQueued(std::unique_lock < std::mutex > &lock)
+{
+    // Another thread passing queued replies picks up the new handler
+    if (!_target || _draining)
+        return;
+
+    // Replies that arrive while the queued ones are passed to the handler
+    // are queued behind them, so the handler gets them in order. Handlers
+    // are invoked unlocked, and the call may be moved meanwhile, so it's
+    // found again through the reply callback context, which is kept alive
+    // even if a handler destroys the call.
+    std::shared_ptr<ReplyTarget> target { _target };
+    LSHandle *sh = _sh;
+    _draining = true;
+    Call *call = this;
+    while (call->hasHandler())
+    {
+        LSMessage *reply = call->_replies.pop();
+        if (!reply)
+            break;
+
+        Handler handler = call->takeHandler();
+        lock.unlock();
+        handler(sh, reply);
+        LSMessageUnref(reply);
+        lock.lock();
+
+        call = target->call;
+        if (!call)
+        {
+            lock.unlock();
+            return;
+        }
+    }
+    call->_draining = false;
+}
+
 void Call::cancel()
 {
     if (isActive())
@@ -105,20 +262,23 @@ bool Call::setTimeout(int msTimeout) const
 
 void Call::continueWith(LSFilterFunc callback, void *context)
 {
-    std::lock_guard < std::mutex > lockg { _mutex };
+    std::unique_lock < std::mutex > lock = lockHandlers();
     _callCB = callback;
     _callCtx = context;
-    if (!_callCB)
-    {
-        return;
-    }
+    dispatchQueued(lock);
+}
 
-    while (!_queue.empty())
+void Call::then(Continuation continuation)
+{
+    std::shared_ptr<Continuation> shared;
+    if (continuation)
     {
-        (_callCB)(_sh, _queue.front(), _callCtx);
-        LSMessageUnref(_queue.front());
-        _queue.pop();
+        shared = std::make_shared<Continuation>(std::move(continuation));
     }
+
+    std::unique_lock < std::mutex > lock = lockHandlers();
+    _continuation = std::move(shared);
+    dispatchQueued(lock);
 }
 
 LSMessage *Call::get()
@@ -156,6 +316,21 @@ LSMessage *Call::get(long unsigned int msTimeout)
 void Call::cleanup()
 {
     cancel();
+
+    std::unique_lock < std::mutex > lock = lockHandlers();
+    while (LSMessage *reply = _replies.pop())
+    {
+        LSMessageUnref(reply);
+    }
+    _callCB = nullptr;
+    _callCtx = nullptr;
+    _continuation = nullptr;
+    _onceContinuation = nullptr;
+    if (_target)
+        _target->call = nullptr;
+    if (lock)
+        lock.unlock();
+    _target.reset();
 }
 
 bool Call::isActive() const
@@ -180,6 +355,7 @@ void Call::call(LSHandle *sh, const char *uri, const char *payload, bool oneRepl
                                  LSError *);
     _sh = sh;
     _single = oneReply;
+    _target = std::make_shared<ReplyTarget>(this);
     CallFuncType callFunc = _single ? LSCallFromApplicationOneReply : LSCallFromApplication;
 
     if (!callFunc(_sh,
@@ -187,7 +363,7 @@ void Call::call(LSHandle *sh, const char *uri, const char *payload, bool oneRepl
                   payload,
                   appID,
                   &replyCallback,
-                  _context.get(),
+                  _target.get(),
                   &_token,
                   error.get()))
     {
@@ -200,12 +376,13 @@ void Call::callSignal(LSHandle *sh, const char *category, const char *methodName
     LS::Error error;
     _sh = sh;
     _single = false;
+    _target = std::make_shared<ReplyTarget>(this);
 
     if (!LSSignalCall(_sh,
                       category,
                       methodName,
                       &replyCallback,
-                      _context.get(),
+                      _target.get(),
                       &_token,
                       error.get()))
     {
@@ -235,13 +412,15 @@ bool Call::isMainLoopThread() const
 
 LSMessage *Call::tryGet()
 {
-    std::lock_guard < std::mutex > lockg { _mutex };
-    LSMessage * result { nullptr };
-    if (!_queue.empty())
-    {
-        result = _queue.front();
-        _queue.pop();
-    }
+    return _replies.pop();
+}
+
+LSMessage *Call::thenOnce(Continuation continuation)
+{
+    std::unique_lock < std::mutex > lock = lockHandlers();
+    LSMessage *result = _replies.pop();
+    if (!result)
+        _onceContinuation = std::move(continuation);
     return result;
 }
 
@@ -253,18 +432,10 @@ LSMessage *Call::waitOnMainLoop()
         return nullptr;
 
     LSMessage * reply { nullptr };
-    while (true)
+    while (!reply)
     {
         g_main_context_iteration(_mainloopCtx, TRUE);
-        if (_queue.empty())
-            continue;
-        std::lock_guard < std::mutex > lockg { _mutex };
-        if (!_queue.empty())
-        {
-            reply = _queue.front();
-            _queue.pop();
-            break;
-        }
+        reply = _replies.pop();
     }
     return reply;
 }
@@ -285,16 +456,9 @@ LSMessage *Call::waitTimeoutOnMainLoop(long unsigned int msTimeout)
         if (FALSE == g_main_context_iteration(_mainloopCtx, TRUE))
             continue;
 
-        if (_queue.empty())
-            continue;
-
-        std::lock_guard < std::mutex > lockg { _mutex };
-        if (!_queue.empty())
-        {
-            reply = _queue.front();
-            _queue.pop();
+        reply = _replies.pop();
+        if (reply)
             break;
-        }
     }
     g_source_remove(timeoutID);
     return reply;
@@ -302,47 +466,61 @@ LSMessage *Call::waitTimeoutOnMainLoop(long unsigned int msTimeout)
 
 LSMessage *Call::wait()
 {
-    std::unique_lock < std::mutex > ul{_mutex};
-    _cv.wait(ul, [this] { return !_queue.empty(); });
-    LSMessage * result = _queue.front();
-    _queue.pop();
+    LSMessage * result { nullptr };
+    std::unique_lock < std::mutex > ul { _mutex };
+    _waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    _cv.wait(ul, [this, &result] { return (result = _replies.pop()) != nullptr; });
+    _waiting.store(false, std::memory_order_relaxed);
     return result;
 }
 
 LSMessage *Call::waitTimeout(long unsigned int msTimeout)
 {
+    LSMessage * result { nullptr };
     std::unique_lock < std::mutex > ul { _mutex };
-    bool gotMessage = _cv.wait_for(ul,
-                                   std::chrono::milliseconds(msTimeout),
-                                   [this] { return !_queue.empty();});
-    if (gotMessage)
-    {
-        LSMessage * result = _queue.front();
-        _queue.pop();
-        return result;
-    }
-    return nullptr;
+    _waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    _cv.wait_for(ul,
+                 std::chrono::milliseconds(msTimeout),
+                 [this, &result] { return (result = _replies.pop()) != nullptr; });
+    _waiting.store(false, std::memory_order_relaxed);
+    return result;
 }
 
-bool Call::handleReply(LSHandle* sh, LSMessage* reply)
+bool Call::handleReply(LSHandle* sh, LSMessage* reply, std::unique_lock < std::mutex > &lock)
 {
-    std::lock_guard < std::mutex > lockg { _mutex };
     if (LSMESSAGE_TOKEN_INVALID == _token)
         return false;
 
     if (_single)
         _token = LSMESSAGE_TOKEN_INVALID;
 
-    if (_callCB)
-    {
-        (_callCB)(sh, reply, _callCtx);
-    }
-    else
+    // While queued replies are passed to the handler, newer ones wait
+    // behind them
+    Handler handler;
+    if (!_draining)
+        handler = takeHandler();
+
+    if (!handler)
     {
         LSMessageRef(reply);
-        _queue.push(reply);
-        _cv.notify_one();
+        _replies.push(reply);
+
+        // wake up a thread blocked in get(), if any
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_waiting.load(std::memory_order_relaxed))
+        {
+            std::lock_guard < std::mutex > lockg { _mutex };
+            _cv.notify_one();
+        }
+        return true;
     }
+
+    // The handler may resume a coroutine that awaits this call again, move
+    // the call or destroy it, so it's invoked unlocked
+    lock.unlock();
+    handler(sh, reply);
     return true;
 }
 
@@ -350,12 +528,56 @@ bool Call::replyCallback(LSHandle* sh, LSMessage* reply, void* context)
 {
     if (context)
     {
-        CallPtr * call = static_cast<CallPtr *>(context);
-        (*call)->handleReply(sh, reply);
+        ReplyTarget *target = static_cast<ReplyTarget *>(context);
+        std::unique_lock < std::mutex > lock { target->mutex };
+        if (target->call)
+        {
+            target->call->handleReply(sh, reply, lock);
+        }
     }
     return true;
 }
 
+void whenAll(std::vector<Call> &calls, AllRepliesCallback done)
+{
+    struct State
+    {
+        std::vector<LSMessage *> replies;
+        std::atomic<size_t> remaining;
+        AllRepliesCallback done;
+    };
+
+    if (calls.empty())
+    {
+        std::vector<LSMessage *> replies;
+        done(replies);
+        return;
+    }
+
+    std::shared_ptr<State> state { new State };
+    state->replies.assign(calls.size(), nullptr);
+    state->remaining = calls.size();
+    state->done = std::move(done);
+
+    for (size_t i = 0; i < calls.size(); ++i)
+    {
+        calls[i].then([state, i](LSMessage *reply)
+            {
+                if (state->replies[i])
+                    return;
+
+                LSMessageRef(reply);
+                state->replies[i] = reply;
+                if (--state->remaining != 0)
+                    return;
+
+                state->done(state->replies);
+                for (LSMessage *r : state->replies)
+                    LSMessageUnref(r);
+            });
+    }
+}
+
 gboolean Call::onWaitCB(gpointer context)
 {
     (static_cast<Call *>(context))->_timeoutExpired = true;
@@ -19,6 +19,8 @@
 #include "ls-performance.hpp"
 #include <iomanip>
 #include <fstream>
+#include <atomic>
+#include <cstdlib>
 
 namespace stdp=std::placeholders;
 
@@ -77,6 +79,21 @@ int CPUStat::GetCPUUsage()
     return (numCPU * 100 * (cur_stat.process_cpu_times - process_cpu_times)) / (cur_stat.total_cpu_times - total_cpu_times);
 }
 
+#ifdef LS_CALL_HAS_COROUTINES
+// Fire-and-forget coroutine used to await calls in the benchmark
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+#endif
+
 class PerformanceTest
 {
     LS2Service client, server;
@@ -85,11 +102,46 @@ class PerformanceTest
     volatile bool call_received;
     std::string payload;
 
+    enum ConcurrentMode
+    {
+        MODE_GET,
+        MODE_CONTINUE_WITH,
+        MODE_THEN,
+        MODE_WHEN_ALL,
+        MODE_COROUTINE,
+    };
+
+    enum PayloadKind
+    {
+        PAYLOAD_FILL,
+        PAYLOAD_JSON,
+        PAYLOAD_RANDOM,
+    };
+
+    size_t replies_left;
+    std::string fanout_key;
+
     void simple_call(LSHandle *sh, LSMessage *mes);
     void reply_on_call(LSHandle *sh, LSMessage *mes);
     void reply_on_call_empty(LSHandle *sh, LSMessage *mes);
+    void reply_on_call_busy(LSHandle *sh, LSMessage *mes);
+    void subscribe(LSHandle *sh, LSMessage *mes);
     void make_server_call(const char* payload, bool with_reply);
-    void measure_latency(size_t payload_size, bool with_reply = false, size_t period = 2500);
+    static std::string make_payload(size_t payload_size, PayloadKind kind);
+    void measure_latency(size_t payload_size, bool with_reply = false, size_t period = 2500,
+                         PayloadKind kind = PAYLOAD_FILL);
+    void reply_received();
+    void wait_replies();
+    static bool on_reply(LSHandle *sh, LSMessage *reply, void *ctx);
+#ifdef LS_CALL_HAS_COROUTINES
+    DetachedTask await_reply(LS::Call &call);
+#endif
+    void measure_concurrent(const char *name, ConcurrentMode mode, size_t count = 1000);
+    void measure_workers(size_t workers, size_t count = 200);
+    void measure_fanout(size_t subscribers, size_t stalled = 0, size_t payload_size = 16*1024, size_t posts = 100);
+    void measure_timed_calls(const char *name, int timeout_ms, size_t count = 50000);
+    void measure_register(const char *name, bool public_bus, bool private_bus, size_t count = 500);
+    void measure_connect(size_t count = 500);
     size_t memory_usage_kb();
 
 public:
@@ -118,6 +170,25 @@ void PerformanceTest::reply_on_call_empty(LSHandle *sh, LSMessage *mes)
     LSMessageRespond(mes, "{}", e.get());
 }
 
+// Burns about a millisecond of CPU before replying
+void PerformanceTest::reply_on_call_busy(LSHandle *sh, LSMessage *mes)
+{
+    auto end = std::chrono::high_resolution_clock::now() + std::chrono::milliseconds(1);
+    volatile unsigned long spin = 0;
+    while (std::chrono::high_resolution_clock::now() < end)
+        ++spin;
+
+    LS::Error e;
+    LSMessageRespond(mes, "{}", e.get());
+}
+
+void PerformanceTest::subscribe(LSHandle *sh, LSMessage *mes)
+{
+    LS::Error e;
+    LSSubscriptionAdd(sh, fanout_key.c_str(), mes, e.get());
+    LSMessageRespond(mes, "{}", e.get());
+}
+
 void PerformanceTest::make_server_call(const char* payload, bool with_reply)
 {
     if (with_reply)
@@ -152,9 +223,35 @@ size_t PerformanceTest::memory_usage_kb()
     return vsize / 1024;
 }
 
-void PerformanceTest::measure_latency(size_t payload_size, bool with_reply, size_t period)
+// Payload of `payload_size` bytes: one repeated character, repetitive JSON
+// (compresses well) or random printable characters (barely compresses)
+std::string PerformanceTest::make_payload(size_t payload_size, PayloadKind kind)
 {
-    payload = std::string(payload_size, '$');
+    std::string result;
+    result.reserve(payload_size);
+
+    switch (kind)
+    {
+    case PAYLOAD_FILL:
+        result.assign(payload_size, '$');
+        break;
+    case PAYLOAD_JSON:
+        for (size_t i = 0; result.size() < payload_size; ++i)
+            result += "{\"id\":" + std::to_string(i) + ",\"name\":\"item\",\"enabled\":true},";
+        result.resize(payload_size);
+        break;
+    case PAYLOAD_RANDOM:
+        for (size_t i = 0; i < payload_size; ++i)
+            result += static_cast<char>('!' + rand() % 94);
+        break;
+    }
+
+    return result;
+}
+
+void PerformanceTest::measure_latency(size_t payload_size, bool with_reply, size_t period, PayloadKind kind)
+{
+    payload = make_payload(payload_size, kind);
 
     // estimate performance before test
     Timer timer_test;
@@ -189,6 +286,323 @@ void PerformanceTest::measure_latency(size_t payload_size, bool with_reply, size
               << '|' << std::endl;
 }
 
+void PerformanceTest::reply_received()
+{
+    std::unique_lock<std::mutex> lock(call_mut);
+    if (--replies_left == 0)
+        call_cv.notify_all();
+}
+
+void PerformanceTest::wait_replies()
+{
+    std::unique_lock<std::mutex> lock(call_mut);
+    while (replies_left)
+        call_cv.wait(lock);
+}
+
+bool PerformanceTest::on_reply(LSHandle *sh, LSMessage *reply, void *ctx)
+{
+    static_cast<PerformanceTest *>(ctx)->reply_received();
+    return true;
+}
+
+#ifdef LS_CALL_HAS_COROUTINES
+DetachedTask PerformanceTest::await_reply(LS::Call &call)
+{
+    LSMessage *reply = co_await call;
+    LSMessageUnref(reply);
+    reply_received();
+}
+#endif
+
+// Issue `count` calls at once and wait for all the replies, which are
+// collected with the given LS::Call API
+void PerformanceTest::measure_concurrent(const char *name, ConcurrentMode mode, size_t count)
+{
+    const char *uri = "luna://com.palm.ls_performance/reply_on_call_empty/call";
+    std::vector<LS::Call> calls;
+    calls.reserve(count);
+    replies_left = count;
+
+    Timer timer;
+    CPUStat cpu_stat;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (mode == MODE_CONTINUE_WITH)
+            calls.push_back(client.callOneReply(uri, "{}", on_reply, this));
+        else
+            calls.push_back(client.callOneReply(uri, "{}"));
+    }
+
+    switch (mode)
+    {
+    case MODE_GET:
+        for (auto &call : calls)
+        {
+            LSMessageUnref(call.get());
+            --replies_left;
+        }
+        break;
+    case MODE_CONTINUE_WITH:
+        break;
+    case MODE_THEN:
+        for (auto &call : calls)
+            call.then([this](LSMessage *) { reply_received(); });
+        break;
+    case MODE_WHEN_ALL:
+        {
+            std::unique_lock<std::mutex> lock(call_mut);
+            replies_left = 1;
+        }
+        LS::whenAll(calls, [this](std::vector<LSMessage *> &) { reply_received(); });
+        break;
+    case MODE_COROUTINE:
+#ifdef LS_CALL_HAS_COROUTINES
+        for (auto &call : calls)
+            await_reply(call);
+#endif
+        break;
+    }
+    wait_replies();
+
+    int duration = std::max(timer.msec(), 1);
+    int calls_per_sec = static_cast<int>(count*1000.0/duration);
+    int cpu_usage = cpu_stat.GetCPUUsage();
+
+    std::cout << '|' << std::setw(31) << name
+              << '|' << std::setw(15) << calls_per_sec
+              << '|' << std::setw(15) << duration
+              << '|' << std::setw(9) << memory_usage_kb()/1024.0
+              << '|' << std::setw(9) << cpu_usage
+              << '|' << std::endl;
+}
+
+// Issue `count` CPU-bound calls at once with the server dispatching them to
+// `workers` worker contexts (0 keeps everything on the server's own loop)
+void PerformanceTest::measure_workers(size_t workers, size_t count)
+{
+    if (workers)
+        server.AttachWorkers(workers);
+
+    replies_left = count;
+    std::vector<LS::Call> calls;
+    calls.reserve(count);
+
+    Timer timer;
+    CPUStat cpu_stat;
+
+    for (size_t i = 0; i < count; ++i)
+        calls.push_back(client.callOneReply("luna://com.palm.ls_performance/reply_on_call_busy/call",
+                                            "{}", on_reply, this));
+    wait_replies();
+
+    int duration = std::max(timer.msec(), 1);
+    int calls_per_sec = static_cast<int>(count*1000.0/duration);
+    int cpu_usage = cpu_stat.GetCPUUsage();
+
+    server.DetachWorkers();
+
+    std::cout << '|' << std::setw(31) << workers
+              << '|' << std::setw(15) << calls_per_sec
+              << '|' << std::setw(15) << duration
+              << '|' << std::setw(9) << memory_usage_kb()/1024.0
+              << '|' << std::setw(9) << cpu_usage
+              << '|' << std::endl;
+}
+
+// Subscribe `subscribers` calls of the client and `stalled` calls of a
+// subscriber that doesn't read during the posts, and post `posts` replies
+// of `payload_size` bytes to all of them. The replies to the stalled
+// subscriber are queued by the server.
+void PerformanceTest::measure_fanout(size_t subscribers, size_t stalled, size_t payload_size, size_t posts)
+{
+    fanout_key = "fanout" + std::to_string(subscribers) + "_" + std::to_string(stalled);
+    payload = std::string(payload_size, '$');
+    payload = "{\"data\":\"" + payload + "\"}";
+
+    // The stalled subscriber reads only while its context is iterated here
+    std::shared_ptr<GMainContext> stalled_context(g_main_context_new(), g_main_context_unref);
+    LS::Service stalled_client;
+
+    std::vector<LS::Call> calls;
+    calls.reserve(subscribers + stalled);
+
+    if (stalled)
+    {
+        stalled_client = LS::registerService(nullptr, true);
+        stalled_client.attachToLoop(stalled_context.get());
+
+        replies_left = stalled;
+        for (size_t i = 0; i < stalled; ++i)
+            calls.push_back(stalled_client.callMultiReply("luna://com.palm.ls_performance/subscribe/call",
+                                                          R"({"subscribe": true})", on_reply, this));
+        while (replies_left)
+            g_main_context_iteration(stalled_context.get(), true);
+    }
+
+    replies_left = subscribers;
+    for (size_t i = 0; i < subscribers; ++i)
+        calls.push_back(client.callMultiReply("luna://com.palm.ls_performance/subscribe/call",
+                                              R"({"subscribe": true})", on_reply, this));
+    wait_replies();
+
+    replies_left = subscribers * posts;
+
+    Timer timer;
+    CPUStat cpu_stat;
+
+    LS::Error error;
+    for (size_t i = 0; i < posts; ++i)
+    {
+        if (!LSSubscriptionReply(server.get(), fanout_key.c_str(), payload.c_str(), error.get()))
+            throw error;
+    }
+    wait_replies();
+
+    int duration = std::max(timer.msec(), 1);
+    size_t replies = subscribers * posts;
+    int replies_per_sec = static_cast<int>(replies*1000.0/duration);
+    double mb_per_sec = (payload.size()*replies*1000.0/duration)/(1024.0*1024.0);
+    int cpu_usage = cpu_stat.GetCPUUsage();
+
+    std::string name = std::to_string(subscribers);
+    if (stalled)
+        name += "+" + std::to_string(stalled) + " stalled";
+
+    std::cout << '|' << std::setw(15) << name
+              << '|' << std::setw(15) << replies_per_sec
+              << '|' << std::setw(15) << mb_per_sec
+              << '|' << std::setw(15) << duration
+              << '|' << std::setw(9) << memory_usage_kb()/1024.0
+              << '|' << std::setw(9) << cpu_usage
+              << '|' << std::endl;
+
+    // Let the stalled subscriber catch up before it goes away
+    replies_left = stalled * posts;
+    while (replies_left)
+        g_main_context_iteration(stalled_context.get(), true);
+}
+
+// Issue `count` calls at once, each with the given timeout (0 for none),
+// and wait for all the replies
+void PerformanceTest::measure_timed_calls(const char *name, int timeout_ms, size_t count)
+{
+    const char *uri = "luna://com.palm.ls_performance/reply_on_call_empty/call";
+    std::vector<LS::Call> calls;
+    calls.reserve(count);
+    replies_left = count;
+
+    Timer timer;
+    CPUStat cpu_stat;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        calls.push_back(client.callOneReply(uri, "{}", on_reply, this));
+        if (timeout_ms)
+            calls.back().setTimeout(timeout_ms);
+    }
+    wait_replies();
+
+    int duration = std::max(timer.msec(), 1);
+    int calls_per_sec = static_cast<int>(count*1000.0/duration);
+    int cpu_usage = cpu_stat.GetCPUUsage();
+
+    std::cout << '|' << std::setw(31) << name
+              << '|' << std::setw(15) << calls_per_sec
+              << '|' << std::setw(15) << duration
+              << '|' << std::setw(9) << memory_usage_kb()/1024.0
+              << '|' << std::setw(9) << cpu_usage
+              << '|' << std::endl;
+}
+
+// Register `count` anonymous handles on the given buses one after another,
+// unregistering each before the next. Only the registrations are timed.
+void PerformanceTest::measure_register(const char *name, bool public_bus, bool private_bus, size_t count)
+{
+    std::chrono::high_resolution_clock::duration registering{0};
+    CPUStat cpu_stat;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        LS::Service public_handle, private_handle;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        if (public_bus)
+            public_handle = LS::registerService(nullptr, true);
+        if (private_bus)
+            private_handle = LS::registerService(nullptr, false);
+        registering += std::chrono::high_resolution_clock::now() - start;
+    }
+
+    double duration = std::max(std::chrono::duration<double, std::milli>(registering).count(), 1.0);
+    int registers_per_sec = static_cast<int>(count*1000.0/duration);
+    double latency = duration / count;
+    int cpu_usage = cpu_stat.GetCPUUsage();
+
+    std::cout << '|' << std::setw(31) << name
+              << '|' << std::setw(15) << registers_per_sec
+              << '|' << std::setw(15) << latency
+              << '|' << std::setw(9) << memory_usage_kb()/1024.0
+              << '|' << std::setw(9) << cpu_usage
+              << '|' << std::endl;
+}
+
+// Make `count` first calls to the server, each from a freshly registered
+// handle, so that each one waits for the hub to connect it. The same calls
+// from a single handle show what the connection costs. Only the calls are
+// timed.
+void PerformanceTest::measure_connect(size_t count)
+{
+    const char *uri = "luna://com.palm.ls_performance/reply_on_call_empty/call";
+    std::chrono::high_resolution_clock::duration first_calls{0}, calls{0};
+    CPUStat cpu_stat;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::shared_ptr<GMainContext> context(g_main_context_new(), g_main_context_unref);
+        LS::Service handle = LS::registerService(nullptr, true);
+        handle.attachToLoop(context.get());
+
+        auto start = std::chrono::high_resolution_clock::now();
+        LSMessageUnref(handle.callOneReply(uri, "{}").get());
+        first_calls += std::chrono::high_resolution_clock::now() - start;
+    }
+
+    int first_cpu_usage = cpu_stat.GetCPUUsage();
+    CPUStat connected_cpu_stat;
+
+    {
+        std::shared_ptr<GMainContext> context(g_main_context_new(), g_main_context_unref);
+        LS::Service handle = LS::registerService(nullptr, true);
+        handle.attachToLoop(context.get());
+        LSMessageUnref(handle.callOneReply(uri, "{}").get());
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            LSMessageUnref(handle.callOneReply(uri, "{}").get());
+            calls += std::chrono::high_resolution_clock::now() - start;
+        }
+    }
+
+    int cpu_usage = connected_cpu_stat.GetCPUUsage();
+
+    auto print = [&](const char *name, std::chrono::high_resolution_clock::duration elapsed, int cpu)
+    {
+        double duration = std::max(std::chrono::duration<double, std::milli>(elapsed).count(), 1.0);
+        std::cout << '|' << std::setw(31) << name
+                  << '|' << std::setw(15) << static_cast<int>(count*1000.0/duration)
+                  << '|' << std::setw(15) << duration / count
+                  << '|' << std::setw(9) << memory_usage_kb()/1024.0
+                  << '|' << std::setw(9) << cpu
+                  << '|' << std::endl;
+    };
+
+    print("first call (connect)", first_calls, first_cpu_usage);
+    print("connected", calls, cpu_usage);
+}
+
 void PerformanceTest::run()
 {
     std::cout << std::string(85, '*') << std::endl;
@@ -229,6 +643,116 @@ void PerformanceTest::run()
     measure_latency(256*1024, true);
     measure_latency(1024*1024, true);
 
+    // payloads above the compression threshold (LS_COMPRESS_THRESHOLD)
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << align_center("client--(call)-->server--(reply)-->client, JSON payload", 83) << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+
+    measure_latency(256*1024, true, 2500, PAYLOAD_JSON);
+    measure_latency(1024*1024, true, 2500, PAYLOAD_JSON);
+
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << align_center("client--(call)-->server--(reply)-->client, random payload", 83) << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+
+    measure_latency(256*1024, true, 2500, PAYLOAD_RANDOM);
+    measure_latency(1024*1024, true, 2500, PAYLOAD_RANDOM);
+
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << align_center("1000 concurrent calls", 83) << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << std::setw(31) << "Reply API"
+              << '|' << std::setw(15) << "calls/sec"
+              << '|' << std::setw(15) << "ms"
+              << '|' << std::setw(9) << "MB"
+              << '|' << std::setw(9) << "%"
+              << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+
+    measure_concurrent("get()", MODE_GET);
+    measure_concurrent("continueWith()", MODE_CONTINUE_WITH);
+    measure_concurrent("then()", MODE_THEN);
+    measure_concurrent("whenAll()", MODE_WHEN_ALL);
+#ifdef LS_CALL_HAS_COROUTINES
+    measure_concurrent("co_await", MODE_COROUTINE);
+#endif
+
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << align_center("200 CPU-bound calls (1 ms each)", 83) << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << std::setw(31) << "Server workers"
+              << '|' << std::setw(15) << "calls/sec"
+              << '|' << std::setw(15) << "ms"
+              << '|' << std::setw(9) << "MB"
+              << '|' << std::setw(9) << "%"
+              << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+
+    measure_workers(0);
+    measure_workers(1);
+    measure_workers(2);
+    measure_workers(4);
+
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << align_center("server--(100 x 16KB subscription posts)-->client", 83) << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << std::setw(15) << "Subscribers"
+              << '|' << std::setw(15) << "replies/sec"
+              << '|' << std::setw(15) << "MB/sec"
+              << '|' << std::setw(15) << "ms"
+              << '|' << std::setw(9) << "MB"
+              << '|' << std::setw(9) << "%"
+              << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+
+    measure_fanout(1);
+    measure_fanout(10);
+    measure_fanout(100);
+    measure_fanout(100, 1);
+    measure_fanout(100, 10);
+
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << align_center("50000 concurrent calls", 83) << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << std::setw(31) << "Call timeout"
+              << '|' << std::setw(15) << "calls/sec"
+              << '|' << std::setw(15) << "ms"
+              << '|' << std::setw(9) << "MB"
+              << '|' << std::setw(9) << "%"
+              << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+
+    measure_timed_calls("none", 0);
+    measure_timed_calls("30 s", 30000);
+
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << align_center("Startup: 500 x LSRegister", 83) << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << std::setw(31) << "Bus"
+              << '|' << std::setw(15) << "registers/sec"
+              << '|' << std::setw(15) << "ms"
+              << '|' << std::setw(9) << "MB"
+              << '|' << std::setw(9) << "%"
+              << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+
+    measure_register("private", false, true);
+    measure_register("public", true, false);
+    measure_register("public + private", true, true);
+
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << align_center("500 x client--(call)-->server--(reply)-->client", 83) << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+    std::cout << '|' << std::setw(31) << "Connection"
+              << '|' << std::setw(15) << "calls/sec"
+              << '|' << std::setw(15) << "ms"
+              << '|' << std::setw(9) << "MB"
+              << '|' << std::setw(9) << "%"
+              << '|' << std::endl;
+    std::cout << std::string(85, '*') << std::endl;
+
+    measure_connect();
+
     std::cout << std::string(85, '*') << std::endl;
 }
 
@@ -239,6 +763,8 @@ PerformanceTest::PerformanceTest()
     server.AddMethod("/simple_call", std::bind(&PerformanceTest::simple_call, this, stdp::_1, stdp::_2));
     server.AddMethod("/reply_on_call", std::bind(&PerformanceTest::reply_on_call, this, stdp::_1, stdp::_2));
     server.AddMethod("/reply_on_call_empty", std::bind(&PerformanceTest::reply_on_call_empty, this, stdp::_1, stdp::_2));
+    server.AddMethod("/reply_on_call_busy", std::bind(&PerformanceTest::reply_on_call_busy, this, stdp::_1, stdp::_2));
+    server.AddMethod("/subscribe", std::bind(&PerformanceTest::subscribe, this, stdp::_1, stdp::_2));
 }
 
 
@@ -27,8 +27,12 @@ class LS2Service : public LS::Service
     std::shared_ptr<GMainLoop> loop;
     std::thread loop_thread;
 
+    std::vector< std::shared_ptr<GMainLoop> > worker_loops;
+    std::vector<std::thread> worker_threads;
+
     void loop_thread_func();
     static bool callback(LSHandle *sh, LSMessage *msg, void *category_context);
+    static unsigned int dispatch_key(LSHandle *sh, LSMessage *msg, void *ctx);
 
 public:
 
@@ -36,6 +40,8 @@ public:
     ~LS2Service();
     void AddMethod(const std::string& name, const LS2Method& _method);
     void callNoReply(const char *uri, const char *payload, const char * appID = NULL);
+    void AttachWorkers(size_t count);
+    void DetachWorkers();
 };
 
 inline void LS2Service::loop_thread_func()
@@ -62,6 +68,7 @@ inline LS2Service::LS2Service(const std::string &name, bool public_service)
 
 inline LS2Service::~LS2Service()
 {
+    DetachWorkers();
     g_main_loop_quit(loop.get());
     loop_thread.join();
 }
@@ -82,6 +89,45 @@ inline void LS2Service::callNoReply(const char *uri, const char *payload, const
         throw error;
 }
 
+// Spread calls over the workers regardless of their category
+inline unsigned int LS2Service::dispatch_key(LSHandle *sh, LSMessage *msg, void *ctx)
+{
+    return LSMessageGetToken(msg);
+}
+
+inline void LS2Service::AttachWorkers(size_t count)
+{
+    std::vector<GMainContext *> contexts;
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::shared_ptr<GMainLoop> worker_loop(g_main_loop_new(g_main_context_new(), false), g_main_loop_unref);
+        g_main_context_unref(g_main_loop_get_context(worker_loop.get()));
+        contexts.push_back(g_main_loop_get_context(worker_loop.get()));
+        worker_threads.emplace_back(g_main_loop_run, worker_loop.get());
+        worker_loops.push_back(worker_loop);
+    }
+
+    LS::Error error;
+    if (!LSGmainAttachWorkers(get(), contexts.data(), count, dispatch_key, nullptr, error.get()))
+        throw error;
+}
+
+inline void LS2Service::DetachWorkers()
+{
+    if (worker_loops.empty())
+        return;
+
+    LS::Error error;
+    LSGmainDetachWorkers(get(), error.get());
+
+    for (auto &worker_loop : worker_loops)
+        g_main_loop_quit(worker_loop.get());
+    for (auto &worker_thread : worker_threads)
+        worker_thread.join();
+    worker_threads.clear();
+    worker_loops.clear();
+}
+
 class Timer
 {
     std::chrono::high_resolution_clock::time_point start;
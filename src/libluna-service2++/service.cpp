@@ -193,6 +193,28 @@ void Service::setPriority(int priority) const
     }
 }
 
+void Service::setOutgoingLimits(unsigned int max_messages, unsigned long max_bytes,
+                                LSOutgoingPolicy policy) const
+{
+    Error error;
+
+    if (!LSSetOutgoingLimits(_handle, max_messages, max_bytes, policy, error.get()))
+    {
+        throw error;
+    }
+}
+
+void Service::setIncomingBudget(unsigned int max_messages, unsigned long max_bytes,
+                                int dispatch_priority) const
+{
+    Error error;
+
+    if (!LSGmainSetIncomingBudget(_handle, max_messages, max_bytes, dispatch_priority, error.get()))
+    {
+        throw error;
+    }
+}
+
 void Service::sendSignal(const char *uri, const char *payload, bool typecheck) const
 {
     Error error;
@@ -272,6 +294,21 @@ ServerStatus Service::registerServerStatus(const char *service_name,
     return ServerStatus(_handle, service_name, callback);
 }
 
+JSONPayload Service::getMetrics() const
+{
+    Error error;
+    jvalue_ref metrics = nullptr;
+
+    if (!LSGetMetrics(_handle, &metrics, error.get()))
+    {
+        throw error;
+    }
+
+    JSONPayload payload {jvalue_tostring_simple(metrics)};
+    j_release(&metrics);
+    return payload;
+}
+
 Service::Service(LSHandle *handle)
     : _handle(handle)
 {
@@ -18,25 +18,32 @@
 
 #include "subscription.hpp"
 
+#include <cstdint>
+
 namespace LS {
 
 inline SubscriptionPoint::SubscriptionItem::SubscriptionItem(LS::Message &&_message,
                                                              LS::SubscriptionPoint *_parent)
     : message{ std::move(_message) },
       parent{ _parent },
-      statusToken{ LSMESSAGE_TOKEN_INVALID }
+      peerWatch{ nullptr }
 {
 }
 
 SubscriptionPoint::SubscriptionItem::~SubscriptionItem()
 {
-    if (statusToken != LSMESSAGE_TOKEN_INVALID)
+    if (peerWatch)
     {
         parent->cleanItem(this);
     }
 }
 
-SubscriptionPoint::SubscriptionPoint(LS::Service *service): _service {service}
+SubscriptionPoint::SubscriptionPoint(LS::Service *service)
+    : _service {service},
+      _latestOnly {false},
+      // posts of different points to the same subscriber mustn't replace
+      // each other
+      _updateKey {"SubscriptionPoint/" + std::to_string(reinterpret_cast<uintptr_t>(this))}
 {
     setCancelNotificationCallback();
 }
@@ -58,11 +65,9 @@ bool SubscriptionPoint::subscribe(LS::Message &message)
         {new SubscriptionItem({&message.getService(), message.get()}, this)};
 
         LS::Error error;
-        LS::JSONPayload payload;
-        payload.set("serviceName", message.getSender());
-        retVal = LSCall(_service->get(), "palm://com.palm.bus/signal/registerServerStatus",
-                        payload.getJSONString().c_str(), subscriberDownCB, item.get(),
-                        &item->statusToken, error.get());
+        retVal = LSRegisterPeerDown(_service->get(), message.getSender(),
+                                    subscriberDownCB, item.get(),
+                                    &item->peerWatch, error.get());
         if (retVal)
         {
             _subs.push_back(item.release());
@@ -88,10 +93,19 @@ bool SubscriptionPoint::post(const char *payload)
 
     try
     {
+        std::vector<LSMessage *> messages;
+        messages.reserve(_subs.size());
         for (auto subscriber: _subs)
         {
-            subscriber->message.reply(*_service, payload);
+            messages.push_back(subscriber->message.get());
         }
+
+        // One validation pass; every subscriber's reply shares the payload
+        LS::Error error;
+        if (!LSMessageReplyUpdateMulti(_service->get(), messages.data(), messages.size(),
+                                       _latestOnly ? _updateKey.c_str() : nullptr, _latestOnly,
+                                       payload, error.get()))
+            throw error;
     }
     catch(LS::Error &e)
     {
@@ -105,6 +119,11 @@ bool SubscriptionPoint::post(const char *payload)
     return true;
 }
 
+void SubscriptionPoint::setLatestOnly(bool latestOnly)
+{
+    _latestOnly = latestOnly;
+}
+
 void SubscriptionPoint::setCancelNotificationCallback()
 {
     if (_service)
@@ -124,11 +143,11 @@ bool SubscriptionPoint::subscriberCancelCB(LSHandle *sh, const char *uniqueToken
     return true;
 }
 
-bool SubscriptionPoint::subscriberDownCB(LSHandle *sh, LSMessage *message, void *context)
+bool SubscriptionPoint::subscriberDownCB(LSHandle *sh, const char *uniqueName, void *context)
 {
     SubscriptionItem *item = static_cast<SubscriptionItem *>(context);
     SubscriptionPoint *self = item->parent;
-    self->removeItem(item, message);
+    self->removeItem(item);
     return true;
 }
 
@@ -153,15 +172,8 @@ void SubscriptionPoint::removeItem(const char *uniqueToken)
     }
 }
 
-void SubscriptionPoint::removeItem(LS::SubscriptionPoint::SubscriptionItem *item, LSMessage *message)
+void SubscriptionPoint::removeItem(LS::SubscriptionPoint::SubscriptionItem *item)
 {
-    LS::JSONPayload reply(LSMessageGetPayload(message));
-    if (!reply.isValid())
-        return;
-    bool isConnected {true};
-    if (!reply.get("connected", isConnected) || isConnected)
-        return;
-
     auto it = std::find_if(_subs.begin(), _subs.end(),
                            [item](SubscriptionItem *_item)
     {
@@ -177,11 +189,11 @@ void SubscriptionPoint::removeItem(LS::SubscriptionPoint::SubscriptionItem *item
 
 void SubscriptionPoint::cleanItem(LS::SubscriptionPoint::SubscriptionItem *item)
 {
-    if (item->statusToken != LSMESSAGE_TOKEN_INVALID)
+    if (item->peerWatch)
     {
         LS::Error error;
-        LSCallCancel(_service->get(), item->statusToken, error.get());
-        item->statusToken = LSMESSAGE_TOKEN_INVALID;
+        LSCancelPeerDown(_service->get(), item->peerWatch, error.get());
+        item->peerWatch = nullptr;
     }
 }
 
@@ -0,0 +1,85 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2014 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+#include <gtest/gtest.h>
+#include <luna-service2/lunaservice.hpp>
+
+#include <string>
+
+using namespace std;
+
+class TestEnvironment
+    : public ::testing::Test
+{
+protected:
+    LS::Error e;
+    LSHandle *sh;
+    GMainLoop *main_loop;
+    string payload;
+
+    static bool OnReply(LSHandle *, LSMessage *msg, void *ctxt)
+    {
+        TestEnvironment *self = static_cast<TestEnvironment *>(ctxt);
+        self->payload = LSMessageGetPayload(msg);
+        g_main_loop_quit(self->main_loop);
+        return true;
+    }
+
+    static gboolean OnTimeout(gpointer ctxt)
+    {
+        g_main_loop_quit(static_cast<TestEnvironment *>(ctxt)->main_loop);
+        return FALSE;
+    }
+
+private:
+    virtual void SetUp()
+    {
+        main_loop = g_main_loop_new(nullptr, false);
+
+        ASSERT_TRUE(LSRegister("com.palm.test_listen_client", &sh, e.get()));
+        ASSERT_TRUE(LSGmainAttach(sh, main_loop, e.get()));
+    }
+
+    virtual void TearDown()
+    {
+        ASSERT_TRUE(LSUnregister(sh, e.get()));
+        g_main_loop_unref(main_loop);
+    }
+
+};
+
+// The hub launches the service on our call, connects us to the socket it
+// created for the service right away, and the service takes that socket
+// with our call already waiting on it
+TEST_F(TestEnvironment, CallQueuedBeforeLaunch)
+{
+    LSMessageToken token;
+    ASSERT_TRUE(LSCallOneReply(sh,
+                               "luna://com.palm.test_listen_service/test/queued",
+                               "{}",
+                               OnReply, this, &token,
+                               e.get()));
+
+    guint timeout = g_timeout_add_seconds(10, OnTimeout, this);
+    g_main_loop_run(main_loop);
+    g_source_remove(timeout);
+
+    EXPECT_EQ("{\"returnValue\":true,\"queued\":true}", payload);
+}
+
+// vim: set et ts=4 sw=4:
@@ -239,6 +239,80 @@ TEST_F(CallTest, MainLoopGetTimeoutSuccess)
     ASSERT_NE(nullptr, reply);
 }
 
+// Tests that replies queued beyond the reply ring survive a move
+TEST_F(CallTest, QueuedRepliesMove)
+{
+    LS::Call call = _service.callMultiReply(SUBSCRIBE_URI, R"({"subscribe": true, "timeout": 1})");
+    TimeoutRemover cancel(g_timeout_add(200, onTimeoutCB, this));
+    g_main_loop_run(_mainloop);
+
+    LS::Call moved = std::move(call);
+    ASSERT_EQ(nullptr, call.get(10));
+    for (int i = 0; i < 32; ++i)
+    {
+        LSMessage * reply = moved.get(100);
+        ASSERT_NE(nullptr, reply);
+        LSMessageUnref(reply);
+    }
+}
+
+// Tests continuation attached with then()
+TEST_F(CallTest, ThenContinuation)
+{
+    LS::Call call = _service.callOneReply(SIMPLE_URI, "{}");
+    call.then([this](LSMessage *reply)
+        {
+            if (reply)
+                _resultFlag = ON_REPLY;
+            g_main_loop_quit(_mainloop);
+        });
+    TimeoutRemover cancel(g_timeout_add(1000, onHangingCB, this));
+    g_main_loop_run(_mainloop);
+    ASSERT_FALSE(ON_MAINLOOP_FAILURE == _resultFlag) << "Main loop quit condition failed - loop not finished in time";
+    ASSERT_EQ(ON_REPLY, _resultFlag);
+}
+
+// Tests then() on a call whose reply is already queued
+TEST_F(CallTest, ThenAfterReply)
+{
+    LS::Call call = _service.callMultiReply(SUBSCRIBE_URI, R"({"subscribe": true, "timeout": 100})");
+    LSMessage * reply = call.get();
+    ASSERT_NE(nullptr, reply);
+    call.then([this](LSMessage *reply)
+        {
+            if (reply)
+                _resultFlag = ON_REPLY;
+            g_main_loop_quit(_mainloop);
+        });
+    TimeoutRemover cancel(g_timeout_add(1000, onHangingCB, this));
+    g_main_loop_run(_mainloop);
+    ASSERT_FALSE(ON_MAINLOOP_FAILURE == _resultFlag) << "Main loop quit condition failed - loop not finished in time";
+    ASSERT_EQ(ON_REPLY, _resultFlag);
+}
+
+// Tests whenAll() fan-in of several calls
+TEST_F(CallTest, WhenAll)
+{
+    std::vector<LS::Call> calls;
+    for (int i = 0; i < 5; ++i)
+        calls.push_back(_service.callOneReply(SIMPLE_URI, "{}"));
+
+    size_t count = 0;
+    LS::whenAll(calls, [this, &count](std::vector<LSMessage *> &replies)
+        {
+            for (auto reply : replies)
+                if (reply)
+                    ++count;
+            _resultFlag = ON_REPLY;
+            g_main_loop_quit(_mainloop);
+        });
+    TimeoutRemover cancel(g_timeout_add(1000, onHangingCB, this));
+    g_main_loop_run(_mainloop);
+    ASSERT_FALSE(ON_MAINLOOP_FAILURE == _resultFlag) << "Main loop quit condition failed - loop not finished in time";
+    ASSERT_EQ(ON_REPLY, _resultFlag);
+    ASSERT_EQ(calls.size(), count);
+}
+
 }  // anonymous namespace
 
 int main(int argc, char **argv)
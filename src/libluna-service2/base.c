@@ -30,6 +30,7 @@
 
 #include "base.h"
 #include "category.h"
+#include "worker_pool.h"
 #include "message.h"
 #include "subscription.h"
 #include "debug_methods.h"
@@ -366,23 +367,25 @@ _LSHandleMethodCall(LSHandle *sh, _LSTransportMessage *transport_msg)
 
     LSMessage *message = _LSMessageNewRef(transport_msg, sh);
 
-    /* look up the name in tableHandlers */
-    GHashTable *categories = sh->tableHandlers;
-
-    const char* category_name = LSMessageGetCategory(message);
-
-    /* find the category in the tableHandlers (LSCategoryTable) */
-    LSCategoryTable *category = g_hash_table_lookup(categories, category_name);
+    /* find the category and the method (LSCategoryTable, LSMethodEntry) */
+    LSCategoryTable *category = LSCategoryDispatchLookup(sh, message);
     if (!category)
     {
-        LOG_LS_ERROR(MSGID_LS_NO_CATEGORY, 1,
-                     PMLOGKS("CATEGORY", category_name),
-                     "Couldn't find category: %s", category_name);
         retVal = LSMessageHandlerResultUnknownMethod;
     }
+    else if (sh->workers &&
+             _LSTransportMessageGetType(transport_msg) == _LSTransportMessageTypeMethodCall)
+    {
+        /* cancels stay here, so they can't overtake the call they cancel
+         * only by being queued to a different worker */
+        _LSWorkerPoolDispatch(sh->workers, category, message->method_entry,
+                              transport_msg->client->service_name, message);
+        retVal = LSMessageHandlerResultDeferred;
+    }
     else
     {
-        retVal = LSCategoryMethodCall(sh, category, transport_msg->client->service_name, message);
+        retVal = LSCategoryMethodInvoke(sh, category, message->method_entry,
+                                        transport_msg->client->service_name, message);
     }
 
     LSMessageUnref(message);
@@ -412,6 +415,7 @@ _LSMessageHandler(_LSTransportMessage *message, void *context)
     case _LSTransportMessageTypeReply:
     case _LSTransportMessageTypeQueryServiceStatusReply:
     case _LSTransportMessageTypeQueryServiceCategoryReply:
+    case _LSTransportMessageTypeQueryHubTelemetryReply:
     case _LSTransportMessageTypeServiceDownSignal:
     case _LSTransportMessageTypeServiceUpSignal:
     case _LSTransportMessageTypeError:
@@ -592,6 +596,7 @@ _LSPrivatePing(LSHandle* lshandle, LSMessage *message, void *user_data)
 static LSMethod _privateMethods[] = {
     { "cancel", _LSPrivateCancel},
     { "ping", _LSPrivatePing},
+    { "metrics", _LSPrivateGetMetrics},
 #ifdef SUBSCRIPTION_DEBUG
     { "subscriptions", _LSPrivateGetSubscriptions},
 #endif
@@ -627,6 +632,42 @@ LSSetDisconnectHandler(LSHandle *sh, LSDisconnectHandler disconnect_handler,
     return true;
 }
 
+/**
+* @brief Bound the outgoing queue of every peer of the service.
+*
+*        A peer that doesn't read fast enough (a slow subscriber, a stuck
+*        monitor) makes messages to it pile up. Once a message would take a
+*        peer's queue past either mark, the policy applies: the oldest
+*        unsent subscription updates are dropped, the unsent update of the
+*        same subscription is replaced, or the peer is disconnected. Only
+*        subscription updates (see LSSubscriptionReply()) are ever dropped
+*        or replaced. Use LSMessageIsBackedUp() to check a subscriber before
+*        producing an update.
+*
+* @param  sh
+* @param  max_messages   high-water mark in messages, 0 for none
+* @param  max_bytes      high-water mark in bytes, 0 for none
+* @param  policy
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSSetOutgoingLimits(LSHandle *sh, unsigned int max_messages, unsigned long max_bytes,
+                    LSOutgoingPolicy policy, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+    LSHANDLE_VALIDATE(sh);
+
+    _LSErrorIfFailMsg(policy <= LSOutgoingPolicyDisconnect, lserror, MSGID_LS_QUEUE_ERROR, -EINVAL,
+                      "%s: %s", __FUNCTION__, ": Invalid policy.");
+
+    _LSTransportOutgoingLimits limits = { max_messages, max_bytes, policy };
+    _LSTransportSetOutgoingLimits(sh->transport, &limits);
+
+    return true;
+}
+
 /*
     We need a common routine one level down from all the public LSRegister* functions
 */
@@ -650,9 +691,17 @@ _LSRegisterCommon(const char *name, LSHandle **ret_sh,
 
     sh->name        = g_strdup(name);
     sh->transport   = NULL;
+    g_mutex_init(&sh->dispatch_lock);
 
     LSHANDLE_SET_VALID(sh, call_ret_addr);
 
+    sh->metrics = _LSMetricsNew();
+    if (!sh->metrics)
+    {
+        _LSErrorSetOOM(lserror);
+        goto error;
+    }
+
     /* custom message queue */
     sh->custom_message_queue = LSCustomMessageQueueNew();
     if (!sh->custom_message_queue)
@@ -718,6 +767,10 @@ error:
 
         if (sh->custom_message_queue) LSCustomMessageQueueFree(sh->custom_message_queue);
 
+        _LSMetricsFree(sh->metrics);
+
+        g_mutex_clear(&sh->dispatch_lock);
+
         g_free(sh->name);
 
         LSHANDLE_SET_DESTROYED(sh, call_ret_addr);
@@ -881,6 +934,13 @@ _LSUnregisterCommon(LSHandle *sh, bool flush_and_send_shutdown, void *call_ret_a
 
     _LSGlobalLock();
 
+    _LSWorkerPoolFree(sh->workers, false);
+    sh->workers = NULL;
+
+    _LSDispatchTableFree(sh->dispatch);
+    sh->dispatch = NULL;
+    g_mutex_clear(&sh->dispatch_lock);
+
     if (sh->tableHandlers)
     {
         g_hash_table_unref(sh->tableHandlers);
@@ -907,6 +967,9 @@ _LSUnregisterCommon(LSHandle *sh, bool flush_and_send_shutdown, void *call_ret_a
         sh->context = NULL;
     }
 
+    _LSMetricsFree(sh->metrics);
+    sh->metrics = NULL;
+
     g_free(sh->name);
 
     LSHANDLE_SET_DESTROYED(sh, call_ret_addr);
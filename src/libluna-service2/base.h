@@ -30,6 +30,7 @@
 #include "signal.h"
 #include "subscription.h"
 #include "transport.h"
+#include "metrics.h"
 
 /**
  * @addtogroup LunaServiceInternals
@@ -117,6 +118,11 @@ struct LSHandle {
     _Catalog       *catalog;       /**< contains subscriptions */
 
     GHashTable     *tableHandlers; /**< contains method tables */
+    struct _LSDispatchTable *dispatch; /**< flat index of tableHandlers methods,
+                                            owned by the dispatching thread */
+    gint            dispatch_dirty; /**< dispatch misses registered methods */
+    GMutex          dispatch_lock; /**< protects tableHandlers against
+                                        indexing while methods are registered */
 
     LSDisconnectHandler disconnect_handler;
     void           *disconnect_handler_data;
@@ -126,6 +132,11 @@ struct LSHandle {
                                   /**< queue for fetch style retreival */
     LSCustomMessageQueue *custom_message_queue;
 
+    _LSMetrics     *metrics;       /**< always-on counters (see metrics.h) */
+
+    struct _LSWorkerPool *workers; /**< method call dispatch, NULL unless
+                                        LSGmainAttachWorkers() (see worker_pool.h) */
+
 #ifdef LSHANDLE_CHECK
     /* This  M U S T  be that last thing in the struct for LSHANDLE_POISON to work */
     _LSHandleHistory history;      /**< fields for detecting invalid handles and where they were created and destroyed */
@@ -144,6 +155,10 @@ struct LSPalmService {
 /** Category for lunabus watch category signal */
 #define LUNABUS_WATCH_CATEGORY_CATEGORY "/com/palm/bus/watch/category"
 
+/** Category and method of the hub telemetry reply (luna://com.palm.bus/hub/telemetry) */
+#define LUNABUS_HUB_CATEGORY            "/com/palm/bus/hub"
+#define LUNABUS_HUB_TELEMETRY           "telemetry"
+
 /* @} END OF LunaServiceInternals */
 
 #endif // _BASE_H_
@@ -41,6 +41,7 @@
 #include "category.h"
 #include "transport_utils.h"
 #include "clock.h"
+#include "timer_wheel.h"
 #include "pmtrace_ls2.h"
 
 /**
@@ -54,6 +55,9 @@ static bool _LSCallFromApplicationCommon(LSHandle *sh, const char *uri,
        LSFilterFunc callback, void *ctx,
        LSMessageToken *ret_token, bool single, LSError *lserror);
 
+/** Resolution of method call timeouts */
+#define CALL_TIMEOUT_TICK_MS 1
+
 #define LUNA_OLD_PREFIX "luna://"
 #define LUNA_PREFIX "palm://"
 
@@ -432,6 +436,7 @@ typedef struct _ServerStatus
     LSServerStatusFunc callback;
     void              *ctx;
     LSMessageToken     token;
+    char              *serviceName;
 } _ServerStatus;
 
 typedef struct _ServerInfo
@@ -441,11 +446,38 @@ typedef struct _ServerInfo
     bool connected;
 } _ServerInfo;
 
+typedef struct _PeerWatch _PeerWatch;
+
+/**
+* @brief One LSRegisterPeerDown() registration, the cookie handed out.
+*/
+typedef struct _PeerWatcher
+{
+    int             ref;
+    int             cancelled;  //< set atomically by LSCancelPeerDown()
+    LSPeerDownFunc  callback;
+    void           *ctx;
+    _PeerWatch     *watch;      //< valid until cancelled
+} _PeerWatcher;
+
+/**
+* @brief Hub watch of one peer, shared by all the watchers of that peer.
+*/
+struct _PeerWatch
+{
+    char           *peer;       //< unique name, key in callmap->peerMap
+    LSMessageToken  token;      //< token of the server status call
+    GHashTable     *watchers;   //< set of _PeerWatcher
+};
+
 struct _CallMap {
 
     GHashTable *tokenMap;      //< Map from token to _Call
     GHashTable *signalMap;     //< Map from signal key to list of tokens
     GHashTable *serviceMap;    //< Map from serviceName to list of tokens
+    GHashTable *peerMap;       //< Map from peer unique name to _PeerWatch
+
+    _LSTimerWheel *timers;     //< Call timeouts, created with the first one
 
     //DBusHandleMessageFunction message_handler;
 
@@ -500,11 +532,17 @@ typedef struct _Call {
     char          *signal_category; //< registered signal category (required)
     char          *match_key;  //<key used in callmap->signalMap
     struct        timespec time;  //< time value for performance measurement
-    guint         timer_id;  //< timer id for the expiration (> 0 if set)
+    _LSTimer      timer;     //< expiration; holds a reference while armed
     int           timeout_ms;  //< milliseconds to timeout before next message reply.
+    bool          replied;     //< true once the first reply has been dispatched
+    bool          peer_watch;  //< server status call of callmap->peerMap,
+                               //  handled without a callback
 } _Call;
 
 
+static void _CallRelease(_Call *call);
+static void OnCallTimedOut(_Call *call);
+
 _Call *
 _CallNew(LSHandle *sh, int type, const char *serviceName,
          LSFilterFunc callback, void *ctx,
@@ -521,6 +559,8 @@ _CallNew(LSHandle *sh, int type, const char *serviceName,
 #ifdef HAS_LTTNG
     call->methodName = g_strdup(methodName);
 #endif
+    ClockGetTime(&call->time);
+    _LSTimerInit(&call->timer, (_LSTimerFunc) OnCallTimedOut, (GDestroyNotify) _CallRelease, call);
 
     return call;
 }
@@ -530,8 +570,6 @@ _CallFree(_Call *call)
 {
     if (!call) return;
 
-    if (call->timer_id > 0)
-        g_source_remove(call->timer_id);
     g_free(call->serviceName);
     //g_free(call->rule);
     g_free(call->signal_method);
@@ -665,7 +703,13 @@ _CallRemove(LSHandle *sh, _CallMap *map, _Call *call)
 
     /* <eeh> TODO: what does the else case mean (i.e., orig_call != call) */
 
+    _LSTimerWheel *timers = map->timers;
+
     _CallMapUnlock(map);
+
+    /* a removed call can't time out anymore, drop the timer's reference */
+    if (timers)
+        _LSTimerWheelCancel(timers, &call->timer);
 }
 
 static void
@@ -702,6 +746,36 @@ _CallRelease(_Call *call)
     }
 }
 
+static void
+_PeerWatcherRelease(_PeerWatcher *watcher)
+{
+    LS_ASSERT(g_atomic_int_get(&watcher->ref) > 0);
+
+    if (g_atomic_int_dec_and_test(&watcher->ref))
+    {
+        g_free(watcher);
+    }
+}
+
+static _PeerWatch *
+_PeerWatchNew(const char *peer, LSMessageToken token)
+{
+    _PeerWatch *watch = g_new0(_PeerWatch, 1);
+    watch->peer = g_strdup(peer);
+    watch->token = token;
+    watch->watchers = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                            (GDestroyNotify)_PeerWatcherRelease, NULL);
+    return watch;
+}
+
+static void
+_PeerWatchFree(_PeerWatch *watch)
+{
+    g_hash_table_destroy(watch->watchers);
+    g_free(watch->peer);
+    g_free(watch);
+}
+
 /**
 * @brief Initialize callmap.
 *
@@ -722,6 +796,8 @@ _CallMapInit(LSHandle *sh, _CallMap **ret_map, LSError *lserror)
                     (GDestroyNotify)g_free, (GDestroyNotify)_TokenListFree);
     map->serviceMap = g_hash_table_new_full(g_str_hash, g_str_equal,
                     (GDestroyNotify)g_free, (GDestroyNotify)_TokenListFree);
+    map->peerMap = g_hash_table_new_full(g_str_hash, g_str_equal,
+                    NULL, (GDestroyNotify)_PeerWatchFree);
 
     if (pthread_mutex_init(&map->lock, NULL))
     {
@@ -748,6 +824,10 @@ _CallMapDeinit(LSHandle *sh, _CallMap *map)
 {
     if (map)
     {
+        /* releases the references held by the armed timers */
+        _LSTimerWheelFree(map->timers);
+
+        g_hash_table_destroy(map->peerMap);
         g_hash_table_destroy(map->signalMap);
         g_hash_table_destroy(map->serviceMap);
         g_hash_table_destroy(map->tokenMap);
@@ -828,6 +908,15 @@ error:
         "{\"returnValue\":false,\"errorCode\":-1,\"errorText\":\"OOM\"}";
 }
 
+static bool
+_query_service_status_available(_LSTransportMessage *msg)
+{
+    /* FIXME -- need getter for this or make GetBody skip over the
+     * reply serial */
+    /* skip over reply serial to get available value */
+    return *((int*)(_LSTransportMessageGetBody(msg) + sizeof(LSMessageToken))) != 0;
+}
+
 void
 _LSMessageTranslateFromCall(_Call *call, LSMessage *reply,
                             _ServerInfo *server_info)
@@ -907,12 +996,7 @@ _LSMessageTranslateFromCall(_Call *call, LSMessage *reply,
     {
         LS_ASSERT(call->type == CALL_TYPE_SIGNAL_SERVER_STATUS);
 
-        /* FIXME -- need getter for this or make GetBody skip over the
-         * reply serial */
-        /* skip over reply serial to get available value */
-        int available = *((int*)(_LSTransportMessageGetBody(msg) + sizeof(LSMessageToken)));
-
-        if (available)
+        if (_query_service_status_available(msg))
         {
             reply->category = LUNABUS_SIGNAL_CATEGORY;
             reply->method = LUNABUS_SIGNAL_SERVERSTATUS;
@@ -955,6 +1039,27 @@ _LSMessageTranslateFromCall(_Call *call, LSMessage *reply,
         break;
     }
 
+    /* reply for hub telemetry query (luna://com.palm.bus/hub/telemetry) */
+    case _LSTransportMessageTypeQueryHubTelemetryReply:
+    {
+        LS_ASSERT(call->type == CALL_TYPE_SIGNAL);
+
+        _LSTransportMessageIter iter;
+        _LSTransportMessageIterInit(msg, &iter);
+
+        LS_ASSERT(_LSTransportMessageIterHasNext(&iter));
+        _LSTransportMessageIterNext(&iter);
+
+        const char *telemetry = NULL;
+        _LSTransportMessageGetString(&iter, &telemetry);
+
+        reply->category = LUNABUS_HUB_CATEGORY;
+        reply->method = LUNABUS_HUB_TELEMETRY;
+        reply->payload = reply->payloadAllocated = g_strdup(telemetry);
+
+        break;
+    }
+
     /* translate all transport errors to lunabus errors. */
     case _LSTransportMessageTypeError:
     case _LSTransportMessageTypeErrorUnknownMethod:
@@ -986,6 +1091,68 @@ _LSMessageTranslate(LSHandle *sh, LSMessage *message,
 
 static void ResetCallTimeout(_Call *call);
 
+/**
+* @brief Tell the watchers of the peer of a peer watch call it's gone, if
+*        the message says so.
+*
+* Called without the callmap lock; watchers are called without it either,
+* so that they may cancel their watch.
+*
+* @param  sh
+* @param  call
+* @param  msg
+* @param  server_info
+*/
+static void
+_handle_peer_status(LSHandle *sh, _Call *call, _LSTransportMessage *msg,
+                    _ServerInfo *server_info)
+{
+    LS_ASSERT(call->peer_watch);
+
+    switch (_LSTransportMessageGetType(msg))
+    {
+    case _LSTransportMessageTypeQueryServiceStatusReply:
+        if (_query_service_status_available(msg)) return;
+        break;
+    case _LSTransportMessageTypeServiceDownSignal:
+        if (!server_info || !server_info->ServiceStatusChanged || server_info->connected) return;
+        break;
+    default:
+        return;
+    }
+
+    _CallMap *map = sh->callmap;
+    GPtrArray *watchers = g_ptr_array_new_with_free_func((GDestroyNotify)_PeerWatcherRelease);
+
+    _CallMapLock(map);
+    _PeerWatch *watch = g_hash_table_lookup(map->peerMap, call->serviceName);
+    if (watch && watch->token == call->token)
+    {
+        GHashTableIter iter;
+        _PeerWatcher *watcher;
+        g_hash_table_iter_init(&iter, watch->watchers);
+        while (g_hash_table_iter_next(&iter, (gpointer *) &watcher, NULL))
+        {
+            g_atomic_int_inc(&watcher->ref);
+            g_ptr_array_add(watchers, watcher);
+        }
+    }
+    _CallMapUnlock(map);
+
+    int i;
+    for (i = 0; i < watchers->len; i++)
+    {
+        _PeerWatcher *watcher = g_ptr_array_index(watchers, i);
+
+        /* cancelled by one of the watchers called before it */
+        if (g_atomic_int_get(&watcher->cancelled)) continue;
+
+        watcher->callback(sh, call->serviceName, watcher->ctx);
+    }
+
+    g_ptr_array_free(watchers, TRUE);
+}
+
 /**
 * @brief Dispatch a message to each callback in tokens list.
 *
@@ -1021,7 +1188,11 @@ _handle_reply(LSHandle *sh, _TokenList *tokens, _LSTransportMessage *msg,
 
         ResetCallTimeout(call);
 
-        if (call->callback)
+        if (call->peer_watch)
+        {
+            _handle_peer_status(sh, call, msg, server_info);
+        }
+        else if (call->callback)
         {
             LSMessage *reply = _LSMessageNewRef(msg, sh);
 
@@ -1033,10 +1204,15 @@ _handle_reply(LSHandle *sh, _TokenList *tokens, _LSTransportMessage *msg,
                 PMTRACE_CLIENT_CALLBACK(sh->name, call->serviceName, call->methodName, token);
 
                 struct timespec current_time, gap_time;
+                ClockGetTime(&current_time);
+                ClockDiff(&gap_time, &current_time, &call->time);
+
+                bool first_reply = (call->type == CALL_TYPE_METHOD_CALL && !call->replied);
+                call->replied = true;
+                _LSMetricsReplyReceived(sh, first_reply ? &gap_time : NULL);
+
                 if (DEBUG_TRACING)
                 {
-                    ClockGetTime(&current_time);
-                    ClockDiff(&gap_time, &current_time, &call->time);
                     LOG_LS_DEBUG("TYPE=method call response time | TIME=%ld | FROM=%s | TO=%s",
                               ClockGetMs(&gap_time), sh->name, call->serviceName);
                 }
@@ -1392,6 +1568,7 @@ _MessageFindTokens(_CallMap *callmap, _LSTransportMessage *msg,
         _get_reply_tokens(callmap, msg, tokens);
         break;
     case _LSTransportMessageTypeQueryServiceCategoryReply:
+    case _LSTransportMessageTypeQueryHubTelemetryReply:
         _get_first_field_tokens(callmap, msg, tokens);
         break;
     case _LSTransportMessageTypeMethodCall:
@@ -1698,6 +1875,37 @@ _send_reg_service_category(LSHandle     *sh,
     return retVal;
 }
 
+static bool
+_send_hub_telemetry(LSHandle     *sh,
+                    _Uri         *luri,
+                    LSFilterFunc callback,
+                    void         *ctx,
+                    _Call        **ret_call,
+                    LSError      *lserror)
+{
+    /* The hub answers a single reply with the reply serial followed by a
+     * JSON string. The call is tracked as a signal type call without a
+     * signal category, so cancelling it doesn't send anything to the hub. */
+
+    LSMessageToken token;
+
+    if (!LSTransportSendQueryHubTelemetry(sh->transport, &token, lserror))
+    {
+        return false;
+    }
+
+    _Call *call = _CallNew(sh, CALL_TYPE_SIGNAL,
+                           luri->serviceName, callback, ctx, token, luri->methodName);
+
+    call->match_key = g_strdup(LUNABUS_HUB_CATEGORY);
+
+    if (ret_call)
+    {
+        *ret_call = call;
+    }
+
+    return true;
+}
 
 static bool
 _send_method_call(LSHandle *sh,
@@ -2052,6 +2260,13 @@ _LSCallFromApplicationCommon(LSHandle *sh, const char *uri,
                 goto error;
             }
         }
+        // uri == "luna://com.palm.bus/hub/telemetry"
+        else if (strcmp(luri->objectPath, "/hub") == 0 &&
+                 strcmp(luri->methodName, LUNABUS_HUB_TELEMETRY) == 0)
+        {
+            bool ret = _send_hub_telemetry(sh, luri, callback, ctx, &call, lserror);
+            if (!ret) goto error;
+        }
         else
         {
             _LSErrorSet(lserror, MSGID_LS_INVALID_CALL, -EINVAL, "Invalid parameters to LSCall.");
@@ -2064,6 +2279,8 @@ _LSCallFromApplicationCommon(LSHandle *sh, const char *uri,
                             applicationID,
                             callback, ctx, &call, lserror);
         if (!ret) goto error;
+
+        _LSMetricsCallSent(sh, luri->serviceName, luri->objectPath);
     }
 
     if (ret_token)
@@ -2094,7 +2311,6 @@ _LSCallFromApplicationCommon(LSHandle *sh, const char *uri,
             }
             else
             {
-                ClockGetTime(&call->time);
                 LOG_LS_DEBUG("TX: LSCall token <<%ld>> %s", call->token, uri);
             }
         }
@@ -2119,7 +2335,7 @@ error:
 }
 
 
-static gboolean
+static void
 OnCallTimedOut(_Call *call)
 {
     LSError lserror;
@@ -2129,23 +2345,45 @@ OnCallTimedOut(_Call *call)
     {
         LSErrorFree(&lserror);
     }
-    call->timer_id = 0;
-    return FALSE;  /* One-shot timer */
 }
 
 
+/**
+* @brief (Re)arm the timeout of a call, or disarm it if the call has none.
+*
+* All the timeouts of a handle share one timer wheel, attached to the
+* handle's context (or the default one if the handle isn't attached yet),
+* so re-arming on every reply doesn't touch the GLib source list.
+*
+* @param  call
+*/
 static void
 ResetCallTimeout(_Call *call)
 {
-    if (call->timer_id > 0)
-        g_source_remove(call->timer_id);
+    _CallMap *map = call->sh->callmap;
+
+    /* method handlers may run on worker threads (see worker_pool.h) */
+    _CallMapLock(map);
+    if (!map->timers && call->timeout_ms > 0)
+    {
+        map->timers = _LSTimerWheelNew(_LSTransportGetGmainContext(call->sh->transport),
+                                       CALL_TIMEOUT_TICK_MS);
+    }
+    _LSTimerWheel *timers = map->timers;
+    _CallMapUnlock(map);
+
+    if (!timers)
+        return;
 
     if (call->timeout_ms > 0)
     {
+        /* released when this arming ends, see _CallNew() */
         _CallAddReference(call);
-        call->timer_id = g_timeout_add_full(G_PRIORITY_DEFAULT, call->timeout_ms,
-                                            (GSourceFunc) OnCallTimedOut, call,
-                                            (GDestroyNotify) _CallRelease);
+        _LSTimerWheelArm(timers, &call->timer, call->timeout_ms);
+    }
+    else
+    {
+        _LSTimerWheelCancel(timers, &call->timer);
     }
 }
 
@@ -2196,6 +2434,39 @@ LSCallSetTimeout(LSHandle *sh, LSMessageToken token, int timeout_ms, LSError *ls
 }
 
 
+/**
+ * @brief Replaces the user context passed to the callback of a call.
+ *        Used by wrappers that relocate the object the context points to.
+ *
+ * @param  sh       IN  handle the call was made with
+ * @param  token    IN  token of the call
+ * @param  ctx      IN  new user context
+ * @param  lserror  OUT set on error
+ *
+ * @retval true on success
+ * @retval false if the call isn't found, e.g. because it is finished
+ */
+bool
+LSCallSetContext(LSHandle *sh, LSMessageToken token, void *ctx, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+
+    LSHANDLE_VALIDATE(sh);
+
+    _Call *call = _CallAcquire(sh->callmap, token);
+    if (!call)
+    {
+        _LSErrorSetNoPrint(lserror, -1, "Could not find call %ld to set context.", token);
+        return false;
+    }
+
+    call->ctx = ctx;
+
+    _CallRelease(call);
+    return true;
+}
+
+
 /**
 * @brief Sends a cancel message to service to end call session and also
 *        unregisters any callback associated with call.
@@ -2255,41 +2526,30 @@ LSCallCancel(LSHandle *sh, LSMessageToken token, LSError *lserror)
 static bool
 _ServerStatusHelper(LSHandle *sh, LSMessage *message, void *ctx)
 {
-    JSchemaInfo schemaInfo;
-    jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
-
-    const char *payload = LSMessageGetPayload(message);
-
-    jvalue_ref object = jdom_parse(j_cstr_to_buffer(payload), DOMOPT_NOOPT,
-                                   &schemaInfo);
-
     _ServerStatus *server_status = (_ServerStatus*)ctx;
-    if (!server_status) goto error;
-
-    if (!jis_null(object))
-    {
-        bool connected;
-
-        jvalue_ref serviceObj = NULL;
-        jvalue_ref connectedObj = NULL;
+    if (!server_status || !server_status->callback) return true;
 
-        if (!jobject_get_exists(object, J_CSTR_TO_BUF("serviceName"),
-                                &serviceObj)) goto error;
-        if (!jobject_get_exists(object, J_CSTR_TO_BUF("connected"),
-                                &connectedObj)) goto error;
-
-        (void)jboolean_get(connectedObj, &connected);/* TODO: handle appropriately */
+    /* The status comes from the hub's message the reply was translated
+     * from, there's no need to parse the translated payload */
+    bool connected;
+    _LSTransportMessage *transport_msg = message->transport_msg;
 
-        if (server_status->callback)
-        {
-            LOCAL_CSTR_FROM_BUF(serviceName, jstring_get_fast(serviceObj));
-            server_status->callback
-                (sh, serviceName, connected, server_status->ctx);
-        }
+    switch (_LSTransportMessageGetType(transport_msg))
+    {
+    case _LSTransportMessageTypeServiceUpSignal:
+        connected = true;
+        break;
+    case _LSTransportMessageTypeServiceDownSignal:
+        connected = false;
+        break;
+    case _LSTransportMessageTypeQueryServiceStatusReply:
+        connected = _query_service_status_available(transport_msg);
+        break;
+    default:
+        return true;
     }
 
-error:
-    j_release(&object);
+    server_status->callback(sh, server_status->serviceName, connected, server_status->ctx);
     return true;
 }
 
@@ -2349,6 +2609,7 @@ bool LSRegisterServerStatusEx(LSHandle *sh, const char *serviceName,
     server_status->callback = func;
     server_status->ctx = ctx;
     server_status->token = LSMESSAGE_TOKEN_INVALID;
+    server_status->serviceName = g_strdup(serviceName);
 
     if (!LSCall(sh,
                 "palm://com.palm.bus/signal/registerServerStatus",
@@ -2356,6 +2617,7 @@ bool LSRegisterServerStatusEx(LSHandle *sh, const char *serviceName,
                 &server_status->token, lserror))
     {
         g_free(payload);
+        g_free(server_status->serviceName);
         g_free(server_status);
         return false;
     }
@@ -2397,10 +2659,141 @@ bool LSCancelServerStatus(LSHandle *sh, void *cookie, LSError *lserror)
         return false;
     }
 
+    g_free(server_status->serviceName);
     g_free(server_status);
     return true;
 }
 
+/**
+* @brief Register a callback to be called when the peer with the unique
+*        name goes down.
+*
+* Unlike LSRegisterServerStatusEx() all the registrations for the same peer
+* share one watch on the hub, which is dropped with the last of them, and
+* the hub's notification is handed to the callbacks as is, without a JSON
+* round trip. Meant for tracking many calls or subscriptions from one
+* client. Callback may be called in this context if the peer is gone
+* already.
+*
+* @param  sh
+* @param  uniqueName     unique name of the peer (LSMessageGetSender())
+* @param  func
+* @param  ctx
+* @param  cookie         token to use to unregister the callback
+* @param  lserror
+*
+* @retval
+*
+* @sa LSCancelPeerDown
+*/
+bool LSRegisterPeerDown(LSHandle *sh, const char *uniqueName,
+                        LSPeerDownFunc func, void *ctx,
+                        void **cookie, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+    _LSErrorIfFail(uniqueName != NULL, lserror, MSGID_LS_PARAMETER_IS_NULL);
+    _LSErrorIfFail(func != NULL, lserror, MSGID_LS_NO_CALLBACK);
+    _LSErrorIfFail(cookie != NULL, lserror, MSGID_LS_PARAMETER_IS_NULL);
+
+    LSHANDLE_VALIDATE(sh);
+
+    _CallMap *map = sh->callmap;
+
+    _PeerWatcher *watcher = g_new0(_PeerWatcher, 1);
+    watcher->ref = 1;
+    watcher->callback = func;
+    watcher->ctx = ctx;
+
+    _CallMapLock(map);
+
+    _PeerWatch *watch = g_hash_table_lookup(map->peerMap, uniqueName);
+    if (!watch)
+    {
+        LSMessageToken token;
+        if (!LSTransportSendQueryServiceStatus(sh->transport, uniqueName, &token, lserror))
+            goto error;
+
+        _Call *call = _CallNew(sh, CALL_TYPE_SIGNAL_SERVER_STATUS,
+                               uniqueName, NULL, NULL, token, NULL);
+        call->peer_watch = true;
+
+        if (!_service_watch_enable(sh, call, lserror))
+        {
+            _CallFree(call);
+            goto error;
+        }
+
+        if (!_CallInsert(sh, map, call, false, lserror))
+        {
+            _service_watch_disable(sh, call);
+            _CallFree(call);
+            goto error;
+        }
+
+        watch = _PeerWatchNew(uniqueName, token);
+        g_hash_table_insert(map->peerMap, watch->peer, watch);
+    }
+
+    watcher->watch = watch;
+    g_hash_table_add(watch->watchers, watcher);
+
+    _CallMapUnlock(map);
+
+    *cookie = watcher;
+    return true;
+
+error:
+    _CallMapUnlock(map);
+    g_free(watcher);
+    return false;
+}
+
+/**
+* @brief Cancel a callback registered with LSRegisterPeerDown().
+*
+* The hub watch of the peer is dropped with its last callback. Once true
+* is returned the cookie is invalid. The callback isn't called after this,
+* even if the peer is going down at the moment.
+*
+* @param  sh
+* @param  cookie         token obtained during registration, can't be NULL
+* @param  lserror
+*
+* @retval
+*
+* @sa LSRegisterPeerDown
+*/
+bool LSCancelPeerDown(LSHandle *sh, void *cookie, LSError *lserror)
+{
+    LSHANDLE_VALIDATE(sh);
+    LS_ASSERT(cookie != NULL && "A valid cookie from LSRegisterPeerDown() should be passed");
+
+    _PeerWatcher *watcher = (_PeerWatcher *) cookie;
+    _CallMap *map = sh->callmap;
+    LSMessageToken token = LSMESSAGE_TOKEN_INVALID;
+
+    _CallMapLock(map);
+
+    _PeerWatch *watch = watcher->watch;
+    g_atomic_int_set(&watcher->cancelled, 1);
+    g_hash_table_remove(watch->watchers, watcher);
+
+    if (g_hash_table_size(watch->watchers) == 0)
+    {
+        token = watch->token;
+        g_hash_table_remove(map->peerMap, watch->peer);
+    }
+
+    _CallMapUnlock(map);
+
+    if (token != LSMESSAGE_TOKEN_INVALID)
+    {
+        return LSCallCancel(sh, token, lserror);
+    }
+
+    return true;
+}
+
 /* @} END OF LunaServiceClient */
 
 /**
@@ -2666,7 +3059,15 @@ _FetchMessageQueueGet(LSHandle *sh, LSMessage **ret_message, LSError *lserror)
         _Call *call = _CallAcquire(sh->callmap, token);
         if (call)
         {
-            _LSMessageTranslateFromCall(call, reply, &queue->server_info);
+            if (call->peer_watch)
+            {
+                _handle_peer_status(sh, call, queue->message, &queue->server_info);
+                reply->ignore = true;
+            }
+            else
+            {
+                _LSMessageTranslateFromCall(call, reply, &queue->server_info);
+            }
             _CallRelease(call);
         }
 
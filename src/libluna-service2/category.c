@@ -22,6 +22,9 @@
  *  @file category.c
  */
 
+#include <string.h>
+#include <pthread.h>
+
 #include "category.h"
 #include "lserror_pbnjson.h"
 #include "simple_pbnjson.h"
@@ -312,6 +315,205 @@ bool LSCategoryValidateCall(LSMethodEntry *entry, LSMessage *message)
     return false;
 }
 
+/** Method in the dispatch index */
+typedef struct _LSDispatchSlot {
+    const char      *key;       /**< "category\0method", in _LSDispatchTable::keys */
+    unsigned int    key_len;    /**< without the terminating NUL */
+    guint32         hash;
+    LSCategoryTable *category;  /**< NULL for a free slot */
+    LSMethodEntry   *method;
+} _LSDispatchSlot;
+
+/** Open addressing with linear probing, at most half full. Built, probed
+ * and freed only by the thread dispatching the handle's method calls */
+struct _LSDispatchTable {
+    unsigned int    mask;       /**< slot count - 1 */
+    _LSDispatchSlot *slots;
+    char            *keys;      /**< all the keys, back to back */
+};
+
+/* FNV-1a */
+static inline guint32
+_LSDispatchHash(const char *key, unsigned int key_len)
+{
+    guint32 hash = 2166136261u;
+    unsigned int i;
+    for (i = 0; i < key_len; i++)
+    {
+        hash ^= (unsigned char) key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void
+_LSDispatchTableFree(_LSDispatchTable *table)
+{
+    if (!table) return;
+
+    g_free(table->slots);
+    g_free(table->keys);
+    g_free(table);
+}
+
+/* Mark the index out of date after methods were added to tableHandlers, so
+ * that the next lookup rebuilds it. Registering many categories costs one
+ * rebuild. Called with LSHandle::dispatch_lock held */
+static void
+_LSDispatchTableInvalidate(LSHandle *sh)
+{
+    g_atomic_int_set(&sh->dispatch_dirty, 1);
+}
+
+/* Index every method of tableHandlers. Called with LSHandle::dispatch_lock
+ * held */
+static _LSDispatchTable*
+_LSDispatchTableBuild(GHashTable *tableHandlers)
+{
+    if (!tableHandlers) return NULL;
+
+    unsigned int count = 0;
+    size_t keys_size = 0;
+
+    GHashTableIter cat_iter, meth_iter;
+    const char *category_name, *method_name;
+    LSCategoryTable *table;
+    LSMethodEntry *entry;
+
+    g_hash_table_iter_init(&cat_iter, tableHandlers);
+    while (g_hash_table_iter_next(&cat_iter, (gpointer *) &category_name, (gpointer *) &table))
+    {
+        g_hash_table_iter_init(&meth_iter, table->methods);
+        while (g_hash_table_iter_next(&meth_iter, (gpointer *) &method_name, NULL))
+        {
+            count++;
+            keys_size += strlen(category_name) + strlen(method_name) + 2;
+        }
+    }
+
+    unsigned int size = 8;
+    while (size < count * 2)
+    {
+        size <<= 1;
+    }
+
+    _LSDispatchTable *dispatch = g_new0(_LSDispatchTable, 1);
+    dispatch->mask = size - 1;
+    dispatch->slots = g_new0(_LSDispatchSlot, size);
+    dispatch->keys = g_malloc(keys_size ? keys_size : 1);
+
+    char *key = dispatch->keys;
+
+    g_hash_table_iter_init(&cat_iter, tableHandlers);
+    while (g_hash_table_iter_next(&cat_iter, (gpointer *) &category_name, (gpointer *) &table))
+    {
+        size_t category_len = strlen(category_name);
+
+        g_hash_table_iter_init(&meth_iter, table->methods);
+        while (g_hash_table_iter_next(&meth_iter, (gpointer *) &method_name, (gpointer *) &entry))
+        {
+            size_t method_len = strlen(method_name);
+            unsigned int key_len = category_len + 1 + method_len;
+
+            memcpy(key, category_name, category_len + 1);
+            memcpy(key + category_len + 1, method_name, method_len + 1);
+
+            guint32 hash = _LSDispatchHash(key, key_len);
+            unsigned int i = hash & dispatch->mask;
+            while (dispatch->slots[i].category)
+            {
+                i = (i + 1) & dispatch->mask;
+            }
+
+            _LSDispatchSlot *slot = &dispatch->slots[i];
+            slot->key = key;
+            slot->key_len = key_len;
+            slot->hash = hash;
+            slot->category = table;
+            slot->method = entry;
+
+            key += key_len + 1;
+        }
+    }
+
+    return dispatch;
+}
+
+/**
+* @brief Find the category and the method of a method call. The method entry
+* is cached in the message.
+*
+* @param  sh
+* @param  message
+*
+* @retval category, NULL if the category or the method isn't registered
+*/
+LSCategoryTable *
+LSCategoryDispatchLookup(LSHandle *sh, LSMessage *message)
+{
+    const char *category_name = LSMessageGetCategory(message);
+    const char *method_name = LSMessageGetMethod(message);
+
+    if (!category_name || !method_name) return NULL;
+
+    /* nobody else probes the index, so the old one can go right away */
+    if (g_atomic_int_get(&sh->dispatch_dirty))
+    {
+        g_mutex_lock(&sh->dispatch_lock);
+        _LSDispatchTableFree(sh->dispatch);
+        sh->dispatch = _LSDispatchTableBuild(sh->tableHandlers);
+        g_atomic_int_set(&sh->dispatch_dirty, 0);
+        g_mutex_unlock(&sh->dispatch_lock);
+    }
+
+    _LSDispatchTable *dispatch = sh->dispatch;
+    if (dispatch)
+    {
+        /* the key is "category\0method" as it leads the body; a parsed
+         * message knows where the method ends already */
+        const char *payload = message->transport_msg->payload;
+        unsigned int key_len = payload && payload > method_name
+                             ? payload - 1 - category_name
+                             : (method_name - category_name) + strlen(method_name);
+        guint32 hash = _LSDispatchHash(category_name, key_len);
+
+        /* categories and methods outlive the table, only the slots don't */
+        LSCategoryTable *category = NULL;
+        unsigned int i = hash & dispatch->mask;
+        _LSDispatchSlot *slot;
+        for (; (slot = &dispatch->slots[i])->category; i = (i + 1) & dispatch->mask)
+        {
+            if (slot->hash == hash && slot->key_len == key_len &&
+                memcmp(slot->key, category_name, key_len) == 0)
+            {
+                message->method_entry = slot->method;
+                category = slot->category;
+                break;
+            }
+        }
+
+        if (category) return category;
+    }
+
+    g_mutex_lock(&sh->dispatch_lock);
+    bool category_found = sh->tableHandlers && g_hash_table_lookup(sh->tableHandlers, category_name);
+    g_mutex_unlock(&sh->dispatch_lock);
+
+    if (!category_found)
+    {
+        LOG_LS_ERROR(MSGID_LS_NO_CATEGORY, 1,
+                     PMLOGKS("CATEGORY", category_name),
+                     "Couldn't find category: %s", category_name);
+    }
+    else
+    {
+        LOG_LS_ERROR(MSGID_LS_NO_METHOD, 1,
+                     PMLOGKS("METHOD", method_name),
+                     "Couldn't find method: %s", method_name);
+    }
+    return NULL;
+}
+
 /* @} END OF LunaServiceInternals */
 
 /**
@@ -337,6 +539,9 @@ LSRegisterCategoryAppend(LSHandle *sh, const char *category,
 
     LSCategoryTable *table = NULL;
 
+    /* the dispatching thread may be indexing tableHandlers */
+    g_mutex_lock(&sh->dispatch_lock);
+
     if (!sh->tableHandlers)
     {
         sh->tableHandlers = g_hash_table_new_full(g_str_hash, g_str_equal,
@@ -387,8 +592,11 @@ LSRegisterCategoryAppend(LSHandle *sh, const char *category,
             }
             LSMethodEntrySet(entry, m);
         }
+        _LSDispatchTableInvalidate(sh);
     }
 
+    g_mutex_unlock(&sh->dispatch_lock);
+
     if (signals)
     {
         LSSignal *s;
@@ -523,7 +731,10 @@ bool LSCategorySetDescription(
             /* build and keep schema in case if this flag will be true */
             entry->flags |= LUNA_METHOD_FLAG_VALIDATE_IN;
 
+            g_mutex_lock(&sh->dispatch_lock);
             g_hash_table_insert(table->methods, strdup(method_name), entry);
+            _LSDispatchTableInvalidate(sh);
+            g_mutex_unlock(&sh->dispatch_lock);
         }
         else
         {
@@ -30,6 +30,7 @@
 #include "base.h"
 #include "error.h"
 #include "clock.h"
+#include "metrics.h"
 
 #include <pmtrace_ls2.h>
 
@@ -55,35 +56,42 @@ struct LSCategoryTable {
 
 typedef struct LSCategoryTable LSCategoryTable;
 
-typedef struct {
+typedef struct LSMethodEntry {
     LSMethodFunction function;  /**< Method function */
     LSMethodFlags flags;        /**< Method flags */
     jschema_ref schema_call;
     jschema_ref schema_firstReply;
     jschema_ref schema_reply;
+    _LSMethodMetrics metrics;   /**< Call counters */
 } LSMethodEntry;
 
+/**
+ * Flat index of every method of a handle, keyed by the "category\0method"
+ * bytes exactly as they lead the body of a method call. Rebuilt by the first
+ * lookup after methods are registered, so dispatch costs one hash of the key
+ * and no allocation, instead of a string hash lookup per level of
+ * tableHandlers.
+ */
+typedef struct _LSDispatchTable _LSDispatchTable;
+
+void _LSDispatchTableFree(_LSDispatchTable *table);
+
 bool LSCategoryValidateCall(LSMethodEntry *entry, LSMessage *message);
 
-static inline LSMessageHandlerResult LSCategoryMethodCall(
+LSCategoryTable *LSCategoryDispatchLookup(LSHandle *sh, LSMessage *message);
+
+/* Runs the handler of a method looked up with LSCategoryDispatchLookup().
+ * May be called on a worker thread (see worker_pool.h) */
+static inline LSMessageHandlerResult LSCategoryMethodInvoke(
     LSHandle *sh,
     LSCategoryTable *category,
+    LSMethodEntry *method,
     const char *service_name,
     LSMessage *message
 )
 {
     const char* method_name = LSMessageGetMethod(message);
 
-    /* find the method in the tableHandlers->methods hash */
-    LSMethodEntry *method = g_hash_table_lookup(category->methods, method_name);
-
-    if (!method)
-    {
-        LOG_LS_ERROR(MSGID_LS_NO_METHOD, 1,
-                     PMLOGKS("METHOD", method_name),
-                     "Couldn't find method: %s", method_name);
-        return LSMessageHandlerResultUnknownMethod;
-    }
     bool validateCall = method->flags & LUNA_METHOD_FLAG_VALIDATE_IN;
     bool validCall = !validateCall || LSCategoryValidateCall(method, message);
 
@@ -91,10 +99,8 @@ static inline LSMessageHandlerResult LSCategoryMethodCall(
     PMTRACE_SERVER_RECEIVE(service_name, sh->name, (char*)method_name, LSMessageGetToken(message));
 
     struct timespec start_time, end_time, gap_time;
-    if (DEBUG_TRACING)
-    {
-        ClockGetTime(&start_time);
-    }
+    ClockGetTime(&start_time);
+
     bool handled;
 
     if (!validCall) /* validation error were sent */
@@ -104,10 +110,12 @@ static inline LSMessageHandlerResult LSCategoryMethodCall(
     else
     { handled = method->function(sh, message, category->category_user_data); }
 
+    ClockGetTime(&end_time);
+    ClockDiff(&gap_time, &end_time, &start_time);
+    _LSMetricsMethodCalled(sh, &method->metrics, &gap_time);
+
     if (DEBUG_TRACING)
     {
-        ClockGetTime(&end_time);
-        ClockDiff(&gap_time, &end_time, &start_time);
         LOG_LS_DEBUG("TYPE=service handler execution time | TIME=%ld | SERVICE=%s | CATEGORY=%s | METHOD=%s",
                 ClockGetMs(&gap_time), sh->name, LSMessageGetCategory(message), method_name);
     }
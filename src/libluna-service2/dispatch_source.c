@@ -0,0 +1,321 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include "dispatch_source.h"
+#include "error.h"
+
+/**
+ * @addtogroup LunaServiceInternals
+ * @{
+ */
+
+struct _LSDispatchSource {
+    GSource         source;         /**< must be first */
+    GMainContext    *context;
+    _LSDispatchFunc func;
+    void            *data;
+    _LSDispatchRefFunc ref;
+    _LSDispatchRefFunc unref;
+    GMutex          lock;           /**< protects everything below */
+    GQueue          queue;          /**< scheduled items, in turn order */
+    GHashTable      *scheduled;     /**< item -> its link in the queue, NULL
+                                         while the item is having its turn */
+};
+
+static gboolean
+_LSDispatchSourcePrepare(GSource *source, gint *timeout)
+{
+    _LSDispatchSource *dispatch = (_LSDispatchSource *) source;
+    *timeout = -1;
+
+    g_mutex_lock(&dispatch->lock);
+    bool ready = !g_queue_is_empty(&dispatch->queue);
+    g_mutex_unlock(&dispatch->lock);
+
+    return ready;
+}
+
+static gboolean
+_LSDispatchSourceCheck(GSource *source)
+{
+    gint timeout;
+    return _LSDispatchSourcePrepare(source, &timeout);
+}
+
+static gboolean
+_LSDispatchSourceDispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+    _LSDispatchSource *dispatch = (_LSDispatchSource *) source;
+
+    /* One turn for every item scheduled so far; items requeued during the
+     * round wait for the next dispatch */
+    g_mutex_lock(&dispatch->lock);
+    guint turns = g_queue_get_length(&dispatch->queue);
+
+    while (turns-- && !g_queue_is_empty(&dispatch->queue))
+    {
+        void *item = g_queue_pop_head(&dispatch->queue);
+        g_hash_table_insert(dispatch->scheduled, item, NULL);
+        if (dispatch->ref) dispatch->ref(item);
+        g_mutex_unlock(&dispatch->lock);
+
+        bool more = dispatch->func(item, dispatch->data);
+        bool unschedule = false;
+
+        g_mutex_lock(&dispatch->lock);
+        GList *link = NULL;
+        if (g_hash_table_lookup_extended(dispatch->scheduled, item, NULL, (gpointer *) &link) && !link)
+        {
+            /* neither cancelled nor rescheduled during the turn */
+            if (more)
+            {
+                g_queue_push_tail(&dispatch->queue, item);
+                g_hash_table_insert(dispatch->scheduled, item, g_queue_peek_tail_link(&dispatch->queue));
+            }
+            else
+            {
+                g_hash_table_remove(dispatch->scheduled, item);
+                unschedule = true;
+            }
+        }
+        g_mutex_unlock(&dispatch->lock);
+
+        if (dispatch->unref)
+        {
+            if (unschedule) dispatch->unref(item);
+            dispatch->unref(item);
+        }
+
+        g_mutex_lock(&dispatch->lock);
+    }
+    g_mutex_unlock(&dispatch->lock);
+
+    return TRUE;
+}
+
+static void
+_LSDispatchSourceFinalize(GSource *source)
+{
+    _LSDispatchSource *dispatch = (_LSDispatchSource *) source;
+
+    g_hash_table_unref(dispatch->scheduled);
+    g_mutex_clear(&dispatch->lock);
+}
+
+static GSourceFuncs _LSDispatchSourceFuncs = {
+    .prepare  = _LSDispatchSourcePrepare,
+    .check    = _LSDispatchSourceCheck,
+    .dispatch = _LSDispatchSourceDispatch,
+    .finalize = _LSDispatchSourceFinalize,
+};
+
+/**
+ *******************************************************************************
+ * @brief Create a dispatch source and attach it to the context.
+ *
+ * @param  context   IN  context the turns run on (NULL for the default one)
+ * @param  priority  IN  glib priority of the source
+ * @param  func      IN  one turn of an item
+ * @param  data      IN  passed to func
+ * @param  ref       IN  references a scheduled item (may be NULL)
+ * @param  unref     IN  releases a scheduled item (may be NULL)
+ *
+ * @retval  dispatch source
+ *******************************************************************************
+ */
+_LSDispatchSource*
+_LSDispatchSourceNew(GMainContext *context, int priority,
+                     _LSDispatchFunc func, void *data,
+                     _LSDispatchRefFunc ref, _LSDispatchRefFunc unref)
+{
+    LS_ASSERT(func != NULL);
+
+    _LSDispatchSource *dispatch = (_LSDispatchSource *) g_source_new(&_LSDispatchSourceFuncs,
+                                                                    sizeof(_LSDispatchSource));
+
+    g_mutex_init(&dispatch->lock);
+
+    dispatch->func = func;
+    dispatch->data = data;
+    dispatch->ref = ref;
+    dispatch->unref = unref;
+    g_queue_init(&dispatch->queue);
+    dispatch->scheduled = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    g_source_set_priority(&dispatch->source, priority);
+    g_source_attach(&dispatch->source, context);
+    dispatch->context = g_source_get_context(&dispatch->source);
+
+    return dispatch;
+}
+
+/**
+ *******************************************************************************
+ * @brief Detach the source and free it. Scheduled items are released
+ * without getting their turn.
+ *
+ * @param  dispatch  IN  dispatch source (may be NULL)
+ *******************************************************************************
+ */
+void
+_LSDispatchSourceFree(_LSDispatchSource *dispatch)
+{
+    if (!dispatch) return;
+
+    /* including an item having its turn, if freed from within it */
+    g_mutex_lock(&dispatch->lock);
+    GList *items = g_hash_table_get_keys(dispatch->scheduled);
+    g_hash_table_remove_all(dispatch->scheduled);
+    g_queue_clear(&dispatch->queue);
+    g_mutex_unlock(&dispatch->lock);
+
+    g_source_destroy(&dispatch->source);
+
+    if (dispatch->unref)
+    {
+        g_list_foreach(items, (GFunc) dispatch->unref, NULL);
+    }
+    g_list_free(items);
+
+    g_source_unref(&dispatch->source);
+}
+
+/**
+ *******************************************************************************
+ * @brief Change the glib priority of the source.
+ *
+ * @param  dispatch  IN  dispatch source
+ * @param  priority  IN  glib priority
+ *******************************************************************************
+ */
+void
+_LSDispatchSourceSetPriority(_LSDispatchSource *dispatch, int priority)
+{
+    g_source_set_priority(&dispatch->source, priority);
+}
+
+/**
+ *******************************************************************************
+ * @brief Give the item a turn after the items scheduled before it. Does
+ * nothing if the item is scheduled already.
+ *
+ * @param  dispatch  IN  dispatch source
+ * @param  item      IN  item
+ *******************************************************************************
+ */
+void
+_LSDispatchSourceSchedule(_LSDispatchSource *dispatch, void *item)
+{
+    g_mutex_lock(&dispatch->lock);
+
+    if (g_hash_table_lookup(dispatch->scheduled, item))
+    {
+        g_mutex_unlock(&dispatch->lock);
+        return;
+    }
+
+    bool was_empty = g_queue_is_empty(&dispatch->queue);
+    if (dispatch->ref && !g_hash_table_contains(dispatch->scheduled, item))
+    {
+        dispatch->ref(item);
+    }
+    g_queue_push_tail(&dispatch->queue, item);
+    g_hash_table_insert(dispatch->scheduled, item, g_queue_peek_tail_link(&dispatch->queue));
+
+    g_mutex_unlock(&dispatch->lock);
+
+    if (was_empty && !g_main_context_is_owner(dispatch->context))
+    {
+        g_main_context_wakeup(dispatch->context);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Unschedule the item. A turn that is running isn't interrupted, but
+ * the item isn't requeued after it.
+ *
+ * @param  dispatch  IN  dispatch source
+ * @param  item      IN  item
+ *
+ * @retval  true if the item was scheduled
+ * @retval  false otherwise
+ *******************************************************************************
+ */
+bool
+_LSDispatchSourceCancel(_LSDispatchSource *dispatch, void *item)
+{
+    GList *link = NULL;
+
+    g_mutex_lock(&dispatch->lock);
+    bool scheduled = g_hash_table_lookup_extended(dispatch->scheduled, item, NULL, (gpointer *) &link);
+    if (scheduled)
+    {
+        if (link) g_queue_delete_link(&dispatch->queue, link);
+        g_hash_table_remove(dispatch->scheduled, item);
+    }
+    g_mutex_unlock(&dispatch->lock);
+
+    if (scheduled && dispatch->unref)
+    {
+        dispatch->unref(item);
+    }
+
+    return scheduled;
+}
+
+/**
+ *******************************************************************************
+ * @brief Check whether the item is scheduled (or having its turn).
+ *
+ * @param  dispatch  IN  dispatch source
+ * @param  item      IN  item
+ *
+ * @retval  true if scheduled
+ *******************************************************************************
+ */
+bool
+_LSDispatchSourceIsScheduled(_LSDispatchSource *dispatch, void *item)
+{
+    g_mutex_lock(&dispatch->lock);
+    bool scheduled = g_hash_table_contains(dispatch->scheduled, item);
+    g_mutex_unlock(&dispatch->lock);
+
+    return scheduled;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the number of items waiting for their turn.
+ *
+ * @param  dispatch  IN  dispatch source
+ *
+ * @retval  number of items
+ *******************************************************************************
+ */
+unsigned int
+_LSDispatchSourceGetScheduledCount(_LSDispatchSource *dispatch)
+{
+    g_mutex_lock(&dispatch->lock);
+    unsigned int count = g_queue_get_length(&dispatch->queue);
+    g_mutex_unlock(&dispatch->lock);
+
+    return count;
+}
+
+/* @} END OF LunaServiceInternals */
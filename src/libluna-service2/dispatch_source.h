@@ -0,0 +1,65 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _DISPATCH_SOURCE_H_
+#define _DISPATCH_SOURCE_H_
+
+#include <stdbool.h>
+#include <glib.h>
+
+/**
+ * @addtogroup LunaServiceInternals
+ * @{
+ */
+
+/**
+ * Round-robin run queue driven by a single GSource.
+ *
+ * Items (clients with unprocessed incoming messages) are scheduled when
+ * they have more work than one turn may do. Every dispatch gives each
+ * scheduled item one turn, in the order they were scheduled, and requeues
+ * the ones that still have work left, so that between two turns of the same
+ * item every other item and every other source of the context get theirs.
+ *
+ * Items are referenced while scheduled. The queue may be scheduled and
+ * cancelled from any thread; turns run on the source's context without the
+ * queue lock held.
+ */
+typedef struct _LSDispatchSource _LSDispatchSource;
+
+/** One turn of the item. Returns true when the item has work left */
+typedef bool (*_LSDispatchFunc)(void *item, void *data);
+
+/** References or releases an item */
+typedef void (*_LSDispatchRefFunc)(void *item);
+
+_LSDispatchSource* _LSDispatchSourceNew(GMainContext *context, int priority,
+                                        _LSDispatchFunc func, void *data,
+                                        _LSDispatchRefFunc ref, _LSDispatchRefFunc unref);
+void _LSDispatchSourceFree(_LSDispatchSource *dispatch);
+
+void _LSDispatchSourceSetPriority(_LSDispatchSource *dispatch, int priority);
+void _LSDispatchSourceSchedule(_LSDispatchSource *dispatch, void *item);
+bool _LSDispatchSourceCancel(_LSDispatchSource *dispatch, void *item);
+bool _LSDispatchSourceIsScheduled(_LSDispatchSource *dispatch, void *item);
+unsigned int _LSDispatchSourceGetScheduledCount(_LSDispatchSource *dispatch);
+
+/* @} END OF LunaServiceInternals */
+
+#endif // _DISPATCH_SOURCE_H_
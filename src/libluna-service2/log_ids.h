@@ -57,6 +57,7 @@
 #define MSGID_LSHUB_NO_SIGNAL_PERMS             "LSHUB_NO_SIGNAL_PERMS" /** Not allowed to send signals */
 #define MSGID_LSHUB_PEER_NAME_ERR               "LSHUB_PEER_NAME"       /** Getpeername failed */
 #define MSGID_LSHUB_PIPE_ERR                    "LSHUB_PIPE"            /** Pipe error */
+#define MSGID_LSHUB_PRELAUNCH_ERR               "LSHUB_PRELAUNCH"       /** Error loading or saving the pre-launch graph */
 #define MSGID_LSHUB_PUSH_ROLE_ERR               "LSHUB_PUSH_ROLE"       /** Error due role pushing */
 #define MSGID_LSHUB_REG_REPLY_ERR               "LSHUB_REG_REPLY"       /** error sending signal registration reply */
 #define MSGID_LSHUB_ROLE_EXISTS                 "LSHUB_ROLE_EXISTS"     /** Role already exists for exe_path */
@@ -125,6 +126,7 @@
 #define MSGID_LS_MAINLOOP_ERROR                 "LS_MLOOP"              /** Mainloop error */
 #define MSGID_LS_MALLOC_SEND_FAILED             "LS_MALL_SEND_FAIL"     /** Sending malloc info failed */
 #define MSGID_LS_MALLOC_TRIM_SEND_FAILED        "LS_MALLTRIM_SEND_FAIL" /** Sending malloc trim result failed */
+#define MSGID_LS_METRICS_SEND_FAILED            "LS_METRICS_SEND_FAIL"  /** Sending metrics failed */
 #define MSGID_LS_MSG_ERR                        "LS_MSG"                /** Messages errors */
 #define MSGID_LS_MSG_NOT_HANDLED                "LS_MSG_NOT_HNDLD"      /** Messages not handled */
 #define MSGID_LS_MUTEX_ERR                      "LS_MUTEX"              /** Mutex error */
@@ -31,6 +31,7 @@
 #include "base.h"
 #include "message.h"
 #include "transport_priv.h"
+#include "worker_pool.h"
 
 struct LSFetchQueue {
     GSList *sh_list;
@@ -221,6 +222,103 @@ LSGmainSetPriorityPalmService(LSPalmService *psh, int priority, LSError *lserror
     return true;
 }
 
+/**
+* @brief Bound how much of one peer's traffic is handled per main loop
+*        iteration.
+*
+*        By default everything a peer has sent is read and handled as soon
+*        as its socket becomes readable, so a peer that floods the service
+*        holds up every other peer and every other source of the context.
+*        With a budget, at most max_messages messages (or max_bytes bytes of
+*        them) of a peer are read and handled at a time. What is left over
+*        is handled by a dispatch source at dispatch_priority, one budget per
+*        peer in turn.
+*
+* @param  sh
+* @param  max_messages       messages per turn, 0 for no limit
+* @param  max_bytes          bytes per turn, 0 for no limit
+* @param  dispatch_priority  glib priority of the turns after the first one
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSGmainSetIncomingBudget(LSHandle *sh, unsigned int max_messages, unsigned long max_bytes,
+                         int dispatch_priority, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+
+    LSHANDLE_VALIDATE(sh);
+
+    _LSTransportIncomingBudget budget = { max_messages, max_bytes };
+    _LSTransportSetIncomingBudget(sh->transport, &budget, dispatch_priority);
+
+    return true;
+}
+
+/**
+* @brief Dispatch incoming method calls of a service to worker contexts.
+*
+*        The service keeps reading messages, looking up methods and
+*        handling cancels and replies on its own context. Method handlers
+*        are invoked on one of the worker contexts, picked by key_func, so
+*        they must be thread-safe with respect to each other. The caller
+*        runs the main loops of the worker contexts.
+*
+*        This should be called after LSGmainAttach() and after all
+*        categories are registered.
+*
+* @param  sh
+* @param  contexts     worker contexts
+* @param  count        number of worker contexts
+* @param  key_func     dispatch key of a method call, NULL to dispatch by category
+* @param  ctx          user data passed to key_func
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSGmainAttachWorkers(LSHandle *sh, GMainContext **contexts, unsigned int count,
+                     LSDispatchKeyFunc key_func, void *ctx, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+    LSHANDLE_VALIDATE(sh);
+
+    _LSErrorIfFailMsg(contexts != NULL && count > 0, lserror, MSGID_LS_MAINCONTEXT_ERROR, -1,
+                      "%s: %s", __FUNCTION__, ": No worker contexts.");
+    _LSErrorIfFailMsg(sh->context != NULL, lserror, MSGID_LS_MAINCONTEXT_ERROR, -1,
+                      "%s: %s", __FUNCTION__, ": No maincontext.");
+    _LSErrorIfFailMsg(sh->workers == NULL, lserror, MSGID_LS_MAINCONTEXT_ERROR, -1,
+                      "%s: %s", __FUNCTION__, ": Workers already attached.");
+
+    sh->workers = _LSWorkerPoolNew(sh, contexts, count, key_func, ctx);
+
+    return true;
+}
+
+/**
+* @brief Stop dispatching method calls to worker contexts. Calls that
+*        haven't reached a worker yet are handled on the calling thread,
+*        which should be the one running the service's context.
+*
+* @param  sh
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSGmainDetachWorkers(LSHandle *sh, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+    LSHANDLE_VALIDATE(sh);
+
+    _LSWorkerPool *workers = sh->workers;
+    sh->workers = NULL;
+    _LSWorkerPoolFree(workers, true);
+
+    return true;
+}
+
 /* @} END OF LunaServiceMainloop */
 
 /**
@@ -29,6 +29,7 @@
 
 #include "base.h"
 #include "message.h"
+#include "transport_signal.h"
 
 /**
  * @addtogroup LunaServiceInternals
@@ -345,6 +346,19 @@ LSMessageGetPayload(LSMessage *message)
         return message->payload;
     }
 
+    /* service status signals carry typed fields, the JSON is built only for
+     * the callbacks that ask for it */
+    _LSTransportMessageType type = _LSTransportMessageGetType(message->transport_msg);
+    if (type == _LSTransportMessageTypeServiceUpSignal || type == _LSTransportMessageTypeServiceDownSignal)
+    {
+        message->payloadAllocated = LSTransportServiceStatusSignalGetPayload(message->transport_msg);
+        if (message->payloadAllocated)
+        {
+            message->payload = message->payloadAllocated;
+            return message->payload;
+        }
+    }
+
     message->payload = _LSTransportMessageGetPayload(message->transport_msg);
 
     return message->payload;
@@ -405,6 +419,36 @@ exit:
     return ret;
 }
 
+/**
+* @brief Check that a reply payload may be sent.
+*
+* @param  replyPayload
+* @param  lserror
+*
+* @retval
+*/
+bool
+_LSMessageReplyPayloadValidate(const char *replyPayload, LSError *lserror)
+{
+    if (unlikely(_ls_enable_utf8_validation))
+    {
+        if (!g_utf8_validate (replyPayload, -1, NULL))
+        {
+            _LSErrorSet(lserror, MSGID_LS_INVALID_JSON, -EINVAL, "%s: payload is not utf-8",
+                        __FUNCTION__);
+            return false;
+        }
+    }
+
+    if (unlikely(strcmp(replyPayload, "") == 0))
+    {
+        _LSErrorSet(lserror, MSGID_LS_INVALID_JSON, -EINVAL, "Empty payload is not valid JSON. Use {}");
+        return false;
+    }
+
+    return true;
+}
+
 /**
 * @brief Send a reply to message using the same bus that
 *        message came from.
@@ -446,19 +490,8 @@ LSMessageReply(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
 
     LSHANDLE_VALIDATE(sh);
 
-    if (unlikely(_ls_enable_utf8_validation))
+    if (!_LSMessageReplyPayloadValidate(replyPayload, lserror))
     {
-        if (!g_utf8_validate (replyPayload, -1, NULL))
-        {
-            _LSErrorSet(lserror, MSGID_LS_INVALID_JSON, -EINVAL, "%s: payload is not utf-8",
-                        __FUNCTION__);
-            return false;
-        }
-    }
-
-    if (unlikely(strcmp(replyPayload, "") == 0))
-    {
-        _LSErrorSet(lserror, MSGID_LS_INVALID_JSON, -EINVAL, "Empty payload is not valid JSON. Use {}");
         return false;
     }
 
@@ -501,6 +534,169 @@ LSMessageReply(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
     return retVal;
 }
 
+/**
+* @brief Send a reply with a payload already checked with
+*        _LSMessageReplyPayloadValidate(). The payload is shared with
+*        replies to other messages rather than copied for each of them.
+*
+* @param  sh
+* @param  lsmsg
+* @param  replyPayload
+* @param  payload_size   size of replyPayload including the terminating zero
+* @param  shared_payload copy of replyPayload kept by replies that are queued,
+*                        made by the first of them if NULL; the caller unrefs
+*                        it after the last reply (see _LSTransportSendReplyShared())
+* @param  update_key     subscription key if the reply is a subscription
+*                        update (see LSSetOutgoingLimits()), NULL otherwise
+* @param  supersedes     true if the update replaces an unsent update of the
+*                        same subscription (see LSSubscriptionSetLatestOnly())
+* @param  lserror
+*
+* @retval
+*/
+bool
+_LSMessageReplyShared(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
+                      unsigned long payload_size, GBytes **shared_payload,
+                      const char *update_key, bool supersedes, LSError *lserror)
+{
+    if (unlikely(LSMessageGetConnection(lsmsg) != sh))
+    {
+        _LSErrorSet(lserror, MSGID_LS_INVALID_BUS, -EINVAL,
+                    "%s: You are replying to message on different bus.\n"
+                    " If you can't identify which bus, "
+                    "try LSMessageRespond() instead.",
+                    __FUNCTION__);
+        return false;
+    }
+
+    if (DEBUG_TRACING)
+    {
+        LOG_LS_DEBUG("TX: LSMessageReply token <<%ld>>", LSMessageGetToken(lsmsg));
+    }
+
+    return _LSTransportSendReplyShared(lsmsg->transport_msg, replyPayload, payload_size, shared_payload,
+                                       update_key, supersedes, lserror);
+}
+
+/**
+* @brief Send the same reply to several messages received on the bus
+*        identified by LSHandle.
+*
+*        Equivalent to calling LSMessageReply() for each message, but the
+*        payload is validated and measured only once and isn't copied for
+*        every reply.
+*
+* @param  sh
+* @param  messages
+* @param  count
+* @param  replyPayload
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSMessageReplyMulti(LSHandle *sh, LSMessage **messages, unsigned int count,
+                    const char *replyPayload, LSError *lserror)
+{
+    return LSMessageReplyUpdateMulti(sh, messages, count, NULL, false, replyPayload, lserror);
+}
+
+/**
+* @brief Send the same subscription update to several subscribers, like
+*        LSMessageReplyMulti().
+*
+*        The replies are updates of the subscription named key, so they are
+*        subject to the policies of LSSetOutgoingLimits(). With latest_only
+*        an update still queued for a subscriber, because it doesn't read
+*        fast enough, is replaced by the new one instead of being followed
+*        by it; see LSSubscriptionSetLatestOnly().
+*
+* @param  sh
+* @param  messages
+* @param  count
+* @param  key            subscription key, NULL for plain replies
+* @param  latest_only
+* @param  replyPayload
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSMessageReplyUpdateMulti(LSHandle *sh, LSMessage **messages, unsigned int count,
+                          const char *key, bool latest_only,
+                          const char *replyPayload, LSError *lserror)
+{
+    _LSErrorIfFail (sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+    _LSErrorIfFail (messages != NULL || count == 0, lserror, MSGID_LS_MSG_ERR);
+    _LSErrorIfFail (replyPayload != NULL, lserror, MSGID_LS_PARAMETER_IS_NULL);
+
+    LSHANDLE_VALIDATE(sh);
+
+    if (!_LSMessageReplyPayloadValidate(replyPayload, lserror))
+    {
+        return false;
+    }
+
+    unsigned long payload_size = strlen(replyPayload) + 1;
+    GBytes *shared_payload = NULL;
+    bool retVal = true;
+
+    unsigned int i;
+    for (i = 0; i < count && retVal; i++)
+    {
+        retVal = _LSMessageReplyShared(sh, messages[i], replyPayload, payload_size, &shared_payload,
+                                       key, key && latest_only, lserror);
+    }
+
+    if (shared_payload) g_bytes_unref(shared_payload);
+
+    return retVal;
+}
+
+/**
+* @brief Check if the sender of a message is backed up: its outgoing queue
+*        has reached the high-water marks set with LSSetOutgoingLimits(), so
+*        the next reply (e.g., a subscription update) is subject to the
+*        queue's policy. Lets a service skip producing an update nobody
+*        reads yet.
+*
+* @param  message
+*
+* @retval true if the sender is backed up, false if it isn't or no marks are set
+*/
+bool
+LSMessageIsBackedUp(LSMessage *message)
+{
+    if (!message || !message->transport_msg || !message->transport_msg->client)
+        return false;
+
+    return _LSTransportClientIsBackedUp(message->transport_msg->client);
+}
+
+/**
+* @brief Get how much is queued, unsent, for the sender of a message.
+*
+* @param  message
+* @param  messages   number of queued messages, may be NULL
+* @param  bytes      number of queued bytes, may be NULL
+*
+* @retval true on success
+*/
+bool
+LSMessageGetOutgoingQueueDepth(LSMessage *message, unsigned int *messages,
+                               unsigned long *bytes)
+{
+    if (!message || !message->transport_msg || !message->transport_msg->client)
+        return false;
+
+    _LSTransportOutgoingStats stats;
+    _LSTransportClientGetOutgoingStats(message->transport_msg->client, &stats);
+
+    if (messages) *messages = stats.messages;
+    if (bytes) *bytes = stats.bytes;
+
+    return true;
+}
 
 /**
 * @brief Send a reply.
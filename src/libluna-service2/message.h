@@ -46,8 +46,14 @@ struct LSMessage {
 
     bool         ignore;
     bool         serviceDownMessage;
+
+    struct LSMethodEntry *method_entry; //< resolved by LSCategoryDispatchLookup()
 };
 
 LSMessage *_LSMessageNewRef(_LSTransportMessage *transport_msg, LSHandle *sh);
 char *_LSMessageGetKindHelper(const char *category, const char *method);
+bool _LSMessageReplyPayloadValidate(const char *replyPayload, LSError *lserror);
+bool _LSMessageReplyShared(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
+                           unsigned long payload_size, GBytes **shared_payload,
+                           const char *update_key, bool supersedes, LSError *lserror);
 
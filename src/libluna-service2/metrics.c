@@ -0,0 +1,456 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <string.h>
+#include <stdint.h>
+
+#include <luna-service2/lunaservice-meta.h>
+
+#include "metrics.h"
+#include "base.h"
+#include "category.h"
+#include "transport.h"
+#include "log.h"
+
+/**
+ * @addtogroup LunaServiceInternals
+ * @{
+ */
+
+/**
+ *******************************************************************************
+ * @brief Allocate per-handle metrics.
+ *
+ * @retval  metrics on success
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+_LSMetrics*
+_LSMetricsNew(void)
+{
+    _LSMetrics *metrics = g_new0(_LSMetrics, 1);
+
+    if (pthread_mutex_init(&metrics->lock, NULL))
+    {
+        LOG_LS_ERROR(MSGID_LS_MUTEX_ERR, 0, "Could not initialize mutex");
+        g_free(metrics);
+        return NULL;
+    }
+
+    return metrics;
+}
+
+/**
+ *******************************************************************************
+ * @brief Free per-handle metrics.
+ *
+ * @param  metrics  IN  metrics (may be NULL)
+ *******************************************************************************
+ */
+void
+_LSMetricsFree(_LSMetrics *metrics)
+{
+    if (!metrics) return;
+
+    int i;
+    for (i = 0; i < LS_METRICS_CALLS_SENT_SLOTS; i++)
+    {
+        g_free(metrics->calls_sent_to[i].service);
+        g_free(metrics->calls_sent_to[i].category);
+    }
+
+    if (pthread_mutex_destroy(&metrics->lock))
+    {
+        LOG_LS_WARNING(MSGID_LS_MUTEX_ERR, 0, "Could not destroy mutex &metrics->lock");
+    }
+
+#ifdef MEMCHECK
+    memset(metrics, 0xFF, sizeof(_LSMetrics));
+#endif
+
+    g_free(metrics);
+}
+
+/**
+ *******************************************************************************
+ * @brief Add a sample to a histogram.
+ *
+ * @param  hist     IN  histogram
+ * @param  elapsed  IN  sample
+ *******************************************************************************
+ */
+void
+_LSMetricsHistogramAdd(_LSMetricsHistogram *hist, const struct timespec *elapsed)
+{
+    int bucket = 0;
+
+    if (elapsed->tv_sec >= 0)
+    {
+        uint64_t us = (uint64_t)elapsed->tv_sec * 1000000ULL + elapsed->tv_nsec / 1000;
+
+        if (us)
+        {
+            bucket = 64 - __builtin_clzll(us);
+            if (bucket >= LS_METRICS_HISTOGRAM_BUCKETS)
+                bucket = LS_METRICS_HISTOGRAM_BUCKETS - 1;
+        }
+    }
+
+    g_atomic_int_inc(&hist->buckets[bucket]);
+}
+
+/**
+ *******************************************************************************
+ * @brief Convert histogram to a JSON array of bucket counts.
+ *
+ * @param  hist     IN  histogram
+ *
+ * @retval  JSON array (caller must j_release)
+ *******************************************************************************
+ */
+jvalue_ref
+_LSMetricsHistogramToJson(const _LSMetricsHistogram *hist)
+{
+    jvalue_ref array = jarray_create(NULL);
+
+    int i;
+    for (i = 0; i < LS_METRICS_HISTOGRAM_BUCKETS; i++)
+    {
+        jarray_append(array, jnumber_create_i32(g_atomic_int_get(&hist->buckets[i])));
+    }
+
+    return array;
+}
+
+/**
+ *******************************************************************************
+ * @brief Account an invocation of a method handler.
+ *
+ * @param  sh            IN  handle
+ * @param  method        IN  method counters
+ * @param  handler_time  IN  time spent in the handler
+ *******************************************************************************
+ */
+void
+_LSMetricsMethodCalled(LSHandle *sh, _LSMethodMetrics *method,
+                       const struct timespec *handler_time)
+{
+    if (sh->metrics) g_atomic_int_inc(&sh->metrics->calls_received);
+
+    g_atomic_int_inc(&method->calls_received);
+    _LSMetricsHistogramAdd(&method->handler_time, handler_time);
+}
+
+/* Slot of the destination, or the free slot it would take */
+static _LSMetricsDestination*
+_LSMetricsDestinationLookup(_LSMetrics *metrics, const char *service, const char *category)
+{
+    guint slot = g_str_hash(service) * 31 + g_str_hash(category);
+
+    for (;; slot++)
+    {
+        _LSMetricsDestination *dest = &metrics->calls_sent_to[slot % LS_METRICS_CALLS_SENT_SLOTS];
+        const char *dest_service = g_atomic_pointer_get(&dest->service);
+
+        /* there's always a free slot, see LS_METRICS_CALLS_SENT_SLOTS */
+        if (!dest_service ||
+            (strcmp(dest_service, service) == 0 && strcmp(dest->category, category) == 0))
+        {
+            return dest;
+        }
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Account an outgoing method call.
+ *
+ * Calls are counted by destination service and category, and only for the
+ * first LS_METRICS_CALLS_SENT_DESTINATIONS destinations, so that the table
+ * stays small. Counting a call to a known destination doesn't lock or
+ * allocate.
+ *
+ * @attention locks the metrics lock the first time a destination is seen
+ *
+ * @param  sh        IN  handle
+ * @param  service   IN  called service
+ * @param  category  IN  called category
+ *******************************************************************************
+ */
+void
+_LSMetricsCallSent(LSHandle *sh, const char *service, const char *category)
+{
+    _LSMetrics *metrics = sh->metrics;
+    if (!metrics) return;
+
+    g_atomic_int_inc(&metrics->calls_sent);
+
+    _LSMetricsDestination *dest = _LSMetricsDestinationLookup(metrics, service, category);
+    if (likely(g_atomic_pointer_get(&dest->service)))
+    {
+        g_atomic_int_inc(&dest->calls_sent);
+        return;
+    }
+
+    int lock_ret = pthread_mutex_lock(&metrics->lock);
+    LS_ASSERT(lock_ret == 0);
+
+    /* someone may have added it meanwhile */
+    dest = _LSMetricsDestinationLookup(metrics, service, category);
+    if (!dest->service && metrics->destinations < LS_METRICS_CALLS_SENT_DESTINATIONS)
+    {
+        dest->category = g_strdup(category);
+        g_atomic_pointer_set(&dest->service, g_strdup(service));
+        metrics->destinations++;
+    }
+
+    /* counts are never freed before the metrics */
+    gint *count = dest->service ? &dest->calls_sent : &metrics->calls_sent_other;
+
+    lock_ret = pthread_mutex_unlock(&metrics->lock);
+    LS_ASSERT(lock_ret == 0);
+
+    g_atomic_int_inc(count);
+}
+
+/**
+ *******************************************************************************
+ * @brief Account a reply dispatched to a method call callback.
+ *
+ * @param  sh       IN  handle
+ * @param  latency  IN  time since the call was sent, or NULL if this is not
+ *                      the first reply to the call
+ *******************************************************************************
+ */
+void
+_LSMetricsReplyReceived(LSHandle *sh, const struct timespec *latency)
+{
+    _LSMetrics *metrics = sh->metrics;
+    if (!metrics) return;
+
+    g_atomic_int_inc(&metrics->replies_received);
+
+    if (latency)
+    {
+        _LSMetricsHistogramAdd(&metrics->reply_latency, latency);
+    }
+}
+
+static jvalue_ref
+_LSMetricsMethodsToJson(LSHandle *sh)
+{
+    jvalue_ref methods = jarray_create(NULL);
+
+    if (!sh->tableHandlers) return methods;
+
+    GHashTableIter cat_iter;
+    gpointer cat_key, cat_value;
+
+    g_hash_table_iter_init(&cat_iter, sh->tableHandlers);
+    while (g_hash_table_iter_next(&cat_iter, &cat_key, &cat_value))
+    {
+        LSCategoryTable *table = cat_value;
+
+        GHashTableIter meth_iter;
+        gpointer meth_key, meth_value;
+
+        g_hash_table_iter_init(&meth_iter, table->methods);
+        while (g_hash_table_iter_next(&meth_iter, &meth_key, &meth_value))
+        {
+            LSMethodEntry *entry = meth_value;
+
+            jvalue_ref method = jobject_create();
+            jobject_put(method, J_CSTR_TO_JVAL("category"), jstring_create(cat_key));
+            jobject_put(method, J_CSTR_TO_JVAL("method"), jstring_create(meth_key));
+            jobject_put(method, J_CSTR_TO_JVAL("callsReceived"),
+                        jnumber_create_i32(g_atomic_int_get(&entry->metrics.calls_received)));
+            jobject_put(method, J_CSTR_TO_JVAL("handlerTimeUs"),
+                        _LSMetricsHistogramToJson(&entry->metrics.handler_time));
+
+            jarray_append(methods, method);
+        }
+    }
+
+    return methods;
+}
+
+static jvalue_ref
+_LSMetricsCallsSentToJson(_LSMetrics *metrics)
+{
+    jvalue_ref calls = jarray_create(NULL);
+
+    int i;
+    for (i = 0; i < LS_METRICS_CALLS_SENT_SLOTS; i++)
+    {
+        _LSMetricsDestination *dest = &metrics->calls_sent_to[i];
+        const char *service = g_atomic_pointer_get(&dest->service);
+        if (!service)
+            continue;
+
+        /* "luna://service" for the root category, "luna://service/category" otherwise */
+        char *uri = g_strconcat("luna://", service,
+                                strcmp(dest->category, "/") == 0 ? "" : dest->category, NULL);
+
+        jvalue_ref call = jobject_create();
+        jobject_put(call, J_CSTR_TO_JVAL("uri"), jstring_create(uri));
+        jobject_put(call, J_CSTR_TO_JVAL("callsSent"), jnumber_create_i32(g_atomic_int_get(&dest->calls_sent)));
+        jarray_append(calls, call);
+
+        g_free(uri);
+    }
+
+    return calls;
+}
+
+static void
+_LSMetricsClientQueueToJson(const char *service_name, const char *unique_name,
+                            const _LSTransportOutgoingStats *stats, void *ctx)
+{
+    jvalue_ref clients = ctx;
+    jvalue_ref client = jobject_create();
+
+    if (service_name)
+        jobject_put(client, J_CSTR_TO_JVAL("serviceName"), jstring_create(service_name));
+    if (unique_name)
+        jobject_put(client, J_CSTR_TO_JVAL("uniqueName"), jstring_create(unique_name));
+    jobject_put(client, J_CSTR_TO_JVAL("queuedMessages"), jnumber_create_i64(stats->messages));
+    jobject_put(client, J_CSTR_TO_JVAL("queuedBytes"), jnumber_create_i64(stats->bytes));
+    jobject_put(client, J_CSTR_TO_JVAL("peakMessages"), jnumber_create_i64(stats->peak_messages));
+    jobject_put(client, J_CSTR_TO_JVAL("peakBytes"), jnumber_create_i64(stats->peak_bytes));
+    jobject_put(client, J_CSTR_TO_JVAL("droppedUpdates"), jnumber_create_i64(stats->dropped));
+    jobject_put(client, J_CSTR_TO_JVAL("coalescedUpdates"), jnumber_create_i64(stats->coalesced));
+
+    jarray_append(clients, client);
+}
+
+/**
+ *******************************************************************************
+ * @brief Build a JSON snapshot of the handle's metrics.
+ *
+ * @param  sh       IN  handle
+ * @param  ret_obj  OUT JSON object (caller must j_release)
+ * @param  lserror  OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+_LSMetricsGetJson(LSHandle *sh, jvalue_ref *ret_obj, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+    _LSErrorIfFail(ret_obj != NULL, lserror, MSGID_LS_PARAMETER_IS_NULL);
+
+    _LSMetrics *metrics = sh->metrics;
+    if (!metrics)
+    {
+        _LSErrorSet(lserror, MSGID_LS_INVALID_HANDLE, -1, "Metrics are not available for this handle");
+        return false;
+    }
+
+    jvalue_ref obj = jobject_create();
+
+    jobject_put(obj, J_CSTR_TO_JVAL("callsReceived"),
+                jnumber_create_i32(g_atomic_int_get(&metrics->calls_received)));
+    jobject_put(obj, J_CSTR_TO_JVAL("callsSent"),
+                jnumber_create_i32(g_atomic_int_get(&metrics->calls_sent)));
+    jobject_put(obj, J_CSTR_TO_JVAL("repliesReceived"),
+                jnumber_create_i32(g_atomic_int_get(&metrics->replies_received)));
+    jobject_put(obj, J_CSTR_TO_JVAL("replyLatencyUs"),
+                _LSMetricsHistogramToJson(&metrics->reply_latency));
+    jobject_put(obj, J_CSTR_TO_JVAL("methods"), _LSMetricsMethodsToJson(sh));
+    jobject_put(obj, J_CSTR_TO_JVAL("outgoingCalls"), _LSMetricsCallsSentToJson(metrics));
+    jobject_put(obj, J_CSTR_TO_JVAL("outgoingCallsOther"),
+                jnumber_create_i32(g_atomic_int_get(&metrics->calls_sent_other)));
+
+    if (sh->transport)
+    {
+        jvalue_ref clients = jarray_create(NULL);
+        _LSTransportGetOutgoingQueueStats(sh->transport, _LSMetricsClientQueueToJson, clients);
+        jobject_put(obj, J_CSTR_TO_JVAL("clients"), clients);
+
+        jobject_put(obj, J_CSTR_TO_JVAL("pendingQueryNames"),
+                    jnumber_create_i64(_LSTransportGetPendingQueryNameCount(sh->transport)));
+    }
+
+    *ret_obj = obj;
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Handler for "/com/palm/luna/private/metrics".
+ *
+ * @param  sh       IN  handle
+ * @param  message  IN  message
+ * @param  ctx      IN  unused
+ *
+ * @retval  true always
+ *******************************************************************************
+ */
+bool
+_LSPrivateGetMetrics(LSHandle* sh, LSMessage *message, void *ctx)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    jvalue_ref ret_obj = NULL;
+    if (_LSMetricsGetJson(sh, &ret_obj, &lserror))
+    {
+        jobject_put(ret_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+    }
+    else
+    {
+        /* don't leave the caller waiting for its timeout */
+        ret_obj = jobject_create();
+        jobject_put(ret_obj, J_CSTR_TO_JVAL("returnValue"), jboolean_create(false));
+        jobject_put(ret_obj, J_CSTR_TO_JVAL("errorCode"), jnumber_create_i32(lserror.error_code));
+        jobject_put(ret_obj, J_CSTR_TO_JVAL("errorText"), jstring_create(lserror.message));
+        LSErrorFree(&lserror);
+    }
+
+    if (!LSMessageReply(sh, message, jvalue_tostring_simple(ret_obj), &lserror))
+    {
+        LOG_LSERROR(MSGID_LS_METRICS_SEND_FAILED, &lserror);
+        LSErrorFree(&lserror);
+    }
+
+    j_release(&ret_obj);
+
+    return true;
+}
+
+/* @} END OF LunaServiceInternals */
+
+/**
+ * @addtogroup LunaServiceMeta
+ * @{
+ */
+
+bool
+LSGetMetrics(LSHandle *sh, jvalue_ref *metrics, LSError *error)
+{
+    _LSErrorIfFail(sh != NULL, error, MSGID_LS_INVALID_HANDLE);
+
+    LSHANDLE_VALIDATE(sh);
+
+    return _LSMetricsGetJson(sh, metrics, error);
+}
+
+/* @} END OF LunaServiceMeta */
@@ -0,0 +1,112 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <glib.h>
+#include <pbnjson.h>
+
+#include <luna-service2/lunaservice.h>
+
+/**
+ * @addtogroup LunaServiceInternals
+ * @{
+ */
+
+/**
+ * Number of buckets in a latency histogram. Bucket 0 counts samples below
+ * 1 us, bucket i counts samples in [2^(i-1), 2^i) us and the last bucket
+ * counts everything from 2^(N-2) us (~262 ms) up.
+ */
+#define LS_METRICS_HISTOGRAM_BUCKETS    20
+
+/**
+ * Most service/category destinations whose outgoing calls are counted one
+ * by one. Calls to further destinations are only counted in total.
+ */
+#define LS_METRICS_CALLS_SENT_DESTINATIONS  128
+
+/** Slots of the destination table, kept at most half full so probes are short */
+#define LS_METRICS_CALLS_SENT_SLOTS         (2 * LS_METRICS_CALLS_SENT_DESTINATIONS)
+
+/**
+ * @brief Calls sent to one service/category. A slot is published by setting
+ * service last, and is never changed or freed afterwards, so that it can be
+ * looked up without locking.
+ */
+typedef struct _LSMetricsDestination {
+    char *service;                          /**< NULL while the slot is free */
+    char *category;
+    gint calls_sent;
+} _LSMetricsDestination;
+
+/**
+ * @brief Log2 latency histogram. Updated with atomic increments only.
+ */
+typedef struct _LSMetricsHistogram {
+    gint buckets[LS_METRICS_HISTOGRAM_BUCKETS];
+} _LSMetricsHistogram;
+
+/**
+ * @brief Counters attached to each registered method (see LSMethodEntry).
+ */
+typedef struct _LSMethodMetrics {
+    gint calls_received;                    /**< number of times handler was invoked */
+    _LSMetricsHistogram handler_time;       /**< handler execution time */
+} _LSMethodMetrics;
+
+/**
+ * @brief Per-handle counters.
+ */
+typedef struct _LSMetrics {
+    gint calls_received;                    /**< method calls dispatched to handlers */
+    gint calls_sent;                        /**< method calls sent with LSCall* */
+    gint replies_received;                  /**< replies dispatched to call callbacks */
+    _LSMetricsHistogram reply_latency;      /**< call -> first reply latency */
+
+    gint calls_sent_other;                  /**< method calls to destinations past
+                                                 LS_METRICS_CALLS_SENT_DESTINATIONS */
+
+    pthread_mutex_t lock;                   /**< serializes adding destinations */
+    unsigned int destinations;              /**< used slots of calls_sent_to */
+    _LSMetricsDestination calls_sent_to[LS_METRICS_CALLS_SENT_SLOTS];
+} _LSMetrics;
+
+_LSMetrics* _LSMetricsNew(void);
+void _LSMetricsFree(_LSMetrics *metrics);
+
+void _LSMetricsHistogramAdd(_LSMetricsHistogram *hist, const struct timespec *elapsed);
+jvalue_ref _LSMetricsHistogramToJson(const _LSMetricsHistogram *hist);
+
+void _LSMetricsMethodCalled(LSHandle *sh, _LSMethodMetrics *method,
+                            const struct timespec *handler_time);
+void _LSMetricsCallSent(LSHandle *sh, const char *service, const char *category);
+void _LSMetricsReplyReceived(LSHandle *sh, const struct timespec *latency);
+
+bool _LSMetricsGetJson(LSHandle *sh, jvalue_ref *ret_obj, LSError *lserror);
+
+bool _LSPrivateGetMetrics(LSHandle* sh, LSMessage *message, void *ctx);
+
+/* @} END OF LunaServiceInternals */
+
+#endif // _METRICS_H_
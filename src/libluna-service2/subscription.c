@@ -32,11 +32,6 @@
  * @{
  */
 
-/**
-* @brief Internal representation of a subscription list.
-*/
-typedef GPtrArray _SubList;
-
 /**
 * @brief Internal representation of a subscriber cancel notification callback list.
 */
@@ -44,18 +39,44 @@ typedef GPtrArray _CancelNotifyCallbackList;
 
 /**
 * @brief One subscription.
+*
+* Subscribers get compact integer ids, reused after they are gone, that
+* index the catalog's subscriber table. The serial tells a subscriber from
+* an earlier one with the same id.
 */
 typedef struct _Subscription
 {
     LSMessage       *message;
-    GPtrArray       *keys;
+    char            *token;         //< unique token, key of the token map
+    GHashTable      *keys;          //< set of _SubKey subscribed to
 
-    LSMessageToken   serverStatusWatch;
+    unsigned int     id;
+    unsigned int     serial;
+
+    void            *peerWatch;     //< cookie of LSRegisterPeerDown()
 
     int              ref;
 
 } _Subscription;
 
+/**
+* @brief Interned subscription key with its subscribers.
+*/
+typedef struct _SubKey
+{
+    char            *name;
+    GHashTable      *subscribers;   //< set of subscriber ids
+} _SubKey;
+
+/**
+* @brief Reference to a subscriber, which may be gone by the time it's used.
+*/
+typedef struct _SubscriberRef
+{
+    unsigned int     id;
+    unsigned int     serial;
+} _SubscriberRef;
+
 /**
 * @brief Internal struct that contains all the subscriptions.
 */
@@ -69,8 +90,12 @@ struct _Catalog {
     // each token is ':sender.connection.serial'
 
     GHashTable *token_map;           //< map of token -> _Subscription
-    GHashTable *subscription_lists;  //< map from key ->
-                                     //   list of tokens (_SubList)
+    GPtrArray  *subscribers;         //< subscriber id -> _Subscription
+    GArray     *free_ids;            //< ids of the subscribers gone
+    unsigned int serial;             //< serial of the last subscriber
+    GHashTable *keys;                //< map from key -> _SubKey
+    GHashTable *latest_only_keys;    //< set of keys whose updates
+                                     //   supersede the previous ones
 
     LSFilterFunc cancel_function;
     void*        cancel_function_ctx;
@@ -92,14 +117,14 @@ typedef struct _SubscriberCancelNotification
 */
 struct LSSubscriptionIter {
 
-    _SubList *tokens;          //< copy of the subscription list
+    GArray   *subscribers;     //< copy of the subscription list (_SubscriberRef)
     _Catalog *catalog;
 
     GSList   *seen_messages;   //< ref-counted references to messages iterated
     int index;
 };
 
-static bool _subscriber_down(LSHandle *sh, LSMessage *message, void *ctx);
+static bool _subscriber_down(LSHandle *sh, const char *uniqueName, void *ctx);
 static void _SubscriptionRelease(_Catalog *catalog, _Subscription *subs);
 
 static void
@@ -114,16 +139,6 @@ _CatalogUnlock(_Catalog *catalog)
     pthread_mutex_unlock(&catalog->lock);
 }
 
-static void
-_SubscriptionRemove(_Catalog *catalog, _Subscription *subs, const char *token)
-{
-    _CatalogLock(catalog);
-    g_hash_table_remove(catalog->token_map, token);
-    _CatalogUnlock(catalog);
-
-    _SubscriptionRelease(catalog, subs);
-}
-
 static void
 _SubscriptionFree(_Catalog *catalog, _Subscription *subs)
 {
@@ -133,16 +148,15 @@ _SubscriptionFree(_Catalog *catalog, _Subscription *subs)
 
         if (subs->keys)
         {
-            g_ptr_array_foreach(subs->keys, (GFunc)g_free, NULL);
-            g_ptr_array_free(subs->keys, TRUE);
+            g_hash_table_destroy(subs->keys);
         }
 
-        if (subs->serverStatusWatch)
+        if (subs->peerWatch)
         {
             bool retVal;
             LSError lserror;
             LSErrorInit(&lserror);
-            retVal = LSCallCancel(catalog->sh, subs->serverStatusWatch,
+            retVal = LSCancelPeerDown(catalog->sh, subs->peerWatch,
                         &lserror);
             if (!retVal)
             {
@@ -151,6 +165,8 @@ _SubscriptionFree(_Catalog *catalog, _Subscription *subs)
             }
         }
 
+        g_free(subs->token);
+
 #ifdef MEMCHECK
         memset(subs, 0xFF, sizeof(_Subscription));
 #endif
@@ -195,11 +211,12 @@ _SubscriptionRelease(_Catalog *catalog, _Subscription *subs)
 * @brief Create a new subscription.
 *
 * @param  message
+* @param  token
 *
 * @retval
 */
 static _Subscription *
-_SubscriptionNew(LSHandle *sh, LSMessage *message)
+_SubscriptionNew(LSHandle *sh, LSMessage *message, const char *token)
 {
     _Subscription *subs;
     bool retVal;
@@ -207,23 +224,21 @@ _SubscriptionNew(LSHandle *sh, LSMessage *message)
     subs = g_new0(_Subscription,1);
 
     subs->ref = 1;
-    subs->keys = g_ptr_array_new();
+    subs->token = g_strdup(token);
+    subs->keys = g_hash_table_new(g_direct_hash, g_direct_equal);
 
     LSMessageRef(message);
     subs->message = message;
 
-    char *payload = g_strdup_printf("{\"serviceName\":\"%s\"}",
-            LSMessageGetSender(message));
-
     LSError lserror;
     LSErrorInit(&lserror);
 
-    LSMessageToken token = LSMessageGetToken(message);
+    LSMessageToken msg_token = LSMessageGetToken(message);
 
-    retVal = LSCall(sh, "palm://com.palm.bus/signal/registerServerStatus",
-           payload, _subscriber_down, (void*)token,
-           &subs->serverStatusWatch, &lserror);
-    g_free(payload);
+    /* all the subscriptions of a client share its watch */
+    retVal = LSRegisterPeerDown(sh, LSMessageGetSender(message),
+           _subscriber_down, (void*)msg_token,
+           &subs->peerWatch, &lserror);
 
     if (!retVal)
     {
@@ -240,138 +255,120 @@ error:
 }
 
 /**
-* @brief Create new subscription List
+* @brief Create a new interned key.
+*
+* @param  name
 *
 * @retval
 */
-static _SubList *
-_SubListNew()
+static _SubKey *
+_SubKeyNew(const char *name)
 {
-    return g_ptr_array_new();
+    _SubKey *sub_key = g_new0(_SubKey, 1);
+    sub_key->name = g_strdup(name);
+    sub_key->subscribers = g_hash_table_new(g_direct_hash, g_direct_equal);
+    return sub_key;
 }
 
 static void
-_SubListFree(_SubList *tokens)
+_SubKeyFree(_SubKey *sub_key)
 {
-    if (!tokens) return;
+    if (!sub_key) return;
 
-    g_ptr_array_foreach(tokens, (GFunc)g_free, NULL);
-    g_ptr_array_free(tokens, TRUE);
-}
-
-static int
-_SubListLen(_SubList *tokens)
-{
-    if (!tokens) return 0;
-    return tokens->len;
+    g_hash_table_destroy(sub_key->subscribers);
+    g_free(sub_key->name);
+    g_free(sub_key);
 }
 
 /**
-* @brief Add _SubList.
+* @brief Give the subscription an id and a slot in the subscriber table.
 *
-* @param  tokens
-* @param  data
+* @param  catalog
+* @param  subs
 */
 static void
-_SubListAdd(_SubList *tokens, char *data)
+_CatalogAssignId_unlocked(_Catalog *catalog, _Subscription *subs)
 {
-    if (tokens && data)
-        g_ptr_array_add(tokens, data);
-}
-
-static _SubList*
-_SubListDup(_SubList *src)
-{
-    _SubList *dst = NULL;
-
-    if (src)
+    if (catalog->free_ids->len)
     {
-        dst = _SubListNew();
-
-        int i;
-        for (i = 0; i < src->len; i++)
-        {
-            char *tok = g_ptr_array_index(src, i);
-            g_ptr_array_add(dst, g_strdup(tok));
-        }
+        subs->id = g_array_index(catalog->free_ids, unsigned int, catalog->free_ids->len - 1);
+        g_array_set_size(catalog->free_ids, catalog->free_ids->len - 1);
+        g_ptr_array_index(catalog->subscribers, subs->id) = subs;
+    }
+    else
+    {
+        subs->id = catalog->subscribers->len;
+        g_ptr_array_add(catalog->subscribers, subs);
     }
 
-    return dst;
+    subs->serial = ++catalog->serial;
+}
+
+static _Subscription *
+_CatalogGetSubscriber_unlocked(_Catalog *catalog, unsigned int id)
+{
+    if (id >= catalog->subscribers->len) return NULL;
+    return g_ptr_array_index(catalog->subscribers, id);
 }
 
 /**
-* @brief Remove from _SubList.  This is more expensive.
+* @brief Snapshot the subscribers of the key.
+*
+* @param  catalog
+* @param  sub_key
 *
-* @param  tokens
-* @param  data
+* @retval  array of _SubscriberRef
 */
-static void
-_SubListRemove(_SubList *tokens, const char *data)
+static GArray *
+_CatalogGetSubscriberRefs_unlocked(_Catalog *catalog, _SubKey *sub_key)
 {
-    if (!tokens) return;
+    unsigned int count = sub_key ? g_hash_table_size(sub_key->subscribers) : 0;
+    GArray *refs = g_array_sized_new(FALSE, FALSE, sizeof(_SubscriberRef), count);
 
-    int i;
-    for (i = 0; i < tokens->len; i++)
-    {
-        char *tok = g_ptr_array_index(tokens, i);
-        if (strcmp(tok, data) == 0)
-        {
-            g_ptr_array_remove_index(tokens, i);
-            g_free(tok);
-            break;
-        }
-    }
-}
+    if (!count) return refs;
 
-static bool
-g_char_ptr_array_contains(GPtrArray *array, const char *data)
-{
-    if (!array) return false;
-
-    int i;
-    for (i = 0; i < array->len; i++)
+    GHashTableIter iter;
+    gpointer id;
+    g_hash_table_iter_init(&iter, sub_key->subscribers);
+    while (g_hash_table_iter_next(&iter, &id, NULL))
     {
-        char *tok = g_ptr_array_index(array, i);
-        if (strcmp(tok, data) == 0)
-        {
-            return true;
-        }
+        _Subscription *subs = _CatalogGetSubscriber_unlocked(catalog, GPOINTER_TO_UINT(id));
+        LS_ASSERT(subs != NULL);
+
+        _SubscriberRef ref = { subs->id, subs->serial };
+        g_array_append_val(refs, ref);
     }
-    return false;
+
+    return refs;
 }
 
-static bool
-_SubListContains(_SubList *tokens, const char *data)
+/**
+* @brief Look up the subscriber referred to, unless it's gone.
+*
+* @param  catalog
+* @param  ref
+*
+* @retval  acquired subscription or NULL
+*/
+static _Subscription *
+_CatalogAcquireSubscriber(_Catalog *catalog, const _SubscriberRef *ref)
 {
-    if (!tokens) return false;
+    _CatalogLock(catalog);
 
-    int i;
-    for (i = 0; i < tokens->len; i++)
+    _Subscription *subs = _CatalogGetSubscriber_unlocked(catalog, ref->id);
+    if (subs && subs->serial == ref->serial)
     {
-        char *tok = g_ptr_array_index(tokens, i);
-        if (strcmp(tok, data) == 0)
-        {
-            return true;
-        }
+        LS_ASSERT(g_atomic_int_get(&subs->ref) > 0);
+        g_atomic_int_inc(&subs->ref);
     }
-    return false;
-}
-
-const char *
-_SubListGet(_SubList *tokens, int i)
-{
-    if (i < 0 || i >= tokens->len)
+    else
     {
-        LOG_LS_ERROR(MSGID_LS_SUBSCRIPTION_ERR, 0,
-                     "%s: attempting to get out of range subscription %d\n"
-                     "It is possible you forgot to follow the pattern: "
-                     " LSSubscriptionHasNext() + LSSubscriptionNext()",
-                     __FUNCTION__, i);
-        return NULL;
+        subs = NULL;
     }
 
-    LS_ASSERT(i >= 0 && i < tokens->len);
-    return g_ptr_array_index(tokens, i);
+    _CatalogUnlock(catalog);
+
+    return subs;
 }
 
 /**
@@ -427,11 +424,17 @@ _CatalogNew(LSHandle *sh)
         goto error;
     }
 
-    catalog->token_map = g_hash_table_new_full(
-            g_str_hash, g_str_equal, g_free, NULL);
+    /* keys are owned by the subscriptions */
+    catalog->token_map = g_hash_table_new(g_str_hash, g_str_equal);
 
-    catalog->subscription_lists = g_hash_table_new_full(
-            g_str_hash, g_str_equal, g_free, (GDestroyNotify)_SubListFree);
+    catalog->subscribers = g_ptr_array_new();
+    catalog->free_ids = g_array_new(FALSE, FALSE, sizeof(unsigned int));
+
+    catalog->keys = g_hash_table_new_full(
+            g_str_hash, g_str_equal, NULL, (GDestroyNotify)_SubKeyFree);
+
+    catalog->latest_only_keys = g_hash_table_new_full(
+            g_str_hash, g_str_equal, g_free, NULL);
 
     catalog->sh = sh;
 
@@ -455,14 +458,26 @@ _CatalogFree(_Catalog *catalog)
 {
     if (catalog)
     {
+        if (catalog->keys)
+        {
+            g_hash_table_destroy(catalog->keys);
+        }
         if (catalog->token_map)
         {
             g_hash_table_foreach_remove(catalog->token_map, _TokenMapFree, catalog);
             g_hash_table_destroy(catalog->token_map);
         }
-        if (catalog->subscription_lists)
+        if (catalog->subscribers)
+        {
+            g_ptr_array_free(catalog->subscribers, TRUE);
+        }
+        if (catalog->free_ids)
         {
-            g_hash_table_destroy(catalog->subscription_lists);
+            g_array_free(catalog->free_ids, TRUE);
+        }
+        if (catalog->latest_only_keys)
+        {
+            g_hash_table_destroy(catalog->latest_only_keys);
         }
         if (catalog->cancel_notify_list)
         {
@@ -491,22 +506,14 @@ _CatalogAdd(_Catalog *catalog, const char *key,
 
     _CatalogLock(catalog);
 
-    _SubList *list =
-        g_hash_table_lookup(catalog->subscription_lists, key);
-    if (!list)
-    {
-        list = _SubListNew();
-        g_hash_table_replace(catalog->subscription_lists,
-                             g_strdup(key), list);
-    }
-
     _Subscription *subs = g_hash_table_lookup(catalog->token_map, token);
     if (!subs)
     {
-        subs = _SubscriptionNew(catalog->sh, message);
+        subs = _SubscriptionNew(catalog->sh, message, token);
         if (subs)
         {
-            g_hash_table_replace(catalog->token_map, g_strdup(token), subs);
+            _CatalogAssignId_unlocked(catalog, subs);
+            g_hash_table_insert(catalog->token_map, subs->token, subs);
         }
         else
         {
@@ -515,15 +522,15 @@ _CatalogAdd(_Catalog *catalog, const char *key,
     }
     LS_ASSERT(subs->message == message);
 
-    if (!_SubListContains(list, token))
+    _SubKey *sub_key = g_hash_table_lookup(catalog->keys, key);
+    if (!sub_key)
     {
-        _SubListAdd(list, g_strdup(token));
+        sub_key = _SubKeyNew(key);
+        g_hash_table_insert(catalog->keys, sub_key->name, sub_key);
     }
 
-    if (!g_char_ptr_array_contains(subs->keys, key))
-    {
-        g_ptr_array_add(subs->keys, g_strdup(key));
-    }
+    g_hash_table_add(sub_key->subscribers, GUINT_TO_POINTER(subs->id));
+    g_hash_table_add(subs->keys, sub_key);
 
     retVal = true;
 
@@ -532,13 +539,20 @@ cleanup:
     return retVal;
 }
 
+/**
+* @brief Take the subscription out of the catalog and release the
+*        catalog's reference to it.
+*
+* @param  catalog
+* @param  subs      acquired subscription
+* @param  notify    call the cancel function
+*
+* @retval  false if the subscription was out already
+*/
 static bool
-_CatalogRemoveToken(_Catalog *catalog, const char *token,
-                             bool notify)
+_CatalogRemoveSubscription(_Catalog *catalog, _Subscription *subs,
+                           bool notify)
 {
-    _Subscription *subs = _SubscriptionAcquire(catalog, token);
-    if (!subs) return false;
-
     if (notify && catalog->cancel_function)
     {
         catalog->cancel_function(catalog->sh,
@@ -546,24 +560,48 @@ _CatalogRemoveToken(_Catalog *catalog, const char *token,
     }
 
     _CatalogLock(catalog);
-    int i;
-    for (i = 0; i < subs->keys->len; i++)
+
+    bool removed = _CatalogGetSubscriber_unlocked(catalog, subs->id) == subs;
+    if (removed)
     {
-        const char *key = g_ptr_array_index(subs->keys, i);
+        GHashTableIter iter;
+        _SubKey *sub_key;
+        g_hash_table_iter_init(&iter, subs->keys);
+        while (g_hash_table_iter_next(&iter, (gpointer *) &sub_key, NULL))
+        {
+            g_hash_table_remove(sub_key->subscribers, GUINT_TO_POINTER(subs->id));
 
-        _SubList *sub_list =
-            g_hash_table_lookup(catalog->subscription_lists, key);
+            if (g_hash_table_size(sub_key->subscribers) == 0)
+            {
+                g_hash_table_remove(catalog->keys, sub_key->name);
+            }
+        }
+        g_hash_table_remove_all(subs->keys);
 
-        _SubListRemove(sub_list, token);
+        g_hash_table_remove(catalog->token_map, subs->token);
 
-        if (_SubListLen(sub_list) == 0)
-        {
-            g_hash_table_remove(catalog->subscription_lists, key);
-        }
+        g_ptr_array_index(catalog->subscribers, subs->id) = NULL;
+        g_array_append_val(catalog->free_ids, subs->id);
     }
+
     _CatalogUnlock(catalog);
 
-    _SubscriptionRemove(catalog, subs, token);
+    if (removed)
+    {
+        _SubscriptionRelease(catalog, subs);
+    }
+
+    return removed;
+}
+
+static bool
+_CatalogRemoveToken(_Catalog *catalog, const char *token,
+                             bool notify)
+{
+    _Subscription *subs = _SubscriptionAcquire(catalog, token);
+    if (!subs) return false;
+
+    _CatalogRemoveSubscription(catalog, subs, notify);
 
     _SubscriptionRelease(catalog, subs);
 
@@ -636,15 +674,6 @@ error:
     return false;
 }
 
-static _SubList*
-_CatalogGetSubList_unlocked(_Catalog *catalog, const char *key)
-{
-    _SubList *tokens =
-        g_hash_table_lookup(catalog->subscription_lists, key);
-
-    return tokens;
-}
-
 static bool
 _CatalogAddCancelNotification(_Catalog *catalog,
               LSCancelNotificationFunc function, void *context, LSError *lserror)
@@ -691,54 +720,39 @@ cleanup:
     return retVal;
 }
 
-static bool
-_subscriber_down(LSHandle *sh, LSMessage *message, void *ctx)
+/**
+* @brief Look up the subscriber the iterator is at, unless it's gone.
+*
+* @param  iter
+*
+* @retval  acquired subscription or NULL
+*/
+static _Subscription *
+_SubscriptionIterAcquire(LSSubscriptionIter *iter)
 {
-    JSchemaInfo schemaInfo;
-    jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
-
-    bool connected;
-    raw_buffer serviceName;
-
-    jvalue_ref connectedObj = NULL;
-    jvalue_ref serviceNameObj = NULL;
-
-    LSMessageToken token = (LSMessageToken)ctx;
-
-    const char *payload = LSMessageGetPayload(message);
-    jvalue_ref object = jdom_parse(j_cstr_to_buffer(payload), DOMOPT_NOOPT,
-                                   &schemaInfo);
-
-    if (jis_null(object))
+    if (iter->index < 0 || iter->index >= (int) iter->subscribers->len)
     {
-        LOG_LS_ERROR(MSGID_LS_INVALID_JSON, 0, "%s: Invalid JSON: %s", __func__, payload);
-        goto error;
+        LOG_LS_ERROR(MSGID_LS_SUBSCRIPTION_ERR, 0,
+                     "%s: attempting to get out of range subscription %d\n"
+                     "It is possible you forgot to follow the pattern: "
+                     " LSSubscriptionHasNext() + LSSubscriptionNext()",
+                     __FUNCTION__, iter->index);
+        return NULL;
     }
 
-    if (!jobject_get_exists(object, J_CSTR_TO_BUF("connected"),
-                            &connectedObj)) goto error;
-    if (!jobject_get_exists(object, J_CSTR_TO_BUF("serviceName"),
-                            &serviceNameObj)) goto error;
-
-    (void)jboolean_get(connectedObj, &connected);/* TODO: handle appropriately */
-    serviceName = jstring_get_fast(serviceNameObj);
-
-    if (!connected)
-    {
-        char *uniqueToken = g_strdup_printf("%.*s.%ld", (int)serviceName.m_len, serviceName.m_str, token);
+    return _CatalogAcquireSubscriber(iter->catalog,
+                                     &g_array_index(iter->subscribers, _SubscriberRef, iter->index));
+}
 
-        _Subscription *subs = _SubscriptionAcquire(sh->catalog, uniqueToken);
-        if (subs)
-        {
-            _CatalogRemoveToken(sh->catalog, uniqueToken, true);
-            _SubscriptionRelease(sh->catalog, subs);
-        }
+static bool
+_subscriber_down(LSHandle *sh, const char *uniqueName, void *ctx)
+{
+    LSMessageToken token = (LSMessageToken)ctx;
 
-        g_free(uniqueToken);
-    }
+    char *uniqueToken = g_strdup_printf("%s.%ld", uniqueName, token);
+    _CatalogRemoveToken(sh->catalog, uniqueToken, true);
+    g_free(uniqueToken);
 
-error:
-    j_release(&object);
     return true;
 }
 
@@ -746,8 +760,7 @@ bool
 _LSSubscriptionGetJson(LSHandle *sh, jvalue_ref *ret_obj, LSError *lserror)
 {
     _Catalog *catalog = sh->catalog;
-    const char *key = NULL;
-    _SubList *sub_list = NULL;
+    _SubKey *sub_key = NULL;
     GHashTableIter iter;
 
     jvalue_ref true_obj = NULL;
@@ -777,9 +790,9 @@ _LSSubscriptionGetJson(LSHandle *sh, jvalue_ref *ret_obj, LSError *lserror)
      */
     _CatalogLock(catalog);
 
-    g_hash_table_iter_init(&iter, catalog->subscription_lists);
+    g_hash_table_iter_init(&iter, catalog->keys);
 
-    while (g_hash_table_iter_next(&iter, (gpointer)&key, (gpointer)&sub_list))
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer)&sub_key))
     {
         cur_obj = jobject_create();
         if (cur_obj == NULL) goto error;
@@ -787,60 +800,55 @@ _LSSubscriptionGetJson(LSHandle *sh, jvalue_ref *ret_obj, LSError *lserror)
         sub_array = jarray_create(NULL);
         if (sub_array == NULL) goto error;
 
-        key_name = jstring_create_copy(j_cstr_to_buffer(key));
+        key_name = jstring_create_copy(j_cstr_to_buffer(sub_key->name));
         if (key_name == NULL) goto error;
 
-        /* iterate over SubList */
-        int i = 0;
-        const char *token = NULL;
-        const int len = _SubListLen(sub_list);
-        for (i = 0; i < len; i++)
+        /* iterate over the subscribers */
+        GHashTableIter sub_iter;
+        gpointer id;
+        g_hash_table_iter_init(&sub_iter, sub_key->subscribers);
+        while (g_hash_table_iter_next(&sub_iter, &id, NULL))
         {
-            token = _SubListGet(sub_list, i);
-
-            if (token)
-            {
-                _Subscription *sub = g_hash_table_lookup(catalog->token_map, token);
-
-                if (!sub) continue;
-
-                LSMessage *msg = sub->message;
-                const char *unique_name = LSMessageGetSender(msg);
-                const char *service_name = LSMessageGetSenderServiceName(msg);
-                const char *message_body = LSMessageGetPayload(msg);
-
-                /* create subscribers item and add to sub_array */
-                sub_array_item = jobject_create();
-                if (sub_array_item == NULL) goto error;
-
-                unique_name_obj = unique_name ? jstring_create_copy(j_cstr_to_buffer(unique_name))
-                                              : jstring_empty();
-                if (unique_name_obj == NULL) goto error;
-
-                service_name_obj = service_name ? jstring_create_copy(j_cstr_to_buffer(service_name))
-                                                : jstring_empty();
-                if (service_name_obj == NULL) goto error;
-
-                message_obj = message_body ? jstring_create_copy(j_cstr_to_buffer(message_body))
-                                                : jstring_empty();
-                if (message_obj == NULL) goto error;
-
-                jobject_put(sub_array_item,
-                            J_CSTR_TO_JVAL("unique_name"),
-                            unique_name_obj);
-                jobject_put(sub_array_item,
-                            J_CSTR_TO_JVAL("service_name"),
-                            service_name_obj);
-                jobject_put(sub_array_item,
-                            J_CSTR_TO_JVAL("subscription_message"),
-                            message_obj);
-                jarray_append(sub_array, sub_array_item);
-
-                sub_array_item = NULL;
-                unique_name_obj = NULL;
-                service_name_obj = NULL;
-                message_obj = NULL;
-            }
+            _Subscription *sub = _CatalogGetSubscriber_unlocked(catalog, GPOINTER_TO_UINT(id));
+
+            if (!sub) continue;
+
+            LSMessage *msg = sub->message;
+            const char *unique_name = LSMessageGetSender(msg);
+            const char *service_name = LSMessageGetSenderServiceName(msg);
+            const char *message_body = LSMessageGetPayload(msg);
+
+            /* create subscribers item and add to sub_array */
+            sub_array_item = jobject_create();
+            if (sub_array_item == NULL) goto error;
+
+            unique_name_obj = unique_name ? jstring_create_copy(j_cstr_to_buffer(unique_name))
+                                          : jstring_empty();
+            if (unique_name_obj == NULL) goto error;
+
+            service_name_obj = service_name ? jstring_create_copy(j_cstr_to_buffer(service_name))
+                                            : jstring_empty();
+            if (service_name_obj == NULL) goto error;
+
+            message_obj = message_body ? jstring_create_copy(j_cstr_to_buffer(message_body))
+                                            : jstring_empty();
+            if (message_obj == NULL) goto error;
+
+            jobject_put(sub_array_item,
+                        J_CSTR_TO_JVAL("unique_name"),
+                        unique_name_obj);
+            jobject_put(sub_array_item,
+                        J_CSTR_TO_JVAL("service_name"),
+                        service_name_obj);
+            jobject_put(sub_array_item,
+                        J_CSTR_TO_JVAL("subscription_message"),
+                        message_obj);
+            jarray_append(sub_array, sub_array_item);
+
+            sub_array_item = NULL;
+            unique_name_obj = NULL;
+            service_name_obj = NULL;
+            message_obj = NULL;
         }
         jobject_put(cur_obj, J_CSTR_TO_JVAL("key"),
                     key_name);
@@ -1000,8 +1008,8 @@ LSSubscriptionAcquire(LSHandle *sh, const char *key,
     LSSubscriptionIter *iter = g_new0(LSSubscriptionIter, 1);
 
     _CatalogLock(catalog);
-    _SubList *tokens = _CatalogGetSubList_unlocked(catalog, key);
-    iter->tokens = _SubListDup(tokens);
+    _SubKey *sub_key = g_hash_table_lookup(catalog->keys, key);
+    iter->subscribers = _CatalogGetSubscriberRefs_unlocked(catalog, sub_key);
     _CatalogUnlock(catalog);
 
     iter->catalog = catalog;
@@ -1033,7 +1041,7 @@ LSSubscriptionRelease(LSSubscriptionIter *iter)
         seen_iter = seen_iter->next;
     }
 
-    _SubListFree(iter->tokens);
+    g_array_free(iter->subscribers, TRUE);
     g_slist_free(iter->seen_messages);
     g_free(iter);
 }
@@ -1048,12 +1056,7 @@ LSSubscriptionRelease(LSSubscriptionIter *iter)
 bool
 LSSubscriptionHasNext(LSSubscriptionIter *iter)
 {
-    if (!iter->tokens)
-    {
-        return false;
-    }
-
-    return iter->index+1 < _SubListLen(iter->tokens);
+    return iter->index+1 < (int) iter->subscribers->len;
 }
 
 /**
@@ -1070,20 +1073,16 @@ LSSubscriptionNext(LSSubscriptionIter *iter)
     LSMessage *message = NULL;
 
     iter->index++;
-    const char *tok = _SubListGet(iter->tokens, iter->index);
-    if (tok)
+    subs = _SubscriptionIterAcquire(iter);
+    if (subs)
     {
-        subs = _SubscriptionAcquire(iter->catalog, tok);
-        if (subs)
-        {
-            message = subs->message;
-            LSMessageRef(message);
+        message = subs->message;
+        LSMessageRef(message);
 
-            iter->seen_messages =
-                g_slist_prepend(iter->seen_messages, message);
+        iter->seen_messages =
+            g_slist_prepend(iter->seen_messages, message);
 
-            _SubscriptionRelease(iter->catalog, subs);
-        }
+        _SubscriptionRelease(iter->catalog, subs);
     }
 
     return message;
@@ -1097,10 +1096,11 @@ LSSubscriptionNext(LSSubscriptionIter *iter)
 void
 LSSubscriptionRemove(LSSubscriptionIter *iter)
 {
-    const char *tok = _SubListGet(iter->tokens, iter->index);
-    if (tok)
+    _Subscription *subs = _SubscriptionIterAcquire(iter);
+    if (subs)
     {
-        _CatalogRemoveToken(iter->catalog, tok, false);
+        _CatalogRemoveSubscription(iter->catalog, subs, false);
+        _SubscriptionRelease(iter->catalog, subs);
     }
 }
 
@@ -1123,31 +1123,54 @@ LSSubscriptionReply(LSHandle *sh, const char *key,
     bool retVal = true;
     _Catalog *catalog = sh->catalog;
 
+    /* validated and measured once, then shared by all the replies */
+    unsigned long payload_size = 0;
+    GBytes *shared_payload = NULL;
+
     _CatalogLock(catalog);
 
-    _SubList *tokens = _CatalogGetSubList_unlocked(catalog, key);
-    if (!tokens)
+    _SubKey *sub_key = g_hash_table_lookup(catalog->keys, key);
+    if (!sub_key)
     {
         retVal = true;
         goto cleanup;
     }
 
-    int i;
-    for (i = 0; i < tokens->len; i++)
-    {
-        char *tok = g_ptr_array_index(tokens, i);
+    bool latest_only = g_hash_table_contains(catalog->latest_only_keys, key);
 
+    GHashTableIter iter;
+    gpointer id;
+    g_hash_table_iter_init(&iter, sub_key->subscribers);
+    while (g_hash_table_iter_next(&iter, &id, NULL))
+    {
         _Subscription *subs =
-            g_hash_table_lookup(catalog->token_map, tok);
+            _CatalogGetSubscriber_unlocked(catalog, GPOINTER_TO_UINT(id));
         if (!subs) continue;
 
         LSMessage *message = subs->message;
 
-        retVal = LSMessageReply(sh, message, payload, lserror);
+        if (!payload_size)
+        {
+            if (!payload)
+            {
+                _LSErrorSet(lserror, MSGID_LS_PARAMETER_IS_NULL, -EINVAL, "%s: NULL payload", __FUNCTION__);
+                retVal = false;
+                goto cleanup;
+            }
+
+            retVal = _LSMessageReplyPayloadValidate(payload, lserror);
+            if (!retVal) goto cleanup;
+
+            payload_size = strlen(payload) + 1;
+        }
+
+        retVal = _LSMessageReplyShared(sh, message, payload, payload_size, &shared_payload,
+                                       key, latest_only, lserror);
         if (!retVal) goto cleanup;
     }
 cleanup:
     _CatalogUnlock(catalog);
+    if (shared_payload) g_bytes_unref(shared_payload);
     return retVal;
 }
 
@@ -1284,4 +1307,48 @@ LSSubscriptionPost(LSHandle *sh, const char *category,
     return retVal;
 }
 
+/**
+* @brief Make only the latest update of subscription 'key' matter.
+*
+*        Meant for status-style subscriptions (battery level, network state)
+*        where intermediate values are of no use. An update sent with
+*        LSSubscriptionReply() or LSSubscriptionPost() while the previous
+*        one is still queued for a subscriber, because it doesn't read fast
+*        enough, replaces that one in place instead of being queued after
+*        it. Updates that have started going out on the wire are never
+*        replaced.
+*
+* @param  sh
+* @param  key
+* @param  latest_only    true for latest value wins, false to deliver every
+*                        update (default)
+* @param  lserror
+*
+* @retval
+*/
+bool
+LSSubscriptionSetLatestOnly(LSHandle *sh, const char *key,
+                            bool latest_only, LSError *lserror)
+{
+    _LSErrorIfFail(sh != NULL, lserror, MSGID_LS_INVALID_HANDLE);
+    _LSErrorIfFail(key != NULL, lserror, MSGID_LS_PARAMETER_IS_NULL);
+
+    LSHANDLE_VALIDATE(sh);
+
+    _Catalog *catalog = sh->catalog;
+
+    _CatalogLock(catalog);
+    if (latest_only)
+    {
+        g_hash_table_add(catalog->latest_only_keys, g_strdup(key));
+    }
+    else
+    {
+        g_hash_table_remove(catalog->latest_only_keys, key);
+    }
+    _CatalogUnlock(catalog);
+
+    return true;
+}
+
 /* @} END OF LunaServiceSubscription */
@@ -67,6 +67,9 @@ typedef struct TestData
     char *registerserverstatus_service_name;
     // service connected flag of test_registerserverstatus_callback
     bool registerserverstatus_connected;
+
+    // call count of test_peerdown_callback
+    int peer_down_callback_called;
 } TestData;
 
 static TestData *test_data = NULL;
@@ -126,6 +129,23 @@ test_registerserverstatus_callback(LSHandle *sh, const char *serviceName, bool c
     return true;
 }
 
+static bool
+test_peerdown_callback(LSHandle *sh, const char *uniqueName, void *ctx)
+{
+    g_assert_cmpstr(uniqueName, ==, "com.name.service");
+    ++test_data->peer_down_callback_called;
+
+    // watchers may cancel themselves
+    void **cookie = ctx;
+    if (cookie)
+    {
+        g_assert(LSCancelPeerDown(sh, *cookie, NULL));
+        *cookie = NULL;
+    }
+
+    return true;
+}
+
 /* Test cases *****************************************************************/
 
 static void
@@ -477,6 +497,51 @@ test_LSRegisterServerStatusAndCancel(TestData *fixture, gconstpointer user_data)
     LSErrorFree(&error);
 }
 
+static void
+test_LSRegisterPeerDownAndCancel(TestData *fixture, gconstpointer user_data)
+{
+    LSError error;
+    LSErrorInit(&error);
+
+    const char *unique_name = "com.name.service";
+
+    // registrations for the same peer share one hub watch
+    void *cookies[3] = { NULL };
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(cookies); i++)
+    {
+        g_assert(LSRegisterPeerDown(&fixture->sh, unique_name, test_peerdown_callback,
+                                    &cookies[i], &cookies[i], &error));
+        g_assert(cookies[i] != NULL);
+    }
+    g_assert_cmpint(fixture->transport_send_query_service_status_called, ==, 1);
+
+    // peer down signal is fanned out to all of them
+    fixture->transport_message_type = _LSTransportMessageTypeServiceDownSignal;
+    fixture->transport_message_category = "/";
+    fixture->transport_message_method = "test";
+    _LSTransportMessage *msg = GINT_TO_POINTER(2);
+
+    g_assert(_LSHandleReply(&fixture->sh, msg));
+    g_assert_cmpint(fixture->peer_down_callback_called, ==, 3);
+    for (i = 0; i < G_N_ELEMENTS(cookies); i++)
+    {
+        g_assert(cookies[i] == NULL);
+    }
+
+    // the watch went with the last registration
+    g_assert(_LSHandleReply(&fixture->sh, msg));
+    g_assert_cmpint(fixture->peer_down_callback_called, ==, 3);
+
+    void *cookie = NULL;
+    g_assert(LSRegisterPeerDown(&fixture->sh, unique_name, test_peerdown_callback,
+                                NULL, &cookie, &error));
+    g_assert_cmpint(fixture->transport_send_query_service_status_called, ==, 2);
+    g_assert(LSCancelPeerDown(&fixture->sh, cookie, &error));
+
+    LSErrorFree(&error);
+}
+
 static void
 test_LSSignalCallAndCancel(TestData *fixture, gconstpointer user_data)
 {
@@ -588,6 +653,45 @@ test_LSCallSetTimeout(TestData *fixture, gconstpointer user_data)
     LSMessageUnref(fixture->methodcall_reply);
 }
 
+static bool
+test_setcontext_callback(LSHandle *sh, LSMessage *reply, void *ctx)
+{
+    ++*(int *) ctx;
+    return true;
+}
+
+static void
+test_LSCallSetContext(TestData *fixture, gconstpointer user_data)
+{
+    LSError error;
+    LSErrorInit(&error);
+
+    const char *uri = "palm://com.name.service/whatever";
+    const char *payload = "{}";
+    LSMessageToken token = LSMESSAGE_TOKEN_INVALID;
+    _LSTransportMessage *msg = GINT_TO_POINTER(2);
+    int old_ctx = 0;
+    int new_ctx = 0;
+
+    g_assert(LSCall(&fixture->sh, uri, payload, test_setcontext_callback, &old_ctx,
+                    &token, &error));
+    g_assert(LSCallSetContext(&fixture->sh, token, &new_ctx, &error));
+
+    fixture->transport_message_type = _LSTransportMessageTypeReply;
+    fixture->transport_message_reply_token = token;
+    fixture->transport_message_payload = "{\"returnValue\":true}";
+    g_assert(_LSHandleReply(&fixture->sh, msg));
+
+    g_assert_cmpint(old_ctx, ==, 0);
+    g_assert_cmpint(new_ctx, ==, 1);
+
+    g_assert(LSCallCancel(&fixture->sh, token, &error));
+
+    // unknown token
+    g_assert(!LSCallSetContext(&fixture->sh, token, &old_ctx, &error));
+    LSErrorFree(&error);
+}
+
 /* Mocks **********************************************************************/
 
 // base.c
@@ -850,10 +954,12 @@ main(int argc, char *argv[])
     LSTEST_ADD("/luna-service2/LSCallFromApplication", test_LSCallFromApplication);
     LSTEST_ADD("/luna-service2/LSCallFromApplicationOneReply", test_LSCallFromApplicationOneReply);
     LSTEST_ADD("/luna-service2/LSRegisterServerStatusAndCancel", test_LSRegisterServerStatusAndCancel);
+    LSTEST_ADD("/luna-service2/LSRegisterPeerDownAndCancel", test_LSRegisterPeerDownAndCancel);
     LSTEST_ADD("/luna-service2/LSSignalCallAndCancel", test_LSSignalCallAndCancel);
     LSTEST_ADD("/luna-service2/LSSignalSendNoTypecheck", test_LSSignalSendNoTypecheck);
     LSTEST_ADD("/luna-service2/LSSignalSend", test_LSSignalSend);
     LSTEST_ADD("/luna-service2/LSCallSetTimeout", test_LSCallSetTimeout);
+    LSTEST_ADD("/luna-service2/LSCallSetContext", test_LSCallSetContext);
 
     return g_test_run();
 }
@@ -0,0 +1,312 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <base.h>
+#include <category.h>
+#include <message.h>
+#include <transport_message.h>
+
+#define TEST_CATEGORIES     20
+#define TEST_METHODS        10
+#define TEST_LOOKUPS        1000000
+
+/* Test data ******************************************************************/
+
+typedef struct TestData
+{
+    LSHandle sh;
+    LSMethod methods[TEST_CATEGORIES][TEST_METHODS + 1];
+    char *names[TEST_CATEGORIES][TEST_METHODS];
+} TestData;
+
+static bool
+test_method(LSHandle *sh, LSMessage *message, void *ctx)
+{
+    return true;
+}
+
+static void
+test_setup(TestData *fixture, gconstpointer user_data)
+{
+    memset(fixture, 0, sizeof(*fixture));
+    g_mutex_init(&fixture->sh.dispatch_lock);
+    LSHANDLE_SET_VALID(&fixture->sh, NULL);
+
+    int c, m;
+    for (c = 0; c < TEST_CATEGORIES; c++)
+    {
+        for (m = 0; m < TEST_METHODS; m++)
+        {
+            fixture->names[c][m] = g_strdup_printf("method%d", m);
+            fixture->methods[c][m].name = fixture->names[c][m];
+            fixture->methods[c][m].function = test_method;
+        }
+
+        char *category = g_strdup_printf("/category%d", c);
+        LSError error;
+        LSErrorInit(&error);
+        g_assert(LSRegisterCategoryAppend(&fixture->sh, category, fixture->methods[c], NULL, &error));
+        g_free(category);
+    }
+}
+
+static void
+test_teardown(TestData *fixture, gconstpointer user_data)
+{
+    _LSDispatchTableFree(fixture->sh.dispatch);
+    g_hash_table_unref(fixture->sh.tableHandlers);
+    g_mutex_clear(&fixture->sh.dispatch_lock);
+
+    int c, m;
+    for (c = 0; c < TEST_CATEGORIES; c++)
+    {
+        for (m = 0; m < TEST_METHODS; m++)
+        {
+            g_free(fixture->names[c][m]);
+        }
+    }
+}
+
+static LSMessage *
+test_message_new(LSHandle *sh, const char *category, const char *method)
+{
+    size_t category_len = strlen(category) + 1;
+    size_t method_len = strlen(method) + 1;
+    const char payload[] = "{}";
+    size_t body_len = category_len + method_len + sizeof(payload) + 1;
+
+    char *body = g_malloc0(body_len);
+    memcpy(body, category, category_len);
+    memcpy(body + category_len, method, method_len);
+    memcpy(body + category_len + method_len, payload, sizeof(payload));
+
+    _LSTransportMessage *transport_msg = _LSTransportMessageNewRef(body_len);
+    _LSTransportMessageSetType(transport_msg, _LSTransportMessageTypeMethodCall);
+    _LSTransportMessageSetBody(transport_msg, body, body_len);
+    _LSTransportMessageParseBody(transport_msg);
+    g_free(body);
+
+    LSMessage *message = _LSMessageNewRef(transport_msg, sh);
+    _LSTransportMessageUnref(transport_msg);
+    return message;
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_LSCategoryDispatchLookup(TestData *fixture, gconstpointer user_data)
+{
+    LSHandle *sh = &fixture->sh;
+
+    LSMessage *message = test_message_new(sh, "/category7", "method3");
+    g_assert_cmpstr(LSMessageGetPayload(message), ==, "{}");
+
+    LSCategoryTable *category = LSCategoryDispatchLookup(sh, message);
+    g_assert(category == g_hash_table_lookup(sh->tableHandlers, "/category7"));
+    g_assert(message->method_entry == g_hash_table_lookup(category->methods, "method3"));
+    g_assert(message->method_entry->function == test_method);
+    LSMessageUnref(message);
+
+    /* unknown category */
+    message = test_message_new(sh, "/category70", "method3");
+    g_assert(LSCategoryDispatchLookup(sh, message) == NULL);
+    g_assert(message->method_entry == NULL);
+    LSMessageUnref(message);
+
+    /* unknown method of a known category */
+    message = test_message_new(sh, "/category7", "method30");
+    g_assert(LSCategoryDispatchLookup(sh, message) == NULL);
+    LSMessageUnref(message);
+
+    /* every registered method is found */
+    int c, m;
+    for (c = 0; c < TEST_CATEGORIES; c++)
+    {
+        char *category_name = g_strdup_printf("/category%d", c);
+        for (m = 0; m < TEST_METHODS; m++)
+        {
+            message = test_message_new(sh, category_name, fixture->names[c][m]);
+            category = LSCategoryDispatchLookup(sh, message);
+            g_assert(category == g_hash_table_lookup(sh->tableHandlers, category_name));
+            g_assert(message->method_entry == g_hash_table_lookup(category->methods, fixture->names[c][m]));
+            LSMessageUnref(message);
+        }
+        g_free(category_name);
+    }
+}
+
+static void
+test_LSCategoryDispatchLookupAppend(TestData *fixture, gconstpointer user_data)
+{
+    LSHandle *sh = &fixture->sh;
+
+    LSMessage *message = test_message_new(sh, "/category3", "late");
+    g_assert(LSCategoryDispatchLookup(sh, message) == NULL);
+
+    /* methods appended later are indexed as well */
+    LSMethod late[] = { { "late", test_method }, { NULL } };
+    LSError error;
+    LSErrorInit(&error);
+    g_assert(LSRegisterCategoryAppend(sh, "/category3", late, NULL, &error));
+
+    g_assert(LSCategoryDispatchLookup(sh, message) != NULL);
+    g_assert(message->method_entry->function == test_method);
+    LSMessageUnref(message);
+}
+
+static void
+test_LSCategoryDispatchLookupLazy(TestData *fixture, gconstpointer user_data)
+{
+    LSHandle *sh = &fixture->sh;
+
+    /* registering the categories in test_setup() didn't build the index */
+    g_assert(sh->dispatch == NULL);
+    g_assert(sh->dispatch_dirty);
+
+    LSMessage *message = test_message_new(sh, "/category3", "method5");
+    g_assert(LSCategoryDispatchLookup(sh, message) != NULL);
+    g_assert(sh->dispatch != NULL);
+    g_assert(!sh->dispatch_dirty);
+
+    /* until methods are registered again */
+    LSMethod late[] = { { "late", test_method }, { NULL } };
+    LSError error;
+    LSErrorInit(&error);
+    g_assert(LSRegisterCategoryAppend(sh, "/category3", late, NULL, &error));
+    g_assert(sh->dispatch_dirty);
+
+    g_assert(LSCategoryDispatchLookup(sh, message) != NULL);
+    g_assert(!sh->dispatch_dirty);
+    LSMessageUnref(message);
+}
+
+typedef struct LookupThreadData
+{
+    LSHandle *sh;
+    LSMessage *message;
+    gint stop;
+} LookupThreadData;
+
+static gpointer
+test_lookup_thread(gpointer data)
+{
+    LookupThreadData *lookup = data;
+    while (!g_atomic_int_get(&lookup->stop))
+    {
+        g_assert(LSCategoryDispatchLookup(lookup->sh, lookup->message) != NULL);
+    }
+    return NULL;
+}
+
+static void
+test_LSCategoryDispatchLookupRebuild(TestData *fixture, gconstpointer user_data)
+{
+    LSHandle *sh = &fixture->sh;
+
+    /* lookups keep finding the method while methods are registered */
+    LookupThreadData lookup = { sh, test_message_new(sh, "/category7", "method3"), 0 };
+    GThread *thread = g_thread_new("lookup", test_lookup_thread, &lookup);
+
+    LSMethod late[] = { { "late", test_method }, { NULL } };
+    int i;
+    for (i = 0; i < 1000; i++)
+    {
+        LSError error;
+        LSErrorInit(&error);
+        g_assert(LSRegisterCategoryAppend(sh, "/category3", late, NULL, &error));
+    }
+
+    g_atomic_int_set(&lookup.stop, 1);
+    g_thread_join(thread);
+    LSMessageUnref(lookup.message);
+}
+
+static void
+test_LSCategoryDispatchLookupPerf(TestData *fixture, gconstpointer user_data)
+{
+    if (!g_test_perf())
+        return;
+
+    LSHandle *sh = &fixture->sh;
+
+    LSMessage *messages[TEST_CATEGORIES * TEST_METHODS];
+    int c, m, i;
+    for (c = 0; c < TEST_CATEGORIES; c++)
+    {
+        char *category_name = g_strdup_printf("/category%d", c);
+        for (m = 0; m < TEST_METHODS; m++)
+        {
+            messages[c * TEST_METHODS + m] = test_message_new(sh, category_name, fixture->names[c][m]);
+        }
+        g_free(category_name);
+    }
+
+    const int count = G_N_ELEMENTS(messages);
+
+    /* category lookup, then method lookup, as before the flat index */
+    g_test_timer_start();
+    for (i = 0; i < TEST_LOOKUPS; i++)
+    {
+        LSMessage *message = messages[i % count];
+        LSCategoryTable *category = g_hash_table_lookup(sh->tableHandlers, LSMessageGetCategory(message));
+        g_assert(g_hash_table_lookup(category->methods, LSMessageGetMethod(message)));
+    }
+    double nested = g_test_timer_elapsed();
+
+    g_test_timer_start();
+    for (i = 0; i < TEST_LOOKUPS; i++)
+    {
+        g_assert(LSCategoryDispatchLookup(sh, messages[i % count]));
+    }
+    double flat = g_test_timer_elapsed();
+
+    g_test_message("%d lookups of %d methods: nested %.1f ns, flat %.1f ns per lookup",
+                   TEST_LOOKUPS, count, nested * 1e9 / TEST_LOOKUPS, flat * 1e9 / TEST_LOOKUPS);
+    g_test_minimized_result(flat * 1e9 / TEST_LOOKUPS, "flat dispatch lookup %.1f ns",
+                            flat * 1e9 / TEST_LOOKUPS);
+
+    for (i = 0; i < count; i++)
+    {
+        LSMessageUnref(messages[i]);
+    }
+}
+
+/* Test suite *****************************************************************/
+
+#define LSTEST_ADD(name, func) \
+    g_test_add(name, TestData, NULL, test_setup, func, test_teardown)
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_log_set_always_fatal (G_LOG_LEVEL_ERROR);
+    g_log_set_fatal_mask ("LunaService", G_LOG_LEVEL_ERROR);
+
+    LSTEST_ADD("/luna-service2/LSCategoryDispatchLookup", test_LSCategoryDispatchLookup);
+    LSTEST_ADD("/luna-service2/LSCategoryDispatchLookupAppend", test_LSCategoryDispatchLookupAppend);
+    LSTEST_ADD("/luna-service2/LSCategoryDispatchLookupLazy", test_LSCategoryDispatchLookupLazy);
+    LSTEST_ADD("/luna-service2/LSCategoryDispatchLookupRebuild", test_LSCategoryDispatchLookupRebuild);
+    LSTEST_ADD("/luna-service2/LSCategoryDispatchLookupPerf", test_LSCategoryDispatchLookupPerf);
+
+    return g_test_run();
+}
@@ -0,0 +1,238 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <dispatch_source.h>
+
+#define TEST_BUDGET         64
+#define TEST_FLOOD          100000
+
+/* Test utils *****************************************************************/
+
+/* Stands in for a client: pending messages, processed one budget per turn */
+typedef struct TestClient
+{
+    int ref;
+    unsigned int pending;
+    unsigned int processed;
+    gint64 done_at;
+} TestClient;
+
+static void
+test_client_ref(TestClient *client)
+{
+    client->ref++;
+}
+
+static void
+test_client_unref(TestClient *client)
+{
+    g_assert_cmpint(client->ref, >, 0);
+    client->ref--;
+}
+
+static bool
+test_turn(void *item, void *data)
+{
+    TestClient *client = item;
+    unsigned int budget = GPOINTER_TO_UINT(data);
+
+    unsigned int n = budget ? MIN(budget, client->pending) : client->pending;
+    client->pending -= n;
+    client->processed += n;
+
+    if (!client->pending)
+        client->done_at = g_get_monotonic_time();
+
+    return client->pending > 0;
+}
+
+static _LSDispatchSource*
+test_dispatch_new(unsigned int budget)
+{
+    return _LSDispatchSourceNew(NULL, G_PRIORITY_DEFAULT, test_turn, GUINT_TO_POINTER(budget),
+                                (_LSDispatchRefFunc) test_client_ref, (_LSDispatchRefFunc) test_client_unref);
+}
+
+/* The way the transport hands a client over: its first budget is processed
+ * right away, only the leftover is scheduled */
+static void
+test_receive(_LSDispatchSource *dispatch, TestClient *client, unsigned int count, unsigned int budget)
+{
+    client->pending += count;
+    if (test_turn(client, GUINT_TO_POINTER(budget)))
+        _LSDispatchSourceSchedule(dispatch, client);
+}
+
+static gboolean
+test_count_iteration(gpointer data)
+{
+    (*(int *) data)++;
+    return G_SOURCE_CONTINUE;
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_dispatch_source_fairness()
+{
+    _LSDispatchSource *dispatch = test_dispatch_new(TEST_BUDGET);
+
+    TestClient flooder = { 0 }, quiet = { 0 };
+
+    /* another source of the context, at the same priority */
+    int idle_runs = 0;
+    guint idle = g_idle_add_full(G_PRIORITY_DEFAULT, test_count_iteration, &idle_runs, NULL);
+
+    test_receive(dispatch, &flooder, TEST_FLOOD, TEST_BUDGET);
+    g_assert(_LSDispatchSourceIsScheduled(dispatch, &flooder));
+    g_assert_cmpint(flooder.ref, ==, 1);
+
+    g_main_context_iteration(NULL, FALSE);
+    g_main_context_iteration(NULL, FALSE);
+
+    /* the other client sends one message while the flood is being processed */
+    unsigned int flooder_before = flooder.processed;
+    gint64 sent_at = g_get_monotonic_time();
+    quiet.pending = 1;
+    _LSDispatchSourceSchedule(dispatch, &quiet);
+
+    while (quiet.pending)
+    {
+        g_main_context_iteration(NULL, FALSE);
+    }
+
+    /* the flooder got at most the turn it was already in line for */
+    g_assert_cmpuint(flooder.processed - flooder_before, <=, TEST_BUDGET);
+    g_assert_cmpint(quiet.ref, ==, 0);
+    g_assert(!_LSDispatchSourceIsScheduled(dispatch, &quiet));
+
+    while (flooder.pending)
+    {
+        g_main_context_iteration(NULL, FALSE);
+    }
+
+    g_assert_cmpuint(flooder.processed, ==, TEST_FLOOD);
+    g_assert_cmpint(flooder.ref, ==, 0);
+
+    /* the rest of the loop ran every turn of the flood */
+    g_assert_cmpint(idle_runs, >=, TEST_FLOOD / TEST_BUDGET - 1);
+
+    g_test_message("latency of a message behind %d flooded ones: %" G_GINT64_FORMAT " us "
+                   "(flood processed in %d turns)",
+                   TEST_FLOOD, quiet.done_at - sent_at, TEST_FLOOD / TEST_BUDGET);
+
+    g_source_remove(idle);
+    _LSDispatchSourceFree(dispatch);
+}
+
+static void
+test_dispatch_source_unbudgeted()
+{
+    _LSDispatchSource *dispatch = test_dispatch_new(0);
+
+    /* without a budget everything is processed on receive, nothing is left
+     * for the dispatch source */
+    TestClient client = { 0 };
+    test_receive(dispatch, &client, TEST_FLOOD, 0);
+    g_assert_cmpuint(client.processed, ==, TEST_FLOOD);
+    g_assert(!_LSDispatchSourceIsScheduled(dispatch, &client));
+    g_assert_cmpint(client.ref, ==, 0);
+
+    _LSDispatchSourceFree(dispatch);
+}
+
+static void
+test_dispatch_source_round_robin()
+{
+    _LSDispatchSource *dispatch = test_dispatch_new(1);
+
+    TestClient clients[3];
+    memset(clients, 0, sizeof(clients));
+
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        clients[i].pending = 10;
+        _LSDispatchSourceSchedule(dispatch, &clients[i]);
+        /* scheduling twice doesn't give two turns */
+        _LSDispatchSourceSchedule(dispatch, &clients[i]);
+    }
+    g_assert_cmpuint(_LSDispatchSourceGetScheduledCount(dispatch), ==, 3);
+
+    /* one turn each per dispatch */
+    g_main_context_iteration(NULL, FALSE);
+    for (i = 0; i < 3; i++)
+    {
+        g_assert_cmpuint(clients[i].processed, ==, 1);
+        g_assert_cmpint(clients[i].ref, ==, 1);
+    }
+
+    g_main_context_iteration(NULL, FALSE);
+    g_assert_cmpuint(clients[0].processed, ==, 2);
+    g_assert_cmpuint(clients[2].processed, ==, 2);
+
+    _LSDispatchSourceFree(dispatch);
+}
+
+static void
+test_dispatch_source_cancel()
+{
+    _LSDispatchSource *dispatch = test_dispatch_new(1);
+
+    TestClient cancelled = { 0 }, freed = { 0 };
+    cancelled.pending = 10;
+    freed.pending = 10;
+
+    _LSDispatchSourceSchedule(dispatch, &cancelled);
+    _LSDispatchSourceSchedule(dispatch, &freed);
+    g_assert_cmpint(cancelled.ref, ==, 1);
+
+    g_assert(_LSDispatchSourceCancel(dispatch, &cancelled));
+    g_assert(!_LSDispatchSourceCancel(dispatch, &cancelled));
+    g_assert_cmpint(cancelled.ref, ==, 0);
+
+    g_main_context_iteration(NULL, FALSE);
+    g_assert_cmpuint(cancelled.processed, ==, 0);
+    g_assert_cmpuint(freed.processed, ==, 1);
+
+    /* scheduled items are released without their turn */
+    _LSDispatchSourceFree(dispatch);
+    g_assert_cmpint(freed.ref, ==, 0);
+    g_assert_cmpuint(freed.processed, ==, 1);
+}
+
+/* Test suite *****************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_log_set_always_fatal (G_LOG_LEVEL_ERROR);
+    g_log_set_fatal_mask ("LunaService", G_LOG_LEVEL_ERROR);
+
+    g_test_add_func("/luna-service2/LSDispatchSourceFairness", test_dispatch_source_fairness);
+    g_test_add_func("/luna-service2/LSDispatchSourceUnbudgeted", test_dispatch_source_unbudgeted);
+    g_test_add_func("/luna-service2/LSDispatchSourceRoundRobin", test_dispatch_source_round_robin);
+    g_test_add_func("/luna-service2/LSDispatchSourceCancel", test_dispatch_source_cancel);
+
+    return g_test_run();
+}
@@ -39,6 +39,9 @@ typedef struct TestData
     LSMessageToken transport_msg_response_token;
     _LSTransportMessageType transport_msg_type;
     const char *transport_msg_payload;
+    // JSON built from the fields of a service status signal
+    const char *service_status_payload;
+    int service_status_payload_call_count;
 
     // connection handle for message
     LSHandle *sh;
@@ -65,6 +68,8 @@ test_setup(TestData *fixture, gconstpointer user_data)
     fixture->transport_msg_response_token = 0;
     fixture->transport_msg_type = _LSTransportMessageTypeUnknown;
     fixture->transport_msg_payload = NULL;
+    fixture->service_status_payload = NULL;
+    fixture->service_status_payload_call_count = 0;
 
     fixture->sh = GINT_TO_POINTER(2);
 
@@ -230,6 +235,27 @@ test_LSMessageGetPayload(TestData *fixture, gconstpointer user_data)
 
     fixture->transport_msg_payload = "a";
     g_assert_cmpstr(LSMessageGetPayload(fixture->msg), ==, "a");
+    g_assert_cmpint(fixture->service_status_payload_call_count, ==, 0);
+
+    // service status signal: the JSON is built from its fields, once
+    fixture->transport_msg_type = _LSTransportMessageTypeServiceDownSignal;
+    fixture->transport_msg_payload = "";
+    fixture->service_status_payload = "{\"connected\":false}";
+
+    LSMessage *msg = _LSMessageNewRef(fixture->transport_msg, fixture->sh);
+    g_assert_cmpstr(LSMessageGetPayload(msg), ==, "{\"connected\":false}");
+    g_assert_cmpstr(LSMessageGetPayload(msg), ==, "{\"connected\":false}");
+    g_assert_cmpint(fixture->service_status_payload_call_count, ==, 1);
+    LSMessageUnref(msg);
+
+    // JSON form sent by an older hub is used as is
+    fixture->transport_msg_type = _LSTransportMessageTypeServiceUpSignal;
+    fixture->transport_msg_payload = "{\"connected\":true}";
+    fixture->service_status_payload = NULL;
+
+    msg = _LSMessageNewRef(fixture->transport_msg, fixture->sh);
+    g_assert_cmpstr(LSMessageGetPayload(msg), ==, "{\"connected\":true}");
+    LSMessageUnref(msg);
 }
 
 static void
@@ -374,6 +400,13 @@ _LSTransportMessageGetType(const _LSTransportMessage *message)
     return test_data->transport_msg_type;
 }
 
+char *
+LSTransportServiceStatusSignalGetPayload(_LSTransportMessage *message)
+{
+    ++test_data->service_status_payload_call_count;
+    return g_strdup(test_data->service_status_payload);
+}
+
 bool
 _LSTransportSendReply(const _LSTransportMessage *message, const char *payload, LSError *lserror)
 {
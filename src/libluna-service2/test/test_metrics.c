@@ -0,0 +1,237 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pbnjson.h>
+#include <base.h>
+#include <metrics.h>
+
+/* Test data ******************************************************************/
+
+typedef struct TestData
+{
+    LSHandle sh;
+
+    // payload from mocked LSMessageReply
+    gchar *lsmessagereply_payload;
+} TestData;
+
+static TestData *test_data = NULL;
+
+static void
+test_setup(TestData *fixture, gconstpointer user_data)
+{
+    test_data = fixture;
+    memset(&fixture->sh, 0, sizeof(fixture->sh));
+    fixture->sh.metrics = _LSMetricsNew();
+    g_assert(fixture->sh.metrics);
+}
+
+static void
+test_teardown(TestData *fixture, gconstpointer user_data)
+{
+    _LSMetricsFree(fixture->sh.metrics);
+    g_free(fixture->lsmessagereply_payload);
+    fixture->lsmessagereply_payload = NULL;
+
+    test_data = NULL;
+}
+
+static gint*
+calls_sent_count(LSHandle *sh, const char *service, const char *category)
+{
+    int i;
+    for (i = 0; i < LS_METRICS_CALLS_SENT_SLOTS; i++)
+    {
+        _LSMetricsDestination *dest = &sh->metrics->calls_sent_to[i];
+        if (dest->service && strcmp(dest->service, service) == 0 && strcmp(dest->category, category) == 0)
+            return &dest->calls_sent;
+    }
+    return NULL;
+}
+
+static void
+histogram_add_us(_LSMetricsHistogram *hist, long us)
+{
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+    _LSMetricsHistogramAdd(hist, &ts);
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_LSMetricsHistogramAdd(TestData *fixture, gconstpointer user_data)
+{
+    _LSMetricsHistogram hist;
+    memset(&hist, 0, sizeof(hist));
+
+    histogram_add_us(&hist, 0);
+    histogram_add_us(&hist, 1);
+    histogram_add_us(&hist, 2);
+    histogram_add_us(&hist, 3);
+    histogram_add_us(&hist, 1000);
+    histogram_add_us(&hist, 100 * 1000 * 1000);
+
+    g_assert_cmpint(hist.buckets[0], ==, 1);
+    g_assert_cmpint(hist.buckets[1], ==, 1);
+    g_assert_cmpint(hist.buckets[2], ==, 2);
+    /* 512 <= 1000 < 1024 */
+    g_assert_cmpint(hist.buckets[10], ==, 1);
+    /* everything above the range ends up in the last bucket */
+    g_assert_cmpint(hist.buckets[LS_METRICS_HISTOGRAM_BUCKETS - 1], ==, 1);
+
+    jvalue_ref array = _LSMetricsHistogramToJson(&hist);
+    g_assert_cmpint(jarray_size(array), ==, LS_METRICS_HISTOGRAM_BUCKETS);
+    j_release(&array);
+}
+
+static void
+test_LSMetricsCounters(TestData *fixture, gconstpointer user_data)
+{
+    LSHandle *sh = &fixture->sh;
+    struct timespec latency = { 0, 5000 };
+
+    _LSMetricsCallSent(sh, "com.palm.foo", "/");
+    _LSMetricsCallSent(sh, "com.palm.foo", "/");
+    _LSMetricsCallSent(sh, "com.palm.foo", "/cat");
+    _LSMetricsReplyReceived(sh, &latency);
+    _LSMetricsReplyReceived(sh, NULL);
+
+    _LSMethodMetrics method;
+    memset(&method, 0, sizeof(method));
+    _LSMetricsMethodCalled(sh, &method, &latency);
+
+    g_assert_cmpint(sh->metrics->calls_sent, ==, 3);
+    g_assert_cmpint(sh->metrics->replies_received, ==, 2);
+    g_assert_cmpint(sh->metrics->calls_received, ==, 1);
+    g_assert_cmpint(method.calls_received, ==, 1);
+    /* counted by service and category */
+    g_assert_cmpint(sh->metrics->destinations, ==, 2);
+    gint *count = calls_sent_count(sh, "com.palm.foo", "/");
+    g_assert(count != NULL);
+    g_assert_cmpint(*count, ==, 2);
+
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    jvalue_ref obj = NULL;
+    g_assert(_LSMetricsGetJson(sh, &obj, &lserror));
+
+    int32_t value = 0;
+    g_assert(jnumber_get_i32(jobject_get(obj, J_CSTR_TO_BUF("callsSent")), &value) == CONV_OK);
+    g_assert_cmpint(value, ==, 3);
+    jvalue_ref calls = jobject_get(obj, J_CSTR_TO_BUF("outgoingCalls"));
+    g_assert_cmpint(jarray_size(calls), ==, 2);
+    g_assert(strstr(jvalue_tostring_simple(calls), "\"luna://com.palm.foo\""));
+    g_assert(strstr(jvalue_tostring_simple(calls), "\"luna://com.palm.foo/cat\""));
+
+    j_release(&obj);
+}
+
+static void
+test_LSMetricsCallsSentBounded(TestData *fixture, gconstpointer user_data)
+{
+    LSHandle *sh = &fixture->sh;
+
+    /* unique destinations don't grow the table past its bound */
+    int i;
+    for (i = 0; i < LS_METRICS_CALLS_SENT_DESTINATIONS * 2; i++)
+    {
+        char *service = g_strdup_printf("com.palm.foo%d", i);
+        _LSMetricsCallSent(sh, service, "/");
+        _LSMetricsCallSent(sh, service, "/");
+        g_free(service);
+    }
+
+    g_assert_cmpint(sh->metrics->calls_sent, ==, LS_METRICS_CALLS_SENT_DESTINATIONS * 4);
+    g_assert_cmpint(sh->metrics->destinations, ==, LS_METRICS_CALLS_SENT_DESTINATIONS);
+    g_assert_cmpint(sh->metrics->calls_sent_other, ==, LS_METRICS_CALLS_SENT_DESTINATIONS * 2);
+
+    /* known destinations are still counted */
+    _LSMetricsCallSent(sh, "com.palm.foo0", "/");
+    gint *count = calls_sent_count(sh, "com.palm.foo0", "/");
+    g_assert(count != NULL);
+    g_assert_cmpint(*count, ==, 3);
+}
+
+static void
+test_LSPrivateGetMetrics(TestData *fixture, gconstpointer user_data)
+{
+    LSMessage *msg = GINT_TO_POINTER(2);
+
+    g_assert(_LSPrivateGetMetrics(&fixture->sh, msg, NULL));
+    g_assert(fixture->lsmessagereply_payload != NULL);
+    g_assert(strstr(fixture->lsmessagereply_payload, "\"returnValue\":true"));
+    g_assert(strstr(fixture->lsmessagereply_payload, "\"replyLatencyUs\":["));
+}
+
+static void
+test_LSPrivateGetMetricsFailure(TestData *fixture, gconstpointer user_data)
+{
+    LSMessage *msg = GINT_TO_POINTER(2);
+
+    /* a handle without metrics still gets a reply */
+    _LSMetricsFree(fixture->sh.metrics);
+    fixture->sh.metrics = NULL;
+
+    g_assert(_LSPrivateGetMetrics(&fixture->sh, msg, NULL));
+    g_assert(fixture->lsmessagereply_payload != NULL);
+    g_assert(strstr(fixture->lsmessagereply_payload, "\"returnValue\":false"));
+    g_assert(strstr(fixture->lsmessagereply_payload, "\"errorText\":\"Metrics are not available"));
+}
+
+/* Mocks **********************************************************************/
+
+bool
+LSMessageReply(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
+                LSError *lserror)
+{
+    g_free(test_data->lsmessagereply_payload);
+    test_data->lsmessagereply_payload = g_strdup(replyPayload);
+    return true;
+}
+
+void
+_lshandle_validate(LSHandle *sh)
+{
+}
+
+/* Test suite *****************************************************************/
+
+#define LSTEST_ADD(name, func) \
+    g_test_add(name, TestData, NULL, test_setup, func, test_teardown)
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_log_set_always_fatal (G_LOG_LEVEL_ERROR);
+    g_log_set_fatal_mask ("LunaService", G_LOG_LEVEL_ERROR);
+
+    LSTEST_ADD("/luna-service2/LSMetricsHistogramAdd", test_LSMetricsHistogramAdd);
+    LSTEST_ADD("/luna-service2/LSMetricsCounters", test_LSMetricsCounters);
+    LSTEST_ADD("/luna-service2/LSMetricsCallsSentBounded", test_LSMetricsCallsSentBounded);
+    LSTEST_ADD("/luna-service2/LSPrivateGetMetrics", test_LSPrivateGetMetrics);
+    LSTEST_ADD("/luna-service2/LSPrivateGetMetricsFailure", test_LSPrivateGetMetricsFailure);
+
+    return g_test_run();
+}
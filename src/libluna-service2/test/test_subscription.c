@@ -26,6 +26,10 @@
 #include <subscription.h>
 #include <base.h>
 
+#define TEST_SUBSCRIBERS            10000
+#define TEST_KEYS                   1000
+#define TEST_KEYS_PER_SUBSCRIBER    4
+
 /* Test data ******************************************************************/
 
 typedef struct TestData
@@ -37,14 +41,17 @@ typedef struct TestData
     const char *message_sender;
     const char *message_service_name;
     const char *message_unique_token;
+    GHashTable *message_unique_tokens;  // message -> token, for many subscribers
     LSMessageToken message_token;
 
-    int lscall_call_count;
-    char *lscall_uri;
-    char *lscall_payload;
+    int registerpeerdown_call_count;
+    int cancelpeerdown_call_count;
+    char *registerpeerdown_unique_name;
 
     int lsmessagereply_call_count;
     char *lsmessagereply_payload;
+    const char *lsmessagereply_update_key;
+    bool lsmessagereply_supersedes;
 
     _Catalog *catalog;
 } TestData;
@@ -65,14 +72,15 @@ test_setup(TestData *fixture, gconstpointer user_data)
     fixture->message_payload = NULL;
     fixture->lsmessagereply_payload = NULL;
 
-    fixture->lscall_call_count = 0;
-    fixture->lscall_uri = 0;
-    fixture->lscall_payload = 0;
+    fixture->registerpeerdown_call_count = 0;
+    fixture->cancelpeerdown_call_count = 0;
+    fixture->registerpeerdown_unique_name = NULL;
 
     fixture->lsmessagereply_call_count = 0;
     fixture->message_token = 0;
 
     fixture->message_unique_token = "a.1";
+    fixture->message_unique_tokens = NULL;
     fixture->message_service_name = "com.name.server";
 
     fixture->catalog = _CatalogNew(&fixture->sh);
@@ -87,18 +95,22 @@ test_setup(TestData *fixture, gconstpointer user_data)
 static void
 test_teardown(TestData *fixture, gconstpointer user_data)
 {
-    g_free(fixture->lscall_uri);
-    g_free(fixture->lscall_payload);
+    g_free(fixture->registerpeerdown_unique_name);
     g_free(fixture->lsmessagereply_payload);
 
-    fixture->lscall_uri = NULL;
-    fixture->lscall_payload = NULL;
+    fixture->registerpeerdown_unique_name = NULL;
     fixture->lsmessagereply_payload = NULL;
 
     _CallMapDeinit(&fixture->sh, fixture->sh.callmap);
 
     _CatalogFree(fixture->catalog);
 
+    if (fixture->message_unique_tokens)
+    {
+        g_hash_table_destroy(fixture->message_unique_tokens);
+        fixture->message_unique_tokens = NULL;
+    }
+
     test_data = NULL;
 }
 
@@ -129,11 +141,8 @@ test_LSSubscriptionAddAndRemove(TestData *fixture, gconstpointer user_data)
 
     g_assert(LSSubscriptionAdd(&fixture->sh, key, fixture->message, &error));
     g_assert_cmpint(fixture->message_ref_count, ==, 2);
-    g_assert_cmpint(fixture->lscall_call_count, ==, 1);
-    g_assert_cmpstr(fixture->lscall_uri, ==, "palm://com.palm.bus/signal/registerServerStatus");
-    char *expected_lscall_payload = g_strdup_printf("{\"serviceName\":\"%s\"}", fixture->message_sender);
-    g_assert_cmpstr(fixture->lscall_payload, ==, expected_lscall_payload);
-    g_free(expected_lscall_payload);
+    g_assert_cmpint(fixture->registerpeerdown_call_count, ==, 1);
+    g_assert_cmpstr(fixture->registerpeerdown_unique_name, ==, fixture->message_sender);
 
     LSSubscriptionIter *sub_iter = NULL;
     g_assert(LSSubscriptionAcquire(&fixture->sh, key, &sub_iter, &error));
@@ -147,6 +156,7 @@ test_LSSubscriptionAddAndRemove(TestData *fixture, gconstpointer user_data)
 
     LSSubscriptionRemove(sub_iter);
     g_assert_cmpint(fixture->message_ref_count, ==, 1);
+    g_assert_cmpint(fixture->cancelpeerdown_call_count, ==, 1);
 
     LSSubscriptionRelease(sub_iter);
 }
@@ -272,6 +282,12 @@ test_LSSubscriptionReply(TestData *fixture, gconstpointer user_data)
     g_assert_cmpstr(fixture->lsmessagereply_payload, ==, payload);
     g_assert_cmpint(fixture->lsmessagereply_call_count, ==, 1);
 
+    // invalid payload is rejected before anything is sent
+    g_assert(!LSSubscriptionReply(&fixture->sh, key, "", &error));
+    g_assert(LSErrorIsSet(&error));
+    LSErrorFree(&error);
+    g_assert_cmpint(fixture->lsmessagereply_call_count, ==, 1);
+
     LSSubscriptionIter *sub_iter = NULL;
     g_assert(LSSubscriptionAcquire(&fixture->sh, key, &sub_iter, &error));
     LSMessage *msg = LSSubscriptionNext(sub_iter);
@@ -323,40 +339,37 @@ test_LSSubscriptionProcess(TestData *fixture, gconstpointer user_data)
 
     g_assert(LSSubscriptionProcess(&fixture->sh, fixture->message, &subscribed, &error));
     g_assert(!subscribed);
-    g_assert_cmpint(fixture->lscall_call_count, ==, 0);
+    g_assert_cmpint(fixture->registerpeerdown_call_count, ==, 0);
 
     // dont subscribe
     fixture->message_payload = "{\"subscribe\": null}";
 
     g_assert(LSSubscriptionProcess(&fixture->sh, fixture->message, &subscribed, &error));
     g_assert(!subscribed);
-    g_assert_cmpint(fixture->lscall_call_count, ==, 0);
+    g_assert_cmpint(fixture->registerpeerdown_call_count, ==, 0);
 
     // dont subscribe
     fixture->message_payload = "{\"subscribe\": 1}";
 
     g_assert(LSSubscriptionProcess(&fixture->sh, fixture->message, &subscribed, &error));
     g_assert(!subscribed);
-    g_assert_cmpint(fixture->lscall_call_count, ==, 0);
+    g_assert_cmpint(fixture->registerpeerdown_call_count, ==, 0);
 
     // dont subscribe
     fixture->message_payload = "{\"subscribe\": false}";
 
     g_assert(LSSubscriptionProcess(&fixture->sh, fixture->message, &subscribed, &error));
     g_assert(!subscribed);
-    g_assert_cmpint(fixture->lscall_call_count, ==, 0);
+    g_assert_cmpint(fixture->registerpeerdown_call_count, ==, 0);
 
     // subscribe
     fixture->message_payload = "{\"subscribe\": true}";
 
     g_assert(LSSubscriptionProcess(&fixture->sh, fixture->message, &subscribed, &error));
     g_assert(subscribed);
-    // verify that registerServerStatus signal sent (really subscribed)
-    g_assert_cmpint(fixture->lscall_call_count, ==, 1);
-    g_assert_cmpstr(fixture->lscall_uri, ==, "palm://com.palm.bus/signal/registerServerStatus");
-    char *expected_lscall_payload = g_strdup_printf("{\"serviceName\":\"%s\"}", fixture->message_sender);
-    g_assert_cmpstr(fixture->lscall_payload, ==, expected_lscall_payload);
-    g_free(expected_lscall_payload);
+    // verify that the subscriber is watched (really subscribed)
+    g_assert_cmpint(fixture->registerpeerdown_call_count, ==, 1);
+    g_assert_cmpstr(fixture->registerpeerdown_unique_name, ==, fixture->message_sender);
 }
 
 static void
@@ -387,6 +400,213 @@ test_LSSubscriptionPost(TestData *fixture, gconstpointer user_data)
     LSSubscriptionRelease(sub_iter);
 }
 
+static void
+test_LSSubscriptionSetLatestOnly(TestData *fixture, gconstpointer user_data)
+{
+    LSError error;
+    LSErrorInit(&error);
+
+    const char *key = "a/b";
+    const char *payload = "{}";
+
+    g_assert(LSSubscriptionAdd(&fixture->sh, key, fixture->message, &error));
+
+    // every update is delivered by default
+    g_assert(LSSubscriptionReply(&fixture->sh, key, payload, &error));
+    g_assert_cmpstr(fixture->lsmessagereply_update_key, ==, key);
+    g_assert(!fixture->lsmessagereply_supersedes);
+
+    g_assert(LSSubscriptionSetLatestOnly(&fixture->sh, key, true, &error));
+    g_assert(LSSubscriptionReply(&fixture->sh, key, payload, &error));
+    g_assert(fixture->lsmessagereply_supersedes);
+
+    // posts go through the same key
+    g_assert(LSSubscriptionPost(&fixture->sh, "a", "b", payload, &error));
+    g_assert(fixture->lsmessagereply_supersedes);
+
+    // other keys are left alone
+    g_assert(LSSubscriptionAdd(&fixture->sh, "a/c", fixture->message, &error));
+    g_assert(LSSubscriptionReply(&fixture->sh, "a/c", payload, &error));
+    g_assert_cmpstr(fixture->lsmessagereply_update_key, ==, "a/c");
+    g_assert(!fixture->lsmessagereply_supersedes);
+
+    g_assert(LSSubscriptionSetLatestOnly(&fixture->sh, key, false, &error));
+    g_assert(LSSubscriptionReply(&fixture->sh, key, payload, &error));
+    g_assert(!fixture->lsmessagereply_supersedes);
+
+    LSSubscriptionIter *sub_iter = NULL;
+    g_assert(LSSubscriptionAcquire(&fixture->sh, key, &sub_iter, &error));
+    LSMessage *msg = LSSubscriptionNext(sub_iter);
+    LSMessageUnref(msg);
+    LSSubscriptionRemove(sub_iter);
+    LSSubscriptionRelease(sub_iter);
+}
+
+static LSMessage *
+test_subscriber_new(TestData *fixture, int i)
+{
+    if (!fixture->message_unique_tokens)
+    {
+        fixture->message_unique_tokens = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                               NULL, g_free);
+    }
+
+    LSMessage *message = GINT_TO_POINTER(0x100 + i);
+    g_hash_table_insert(fixture->message_unique_tokens, message,
+                        g_strdup_printf("com.name.client%d.%d", i, i + 1));
+    return message;
+}
+
+static int
+test_subscription_count(TestData *fixture, const char *key)
+{
+    LSError error;
+    LSErrorInit(&error);
+
+    LSSubscriptionIter *sub_iter = NULL;
+    g_assert(LSSubscriptionAcquire(&fixture->sh, key, &sub_iter, &error));
+
+    int count = 0;
+    while (LSSubscriptionHasNext(sub_iter))
+    {
+        if (LSSubscriptionNext(sub_iter))
+            count++;
+    }
+    LSSubscriptionRelease(sub_iter);
+
+    return count;
+}
+
+static void
+test_subscription_remove(TestData *fixture, const char *key, LSMessage *message)
+{
+    LSError error;
+    LSErrorInit(&error);
+
+    LSSubscriptionIter *sub_iter = NULL;
+    g_assert(LSSubscriptionAcquire(&fixture->sh, key, &sub_iter, &error));
+    while (LSSubscriptionHasNext(sub_iter))
+    {
+        LSMessage *next = LSSubscriptionNext(sub_iter);
+        if (!message || next == message)
+            LSSubscriptionRemove(sub_iter);
+    }
+    LSSubscriptionRelease(sub_iter);
+}
+
+static void
+test_LSSubscriptionManySubscribers(TestData *fixture, gconstpointer user_data)
+{
+    LSError error;
+    LSErrorInit(&error);
+
+    LSMessage *first = test_subscriber_new(fixture, 0);
+    LSMessage *second = test_subscriber_new(fixture, 1);
+    LSMessage *third = test_subscriber_new(fixture, 2);
+
+    g_assert(LSSubscriptionAdd(&fixture->sh, "a/b", first, &error));
+    g_assert(LSSubscriptionAdd(&fixture->sh, "a/c", first, &error));
+    g_assert(LSSubscriptionAdd(&fixture->sh, "a/b", second, &error));
+    g_assert(LSSubscriptionAdd(&fixture->sh, "a/c", third, &error));
+
+    // subscribing twice to the same key counts once
+    g_assert(LSSubscriptionAdd(&fixture->sh, "a/b", first, &error));
+    g_assert_cmpint(fixture->registerpeerdown_call_count, ==, 3);
+
+    g_assert_cmpint(test_subscription_count(fixture, "a/b"), ==, 2);
+    g_assert_cmpint(test_subscription_count(fixture, "a/c"), ==, 2);
+    g_assert_cmpint(test_subscription_count(fixture, "a/d"), ==, 0);
+
+    g_assert(LSSubscriptionReply(&fixture->sh, "a/b", "{}", &error));
+    g_assert_cmpint(fixture->lsmessagereply_call_count, ==, 2);
+
+    // removing a subscriber removes it from all its keys
+    test_subscription_remove(fixture, "a/b", first);
+    g_assert_cmpint(test_subscription_count(fixture, "a/b"), ==, 1);
+    g_assert_cmpint(test_subscription_count(fixture, "a/c"), ==, 1);
+
+    // an iterator doesn't return a subscriber gone since it was acquired,
+    // even if another one took its place
+    LSSubscriptionIter *sub_iter = NULL;
+    g_assert(LSSubscriptionAcquire(&fixture->sh, "a/c", &sub_iter, &error));
+    test_subscription_remove(fixture, "a/c", third);
+    g_assert(LSSubscriptionAdd(&fixture->sh, "a/c", test_subscriber_new(fixture, 3), &error));
+    g_assert(LSSubscriptionHasNext(sub_iter));
+    g_assert(LSSubscriptionNext(sub_iter) == NULL);
+    LSSubscriptionRemove(sub_iter);
+    LSSubscriptionRelease(sub_iter);
+    g_assert_cmpint(test_subscription_count(fixture, "a/c"), ==, 1);
+
+    test_subscription_remove(fixture, "a/b", NULL);
+    test_subscription_remove(fixture, "a/c", NULL);
+    g_assert_cmpint(fixture->message_ref_count, ==, 1);
+}
+
+static void
+test_LSSubscriptionPerf(TestData *fixture, gconstpointer user_data)
+{
+    if (!g_test_perf())
+        return;
+
+    LSError error;
+    LSErrorInit(&error);
+
+    char *keys[TEST_KEYS];
+    LSMessage *messages[TEST_SUBSCRIBERS];
+    int i, k;
+    for (k = 0; k < TEST_KEYS; k++)
+    {
+        keys[k] = g_strdup_printf("/category/method%d", k);
+    }
+    for (i = 0; i < TEST_SUBSCRIBERS; i++)
+    {
+        messages[i] = test_subscriber_new(fixture, i);
+    }
+
+    const int subscriptions = TEST_SUBSCRIBERS * TEST_KEYS_PER_SUBSCRIBER;
+
+    g_test_timer_start();
+    for (i = 0; i < TEST_SUBSCRIBERS; i++)
+    {
+        for (k = 0; k < TEST_KEYS_PER_SUBSCRIBER; k++)
+        {
+            const char *key = keys[(i + k * (TEST_KEYS / TEST_KEYS_PER_SUBSCRIBER)) % TEST_KEYS];
+            g_assert(LSSubscriptionAdd(&fixture->sh, key, messages[i], &error));
+        }
+    }
+    double add = g_test_timer_elapsed();
+
+    g_test_timer_start();
+    for (k = 0; k < TEST_KEYS; k++)
+    {
+        g_assert(LSSubscriptionReply(&fixture->sh, keys[k], "{}", &error));
+    }
+    double reply = g_test_timer_elapsed();
+    g_assert_cmpint(fixture->lsmessagereply_call_count, ==, subscriptions);
+
+    /* every subscriber is removed from all of its keys at once */
+    g_test_timer_start();
+    for (k = 0; k < TEST_KEYS; k++)
+    {
+        test_subscription_remove(fixture, keys[k], NULL);
+    }
+    double remove = g_test_timer_elapsed();
+    g_assert_cmpint(fixture->message_ref_count, ==, 1);
+
+    g_test_message("%d subscriptions of %d subscribers to %d keys: "
+                   "add %.1f ns, reply %.1f ns, remove %.1f ns per subscription",
+                   subscriptions, TEST_SUBSCRIBERS, TEST_KEYS,
+                   add * 1e9 / subscriptions, reply * 1e9 / subscriptions,
+                   remove * 1e9 / subscriptions);
+    g_test_minimized_result(add * 1e9 / subscriptions, "subscription add %.1f ns",
+                            add * 1e9 / subscriptions);
+
+    for (k = 0; k < TEST_KEYS; k++)
+    {
+        g_free(keys[k]);
+    }
+}
+
 /* Mocks **********************************************************************/
 
 const char *
@@ -410,6 +630,8 @@ LSMessageGetSenderServiceName(LSMessage *message)
 const char *
 LSMessageGetUniqueToken(LSMessage *message)
 {
+    if (test_data->message_unique_tokens)
+        return g_hash_table_lookup(test_data->message_unique_tokens, message);
     return test_data->message_unique_token;
 }
 
@@ -438,23 +660,33 @@ LSMessageGetToken(LSMessage *message)
 }
 
 bool
-LSCall(LSHandle *sh, const char *uri, const char *payload,
-       LSFilterFunc callback, void *ctx,
-       LSMessageToken *ret_token, LSError *lserror)
+LSRegisterPeerDown(LSHandle *sh, const char *uniqueName,
+                   LSPeerDownFunc func, void *ctx,
+                   void **cookie, LSError *lserror)
+{
+    ++test_data->registerpeerdown_call_count;
+    g_free(test_data->registerpeerdown_unique_name);
+    test_data->registerpeerdown_unique_name = g_strdup(uniqueName);
+    *cookie = GINT_TO_POINTER(test_data->registerpeerdown_call_count);
+    return true;
+}
+
+bool
+LSCancelPeerDown(LSHandle *sh, void *cookie, LSError *lserror)
 {
-    ++test_data->lscall_call_count;
-    g_free(test_data->lscall_uri);
-    g_free(test_data->lscall_payload);
-    test_data->lscall_uri = g_strdup(uri);
-    test_data->lscall_payload = g_strdup(payload);
+    ++test_data->cancelpeerdown_call_count;
     return true;
 }
 
 bool
-LSMessageReply(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
-                LSError *lserror)
+_LSMessageReplyShared(LSHandle *sh, LSMessage *lsmsg, const char *replyPayload,
+                      unsigned long payload_size, GBytes **shared_payload,
+                      const char *update_key, bool supersedes, LSError *lserror)
 {
+    g_assert_cmpint(payload_size, ==, strlen(replyPayload) + 1);
     ++test_data->lsmessagereply_call_count;
+    test_data->lsmessagereply_update_key = update_key;
+    test_data->lsmessagereply_supersedes = supersedes;
     g_free(test_data->lsmessagereply_payload);
     test_data->lsmessagereply_payload = g_strdup(replyPayload);
     return true;
@@ -488,6 +720,9 @@ main(int argc, char *argv[])
     LSTEST_ADD("/luna-service2/CatalogHandleCancel", test_CatalogHandleCancel);
     LSTEST_ADD("/luna-service2/LSSubscriptionProcess", test_LSSubscriptionProcess);
     LSTEST_ADD("/luna-service2/LSSubscriptionPost", test_LSSubscriptionPost);
+    LSTEST_ADD("/luna-service2/LSSubscriptionSetLatestOnly", test_LSSubscriptionSetLatestOnly);
+    LSTEST_ADD("/luna-service2/LSSubscriptionManySubscribers", test_LSSubscriptionManySubscribers);
+    LSTEST_ADD("/luna-service2/LSSubscriptionPerf", test_LSSubscriptionPerf);
 
     return g_test_run();
 }
@@ -0,0 +1,178 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <timer_wheel.h>
+
+/* Test utils *****************************************************************/
+
+typedef struct TestTimer
+{
+    _LSTimer timer;
+    gint64 armed_at;
+    gint64 fired_at;
+    int fired;
+    int destroyed;
+} TestTimer;
+
+static void
+test_on_timeout(void *data)
+{
+    TestTimer *t = data;
+    t->fired_at = g_get_monotonic_time();
+    t->fired++;
+}
+
+static void
+test_on_destroy(void *data)
+{
+    TestTimer *t = data;
+    t->destroyed++;
+}
+
+static void
+test_timer_init(TestTimer *t)
+{
+    memset(t, 0, sizeof(*t));
+    _LSTimerInit(&t->timer, test_on_timeout, test_on_destroy, t);
+}
+
+static void
+test_arm(_LSTimerWheel *wheel, TestTimer *t, unsigned int timeout_ms)
+{
+    t->armed_at = g_get_monotonic_time();
+    _LSTimerWheelArm(wheel, &t->timer, timeout_ms);
+}
+
+static void
+test_iterate_main_loop(int ms)
+{
+    g_test_timer_start();
+    while (true)
+    {
+        g_main_context_iteration(NULL, FALSE);
+        if (g_test_timer_elapsed() * 1000 > ms)
+            break;
+        g_usleep(500);
+    }
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_timer_wheel_expire()
+{
+    _LSTimerWheel *wheel = _LSTimerWheelNew(NULL, 1);
+    g_assert(wheel != NULL);
+
+    /* level 0, a cascade from level 1 and one from level 2 */
+    TestTimer timers[3];
+    unsigned int timeouts[3] = { 20, 150, 4200 };
+
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        test_timer_init(&timers[i]);
+        test_arm(wheel, &timers[i], timeouts[i]);
+    }
+    g_assert_cmpint(_LSTimerWheelGetArmedCount(wheel), ==, 3);
+
+    test_iterate_main_loop(100);
+    g_assert_cmpint(timers[0].fired, ==, 1);
+    g_assert_cmpint(timers[1].fired, ==, 0);
+
+    test_iterate_main_loop(4300);
+    for (i = 0; i < 3; i++)
+    {
+        g_assert_cmpint(timers[i].fired, ==, 1);
+        g_assert_cmpint(timers[i].destroyed, ==, 1);
+
+        /* never early */
+        g_assert_cmpint(timers[i].fired_at - timers[i].armed_at, >=, timeouts[i] * 1000);
+    }
+    g_assert_cmpint(_LSTimerWheelGetArmedCount(wheel), ==, 0);
+
+    _LSTimerWheelFree(wheel);
+}
+
+static void
+test_timer_wheel_rearm_cancel()
+{
+    _LSTimerWheel *wheel = _LSTimerWheelNew(NULL, 1);
+
+    TestTimer rearmed, cancelled;
+    test_timer_init(&rearmed);
+    test_timer_init(&cancelled);
+
+    test_arm(wheel, &rearmed, 50);
+    test_arm(wheel, &cancelled, 50);
+
+    /* re-arming ends the previous arming */
+    test_arm(wheel, &rearmed, 200);
+    g_assert_cmpint(rearmed.destroyed, ==, 1);
+
+    g_assert(_LSTimerWheelCancel(wheel, &cancelled.timer));
+    g_assert_cmpint(cancelled.destroyed, ==, 1);
+    g_assert(!_LSTimerWheelCancel(wheel, &cancelled.timer));
+    g_assert_cmpint(cancelled.destroyed, ==, 1);
+
+    test_iterate_main_loop(100);
+    g_assert_cmpint(rearmed.fired, ==, 0);
+    g_assert_cmpint(cancelled.fired, ==, 0);
+
+    test_iterate_main_loop(200);
+    g_assert_cmpint(rearmed.fired, ==, 1);
+    g_assert_cmpint(rearmed.destroyed, ==, 2);
+    g_assert_cmpint(cancelled.fired, ==, 0);
+
+    _LSTimerWheelFree(wheel);
+}
+
+static void
+test_timer_wheel_free()
+{
+    _LSTimerWheel *wheel = _LSTimerWheelNew(NULL, 10);
+
+    TestTimer t;
+    test_timer_init(&t);
+    test_arm(wheel, &t, 10000);
+
+    /* armed timers are dropped, but their armings end */
+    _LSTimerWheelFree(wheel);
+    g_assert_cmpint(t.fired, ==, 0);
+    g_assert_cmpint(t.destroyed, ==, 1);
+}
+
+/* Test suite *****************************************************************/
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_log_set_always_fatal (G_LOG_LEVEL_ERROR);
+    g_log_set_fatal_mask ("LunaService", G_LOG_LEVEL_ERROR);
+
+    g_test_add_func("/luna-service2/LSTimerWheelExpire", test_timer_wheel_expire);
+    g_test_add_func("/luna-service2/LSTimerWheelRearmCancel", test_timer_wheel_rearm_cancel);
+    g_test_add_func("/luna-service2/LSTimerWheelFree", test_timer_wheel_free);
+
+    return g_test_run();
+}
@@ -17,6 +17,8 @@
 * LICENSE@@@ */
 
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
 #include <glib.h>
 #include "transport.h"
 #include "transport_priv.h" /* LSTransport */
@@ -40,6 +42,8 @@ int calls_to_messageref;
 int calls_to_messageunref;
 int calls_to_messagesettype;
 int calls_to_messageiterhasnext;
+int calls_to_send;
+ssize_t send_max_bytes = -1; /* <0 means everything */
 int expected_calls_to_messagesettype = -1;
 int headerlen = sizeof(_LSTransportHeader);
 _LSTransportMessageType headertype = _LSTransportMessageTypeMethodCall;
@@ -70,6 +74,7 @@ clear_counters()
     calls_to_messageref = 0;
     calls_to_messagesettype = 0;
     calls_to_messageiterhasnext = 0;
+    calls_to_send = 0;
     expected_calls_to_messagesettype = 0;
     flush_and_shutdown = false;
     use_shared_memory = false;
@@ -246,8 +251,9 @@ _LSTransportMessageNewRef(unsigned long payload_size)
     calls_to_messagenewref++;
 
     _LSTransportMessage *message = g_slice_new0(_LSTransportMessage);
-    message->raw = g_malloc(sizeof(_LSTransportMessageRaw) + payload_size);
-    message->raw->header.len = payload_size;
+    message->raw = g_malloc0(sizeof(_LSTransportMessageRaw) + payload_size);
+    _LSTransportHeaderInit(&message->raw->header, _LSTransportMessageTypeUnknown, payload_size);
+    message->connection_fd = -1;
     message->ref = 1;
 
     return message;
@@ -422,12 +428,18 @@ _LSTransportMessageIterInit(_LSTransportMessage *message, _LSTransportMessageIte
 ssize_t
 send(int sockfd, const void *buf, size_t len, int flags)
 {
+    calls_to_send++;
+    if (send_max_bytes >= 0 && len > send_max_bytes)
+    {
+        return send_max_bytes;
+    }
     return len;
 }
 
 ssize_t
 recv(int sockfd, void *buf, size_t len, int flags)
 {
+    ((_LSTransportHeader*)buf)->magic = LS_TRANSPORT_HEADER_MAGIC;
     ((_LSTransportHeader*)buf)->type = headertype;
     ((_LSTransportHeader*)buf)->len = headerlen;
 
@@ -459,7 +471,7 @@ test_LSTransportLifespan_execute(const char *service_name, int number_of_connect
     }
     expected_message_types = typelist;
 
-    int expected_calls_to_connectclient = use_shm ? 3 : 0; /* x3 = localhost, public hub and internet */
+    int expected_calls_to_connectclient = use_shm ? 4 : 0; /* x4 = abstract and path local hub, inet hub and emulator */
     int expected_shm_deinit_count = use_shm ? 1 : 0;
     /*gboolean is_this_hub = (g_strcmp0(service_name, HUB_NAME) == 0);*/
     gboolean expected_connect_success = false; //TODO find a failure case
@@ -718,6 +730,7 @@ test_LSTransportSendMessageMonitorRequest()
     transport->hub->transport = transport;
     transport->hub->outgoing = g_slice_new0(_LSTransportOutgoing);
     transport->hub->outgoing->queue = g_queue_new();
+    transport->hub->channel.fd = -1; /* not connected, messages stay queued */
 
     LSError error;
     LSErrorInit(&error);
@@ -742,6 +755,50 @@ test_LSTransportSendMessageMonitorRequest()
     g_free(transport);
 }
 
+void
+test_LSTransportSendQueryHubTelemetry()
+{
+    clear_counters();
+
+    expected_calls_to_messagesettype = 1;
+    _LSTransportMessageType typelist[1] = {_LSTransportMessageTypeQueryHubTelemetry};
+    expected_message_types = typelist;
+
+    /*First let's create a minimal transport struct for the test.*/
+    _LSTransport *transport = g_new0(_LSTransport, 1);
+    transport->global_token = g_new0(_LSTransportGlobalToken, 1);
+    transport->global_token->value = LSMESSAGE_TOKEN_INVALID;
+    transport->hub = g_slice_new0(_LSTransportClient);
+    transport->hub->transport = transport;
+    transport->hub->outgoing = g_slice_new0(_LSTransportOutgoing);
+    transport->hub->outgoing->queue = g_queue_new();
+    transport->hub->channel.fd = -1; /* not connected, messages stay queued */
+
+    LSError error;
+    LSErrorInit(&error);
+
+    LSMessageToken serial = LSMESSAGE_TOKEN_INVALID;
+
+    /* Test it. */
+    g_assert(LSTransportSendQueryHubTelemetry(transport, &serial, &error));
+    g_assert_cmpint(calls_to_messagesettype, ==, 1);
+    g_assert_cmpint(serial, !=, LSMESSAGE_TOKEN_INVALID);
+    g_assert_cmpint(g_queue_get_length(transport->hub->outgoing->queue), ==, 1);
+    g_assert_cmpint(calls_to_messageunref, ==, calls_to_messageref + calls_to_messagenewref - 1);
+
+    /* Cleanup. */
+    g_free(transport->global_token);
+    while (!g_queue_is_empty(transport->hub->outgoing->queue))
+    {
+        _LSTransportMessage *message = g_queue_pop_head(transport->hub->outgoing->queue);
+        _LSTransportMessageUnref(message);
+    }
+    g_queue_free(transport->hub->outgoing->queue);
+    g_slice_free(_LSTransportOutgoing, transport->hub->outgoing);
+    g_slice_free(_LSTransportClient, transport->hub);
+    g_free(transport);
+}
+
 void
 test_LSTransportCancelMethodCall_execute(char *service_name, int number_of_clients, int number_of_pending, gboolean expected_success)
 {
@@ -762,6 +819,7 @@ test_LSTransportCancelMethodCall_execute(char *service_name, int number_of_clien
     transport->hub->transport = transport;
     transport->hub->outgoing = g_slice_new0(_LSTransportOutgoing);
     transport->hub->outgoing->queue = g_queue_new();
+    transport->hub->channel.fd = -1; /* not connected, messages stay queued */
     transport->unique_name = "TMM!";
 
     //TODO test also with monitor
@@ -781,6 +839,7 @@ test_LSTransportCancelMethodCall_execute(char *service_name, int number_of_clien
         client->incoming->complete_messages = g_queue_new();
         client->outgoing = g_slice_new0(_LSTransportOutgoing);
         client->outgoing->queue = g_queue_new();
+        client->channel.fd = -1;
 
         g_hash_table_insert(transport->clients, g_strdup_printf("key%d", i), client);
     }
@@ -867,6 +926,7 @@ test_LSTransportSendQueryServiceStatus_execute(char *service_name)
     transport->hub->transport = transport;
     transport->hub->outgoing = g_slice_new0(_LSTransportOutgoing);
     transport->hub->outgoing->queue = g_queue_new();
+    transport->hub->channel.fd = -1; /* not connected, messages stay queued */
     transport->unique_name = "TMM!";
 
     LSMessageToken serial = 11111;
@@ -1007,6 +1067,149 @@ test_LSTransportSendClient()
     sendfd_success = true;
 }
 
+void
+test_LSTransportSendMessageImmediate()
+{
+    clear_counters();
+
+    /*First let's create a minimal transport struct for the test.*/
+    _LSTransport *transport = g_new0(_LSTransport, 1);
+    transport->global_token = g_new0(_LSTransportGlobalToken, 1);
+    transport->global_token->value = LSMESSAGE_TOKEN_INVALID;
+
+    _LSTransportClient *client = g_slice_new0(_LSTransportClient);
+    client->transport = transport;
+    client->channel.fd = 100; /* send() is mocked */
+    client->outgoing = g_slice_new0(_LSTransportOutgoing);
+    client->outgoing->queue = g_queue_new();
+
+    LSError error;
+    LSErrorInit(&error);
+
+    _LSTransportMessage *first = _LSTransportMessageNewRef(20);
+    _LSTransportMessage *second = _LSTransportMessageNewRef(20);
+    _LSTransportMessage *third = _LSTransportMessageNewRef(20);
+    unsigned long total_len = 20 + sizeof(_LSTransportHeader);
+    first->raw->header.type = _LSTransportMessageTypeReply;
+    second->raw->header.type = _LSTransportMessageTypeReply;
+    third->raw->header.type = _LSTransportMessageTypeReply;
+
+    /* Test: empty queue, the whole message is written right away */
+    g_assert(_LSTransportSendMessage(first, client, NULL, &error));
+    g_assert_cmpint(calls_to_send, ==, 1);
+    g_assert(g_queue_is_empty(client->outgoing->queue));
+    g_assert_cmpint(first->ref, ==, 1);
+
+    /* Test: partial write, only the tail is left on the queue */
+    send_max_bytes = 4;
+    g_assert(_LSTransportSendMessage(second, client, NULL, &error));
+    g_assert_cmpint(calls_to_send, ==, 2);
+    g_assert_cmpint(g_queue_get_length(client->outgoing->queue), ==, 1);
+    g_assert_cmpint(second->tx_bytes_remaining, ==, total_len - 4);
+    g_assert_cmpint(second->ref, ==, 2);
+
+    /* Test: queue not empty, nothing is written and a prepended message
+     * doesn't cut into the partially written one */
+    g_assert(_LSTransportSendMessagePrepend(third, client, NULL, &error));
+    g_assert_cmpint(calls_to_send, ==, 2);
+    g_assert_cmpint(g_queue_get_length(client->outgoing->queue), ==, 2);
+    g_assert(g_queue_peek_head(client->outgoing->queue) == second);
+    g_assert(g_queue_peek_tail(client->outgoing->queue) == third);
+    g_assert_cmpint(third->tx_bytes_remaining, ==, total_len);
+    send_max_bytes = -1;
+
+    /* Cleanup. */
+    while (!g_queue_is_empty(client->outgoing->queue))
+    {
+        _LSTransportMessage *message = g_queue_pop_head(client->outgoing->queue);
+        _LSTransportMessageUnref(message);
+    }
+    _LSTransportMessageUnref(first);
+    _LSTransportMessageUnref(second);
+    _LSTransportMessageUnref(third);
+    g_assert_cmpint(calls_to_messageunref, ==, calls_to_messagenewref + calls_to_messageref);
+
+    g_queue_free(client->outgoing->queue);
+    g_slice_free(_LSTransportOutgoing, client->outgoing);
+    g_slice_free(_LSTransportClient, client);
+    g_free(transport->global_token);
+    g_free(transport);
+}
+
+void
+test_LSTransportHandleIncomingConnection()
+{
+    clear_counters();
+
+    LSHandle sh;
+    LSTransportHandlers handlers;
+    handlers.msg_handler = MessageHandler;
+    handlers.msg_context = &sh;
+    handlers.disconnect_handler = DisconnectHandler;
+    handlers.disconnect_context = &sh;
+    handlers.message_failure_handler = FailureHandler;
+    handlers.message_failure_context = &sh;
+
+    LSError error;
+    LSErrorInit(&error);
+
+    g_assert(_LSTransportInit(&this_transport, "huuhaa", &handlers, &error));
+    this_transport->mainloop_context = g_main_context_new();
+
+    _LSTransportClient *hub = g_slice_new0(_LSTransportClient);
+    hub->transport = this_transport;
+    hub->ref = 1;
+    this_transport->hub = hub;
+
+    _LSTransportClient *other = g_slice_new0(_LSTransportClient);
+    other->transport = this_transport;
+    other->ref = 1;
+
+    int pair[2];
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), ==, 0);
+
+    /* Test: a connection passed by anybody but the hub is refused (errors
+     * are fatal here) */
+    _LSTransportMessage *message = _LSTransportMessageNewRef(0);
+    _LSTransportMessageSetClient(message, other);
+    _LSTransportMessageSetConnectionFd(message, pair[0]);
+
+    if (g_test_trap_fork(1000000, G_TEST_TRAP_SILENCE_STDOUT | G_TEST_TRAP_SILENCE_STDERR))
+    {
+        _LSTransportHandleIncomingConnection(message);
+        exit(0);
+    }
+    g_test_trap_assert_failed();
+    g_test_trap_assert_stderr("*Connection not passed by the hub*");
+
+    _LSTransportMessageSetConnectionFd(message, -1);
+    _LSTransportMessageUnref(message);
+
+    /* Test: the hub's is taken as if we had accepted it */
+    message = _LSTransportMessageNewRef(0);
+    _LSTransportMessageSetClient(message, hub);
+    _LSTransportMessageSetConnectionFd(message, pair[0]);
+
+    _LSTransportHandleIncomingConnection(message);
+
+    g_assert_cmpint(_LSTransportMessageGetConnectionFd(message), ==, -1);
+    _LSTransportClient *accepted = g_hash_table_lookup(this_transport->all_connections, GINT_TO_POINTER(pair[0]));
+    g_assert(accepted != NULL);
+    g_assert_cmpint(accepted->channel.fd, ==, pair[0]);
+    g_assert(accepted->state == _LSTransportClientStateConnected);
+    g_assert(accepted->channel.recv_watch != NULL);
+
+    _LSTransportMessageUnref(message);
+
+    /* Cleanup. */
+    _LSTransportRemoveReceiveWatch(&accepted->channel);
+    g_hash_table_remove(this_transport->all_connections, GINT_TO_POINTER(pair[0]));
+    _LSTransportClientUnref(other);
+    _LSTransportDeinit(this_transport);
+    close(pair[0]);
+    close(pair[1]);
+}
+
 /* Test suite **************************************************************/
 
 int
@@ -1018,9 +1221,12 @@ main(int argc, char *argv[])
     g_test_add_func("/luna-service2/LSTransportSend", test_LSTransportSend);
     g_test_add_func("/luna-service2/LSTransportPushRole", test_LSTransportPushRole);
     g_test_add_func("/luna-service2/LSTransportSendMessageMonitorRequest", test_LSTransportSendMessageMonitorRequest);
+    g_test_add_func("/luna-service2/LSTransportSendQueryHubTelemetry", test_LSTransportSendQueryHubTelemetry);
     g_test_add_func("/luna-service2/LSTransportCancelMethodCall", test_LSTransportCancelMethodCall);
     g_test_add_func("/luna-service2/LSTransportSendQueryServiceStatus", test_LSTransportSendQueryServiceStatus);
     g_test_add_func("/luna-service2/LSTransportSendClient", test_LSTransportSendClient);
+    g_test_add_func("/luna-service2/LSTransportSendMessageImmediate", test_LSTransportSendMessageImmediate);
+    g_test_add_func("/luna-service2/LSTransportHandleIncomingConnection", test_LSTransportHandleIncomingConnection);
 
     return g_test_run();
 }
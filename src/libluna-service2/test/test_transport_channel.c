@@ -18,7 +18,10 @@
 
 
 #include <glib.h>
+#include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include "transport.h"
 #include "transport_priv.h"
 
@@ -32,6 +35,95 @@ static const int mvar_priority = G_PRIORITY_DEFAULT_IDLE;
 static int mvar_blockfd_out = 0;
 static bool mvar_blockprev_out = false;
 
+/* Test helpers ***************************************************************/
+
+/* The receiving end of a record based connection */
+static _LSTransportClient*
+test_record_client_new(int fd, bool legacy_wire)
+{
+    _LSTransportClient *client = g_slice_new0(_LSTransportClient);
+    client->ref = 1;
+    client->channel.fd = fd;
+    client->channel.seqpacket = true;
+    client->incoming = _LSTransportIncomingNew();
+    client->incoming->legacy_wire = legacy_wire;
+    client->legacy_wire = legacy_wire;
+
+    return client;
+}
+
+static void
+test_record_client_free(_LSTransportClient *client)
+{
+    g_assert_cmpint(client->ref, ==, 1);
+    _LSTransportIncomingFree(client->incoming);
+    g_slice_free(_LSTransportClient, client);
+}
+
+static _LSTransportMessage*
+test_method_call_new(const char *payload)
+{
+    const char *fields[] = { "/a", "b", payload, "c" };
+    size_t len = 0;
+    int i;
+    for (i = 0; i < G_N_ELEMENTS(fields); i++)
+    {
+        len += strlen(fields[i]) + 1;
+    }
+
+    _LSTransportMessage *message = _LSTransportMessageNewRef(len);
+    char *body = message->raw->data;
+    for (i = 0; i < G_N_ELEMENTS(fields); i++)
+    {
+        strcpy(body, fields[i]);
+        body += strlen(fields[i]) + 1;
+    }
+    message->raw->header.len = len;
+    message->raw->header.type = _LSTransportMessageTypeMethodCall;
+
+    return message;
+}
+
+/* Write a message the way a client does, in records of the largest size */
+static void
+test_record_send(int fd, _LSTransportMessage *message, bool legacy)
+{
+    LSError error;
+    LSErrorInit(&error);
+
+    _LSTransportMessageFrame(message, legacy, false);
+    g_assert(_LSTransportSendWireComplete(fd, LS_TRANSPORT_RECORD_MAX, message, &error));
+}
+
+/* Read a message the way _LSTransportReceiveClient() does: the record that
+ * starts it, then the records with the rest of its body */
+static _LSTransportMessage*
+test_record_receive(_LSTransportClient *client, ssize_t *first_record)
+{
+    _LSTransportIncoming *incoming = client->incoming;
+
+    *first_record = _LSTransportReceiveRecord(client);
+    if (*first_record <= 0)
+    {
+        g_assert(incoming->tmp_msg == NULL);
+        return NULL;
+    }
+
+    _LSTransportMessage *message = incoming->tmp_msg;
+    while (incoming->tmp_msg_offset < message->raw->header.len)
+    {
+        ssize_t ret = recv(client->channel.fd, message->raw->data + incoming->tmp_msg_offset,
+                           message->raw->header.len - incoming->tmp_msg_offset, MSG_DONTWAIT);
+        g_assert_cmpint(ret, >, 0);
+        incoming->tmp_msg_offset += ret;
+    }
+
+    incoming->tmp_msg = NULL;
+    incoming->tmp_msg_offset = 0;
+
+    return message;
+}
+
 /* Test cases *****************************************************************/
 
 static void
@@ -120,6 +212,173 @@ test_LSTransportChannelPositive(void)
     unlink(tmpfilename);
 }
 
+static void
+test_LSTransportChannelRecords(void)
+{
+    int pair[2];
+
+    /* case: a stream channel takes writes of any size. */
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), ==, 0);
+    _LSTransportChannelInit(&mvar_transport, &mvar_channel, pair[0], mvar_priority);
+    g_assert(!mvar_channel.seqpacket);
+    g_assert_cmpuint(_LSTransportChannelGetRecordMax(&mvar_channel), ==, 0);
+    _LSTransportChannelDeinit(&mvar_channel);
+    close(pair[0]);
+    close(pair[1]);
+
+    /* case: a record based channel is recognized... */
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair), ==, 0);
+    _LSTransportChannelInit(&mvar_transport, &mvar_channel, pair[0], mvar_priority);
+    g_assert(mvar_channel.seqpacket);
+    g_assert_cmpuint(_LSTransportChannelGetRecordMax(&mvar_channel), ==, LS_TRANSPORT_RECORD_MAX);
+
+    /* ...and takes a whole record of the largest size at once, read in one go. */
+    char *buf = g_malloc0(LS_TRANSPORT_RECORD_MAX);
+    g_assert_cmpint(send(pair[1], buf, LS_TRANSPORT_RECORD_MAX, MSG_DONTWAIT), ==, LS_TRANSPORT_RECORD_MAX);
+    g_assert_cmpint(recv(pair[0], buf, LS_TRANSPORT_RECORD_MAX, MSG_DONTWAIT), ==, LS_TRANSPORT_RECORD_MAX);
+    g_free(buf);
+
+    _LSTransportChannelDeinit(&mvar_channel);
+    close(pair[0]);
+    close(pair[1]);
+}
+
+static void
+test_LSTransportChannelRecordRoundTrip(void)
+{
+    int pair[2];
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair), ==, 0);
+    _LSTransportClient *client = test_record_client_new(pair[0], false);
+    ssize_t first_record;
+
+    /* case: a small message comes in one record. */
+    _LSTransportMessage *sent = test_method_call_new("{}");
+    test_record_send(pair[1], sent, false);
+
+    _LSTransportMessage *received = test_record_receive(client, &first_record);
+    g_assert(received != NULL);
+    g_assert_cmpint(first_record, ==, sizeof(_LSTransportHeader) + sent->raw->header.len);
+    g_assert(received->client == client);
+    _LSTransportMessageParseBody(received);
+    g_assert_cmpstr(_LSTransportMessageGetCategory(received), ==, "/a");
+    g_assert_cmpstr(_LSTransportMessageGetMethod(received), ==, "b");
+    g_assert_cmpstr(_LSTransportMessageGetPayload(received), ==, "{}");
+    g_assert_cmpstr(_LSTransportMessageGetAppId(received), ==, "c");
+    _LSTransportMessageUnref(received);
+    _LSTransportMessageUnref(sent);
+
+    /* case: a message larger than a record goes on in records of its body. */
+    size_t payload_len = LS_TRANSPORT_RECORD_MAX + LS_TRANSPORT_RECORD_MAX / 2;
+    char *payload = g_malloc(payload_len + 1);
+    memset(payload, 'x', payload_len);
+    payload[payload_len] = '\0';
+
+    sent = test_method_call_new(payload);
+    test_record_send(pair[1], sent, false);
+
+    received = test_record_receive(client, &first_record);
+    g_assert(received != NULL);
+    g_assert_cmpint(first_record, ==, LS_TRANSPORT_RECORD_MAX);
+    g_assert_cmpint(received->raw->header.len, ==, sent->raw->header.len);
+    _LSTransportMessageParseBody(received);
+    g_assert_cmpstr(_LSTransportMessageGetPayload(received), ==, payload);
+    g_assert_cmpstr(_LSTransportMessageGetAppId(received), ==, "c");
+    _LSTransportMessageUnref(received);
+    _LSTransportMessageUnref(sent);
+    g_free(payload);
+
+    /* case: a message without a body is a record of its header. */
+    sent = _LSTransportMessageNewRef(0);
+    _LSTransportMessageSetType(sent, _LSTransportMessageTypeNodeUp);
+    test_record_send(pair[1], sent, false);
+
+    received = test_record_receive(client, &first_record);
+    g_assert(received != NULL);
+    g_assert_cmpint(first_record, ==, sizeof(_LSTransportHeader));
+    g_assert_cmpint(_LSTransportMessageGetType(received), ==, _LSTransportMessageTypeNodeUp);
+    g_assert_cmpint(received->raw->header.len, ==, 0);
+    _LSTransportMessageUnref(received);
+    _LSTransportMessageUnref(sent);
+
+    test_record_client_free(client);
+    close(pair[0]);
+    close(pair[1]);
+}
+
+static void
+test_LSTransportChannelRecordLegacy(void)
+{
+    int pair[2];
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair), ==, 0);
+    _LSTransportClient *client = test_record_client_new(pair[0], true);
+    ssize_t first_record;
+
+    /* case: a peer of protocol version 1 sends the legacy header. */
+    _LSTransportMessage *sent = test_method_call_new("{}");
+    _LSTransportMessageSetToken(sent, 7);
+    test_record_send(pair[1], sent, true);
+
+    _LSTransportMessage *received = test_record_receive(client, &first_record);
+    g_assert(received != NULL);
+    g_assert_cmpint(first_record, ==, sizeof(_LSTransportHeaderV1) + sent->raw->header.len);
+    g_assert_cmpint(_LSTransportMessageGetType(received), ==, _LSTransportMessageTypeMethodCall);
+    g_assert_cmpint(_LSTransportMessageGetToken(received), ==, 7);
+    _LSTransportMessageParseBody(received);
+    g_assert_cmpstr(_LSTransportMessageGetMethod(received), ==, "b");
+    g_assert_cmpstr(_LSTransportMessageGetPayload(received), ==, "{}");
+
+    /* the connection stays on legacy headers */
+    g_assert(client->incoming->legacy_wire);
+
+    _LSTransportMessageUnref(received);
+    _LSTransportMessageUnref(sent);
+
+    test_record_client_free(client);
+    close(pair[0]);
+    close(pair[1]);
+}
+
+static void
+test_LSTransportChannelRecordTruncated(void)
+{
+    int pair[2];
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair), ==, 0);
+    _LSTransportClient *client = test_record_client_new(pair[0], false);
+    ssize_t first_record;
+
+    /* case: a record shorter than a header isn't a message. */
+    g_assert_cmpint(send(pair[1], "abc", 3, MSG_DONTWAIT), ==, 3);
+    g_assert(test_record_receive(client, &first_record) == NULL);
+    g_assert_cmpint(first_record, ==, -1);
+    g_assert_cmpint(errno, ==, EPROTO);
+
+    /* the record was only peeked at; the client would be shut down now */
+    char junk[16] = { 0 };
+    g_assert_cmpint(recv(pair[0], junk, sizeof(junk), MSG_DONTWAIT), ==, 3);
+
+    /* case: nor is a record that holds more than its header announces. */
+    _LSTransportMessage *sent = test_method_call_new("{}");
+    _LSTransportMessageFrame(sent, false, false);
+
+    struct iovec iov[2] = {
+        { .iov_base = sent->raw, .iov_len = sizeof(_LSTransportHeader) + sent->raw->header.len },
+        { .iov_base = junk, .iov_len = sizeof(junk) }
+    };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = G_N_ELEMENTS(iov) };
+    g_assert_cmpint(sendmsg(pair[1], &msg, MSG_DONTWAIT), ==, iov[0].iov_len + iov[1].iov_len);
+
+    g_assert(test_record_receive(client, &first_record) == NULL);
+    g_assert_cmpint(first_record, ==, -1);
+    g_assert_cmpint(errno, ==, EPROTO);
+    g_assert_cmpint(client->ref, ==, 1);
+
+    _LSTransportMessageUnref(sent);
+
+    test_record_client_free(client);
+    close(pair[0]);
+    close(pair[1]);
+}
+
 /* Mocks **********************************************************************/
 
 void
@@ -176,6 +435,14 @@ main(int argc, char *argv[])
 
     g_test_add_func("/luna-service2/LSTransportChannelPositive",
                      test_LSTransportChannelPositive);
+    g_test_add_func("/luna-service2/LSTransportChannelRecords",
+                     test_LSTransportChannelRecords);
+    g_test_add_func("/luna-service2/LSTransportChannelRecordRoundTrip",
+                     test_LSTransportChannelRecordRoundTrip);
+    g_test_add_func("/luna-service2/LSTransportChannelRecordLegacy",
+                     test_LSTransportChannelRecordLegacy);
+    g_test_add_func("/luna-service2/LSTransportChannelRecordTruncated",
+                     test_LSTransportChannelRecordTruncated);
 
     return g_test_run();
 }
@@ -20,9 +20,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <locale.h>
+#include <unistd.h>
+#include <sys/socket.h>
 #include <glib.h>
 #include <transport_message.h>
 #include <transport.h>
+#include <transport_compress.h>
 
 /* Test data ******************************************************************/
 
@@ -217,6 +220,328 @@ test_LSTransportMessageFromVectorNewRef(TestData *fixture, gconstpointer user_da
     _LSTransportMessageUnref(msg);
 }
 
+static void
+test_LSTransportMessageFrame(TestData *fixture, gconstpointer user_data)
+{
+    _LSTransportMessage *msg = fixture->msg;
+    unsigned long len = formatTransportMessageMethodCallBuffer(msg->raw->data, "/a", "b", "{}", "c", NULL, NULL);
+    msg->raw->header.len = len;
+    msg->raw->header.type = _LSTransportMessageTypeMethodCall;
+    _LSTransportMessageSetToken(msg, 7);
+
+    struct iovec iov[3];
+
+    /* current layout: the raw message as is, with the field table filled in */
+    _LSTransportMessageFrame(msg, false, false);
+    g_assert_cmpint(msg->tx_bytes_remaining, ==, sizeof(_LSTransportHeader) + len);
+    g_assert(!_LSTransportMessageIsSendStarted(msg));
+    g_assert_cmpint(_LSTransportMessageGetWireVector(msg, iov), ==, 1);
+    g_assert(iov[0].iov_base == (void*)msg->raw);
+    g_assert_cmpint(iov[0].iov_len, ==, sizeof(_LSTransportHeader) + len);
+
+    const _LSTransportHeader *header = _LSTransportMessageGetHeader(msg);
+    g_assert(!_LSTransportHeaderIsV1(header));
+    g_assert(header->flags & _LSTransportHeaderFlagFields);
+    g_assert_cmpint(header->fields[_LSTransportFieldCategory].offset, ==, 0);
+    g_assert_cmpint(header->fields[_LSTransportFieldCategory].len, ==, 2);
+    g_assert_cmpint(header->fields[_LSTransportFieldMethod].offset, ==, 3);
+    g_assert_cmpint(header->fields[_LSTransportFieldPayload].offset, ==, 5);
+    g_assert_cmpint(header->fields[_LSTransportFieldAppId].offset, ==, 8);
+    g_assert_cmpint(header->fields[_LSTransportFieldMonitor].len, ==, LS_TRANSPORT_FIELD_ABSENT);
+
+    /* the receiver takes the fields from the table */
+    _LSTransportMessage *received = _LSTransportMessageFromVectorNewRef(iov, 1, iov[0].iov_len);
+    _LSTransportMessageParseBody(received);
+    g_assert_cmpstr(_LSTransportMessageGetCategory(received), ==, "/a");
+    g_assert_cmpstr(_LSTransportMessageGetMethod(received), ==, "b");
+    g_assert_cmpstr(_LSTransportMessageGetPayload(received), ==, "{}");
+    g_assert_cmpstr(_LSTransportMessageGetAppId(received), ==, "c");
+    _LSTransportMessageUnref(received);
+
+    /* legacy layout: the legacy header, then the body */
+    _LSTransportMessageFrame(msg, true, false);
+    g_assert_cmpint(msg->tx_bytes_remaining, ==, sizeof(_LSTransportHeaderV1) + len);
+    g_assert_cmpint(_LSTransportMessageGetWireVector(msg, iov), ==, 2);
+    g_assert_cmpint(iov[0].iov_len, ==, sizeof(_LSTransportHeaderV1));
+    g_assert(iov[1].iov_base == (void*)msg->raw->data);
+    g_assert_cmpint(iov[1].iov_len, ==, len);
+
+    const _LSTransportHeaderV1 *header_v1 = iov[0].iov_base;
+    g_assert(_LSTransportHeaderIsV1(header_v1));
+    g_assert_cmpint(header_v1->len, ==, len);
+    g_assert_cmpint(header_v1->token, ==, 7);
+    g_assert_cmpint(header_v1->type, ==, _LSTransportMessageTypeMethodCall);
+
+    /* partially written */
+    msg->tx_bytes_remaining -= 4;
+    g_assert(_LSTransportMessageIsSendStarted(msg));
+    g_assert_cmpint(_LSTransportMessageGetWireVector(msg, iov), ==, 2);
+    g_assert_cmpint(iov[0].iov_len, ==, sizeof(_LSTransportHeaderV1) - 4);
+
+    msg->tx_bytes_remaining = len - 1;
+    g_assert_cmpint(_LSTransportMessageGetWireVector(msg, iov), ==, 1);
+    g_assert(iov[0].iov_base == (void*)(msg->raw->data + 1));
+    g_assert_cmpint(iov[0].iov_len, ==, len - 1);
+
+    /* a received legacy header is brought to the current layout */
+    _LSTransportHeader converted;
+    _LSTransportHeaderFromV1(&converted, header_v1);
+    g_assert(!_LSTransportHeaderIsV1(&converted));
+    g_assert_cmpint(converted.len, ==, len);
+    g_assert_cmpint(converted.token, ==, 7);
+    g_assert_cmpint(converted.type, ==, _LSTransportMessageTypeMethodCall);
+    g_assert_cmpint(converted.flags, ==, 0);
+}
+
+static void
+test_LSTransportMessageFromVectorShared(TestData *fixture, gconstpointer user_data)
+{
+    static const char payload[] = "{\"returnValue\":true}";
+    GBytes *shared = g_bytes_new(payload, sizeof(payload));
+
+    LSMessageToken reply_token = 7;
+    _LSTransportHeader header;
+    _LSTransportHeaderInit(&header, _LSTransportMessageTypeReply, sizeof(reply_token) + sizeof(payload));
+    header.reply_token = reply_token;
+    _LSTransportHeaderSetField(&header, _LSTransportFieldPayload, sizeof(reply_token), sizeof(payload) - 1);
+
+    struct iovec head[2] =
+    {
+        { .iov_base = &header, .iov_len = sizeof(header) },
+        { .iov_base = &reply_token, .iov_len = sizeof(reply_token) }
+    };
+
+    /* only the header and the reply token are copied */
+    _LSTransportMessage *msg = _LSTransportMessageFromVectorSharedNewRef(head, 2, shared);
+    g_assert_cmpint(msg->ref, ==, 1);
+    g_assert_cmpint(msg->alloc_body_size, ==, sizeof(reply_token));
+
+    const unsigned long len = sizeof(reply_token) + sizeof(payload);
+    struct iovec iov[3];
+
+    _LSTransportMessageFrame(msg, false, true);
+    g_assert(msg->wire_raw == NULL);
+    g_assert_cmpint(_LSTransportMessageGetWireSize(msg), ==, sizeof(_LSTransportHeader) + len);
+    g_assert_cmpint(_LSTransportMessageGetWireVector(msg, iov), ==, 2);
+    g_assert(iov[0].iov_base == (void*)msg->raw);
+    g_assert_cmpint(iov[0].iov_len, ==, sizeof(_LSTransportHeader) + sizeof(reply_token));
+    g_assert(iov[1].iov_base == g_bytes_get_data(shared, NULL));
+    g_assert_cmpint(iov[1].iov_len, ==, sizeof(payload));
+
+    /* the receiver gets a plain reply */
+    char wire[sizeof(_LSTransportHeader) + len];
+    memcpy(wire, iov[0].iov_base, iov[0].iov_len);
+    memcpy(wire + iov[0].iov_len, iov[1].iov_base, iov[1].iov_len);
+    struct iovec wire_iov = { .iov_base = wire, .iov_len = sizeof(wire) };
+    _LSTransportMessage *received = _LSTransportMessageFromVectorNewRef(&wire_iov, 1, sizeof(wire));
+    g_assert_cmpint(_LSTransportMessageGetReplyToken(received), ==, reply_token);
+    g_assert_cmpstr(_LSTransportMessageGetPayload(received), ==, payload);
+    _LSTransportMessageUnref(received);
+
+    /* legacy layout */
+    _LSTransportMessageFrame(msg, true, false);
+    g_assert_cmpint(_LSTransportMessageGetWireVector(msg, iov), ==, 3);
+    g_assert_cmpint(iov[0].iov_len, ==, sizeof(_LSTransportHeaderV1));
+    g_assert(iov[1].iov_base == (void*)msg->raw->data);
+    g_assert_cmpint(iov[1].iov_len, ==, sizeof(reply_token));
+    g_assert_cmpint(iov[2].iov_len, ==, sizeof(payload));
+
+    /* partially written */
+    msg->tx_bytes_remaining = sizeof(payload) - 1;
+    g_assert(_LSTransportMessageIsSendStarted(msg));
+    g_assert_cmpint(_LSTransportMessageGetWireVector(msg, iov), ==, 1);
+    g_assert(iov[0].iov_base == (char*)g_bytes_get_data(shared, NULL) + 1);
+    g_assert_cmpint(iov[0].iov_len, ==, sizeof(payload) - 1);
+
+    _LSTransportMessageUnref(msg);
+    g_bytes_unref(shared);
+}
+
+static void
+test_LSTransportMessageFieldsValid(TestData *fixture, gconstpointer user_data)
+{
+    _LSTransportMessage *msg = fixture->msg;
+    unsigned long len = formatTransportMessageMethodCallBuffer(msg->raw->data, "/a", "b", "{}", "c", NULL, NULL);
+    msg->raw->header.len = len;
+    msg->raw->header.type = _LSTransportMessageTypeMethodCall;
+
+    _LSTransportMessageFrame(msg, false, false);
+
+    struct iovec iov[3];
+    g_assert_cmpint(_LSTransportMessageGetWireVector(msg, iov), ==, 1);
+    _LSTransportMessage *received = _LSTransportMessageFromVectorNewRef(iov, 1, iov[0].iov_len);
+    _LSTransportHeader *header = _LSTransportMessageGetHeader(received);
+    g_assert(_LSTransportHeaderFieldsAreValid(header));
+
+    /* a field beyond the body */
+    _LSTransportHeader bad = *header;
+    bad.fields[_LSTransportFieldAppId].offset = len;
+    g_assert(!_LSTransportHeaderFieldsAreValid(&bad));
+
+    bad = *header;
+    bad.fields[_LSTransportFieldPayload].len = UINT32_MAX - 1;
+    g_assert(!_LSTransportHeaderFieldsAreValid(&bad));
+
+    /* the payload ahead of the method */
+    bad = *header;
+    bad.fields[_LSTransportFieldPayload].offset = 0;
+    bad.fields[_LSTransportFieldPayload].len = 2;
+    g_assert(!_LSTransportHeaderFieldsAreValid(&bad));
+
+    /* a gap: the payload without the method */
+    bad = *header;
+    bad.fields[_LSTransportFieldMethod].len = LS_TRANSPORT_FIELD_ABSENT;
+    g_assert(!_LSTransportHeaderFieldsAreValid(&bad));
+
+    /* trailing fields may be absent */
+    bad = *header;
+    bad.fields[_LSTransportFieldAppId].len = LS_TRANSPORT_FIELD_ABSENT;
+    g_assert(_LSTransportHeaderFieldsAreValid(&bad));
+
+    /* an invalid table isn't trusted, the body is scanned instead */
+    header->fields[_LSTransportFieldPayload].offset = 0;
+    header->fields[_LSTransportFieldPayload].len = 2;
+    _LSTransportMessageParseBody(received);
+    g_assert_cmpstr(_LSTransportMessageGetMethod(received), ==, "b");
+    g_assert_cmpstr(_LSTransportMessageGetPayload(received), ==, "{}");
+    g_assert_cmpstr(_LSTransportMessageGetAppId(received), ==, "c");
+
+    _LSTransportMessageUnref(received);
+}
+
+static void
+test_LSTransportMessageCompress(TestData *fixture, gconstpointer user_data)
+{
+    if (_LSTransportCompressGetCodec() == _LSTransportCodecNone)
+        return;
+
+    /* compressible payload above the threshold */
+    size_t payload_len = _LSTransportCompressGetThreshold() + 4096;
+    char *payload = g_malloc(payload_len + 1);
+    size_t i;
+    for (i = 0; i < payload_len; i++)
+    {
+        payload[i] = "{\"key\":\"value\"}"[i % 15];
+    }
+    payload[payload_len] = '\0';
+
+    _LSTransportMessage *msg = _LSTransportMessageNewRef(payload_len + 64);
+    unsigned long len = formatTransportMessageMethodCallBuffer(msg->raw->data, "/a", "b", payload, "c", NULL, NULL);
+    msg->raw->header.len = len;
+    msg->raw->header.type = _LSTransportMessageTypeMethodCall;
+
+    /* a peer that doesn't decompress gets the payload as it is */
+    _LSTransportMessageFrame(msg, false, false);
+    g_assert_cmpint(_LSTransportMessageGetWireSize(msg), ==, sizeof(_LSTransportHeader) + len);
+
+    /* a peer that does gets it compressed, the fields behind it moved */
+    struct iovec iov[3];
+    _LSTransportMessageFrame(msg, false, true);
+    g_assert_cmpint(_LSTransportMessageGetWireSize(msg), <, sizeof(_LSTransportHeader) + len);
+    g_assert_cmpint(_LSTransportMessageGetWireVector(msg, iov), ==, 1);
+
+    _LSTransportMessage *received = _LSTransportMessageFromVectorNewRef(iov, 1, iov[0].iov_len);
+    const _LSTransportHeader *header = _LSTransportMessageGetHeader(received);
+    g_assert(header->flags & _LSTransportHeaderFlagCompressed);
+    g_assert_cmpint(header->inflated_len, ==, payload_len);
+
+    _LSTransportMessageParseBody(received);
+    g_assert_cmpstr(_LSTransportMessageGetCategory(received), ==, "/a");
+    g_assert_cmpstr(_LSTransportMessageGetMethod(received), ==, "b");
+    g_assert_cmpstr(_LSTransportMessageGetAppId(received), ==, "c");
+
+    /* decompressed once, on demand */
+    const char *inflated = _LSTransportMessageGetPayload(received);
+    g_assert_cmpstr(inflated, ==, payload);
+    g_assert(_LSTransportMessageGetPayload(received) == inflated);
+
+    /* forwarded to a legacy peer, it's decompressed on the wire */
+    _LSTransportMessageFrame(received, true, false);
+    g_assert_cmpint(_LSTransportMessageGetWireSize(received), ==, sizeof(_LSTransportHeaderV1) + len);
+    g_assert(_LSTransportMessageIsFramedFor(received, true, false));
+    g_assert(!_LSTransportMessageIsFramedFor(received, false, true));
+
+    _LSTransportMessageUnref(received);
+
+    /* a claimed size beyond any message isn't allocated */
+    received = _LSTransportMessageFromVectorNewRef(iov, 1, iov[0].iov_len);
+    _LSTransportMessageGetHeader(received)->inflated_len = MAX_MESSAGE_SIZE_BYTES + 1;
+    _LSTransportMessageParseBody(received);
+    g_assert(_LSTransportMessageGetPayload(received) == NULL);
+
+    _LSTransportMessageUnref(received);
+    _LSTransportMessageUnref(msg);
+
+    /* incompressible payloads are sent as they are */
+    for (i = 0; i < payload_len; i++)
+    {
+        payload[i] = 1 + g_random_int_range(0, 255);
+    }
+
+    msg = _LSTransportMessageNewRef(payload_len + 64);
+    len = formatTransportMessageMethodCallBuffer(msg->raw->data, "/a", "b", payload, "c", NULL, NULL);
+    msg->raw->header.len = len;
+    msg->raw->header.type = _LSTransportMessageTypeMethodCall;
+
+    _LSTransportMessageFrame(msg, false, true);
+    g_assert_cmpint(_LSTransportMessageGetWireSize(msg), ==, sizeof(_LSTransportHeader) + len);
+
+    _LSTransportMessageUnref(msg);
+    g_free(payload);
+}
+
+static void
+test_LSTransportMessageClientInfoFd(TestData *fixture, gconstpointer user_data)
+{
+    int pair[2];
+    g_assert_cmpint(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), ==, 0);
+
+    /* the hub introduces a client that registered with version 4 */
+    LSError error;
+    LSErrorInit(&error);
+    g_assert(_LSTransportSendClientInfoFd(pair[0], "com.a", "com.a-1", 4, &error));
+
+    /* the service reads a legacy header, then the body */
+    _LSTransportHeaderV1 header_v1;
+    g_assert_cmpint(recv(pair[1], &header_v1, sizeof(header_v1), MSG_DONTWAIT), ==, sizeof(header_v1));
+    g_assert(_LSTransportHeaderIsV1(&header_v1));
+
+    _LSTransportHeader header;
+    _LSTransportHeaderFromV1(&header, &header_v1);
+    g_assert_cmpint(header.type, ==, _LSTransportMessageTypeClientInfo);
+
+    char *body = g_malloc(header.len);
+    g_assert_cmpint(recv(pair[1], body, header.len, MSG_DONTWAIT), ==, header.len);
+
+    struct iovec iov[2] =
+    {
+        { .iov_base = &header, .iov_len = sizeof(header) },
+        { .iov_base = body, .iov_len = header.len }
+    };
+    _LSTransportMessage *received = _LSTransportMessageFromVectorNewRef(iov, 2, sizeof(header) + header.len);
+
+    /* it names the client, with the client's version rather than the hub's */
+    _LSTransportMessageIter iter;
+    _LSTransportMessageIterInit(received, &iter);
+
+    const char *name = NULL;
+    g_assert(_LSTransportMessageGetString(&iter, &name));
+    g_assert_cmpstr(name, ==, "com.a");
+    _LSTransportMessageIterNext(&iter);
+    g_assert(_LSTransportMessageGetString(&iter, &name));
+    g_assert_cmpstr(name, ==, "com.a-1");
+    _LSTransportMessageIterNext(&iter);
+
+    int32_t protocol_version;
+    g_assert(_LSTransportMessageGetInt32(&iter, &protocol_version));
+    g_assert_cmpint(protocol_version, ==, 4);
+
+    _LSTransportMessageUnref(received);
+    g_free(body);
+    close(pair[0]);
+    close(pair[1]);
+}
+
 static void
 test_LSTransportMessageReset(TestData *fixture, gconstpointer user_data)
 {
@@ -269,9 +594,9 @@ test_LSTransportMessageMiscGetSet(TestData *fixture, gconstpointer user_data)
     _LSTransportMessageSetBody(fixture->msg, body, strlen(body)+1);
     g_assert_cmpstr(_LSTransportMessageGetBody(fixture->msg), ==, body);
 
-    // get/set timeout id
-    _LSTransportMessageSetTimeoutId(fixture->msg, 1);
-    g_assert_cmpint(_LSTransportMessageGetTimeoutId(fixture->msg), ==, 1);
+    // get timeout timer
+    g_assert(_LSTransportMessageGetTimeout(fixture->msg) == &fixture->msg->timeout);
+    g_assert(_LSTransportMessageGetTimeout(fixture->msg)->pprev == NULL);
 
     // get/set connect state
     _LSTransportMessageSetConnectState(fixture->msg, _LSTransportConnectStateOtherFailure);
@@ -899,11 +1224,12 @@ test_LSTransportMessageTypes(TestData *fixture, gconstpointer user_data)
     {
         _LSTransportMessageTypeQueryNameReply,
         _LSTransportMessageTypeRequestNameLocalReply,
-        _LSTransportMessageTypeMonitorConnected
+        _LSTransportMessageTypeMonitorConnected,
+        _LSTransportMessageTypeIncomingConnection
     };
     types = g_array_append_vals(types, connectionfd_types, G_N_ELEMENTS(connectionfd_types));
 
-    for (i=0; i<_LSTransportMessageTypeUnknown+1; ++i)
+    for (i=0; i<_LSTransportMessageTypeIncomingConnection+1; ++i)
     {
         _LSTransportMessageSetType(fixture->msg, i);
 
@@ -1075,6 +1401,11 @@ main(int argc, char *argv[])
     LSTEST_ADD("/luna-service2/LSTransportMessageCopyNewRef", test_LSTransportMessageCopyNewRef);
     LSTEST_ADD("/luna-service2/LSTransportMessageCopy", test_LSTransportMessageCopy);
     LSTEST_ADD("/luna-service2/LSTransportMessageFromVectorNewRef", test_LSTransportMessageFromVectorNewRef);
+    LSTEST_ADD("/luna-service2/LSTransportMessageFrame", test_LSTransportMessageFrame);
+    LSTEST_ADD("/luna-service2/LSTransportMessageFromVectorShared", test_LSTransportMessageFromVectorShared);
+    LSTEST_ADD("/luna-service2/LSTransportMessageFieldsValid", test_LSTransportMessageFieldsValid);
+    LSTEST_ADD("/luna-service2/LSTransportMessageCompress", test_LSTransportMessageCompress);
+    LSTEST_ADD("/luna-service2/LSTransportMessageClientInfoFd", test_LSTransportMessageClientInfoFd);
     LSTEST_ADD("/luna-service2/LSTransportMessageReset", test_LSTransportMessageReset);
     LSTEST_ADD("/luna-service2/LSTransportMessageRefAndUnref", test_LSTransportMessageRefAndUnref);
     LSTEST_ADD("/luna-service2/LSTransportMessageMiscGetSet", test_LSTransportMessageMiscGetSet);
@@ -18,6 +18,7 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 #include <glib.h>
 #include "transport_message.h"
 #include "transport_outgoing.h"
@@ -68,6 +69,121 @@ test_LSTransportOutgoing(void)
     g_assert_cmpint(mvar_serial_freed, !=, 0);
 }
 
+static _LSTransportMessage*
+test_update_new(LSMessageToken reply_token, const char *key)
+{
+    const char payload[] = "{}";
+    _LSTransportMessage *message = _LSTransportMessageNewRef(sizeof(reply_token) + sizeof(payload));
+    char *body = _LSTransportMessageGetBody(message);
+
+    _LSTransportMessageSetType(message, _LSTransportMessageTypeReply);
+    memcpy(body, &reply_token, sizeof(reply_token));
+    memcpy(body + sizeof(reply_token), payload, sizeof(payload));
+    message->update_key = g_strdup(key);
+
+    return message;
+}
+
+static void
+test_LSTransportOutgoingLimits(void)
+{
+    _LSTransportOutgoing *outqueue = _LSTransportOutgoingNew();
+    _LSTransportOutgoingLimits limits = { 2, 0, LSOutgoingPolicyQueue };
+
+    _LSTransportMessage *call = test_update_new(1, NULL);
+    _LSTransportMessage *a1 = test_update_new(1, "/a");
+    _LSTransportMessage *b1 = test_update_new(2, "/a");
+    _LSTransportMessage *a2 = test_update_new(1, "/a");
+    _LSTransportMessage *a3 = test_update_new(1, "/a");
+    unsigned long size = a1->tx_bytes_remaining;
+
+    /* case: counted on the way in and out, past the marks by default */
+    g_assert(_LSTransportOutgoingPushLimited(outqueue, call, &limits, false));
+    g_assert(_LSTransportOutgoingPushLimited(outqueue, a1, &limits, false));
+    g_assert(_LSTransportOutgoingPushLimited(outqueue, b1, &limits, false));
+    g_assert_cmpint(outqueue->stats.messages, ==, 3);
+    g_assert_cmpint(outqueue->stats.bytes, ==, 3 * size);
+    g_assert(_LSTransportOutgoingIsOverLimits(outqueue, &limits, 0, 0));
+
+    g_assert(_LSTransportOutgoingPopHead(outqueue) == call);
+    g_assert_cmpint(outqueue->stats.messages, ==, 2);
+    g_assert_cmpint(outqueue->stats.bytes, ==, 2 * size);
+    g_assert_cmpint(outqueue->stats.peak_messages, ==, 3);
+    g_assert_cmpint(outqueue->stats.peak_bytes, ==, 3 * size);
+
+    /* case: coalesced with the unsent update of the same subscription */
+    limits.policy = LSOutgoingPolicyCoalesce;
+    g_assert(_LSTransportOutgoingPushLimited(outqueue, a2, &limits, false));
+    g_assert_cmpint(g_queue_get_length(outqueue->queue), ==, 2);
+    g_assert(g_queue_peek_head(outqueue->queue) == a2);
+    g_assert(g_queue_peek_tail(outqueue->queue) == b1);
+    g_assert_cmpint(outqueue->stats.coalesced, ==, 1);
+
+    /* case: updates partially on the wire are left alone */
+    a2->tx_bytes_remaining--;
+    g_assert(_LSTransportOutgoingPushLimited(outqueue, a3, &limits, false));
+    g_assert_cmpint(g_queue_get_length(outqueue->queue), ==, 3);
+    g_assert_cmpint(outqueue->stats.coalesced, ==, 1);
+
+    /* case: the oldest unsent updates are dropped, anything else stays */
+    limits.policy = LSOutgoingPolicyDropOldest;
+    call = test_update_new(1, NULL);
+    g_assert(_LSTransportOutgoingPushLimited(outqueue, call, &limits, false));
+    g_assert_cmpint(g_queue_get_length(outqueue->queue), ==, 2);
+    g_assert(g_queue_peek_head(outqueue->queue) == a2);
+    g_assert(g_queue_peek_tail(outqueue->queue) == call);
+    g_assert_cmpint(outqueue->stats.dropped, ==, 2);
+    g_assert_cmpint(outqueue->stats.bytes, ==, 2 * size);
+
+    /* case: past the marks, the peer is to be disconnected */
+    limits.policy = LSOutgoingPolicyDisconnect;
+    g_assert(!_LSTransportOutgoingPushLimited(outqueue, test_update_new(3, "/b"), &limits, false));
+    g_assert_cmpint(g_queue_get_length(outqueue->queue), ==, 3);
+
+    _LSTransportOutgoingFree(outqueue);
+}
+
+static void
+test_LSTransportOutgoingSupersede(void)
+{
+    _LSTransportOutgoing *outqueue = _LSTransportOutgoingNew();
+    _LSTransportOutgoingLimits limits = { 0, 0, LSOutgoingPolicyQueue };
+
+    _LSTransportMessage *a1 = test_update_new(1, "/a");
+    _LSTransportMessage *b1 = test_update_new(2, "/a");
+    _LSTransportMessage *a2 = test_update_new(1, "/a");
+    _LSTransportMessage *a3 = test_update_new(1, "/a");
+    _LSTransportMessage *a4 = test_update_new(1, "/a");
+    a2->update_supersedes = true;
+    a3->update_supersedes = true;
+    unsigned long size = a1->tx_bytes_remaining;
+
+    g_assert(_LSTransportOutgoingPushLimited(outqueue, a1, &limits, false));
+    g_assert(_LSTransportOutgoingPushLimited(outqueue, b1, &limits, false));
+
+    /* case: replaces the unsent update of the same subscriber in place,
+     * without any marks */
+    g_assert(_LSTransportOutgoingPushLimited(outqueue, a2, &limits, false));
+    g_assert_cmpint(g_queue_get_length(outqueue->queue), ==, 2);
+    g_assert(g_queue_peek_head(outqueue->queue) == a2);
+    g_assert(g_queue_peek_tail(outqueue->queue) == b1);
+    g_assert_cmpint(outqueue->stats.coalesced, ==, 1);
+    g_assert_cmpint(outqueue->stats.bytes, ==, 2 * size);
+
+    /* case: updates partially on the wire are left alone */
+    a2->tx_bytes_remaining--;
+    g_assert(_LSTransportOutgoingPushLimited(outqueue, a3, &limits, false));
+    g_assert_cmpint(g_queue_get_length(outqueue->queue), ==, 3);
+    g_assert(g_queue_peek_tail(outqueue->queue) == a3);
+
+    /* case: updates without the mode are queued after it */
+    g_assert(_LSTransportOutgoingPushLimited(outqueue, a4, &limits, false));
+    g_assert_cmpint(g_queue_get_length(outqueue->queue), ==, 4);
+    g_assert_cmpint(outqueue->stats.coalesced, ==, 1);
+
+    _LSTransportOutgoingFree(outqueue);
+}
+
 /* Mocks **********************************************************************/
 
 _LSTransportSerial*
@@ -106,6 +222,10 @@ main(int argc, char *argv[])
 
     g_test_add_func("/luna-service2/LSTransportOutgoing",
                     test_LSTransportOutgoing);
+    g_test_add_func("/luna-service2/LSTransportOutgoingLimits",
+                    test_LSTransportOutgoingLimits);
+    g_test_add_func("/luna-service2/LSTransportOutgoingSupersede",
+                    test_LSTransportOutgoingSupersede);
 
     return g_test_run();
 }
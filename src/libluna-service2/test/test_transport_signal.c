@@ -192,6 +192,74 @@ test_LSTransportServiceStatusSignalGetServiceName(TestData *fixture, gconstpoint
     _LSTransportMessageUnref(msg);
 }
 
+static void
+test_LSTransportMessageServiceStatusSignalNewRef(TestData *fixture, gconstpointer user_data)
+{
+    _LSTransportServiceStatus status;
+
+    /* odd lengths, so that the fields need padding */
+    _LSTransportMessage *msg = LSTransportMessageServiceStatusSignalNewRef("com.name.service", "com.name.service.x",
+                                                                           42, "\"com.name.service\"", true);
+    g_assert(NULL != msg);
+    g_assert_cmpint(_LSTransportMessageGetType(msg), ==, _LSTransportMessageTypeServiceUpSignal);
+    g_assert_cmpstr(_LSTransportMessageGetCategory(msg), ==, SERVICE_STATUS_CATEGORY);
+    g_assert_cmpstr(_LSTransportMessageGetMethod(msg), ==, "com.name.service");
+    g_assert_cmpstr(_LSTransportMessageGetPayload(msg), ==, "");
+
+    g_assert(LSTransportServiceStatusSignalGetStatus(msg, &status));
+    g_assert_cmpstr(status.service_name, ==, "com.name.service");
+    g_assert_cmpstr(status.unique_name, ==, "com.name.service.x");
+    g_assert_cmpint(status.pid, ==, 42);
+    g_assert_cmpstr(status.all_names, ==, "\"com.name.service\"");
+    g_assert(status.connected);
+
+    char *service_name = LSTransportServiceStatusSignalGetServiceName(msg);
+    g_assert_cmpstr(service_name, ==, "com.name.service");
+    g_free(service_name);
+
+    char *payload = LSTransportServiceStatusSignalGetPayload(msg);
+    char *expected = g_strdup_printf(SERVICE_STATUS_UP_PAYLOAD, "com.name.service", "com.name.service.x",
+                                     42, "\"com.name.service\"");
+    g_assert_cmpstr(payload, ==, expected);
+    g_free(expected);
+
+    /* JSON form for the older clients */
+    _LSTransportMessage *legacy = LSTransportMessageServiceStatusSignalLegacyNewRef(msg);
+    g_assert(NULL != legacy);
+    g_assert_cmpint(_LSTransportMessageGetType(legacy), ==, _LSTransportMessageTypeServiceUpSignal);
+    g_assert_cmpstr(_LSTransportMessageGetMethod(legacy), ==, "com.name.service");
+    g_assert_cmpstr(_LSTransportMessageGetPayload(legacy), ==, payload);
+    g_assert(!LSTransportServiceStatusSignalGetStatus(legacy, &status));
+    g_assert(NULL == LSTransportServiceStatusSignalGetPayload(legacy));
+    g_assert(NULL == LSTransportMessageServiceStatusSignalLegacyNewRef(legacy));
+
+    service_name = LSTransportServiceStatusSignalGetServiceName(legacy);
+    g_assert_cmpstr(service_name, ==, "com.name.service");
+    g_free(service_name);
+
+    g_free(payload);
+    _LSTransportMessageUnref(legacy);
+    _LSTransportMessageUnref(msg);
+
+    /* going down */
+    msg = LSTransportMessageServiceStatusSignalNewRef("a.b", "c.d", 0, NULL, false);
+    g_assert_cmpint(_LSTransportMessageGetType(msg), ==, _LSTransportMessageTypeServiceDownSignal);
+
+    g_assert(LSTransportServiceStatusSignalGetStatus(msg, &status));
+    g_assert_cmpstr(status.service_name, ==, "a.b");
+    g_assert_cmpstr(status.unique_name, ==, "c.d");
+    g_assert(NULL == status.all_names);
+    g_assert(!status.connected);
+
+    payload = LSTransportServiceStatusSignalGetPayload(msg);
+    expected = g_strdup_printf(SERVICE_STATUS_DOWN_PAYLOAD, "a.b", "c.d");
+    g_assert_cmpstr(payload, ==, expected);
+    g_free(expected);
+    g_free(payload);
+
+    _LSTransportMessageUnref(msg);
+}
+
 /* Mocks *******************************************************************/
 
 bool
@@ -222,6 +290,7 @@ main(int argc, char *argv[])
     LSTEST_ADD("/luna-service2/LSTransportMessageSignalNewRef", test_LSTransportMessageSignalNewRef);
     LSTEST_ADD("/luna-service2/LSTransportSendSignal", test_LSTransportSendSignal);
     LSTEST_ADD("/luna-service2/LSTransportServiceStatusSignalGetServiceName", test_LSTransportServiceStatusSignalGetServiceName);
+    LSTEST_ADD("/luna-service2/LSTransportMessageServiceStatusSignalNewRef", test_LSTransportMessageServiceStatusSignalNewRef);
 
     return g_test_run();
 }
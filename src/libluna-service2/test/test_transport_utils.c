@@ -18,10 +18,15 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <unistd.h>
+#include <transport.h>
 #include <transport_utils.h>
 
+#define TEST_CONNECTS   2000
+
 /* Test data ******************************************************************/
 
 static bool test_sigusr1_handled = false;
@@ -127,6 +132,94 @@ test_LSTransportFdSetBlockAndNonBlock()
     unlink(templ);
 }
 
+static void
+test_LSTransportSockaddrLocal()
+{
+    struct sockaddr_un addr;
+
+    g_assert(!_LSTransportIsAbstractName("/tmp/com.palm.public_hub"));
+    g_assert(_LSTransportIsAbstractName("@com.palm.public_hub"));
+    g_assert(!_LSTransportIsAbstractName(NULL));
+
+    /* paths take the whole address */
+    g_assert_cmpuint(_LSTransportSockaddrLocal("/tmp/com.palm.public_hub", &addr), ==, sizeof(addr));
+    g_assert_cmpint(addr.sun_family, ==, AF_UNIX);
+    g_assert_cmpstr(addr.sun_path, ==, "/tmp/com.palm.public_hub");
+
+    /* abstract names start with a zero and take only their length */
+    g_assert_cmpuint(_LSTransportSockaddrLocal("@com.palm.public_hub", &addr), ==,
+                     offsetof(struct sockaddr_un, sun_path) + 1 + strlen("com.palm.public_hub"));
+    g_assert_cmpint(addr.sun_path[0], ==, '\0');
+    g_assert(memcmp(addr.sun_path + 1, "com.palm.public_hub", strlen("com.palm.public_hub")) == 0);
+
+    /* too long a name is cut at the size of the address */
+    char *name = g_strnfill(2 * sizeof(addr.sun_path), 'a');
+    name[0] = LS_TRANSPORT_ABSTRACT_PREFIX;
+    g_assert_cmpuint(_LSTransportSockaddrLocal(name, &addr), ==, sizeof(addr));
+    g_free(name);
+}
+
+/* connect to the listener and accept the connection, count times */
+static double
+test_connect_local(const char *name, int count)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    int listen_fd = -1;
+    g_assert(_LSTransportListenLocal(name, S_IRUSR | S_IWUSR, &listen_fd, &lserror));
+
+    g_test_timer_start();
+
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        int fd = -1;
+        g_assert_cmpint(_LSTransportConnectLocal(name, true, &fd, &lserror), ==, _LSTransportConnectStateNoError);
+
+        int accepted_fd = accept(listen_fd, NULL, NULL);
+        g_assert_cmpint(accepted_fd, >=, 0);
+
+        close(accepted_fd);
+        close(fd);
+    }
+
+    double elapsed = g_test_timer_elapsed();
+
+    close(listen_fd);
+    if (!_LSTransportIsAbstractName(name))
+    {
+        g_unlink(name);
+    }
+
+    return elapsed;
+}
+
+static void
+test_LSTransportConnectLocalPerf()
+{
+    if (!g_test_perf())
+        return;
+
+    char *path = g_build_filename(g_get_tmp_dir(), "test_transport_utils.XXXXXX", NULL);
+    int fd = g_mkstemp(path);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+
+    char *abstract = g_strdup_printf("%c%s", LS_TRANSPORT_ABSTRACT_PREFIX, path);
+
+    double by_path = test_connect_local(path, TEST_CONNECTS);
+    double by_abstract = test_connect_local(abstract, TEST_CONNECTS);
+
+    g_test_message("%d connects: path %.2f us, abstract %.2f us per connect",
+                   TEST_CONNECTS, by_path * 1e6 / TEST_CONNECTS, by_abstract * 1e6 / TEST_CONNECTS);
+    g_test_minimized_result(by_abstract * 1e6 / TEST_CONNECTS, "abstract connect %.2f us",
+                            by_abstract * 1e6 / TEST_CONNECTS);
+
+    g_free(abstract);
+    g_free(path);
+}
+
 /* Test suite *****************************************************************/
 
 int
@@ -139,6 +232,8 @@ main(int argc, char *argv[])
     g_test_add_func("/luna-service2/DumpHashItemTable", test_DumpHashItemTable);
     g_test_add_func("/luna-service2/test_LSTransportSetupSignalHandler", test_LSTransportSetupSignalHandler);
     g_test_add_func("/luna-service2/LSTransportFdSetBlockAndNonBlock", test_LSTransportFdSetBlockAndNonBlock);
+    g_test_add_func("/luna-service2/LSTransportSockaddrLocal", test_LSTransportSockaddrLocal);
+    g_test_add_func("/luna-service2/LSTransportConnectLocalPerf", test_LSTransportConnectLocalPerf);
 
     return g_test_run();
 }
@@ -0,0 +1,298 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include <string.h>
+#include <glib.h>
+#include <base.h>
+#include <message.h>
+#include <worker_pool.h>
+
+#define TEST_WORKERS    2
+#define TEST_MESSAGES   8
+
+/* Test data ******************************************************************/
+
+typedef struct TestData
+{
+    LSHandle sh;
+    LSCategoryTable category;
+    LSMethodEntry method;
+    GMainContext *contexts[TEST_WORKERS];
+
+    LSMessage messages[TEST_MESSAGES];
+
+    // order in which the method handler saw the messages
+    GPtrArray *handled;
+    // results reported by the workers
+    int results[TEST_MESSAGES];
+} TestData;
+
+static TestData *test_data = NULL;
+
+static bool
+test_method(LSHandle *sh, LSMessage *message, void *ctx)
+{
+    g_assert(sh == &test_data->sh);
+    g_assert(ctx == test_data);
+    g_ptr_array_add(test_data->handled, message);
+    return true;
+}
+
+static unsigned int
+test_key(LSHandle *sh, LSMessage *message, void *ctx)
+{
+    g_assert(ctx == test_data);
+    /* even messages go to worker 0, odd ones to worker 1 */
+    return message - test_data->messages;
+}
+
+static void
+test_setup(TestData *fixture, gconstpointer user_data)
+{
+    test_data = fixture;
+    memset(fixture, 0, sizeof(*fixture));
+
+    fixture->category.category_user_data = fixture;
+    fixture->method.function = test_method;
+    fixture->handled = g_ptr_array_new();
+
+    int i;
+    for (i = 0; i < TEST_WORKERS; i++)
+    {
+        fixture->contexts[i] = g_main_context_new();
+    }
+    for (i = 0; i < TEST_MESSAGES; i++)
+    {
+        fixture->messages[i].ref = 1;
+        fixture->messages[i].transport_msg = (_LSTransportMessage *) &fixture->results[i];
+        fixture->results[i] = -1;
+    }
+}
+
+static void
+test_teardown(TestData *fixture, gconstpointer user_data)
+{
+    int i;
+    for (i = 0; i < TEST_WORKERS; i++)
+    {
+        g_main_context_unref(fixture->contexts[i]);
+    }
+    for (i = 0; i < TEST_MESSAGES; i++)
+    {
+        g_assert_cmpint(fixture->messages[i].ref, ==, 1);
+    }
+    g_ptr_array_free(fixture->handled, TRUE);
+
+    test_data = NULL;
+}
+
+static _LSWorkerPool*
+pool_new_dispatch_all(TestData *fixture)
+{
+    _LSWorkerPool *pool = _LSWorkerPoolNew(&fixture->sh, fixture->contexts, TEST_WORKERS,
+                                           test_key, fixture);
+    g_assert(pool);
+
+    int i;
+    for (i = 0; i < TEST_MESSAGES; i++)
+    {
+        _LSWorkerPoolDispatch(pool, &fixture->category, &fixture->method, "com.palm.caller",
+                              &fixture->messages[i]);
+        g_assert_cmpint(fixture->messages[i].ref, ==, 2);
+    }
+
+    /* nothing runs until a worker iterates its context */
+    g_assert_cmpint(fixture->handled->len, ==, 0);
+    return pool;
+}
+
+/* Test cases *****************************************************************/
+
+static void
+test_LSWorkerPoolDispatch(TestData *fixture, gconstpointer user_data)
+{
+    _LSWorkerPool *pool = pool_new_dispatch_all(fixture);
+
+    /* worker 1 gets the odd messages only, in arrival order */
+    while (g_main_context_iteration(fixture->contexts[1], FALSE));
+    g_assert_cmpint(fixture->handled->len, ==, TEST_MESSAGES / 2);
+
+    int i;
+    for (i = 0; i < TEST_MESSAGES / 2; i++)
+    {
+        g_assert(g_ptr_array_index(fixture->handled, i) == &fixture->messages[2 * i + 1]);
+    }
+
+    while (g_main_context_iteration(fixture->contexts[0], FALSE));
+    g_assert_cmpint(fixture->handled->len, ==, TEST_MESSAGES);
+
+    for (i = 0; i < TEST_MESSAGES; i++)
+    {
+        g_assert_cmpint(fixture->results[i], ==, LSMessageHandlerResultHandled);
+    }
+
+    _LSWorkerPoolFree(pool, false);
+}
+
+static void
+test_LSWorkerPoolFreePending(TestData *fixture, gconstpointer user_data)
+{
+    _LSWorkerPool *pool = pool_new_dispatch_all(fixture);
+
+    _LSWorkerPoolFree(pool, true);
+    g_assert_cmpint(fixture->handled->len, ==, TEST_MESSAGES);
+
+    /* the sources are gone from the worker contexts */
+    g_assert(!g_main_context_iteration(fixture->contexts[0], FALSE));
+    g_assert(!g_main_context_iteration(fixture->contexts[1], FALSE));
+}
+
+static void
+test_LSWorkerPoolFreeDrop(TestData *fixture, gconstpointer user_data)
+{
+    _LSWorkerPool *pool = pool_new_dispatch_all(fixture);
+
+    _LSWorkerPoolFree(pool, false);
+    g_assert_cmpint(fixture->handled->len, ==, 0);
+
+    int i;
+    for (i = 0; i < TEST_MESSAGES; i++)
+    {
+        g_assert_cmpint(fixture->results[i], ==, -1);
+    }
+}
+
+static gpointer
+worker_thread(gpointer loop)
+{
+    g_main_loop_run(loop);
+    return NULL;
+}
+
+static void
+test_LSWorkerPoolThreads(TestData *fixture, gconstpointer user_data)
+{
+    GMainLoop *loops[TEST_WORKERS];
+    GThread *threads[TEST_WORKERS];
+
+    int i;
+    for (i = 0; i < TEST_WORKERS; i++)
+    {
+        loops[i] = g_main_loop_new(fixture->contexts[i], FALSE);
+        threads[i] = g_thread_new("worker", worker_thread, loops[i]);
+    }
+
+    _LSWorkerPool *pool = _LSWorkerPoolNew(&fixture->sh, fixture->contexts, TEST_WORKERS,
+                                           NULL, NULL);
+    g_assert(pool);
+
+    for (i = 0; i < TEST_MESSAGES; i++)
+    {
+        _LSWorkerPoolDispatch(pool, &fixture->category, &fixture->method, "com.palm.caller",
+                              &fixture->messages[i]);
+    }
+
+    for (i = 0; i < TEST_MESSAGES; i++)
+    {
+        while (g_atomic_int_get(&fixture->results[i]) == -1)
+        {
+            g_usleep(1000);
+        }
+    }
+
+    /* the default key is the category, so a single worker saw them in order */
+    g_assert_cmpint(fixture->handled->len, ==, TEST_MESSAGES);
+    for (i = 0; i < TEST_MESSAGES; i++)
+    {
+        g_assert(g_ptr_array_index(fixture->handled, i) == &fixture->messages[i]);
+    }
+
+    for (i = 0; i < TEST_WORKERS; i++)
+    {
+        g_main_loop_quit(loops[i]);
+        g_thread_join(threads[i]);
+        g_main_loop_unref(loops[i]);
+    }
+
+    _LSWorkerPoolFree(pool, false);
+}
+
+/* Mocks **********************************************************************/
+
+const char *
+LSMessageGetCategory(LSMessage *message)
+{
+    return "/category";
+}
+
+const char *
+LSMessageGetMethod(LSMessage *message)
+{
+    return "method";
+}
+
+LSMessageToken
+LSMessageGetToken(LSMessage *message)
+{
+    return message - test_data->messages;
+}
+
+void
+LSMessageRef(LSMessage *message)
+{
+    g_atomic_int_inc(&message->ref);
+}
+
+void
+LSMessageUnref(LSMessage *message)
+{
+    g_atomic_int_add(&message->ref, -1);
+}
+
+void
+_LSTransportHandleMessageHandlerResult(_LSTransportMessage *message, LSMessageHandlerResult ret)
+{
+    g_atomic_int_set((int *) message, ret);
+}
+
+void
+_lshandle_validate(LSHandle *sh)
+{
+}
+
+/* Test suite *****************************************************************/
+
+#define LSTEST_ADD(name, func) \
+    g_test_add(name, TestData, NULL, test_setup, func, test_teardown)
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_log_set_always_fatal (G_LOG_LEVEL_ERROR);
+    g_log_set_fatal_mask ("LunaService", G_LOG_LEVEL_ERROR);
+
+    LSTEST_ADD("/luna-service2/LSWorkerPoolDispatch", test_LSWorkerPoolDispatch);
+    LSTEST_ADD("/luna-service2/LSWorkerPoolFreePending", test_LSWorkerPoolFreePending);
+    LSTEST_ADD("/luna-service2/LSWorkerPoolFreeDrop", test_LSWorkerPoolFreeDrop);
+    LSTEST_ADD("/luna-service2/LSWorkerPoolThreads", test_LSWorkerPoolThreads);
+
+    return g_test_run();
+}
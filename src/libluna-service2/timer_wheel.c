@@ -0,0 +1,487 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <string.h>
+
+#include "timer_wheel.h"
+#include "error.h"
+
+/**
+ * @addtogroup LunaServiceInternals
+ * @{
+ */
+
+#define WHEEL_LEVELS        4
+#define WHEEL_BITS          6
+#define WHEEL_SLOTS         (1 << WHEEL_BITS)
+#define WHEEL_MASK          (WHEEL_SLOTS - 1)
+
+/** Timers further away than this are parked in the last slot of the top
+ * level and re-inserted when it cascades (2^24 ticks; 4.6 hours at 1 ms) */
+#define WHEEL_RANGE         (G_GUINT64_CONSTANT(1) << (WHEEL_LEVELS * WHEEL_BITS))
+
+#define WHEEL_TICK_NONE     G_MAXUINT64
+
+/**
+ * Classic cascading wheel: level 0 has one slot per tick, every slot of level
+ * N spans a whole turn of level N-1. When level N-1 wraps, the next slot of
+ * level N is cascaded (re-inserted) into the lower levels.
+ */
+struct _LSTimerWheel {
+    GSource         source;         /**< must be first */
+    GMainContext    *context;
+    GMutex          lock;           /**< protects everything below */
+    gint64          base_time;      /**< monotonic time of tick 0, in usec */
+    gint64          tick_us;
+    guint64         now;            /**< next tick to process */
+    guint64         next_tick;      /**< no timer expires or cascades before this tick */
+    unsigned int    count;          /**< armed timers */
+    _LSTimer        *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+};
+
+static inline void
+_LSTimerLink(_LSTimer **head, _LSTimer *timer)
+{
+    timer->next = *head;
+    if (timer->next)
+        timer->next->pprev = &timer->next;
+    timer->pprev = head;
+    *head = timer;
+}
+
+static inline void
+_LSTimerUnlink(_LSTimer *timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next)
+        timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/* Returns the tick at which the timer is next looked at: its expiration for
+ * level 0, the cascade of its slot otherwise */
+static guint64
+_LSTimerWheelInsert(_LSTimerWheel *wheel, _LSTimer *timer)
+{
+    guint64 expires = timer->expires;
+
+    if (expires < wheel->now)
+    {
+        /* overdue -- goes into the slot processed next */
+        expires = wheel->now;
+    }
+    else if (expires - wheel->now >= WHEEL_RANGE)
+    {
+        expires = wheel->now + WHEEL_RANGE - 1;
+    }
+
+    guint64 delta = expires - wheel->now;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (G_GUINT64_CONSTANT(1) << ((level + 1) * WHEEL_BITS)))
+    {
+        level++;
+    }
+
+    unsigned int shift = level * WHEEL_BITS;
+    _LSTimerLink(&wheel->slots[level][(expires >> shift) & WHEEL_MASK], timer);
+
+    return (expires >> shift) << shift;
+}
+
+/* Lower bound of the next tick that has anything to do */
+static guint64
+_LSTimerWheelNextTick(_LSTimerWheel *wheel)
+{
+    if (!wheel->count) return WHEEL_TICK_NONE;
+
+    guint64 next = WHEEL_TICK_NONE;
+    unsigned int i;
+
+    for (i = 0; i < WHEEL_SLOTS; i++)
+    {
+        if (wheel->slots[0][(wheel->now + i) & WHEEL_MASK])
+        {
+            return wheel->now + i;
+        }
+    }
+
+    int level;
+    for (level = 1; level < WHEEL_LEVELS; level++)
+    {
+        unsigned int shift = level * WHEEL_BITS;
+        guint64 low_mask = (G_GUINT64_CONSTANT(1) << shift) - 1;
+
+        /* first block of this level that starts at or after now */
+        guint64 block = (wheel->now >> shift) + ((wheel->now & low_mask) ? 1 : 0);
+
+        for (i = 0; i < WHEEL_SLOTS; i++)
+        {
+            if (wheel->slots[level][(block + i) & WHEEL_MASK])
+            {
+                next = MIN(next, (block + i) << shift);
+                break;
+            }
+        }
+    }
+
+    return next;
+}
+
+static void
+_LSTimerWheelCascade(_LSTimerWheel *wheel, int level, unsigned int index)
+{
+    _LSTimer *timer = wheel->slots[level][index];
+    wheel->slots[level][index] = NULL;
+
+    while (timer)
+    {
+        _LSTimer *next = timer->next;
+        timer->pprev = NULL;
+        (void) _LSTimerWheelInsert(wheel, timer);
+        timer = next;
+    }
+}
+
+/* Process every tick up to and including target, moving expired timers to
+ * the array. Empty stretches are skipped */
+static void
+_LSTimerWheelAdvance(_LSTimerWheel *wheel, guint64 target, GPtrArray *expired)
+{
+    while (wheel->now <= target)
+    {
+        if (wheel->now < wheel->next_tick)
+        {
+            wheel->now = MIN(wheel->next_tick, target + 1);
+            continue;
+        }
+
+        unsigned int index = wheel->now & WHEEL_MASK;
+
+        int level;
+        for (level = 1; index == 0 && level < WHEEL_LEVELS; level++)
+        {
+            index = (wheel->now >> (level * WHEEL_BITS)) & WHEEL_MASK;
+            _LSTimerWheelCascade(wheel, level, index);
+        }
+
+        _LSTimer **slot = &wheel->slots[0][wheel->now & WHEEL_MASK];
+        while (*slot)
+        {
+            _LSTimer *timer = *slot;
+            _LSTimerUnlink(timer);
+            wheel->count--;
+            g_ptr_array_add(expired, timer);
+        }
+
+        wheel->now++;
+        wheel->next_tick = _LSTimerWheelNextTick(wheel);
+    }
+}
+
+static inline guint64
+_LSTimerWheelTickAt(const _LSTimerWheel *wheel, gint64 time)
+{
+    return time > wheel->base_time ? (time - wheel->base_time) / wheel->tick_us : 0;
+}
+
+/* Time until the next tick is due, in ms rounded up. 0 when it's due */
+static gint
+_LSTimerWheelTimeout(_LSTimerWheel *wheel, gint64 time)
+{
+    g_mutex_lock(&wheel->lock);
+    guint64 next_tick = wheel->next_tick;
+    g_mutex_unlock(&wheel->lock);
+
+    if (next_tick == WHEEL_TICK_NONE) return -1;
+
+    gint64 due = wheel->base_time + (gint64)next_tick * wheel->tick_us;
+    if (time >= due) return 0;
+
+    return (gint)((due - time + 999) / 1000);
+}
+
+static gboolean
+_LSTimerWheelPrepare(GSource *source, gint *timeout)
+{
+    *timeout = _LSTimerWheelTimeout((_LSTimerWheel *) source, g_source_get_time(source));
+    return *timeout == 0;
+}
+
+static gboolean
+_LSTimerWheelCheck(GSource *source)
+{
+    return _LSTimerWheelTimeout((_LSTimerWheel *) source, g_source_get_time(source)) == 0;
+}
+
+static gboolean
+_LSTimerWheelDispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+    _LSTimerWheel *wheel = (_LSTimerWheel *) source;
+    GPtrArray *expired = g_ptr_array_new();
+
+    g_mutex_lock(&wheel->lock);
+    _LSTimerWheelAdvance(wheel, _LSTimerWheelTickAt(wheel, g_source_get_time(source)), expired);
+    g_mutex_unlock(&wheel->lock);
+
+    /* The timers are disarmed now, so the callbacks may re-arm them */
+    guint i;
+    for (i = 0; i < expired->len; i++)
+    {
+        _LSTimer *timer = g_ptr_array_index(expired, i);
+        GDestroyNotify destroy = timer->destroy;
+        void *data = timer->data;
+
+        if (timer->func)
+            timer->func(data);
+        if (destroy)
+            destroy(data);
+    }
+
+    g_ptr_array_free(expired, TRUE);
+    return TRUE;
+}
+
+static void
+_LSTimerWheelFinalize(GSource *source)
+{
+    _LSTimerWheel *wheel = (_LSTimerWheel *) source;
+
+    g_mutex_clear(&wheel->lock);
+}
+
+static GSourceFuncs _LSTimerWheelFuncs = {
+    .prepare  = _LSTimerWheelPrepare,
+    .check    = _LSTimerWheelCheck,
+    .dispatch = _LSTimerWheelDispatch,
+    .finalize = _LSTimerWheelFinalize,
+};
+
+/**
+ *******************************************************************************
+ * @brief Create a timer wheel and attach its source to the context.
+ *
+ * @param  context  IN  context the timers expire on (NULL for the default one)
+ * @param  tick_ms  IN  resolution of the wheel; timers expire up to one tick
+ *                      late, never early
+ *
+ * @retval  wheel
+ *******************************************************************************
+ */
+_LSTimerWheel*
+_LSTimerWheelNew(GMainContext *context, unsigned int tick_ms)
+{
+    LS_ASSERT(tick_ms > 0);
+
+    _LSTimerWheel *wheel = (_LSTimerWheel *) g_source_new(&_LSTimerWheelFuncs, sizeof(_LSTimerWheel));
+
+    g_mutex_init(&wheel->lock);
+
+    wheel->base_time = g_get_monotonic_time();
+    wheel->tick_us = (gint64)tick_ms * 1000;
+    wheel->next_tick = WHEEL_TICK_NONE;
+    memset(wheel->slots, 0, sizeof(wheel->slots));
+
+    g_source_attach(&wheel->source, context);
+    wheel->context = g_source_get_context(&wheel->source);
+
+    return wheel;
+}
+
+/**
+ *******************************************************************************
+ * @brief Detach the wheel and free it. Armed timers don't expire, but their
+ * destroy notifications are called.
+ *
+ * @param  wheel  IN  wheel (may be NULL)
+ *******************************************************************************
+ */
+void
+_LSTimerWheelFree(_LSTimerWheel *wheel)
+{
+    if (!wheel) return;
+
+    GPtrArray *armed = g_ptr_array_new();
+
+    g_mutex_lock(&wheel->lock);
+    int level;
+    unsigned int index;
+    for (level = 0; level < WHEEL_LEVELS; level++)
+    {
+        for (index = 0; index < WHEEL_SLOTS; index++)
+        {
+            while (wheel->slots[level][index])
+            {
+                _LSTimer *timer = wheel->slots[level][index];
+                _LSTimerUnlink(timer);
+                g_ptr_array_add(armed, timer);
+            }
+        }
+    }
+    wheel->count = 0;
+    wheel->next_tick = WHEEL_TICK_NONE;
+    g_mutex_unlock(&wheel->lock);
+
+    g_source_destroy(&wheel->source);
+
+    guint i;
+    for (i = 0; i < armed->len; i++)
+    {
+        _LSTimer *timer = g_ptr_array_index(armed, i);
+        if (timer->destroy)
+            timer->destroy(timer->data);
+    }
+    g_ptr_array_free(armed, TRUE);
+
+    g_source_unref(&wheel->source);
+}
+
+/**
+ *******************************************************************************
+ * @brief Initialize a disarmed timer.
+ *
+ * @param  timer    IN  timer
+ * @param  func     IN  called when the timer expires
+ * @param  destroy  IN  called when an arming of the timer ends for any reason
+ *                      (like the notify of g_timeout_add_full()), may be NULL
+ * @param  data     IN  passed to func and destroy
+ *******************************************************************************
+ */
+void
+_LSTimerInit(_LSTimer *timer, _LSTimerFunc func, GDestroyNotify destroy, void *data)
+{
+    memset(timer, 0, sizeof(*timer));
+    timer->func = func;
+    timer->destroy = destroy;
+    timer->data = data;
+}
+
+/**
+ *******************************************************************************
+ * @brief Arm the timer to expire after timeout_ms, re-arming it if it is
+ * armed already (which ends the previous arming).
+ *
+ * @param  wheel       IN  wheel
+ * @param  timer       IN  initialized timer
+ * @param  timeout_ms  IN  timeout
+ *******************************************************************************
+ */
+void
+_LSTimerWheelArm(_LSTimerWheel *wheel, _LSTimer *timer, unsigned int timeout_ms)
+{
+    gint64 time = g_get_monotonic_time();
+    gint64 expires_at = time + (gint64)timeout_ms * 1000 - wheel->base_time;
+
+    g_mutex_lock(&wheel->lock);
+
+    bool was_armed = (timer->pprev != NULL);
+    if (was_armed)
+    {
+        _LSTimerUnlink(timer);
+    }
+    else
+    {
+        /* an empty wheel isn't advanced, catch up with the clock */
+        if (!wheel->count)
+        {
+            wheel->now = MAX(wheel->now, _LSTimerWheelTickAt(wheel, time));
+        }
+        wheel->count++;
+    }
+
+    /* round up, so that the timer never expires early */
+    timer->expires = (expires_at + wheel->tick_us - 1) / wheel->tick_us;
+
+    guint64 tick = _LSTimerWheelInsert(wheel, timer);
+    bool wakeup = (tick < wheel->next_tick);
+    if (wakeup)
+    {
+        wheel->next_tick = tick;
+    }
+
+    g_mutex_unlock(&wheel->lock);
+
+    /* the context may be polling with a longer timeout */
+    if (wakeup)
+    {
+        g_main_context_wakeup(wheel->context);
+    }
+
+    if (was_armed && timer->destroy)
+    {
+        timer->destroy(timer->data);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Disarm the timer.
+ *
+ * @param  wheel  IN  wheel
+ * @param  timer  IN  timer
+ *
+ * @retval  true if the timer was armed (its destroy notification was called)
+ * @retval  false if it wasn't armed or has just expired
+ *******************************************************************************
+ */
+bool
+_LSTimerWheelCancel(_LSTimerWheel *wheel, _LSTimer *timer)
+{
+    g_mutex_lock(&wheel->lock);
+
+    bool was_armed = (timer->pprev != NULL);
+    if (was_armed)
+    {
+        _LSTimerUnlink(timer);
+        if (!--wheel->count)
+        {
+            wheel->next_tick = WHEEL_TICK_NONE;
+        }
+    }
+
+    /* otherwise next_tick stays a valid lower bound; it's tightened on the
+     * next dispatch */
+    g_mutex_unlock(&wheel->lock);
+
+    if (was_armed && timer->destroy)
+    {
+        timer->destroy(timer->data);
+    }
+
+    return was_armed;
+}
+
+/**
+ *******************************************************************************
+ * @brief Number of armed timers.
+ *
+ * @param  wheel  IN  wheel
+ *
+ * @retval  count
+ *******************************************************************************
+ */
+unsigned int
+_LSTimerWheelGetArmedCount(_LSTimerWheel *wheel)
+{
+    g_mutex_lock(&wheel->lock);
+    unsigned int count = wheel->count;
+    g_mutex_unlock(&wheel->lock);
+    return count;
+}
+
+/* @} END OF LunaServiceInternals */
@@ -0,0 +1,68 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <stdbool.h>
+#include <glib.h>
+
+/**
+ * @addtogroup LunaServiceInternals
+ * @{
+ */
+
+/**
+ * Hierarchical timer wheel driven by a single GSource.
+ *
+ * Timers are embedded in the objects they time out (calls, hub messages),
+ * so arming, re-arming and cancelling are O(1) and don't allocate. The
+ * wheel only wakes its context when the earliest timer may be due, and all
+ * the timers that are due are expired in one dispatch.
+ *
+ * The wheel may be armed and cancelled from any thread; callbacks run on the
+ * wheel's context without the wheel lock held.
+ */
+typedef struct _LSTimerWheel _LSTimerWheel;
+
+typedef void (*_LSTimerFunc)(void *data);
+
+/** Timer embedded in the timed object. Treat as opaque; zero-filled memory
+ * is a valid disarmed timer without callbacks */
+typedef struct _LSTimer {
+    struct _LSTimer *next;
+    struct _LSTimer **pprev;        /**< NULL while the timer isn't armed */
+    guint64         expires;        /**< in wheel ticks */
+    _LSTimerFunc    func;           /**< called on expiration */
+    GDestroyNotify  destroy;        /**< called whenever an arming ends (expired,
+                                         cancelled, re-armed or wheel freed) */
+    void            *data;
+} _LSTimer;
+
+_LSTimerWheel* _LSTimerWheelNew(GMainContext *context, unsigned int tick_ms);
+void _LSTimerWheelFree(_LSTimerWheel *wheel);
+
+void _LSTimerInit(_LSTimer *timer, _LSTimerFunc func, GDestroyNotify destroy, void *data);
+void _LSTimerWheelArm(_LSTimerWheel *wheel, _LSTimer *timer, unsigned int timeout_ms);
+bool _LSTimerWheelCancel(_LSTimerWheel *wheel, _LSTimer *timer);
+unsigned int _LSTimerWheelGetArmedCount(_LSTimerWheel *wheel);
+
+/* @} END OF LunaServiceInternals */
+
+#endif // _TIMER_WHEEL_H_
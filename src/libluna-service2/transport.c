@@ -20,6 +20,7 @@
 #include <glib.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/un.h>
 #include <sys/socket.h>
@@ -35,6 +36,7 @@
 #include "transport.h"
 #include "transport_priv.h"
 #include "transport_utils.h"
+#include "transport_compress.h"
 #include "base.h"
 #include "message.h"
 //#include "callmap.h"
@@ -88,6 +90,8 @@ void _LSTransportAddReceiveWatch(_LSTransportChannel *channel, GMainContext *con
 void _LSTransportRemoveReceiveWatch(_LSTransportChannel *channel);
 
 bool _LSTransportProcessIncomingMessages(_LSTransportClient *client, LSError *lserror);
+static bool _LSTransportProcessIncomingBudget(_LSTransportClient *client, const _LSTransportIncomingBudget *budget);
+static bool _LSTransportDispatchIncoming(void *item, void *data);
 
 
 bool _LSTransportSendMessageClientInfo(_LSTransportClient *client, const char *service_name, const char *unique_name, bool prepend, LSError *lserror);
@@ -348,7 +352,7 @@ _LSTransportClientShutdownProcessQueue(_LSTransport *transport, _LSTransportOutg
         while (!g_queue_is_empty(outgoing->queue))
         {
             /* grab message off queue */
-            _LSTransportMessage *failed_message = (_LSTransportMessage*)g_queue_pop_head(outgoing->queue);
+            _LSTransportMessage *failed_message = _LSTransportOutgoingPopHead(outgoing);
 
             // We can be reentered from the callback. So don't hold the lock during the callback
             OUTGOING_UNLOCK(&outgoing->lock);
@@ -616,7 +620,7 @@ _LSTransportHandleShutdown(_LSTransportMessage *message)
                    (outgoing_message_token = _LSTransportMessageGetToken(outgoing_message)) <= serial_message_token
             )
             {
-                outgoing_message = g_queue_pop_head(client->outgoing->queue);
+                outgoing_message = _LSTransportOutgoingPopHead(client->outgoing);
 
                 if (outgoing_message_token < serial_message_token)
                 {
@@ -636,7 +640,7 @@ _LSTransportHandleShutdown(_LSTransportMessage *message)
         }
 
         // Move the remaining contents (if any) of the outgoing queue to the new pending queue
-        while ((outgoing_message = g_queue_pop_head(client->outgoing->queue)) != NULL)
+        while ((outgoing_message = _LSTransportOutgoingPopHead(client->outgoing)) != NULL)
         {
             LS_ASSERT(_LSTransportMessageTypeMethodCall != _LSTransportMessageGetType(outgoing_message));
             LS_ASSERT(_LSTransportMessageGetToken(outgoing_message) > serial_message_token);
@@ -963,8 +967,11 @@ _LSTransportAddInitialWatches(_LSTransport *transport, GMainContext *context)
         _LSTransportAddClientWatches(NULL, transport->monitor, context);
     }
 
-    /* Watch and accept incoming connections */
-    _LSTransportAddAcceptWatch(&transport->listen_channel, context, transport);
+    /* Watch and accept incoming connections, if we listen for them */
+    if (transport->listen_channel.channel)
+    {
+        _LSTransportAddAcceptWatch(&transport->listen_channel, context, transport);
+    }
 }
 
 /**
@@ -985,6 +992,11 @@ _LSTransportGmainAttach(_LSTransport *transport, GMainContext *context)
 
     transport->mainloop_context = g_main_context_ref(context);
 
+    transport->incoming_dispatch = _LSDispatchSourceNew(transport->mainloop_context, transport->dispatch_priority,
+                                                        _LSTransportDispatchIncoming, transport,
+                                                        (_LSDispatchRefFunc) _LSTransportClientRef,
+                                                        (_LSDispatchRefFunc) _LSTransportClientUnref);
+
     _LSTransportAddInitialWatches(transport, transport->mainloop_context);
 }
 
@@ -1067,20 +1079,30 @@ _LSTransportListenLocal(const char *unique_name, mode_t mode, int *fd, LSError *
         goto error;
     }
 
-    memset(&addr, 0, sizeof(struct sockaddr_un));
-
-    addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path, unique_name, sizeof(addr.sun_path) -1);
+    socklen_t addr_len = _LSTransportSockaddrLocal(unique_name, &addr);
+    bool abstract = _LSTransportIsAbstractName(unique_name);
 
-    unlink(unique_name);
+    /* an abstract name can't be left behind by a dead process */
+    if (!abstract)
+    {
+        unlink(unique_name);
+    }
 
-    if (bind(tmp_fd, (struct sockaddr*) &addr, sizeof(struct sockaddr_un)) < 0)
+    if (bind(tmp_fd, (struct sockaddr*) &addr, addr_len) < 0)
     {
+        /* the caller tells a taken name by the error code */
+        int bind_errno = errno;
         LOG_LS_ERROR(MSGID_LS_SOCK_ERROR, 0, "Socket bind error");
+        errno = bind_errno;
         goto error;
     }
 
-    chmod(unique_name, mode);
+    /* there are no permissions on abstract sockets: the peers are checked
+     * when they connect instead */
+    if (!abstract)
+    {
+        chmod(unique_name, mode);
+    }
 
     if (listen(tmp_fd, LISTEN_BACKLOG) < 0)
     {
@@ -1129,7 +1151,22 @@ _LSTransportSetupListenerLocalRaw(_LSTransport *transport, const char *name, int
     return ret;
 }
 
-static bool
+/**
+ *******************************************************************************
+ * @brief Set up the listen channel with a unix domain socket that is already
+ * bound to @ref name and listening, e.g., created by the hub or by the
+ * launcher of the process (see _LSTransportGetInheritedListenFd()).
+ *
+ * @param  transport    IN  transport
+ * @param  name         IN  full path to unix domain socket
+ * @param  listen_fd    IN  fd that is already bound to @name and set up to listen
+ * @param  lserror      OUT set on error
+ *
+ * @retval true on success
+ * @retval false on error
+ *******************************************************************************
+ */
+bool
 _LSTransportSetupListenerLocalWithFd(_LSTransport *transport, const char *name, int listen_fd, LSError *lserror)
 {
     LS_ASSERT(listen_fd != -1);
@@ -1148,6 +1185,100 @@ _LSTransportSetupListenerLocalWithFd(_LSTransport *transport, const char *name,
 #endif
 }
 
+/**
+ *******************************************************************************
+ * @brief Check that a descriptor is a unix domain stream socket that is
+ * bound to @ref name and listening.
+ *
+ * @param  fd    IN  descriptor
+ * @param  name  IN  full path or abstract name of the socket
+ *
+ * @retval  true if it is
+ *******************************************************************************
+ */
+static bool
+_LSTransportIsListeningOn(int fd, const char *name)
+{
+    int value = 0;
+    socklen_t len = sizeof(value);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &value, &len) != 0 || value != SOCK_STREAM)
+    {
+        return false;
+    }
+
+    len = sizeof(value);
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &value, &len) != 0 || !value)
+    {
+        return false;
+    }
+
+    struct sockaddr_un addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    if (getsockname(fd, (struct sockaddr*) &addr, &addr_len) != 0 || addr.sun_family != AF_UNIX)
+    {
+        return false;
+    }
+
+    struct sockaddr_un expected;
+    socklen_t expected_len = _LSTransportSockaddrLocal(name, &expected);
+
+    /* the length tells abstract names apart, paths are compared as strings */
+    if (_LSTransportIsAbstractName(name))
+    {
+        return addr_len == expected_len && memcmp(&addr, &expected, expected_len) == 0;
+    }
+
+    return strncmp(addr.sun_path, expected.sun_path, sizeof(addr.sun_path)) == 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the listening socket passed by the launcher of the process, the
+ * way systemd passes them to socket-activated services: LISTEN_PID is the
+ * pid of the process and LISTEN_FDS the number of sockets, which start at
+ * descriptor 3. Only the first socket is used, and only if it is a unix
+ * domain stream socket listening on @ref name; otherwise the caller creates
+ * its own. The variables are cleared so that the children of the process
+ * don't take the socket for theirs.
+ *
+ * @param  name  IN  full path or abstract name the socket is expected to be
+ *                   bound to
+ *
+ * @retval  listening socket
+ * @retval  -1 if the launcher didn't pass a suitable one
+ *******************************************************************************
+ */
+int
+_LSTransportGetInheritedListenFd(const char *name)
+{
+    const char *listen_pid = getenv("LISTEN_PID");
+    const char *listen_fds = getenv("LISTEN_FDS");
+    int fd = -1;
+
+    if (listen_pid && listen_fds &&
+        strtol(listen_pid, NULL, 10) == getpid() && strtol(listen_fds, NULL, 10) >= 1)
+    {
+        if (_LSTransportIsListeningOn(LS_TRANSPORT_LISTEN_FDS_START, name))
+        {
+            fd = LS_TRANSPORT_LISTEN_FDS_START;
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        else
+        {
+            LOG_LS_WARNING(MSGID_LS_SOCK_ERROR, 0, "Inherited descriptor %d is not a socket listening on %s",
+                           LS_TRANSPORT_LISTEN_FDS_START, name);
+        }
+    }
+
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+
+    return fd;
+}
+
 /**
  *******************************************************************************
  * @brief Set up the listen channel for the unix domain socket @ref name.
@@ -1556,11 +1687,9 @@ _LSTransportConnectLocal(const char *unique_name, bool new_socket, int *fd, LSEr
 
     _LSTransportFdSetNonBlock(tmp_fd, NULL);
 
-    memset(&addr, 0, sizeof(addr));
-    addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path, unique_name, sizeof(addr.sun_path) -1);
+    socklen_t addr_len = _LSTransportSockaddrLocal(unique_name, &addr);
 
-    int ret = connect(tmp_fd, (struct sockaddr*)&addr, sizeof(addr));
+    int ret = connect(tmp_fd, (struct sockaddr*)&addr, addr_len);
 
     if (ret < 0)
     {
@@ -1894,27 +2023,82 @@ _LSTransportSendFd(int fd, int fd_to_send, bool *retry, LSError *lserror)
 
 /**
  *******************************************************************************
- * @brief Send data until all has been sent or an error is encountered.
+ * @brief Write as much of a framed message as the socket takes and account
+ * for it in the message.
  *
- * @param  fd       IN  destination fd
- * @param  buf      IN  data to send
- * @param  len      IN  size of @ref buf
- * @param  lserror  IN  set on error
+ * On a record based channel a write either goes out whole or not at all,
+ * so a message that fits in a record is never partially written. Larger
+ * ones are written in records of @ref record_max bytes: the first one
+ * takes the header, the rest the body only.
  *
- * @retval  bytes sent (same as len) on success
- * @retval  -1 on failure
+ * @param  fd           IN  destination fd
+ * @param  record_max   IN  most bytes to write, 0 for no limit (see
+ *                          _LSTransportChannelGetRecordMax())
+ * @param  message      IN  message framed with _LSTransportMessageFrame()
+ * @param  flags        IN  flags for send()
+ *
+ * @retval  bytes sent
+ * @retval  -1 on failure (errno is set)
  *******************************************************************************
  */
-static int
-_LSTransportSendComplete(int fd, void *buf, int len, LSError *lserror)
+static ssize_t
+_LSTransportSendWire(int fd, unsigned long record_max, _LSTransportMessage *message, int flags)
 {
-    int total_bytes_sent = 0;
+    struct iovec iov[3];
+    ssize_t ret;
 
-    while (total_bytes_sent < len)
+    int iovcnt = _LSTransportMessageGetWireVector(message, iov);
+
+    if (record_max && message->tx_bytes_remaining > record_max)
+    {
+        /* cut the record off the end; the header (if still there) comes
+         * first and is short */
+        unsigned long excess = message->tx_bytes_remaining - record_max;
+        while (excess >= iov[iovcnt - 1].iov_len)
+        {
+            excess -= iov[--iovcnt].iov_len;
+        }
+        iov[iovcnt - 1].iov_len -= excess;
+    }
+
+    if (iovcnt == 1)
+    {
+        ret = send(fd, iov[0].iov_base, iov[0].iov_len, flags);
+    }
+    else
+    {
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = iovcnt };
+        ret = sendmsg(fd, &msg, flags);
+    }
+
+    if (ret > 0)
     {
+        message->tx_bytes_remaining -= ret;
+    }
 
-        int bytes_sent = send(fd, (char*)buf + total_bytes_sent, len - total_bytes_sent, 0);
+    return ret;
+}
 
+/**
+ *******************************************************************************
+ * @brief Write a framed message and block until all of it has been written
+ * or an error is encountered.
+ *
+ * @param  fd           IN  destination fd
+ * @param  record_max   IN  most bytes to write at once, as for
+ *                          _LSTransportSendWire()
+ * @param  message      IN  message framed with _LSTransportMessageFrame()
+ * @param  lserror      OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+_LSTransportSendWireComplete(int fd, unsigned long record_max, _LSTransportMessage *message, LSError *lserror)
+{
+    while (message->tx_bytes_remaining > 0)
+    {
         /*
          * We encountered an error. This could happen for a variety of
          * reasons. One example would be if a client goes down after
@@ -1922,24 +2106,56 @@ _LSTransportSendComplete(int fd, void *buf, int len, LSError *lserror)
          * the fact that it's down because the mainloop hasn't run yet).
          * See the LSUnregister.c test for an artificial example.
          */
-        if (bytes_sent < 0)
+        if (_LSTransportSendWire(fd, record_max, message, 0) < 0 &&
+            errno != EAGAIN && errno != EINTR)
         {
-            if (errno == EAGAIN || errno == EINTR)
-            {
-                /* keep going */
-                bytes_sent = 0;
-            }
-            else
-            {
-                _LSErrorSetFromErrno(lserror, MSGID_LS_SOCK_ERROR, errno);
-                return -1;
-            }
+            _LSErrorSetFromErrno(lserror, MSGID_LS_SOCK_ERROR, errno);
+            return false;
         }
+    }
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Check a header that has been read completely and bring a legacy one
+ * to the current layout. A peer that sends a version 2 header reads it too,
+ * so the connection switches to version 2 in both directions.
+ *
+ * @param  client   IN      client the header was read from
+ * @param  header   IN/OUT  header
+ * @param  legacy   IN      true if @ref header holds a version 1 header
+ *
+ * @retval  true if the header is valid
+ *******************************************************************************
+ */
+static bool
+_LSTransportHeaderReceived(_LSTransportClient *client, _LSTransportHeader *header, bool legacy)
+{
+    if (legacy)
+    {
+        _LSTransportHeaderV1 header_v1;
+        memcpy(&header_v1, header, sizeof(header_v1));
+        _LSTransportHeaderFromV1(header, &header_v1);
+        return true;
+    }
+
+    if (header->magic != LS_TRANSPORT_HEADER_MAGIC ||
+        header->inflated_len > MAX_MESSAGE_SIZE_BYTES ||
+        !_LSTransportHeaderFieldsAreValid(header))
+    {
+        return false;
+    }
 
-        total_bytes_sent += bytes_sent;
+    if (client->incoming)
+    {
+        client->incoming->legacy_wire = false;
     }
+    client->legacy_wire = false;
+    client->peer_inflates = _LSTransportHeaderPeerInflates(header);
 
-    return total_bytes_sent;
+    return true;
 }
 
 /**
@@ -2035,14 +2251,32 @@ _LSTransportRecvMessageBlocking(_LSTransportClient *client, _LSTransportMessageT
      * to be handled later -- how do we kick the message handler? */
 
     /* TODO: use poll() with timeout value */
-    int bytes_recvd = _LSTransportRecvComplete(client->channel.fd, &header, sizeof(header), lserror);
+    bool legacy = client->incoming && client->incoming->legacy_wire;
+    int header_size = legacy ? sizeof(_LSTransportHeaderV1) : sizeof(_LSTransportHeader);
+    int bytes_recvd = _LSTransportRecvComplete(client->channel.fd, &header, header_size, lserror);
 
     if (bytes_recvd == -1)
     {
         goto exit;
     }
 
-    LS_ASSERT(bytes_recvd == sizeof(header));
+    if (legacy && !_LSTransportHeaderIsV1(&header))
+    {
+        /* the peer speaks version 2, the rest of its header follows */
+        legacy = false;
+        bytes_recvd = _LSTransportRecvComplete(client->channel.fd, (char*)&header + header_size,
+                                               sizeof(header) - header_size, lserror);
+        if (bytes_recvd == -1)
+        {
+            goto exit;
+        }
+    }
+
+    if (!_LSTransportHeaderReceived(client, &header, legacy))
+    {
+        _LSErrorSet(lserror, MSGID_LS_MSG_ERR, -1, "Malformed message header");
+        goto exit;
+    }
 
     int i;
     bool msg_type_match = false;
@@ -2148,19 +2382,15 @@ _LSTransportSendMessageBlocking(_LSTransportMessage *message, _LSTransportClient
     /* LOCK -- this grabs global_token lock */
     _LSTransportMessageSetToken(message, _LSTransportGetNextToken(client->transport));
 
-    message->tx_bytes_remaining = message->raw->header.len + sizeof(_LSTransportHeader);
-
-    int send_ret = _LSTransportSendComplete(client->channel.fd, (char*)message->raw + message->raw->header.len + sizeof(_LSTransportHeader) - message->tx_bytes_remaining, message->tx_bytes_remaining, lserror);
+    _LSTransportMessageFrame(message, client->legacy_wire, client->peer_inflates);
 
-    if (send_ret == -1)
+    if (!_LSTransportSendWireComplete(client->channel.fd, _LSTransportChannelGetRecordMax(&client->channel),
+                                      message, lserror))
     {
         ret = false;
         goto exit;
     }
 
-    LS_ASSERT(send_ret == message->tx_bytes_remaining);
-    message->tx_bytes_remaining = 0;
-
     if (token)
     {
         *token = _LSTransportMessageGetToken(message);
@@ -2259,14 +2489,33 @@ _LSTransportHandleUserMessageHandler(_LSTransportMessage *message)
 {
     LOG_LS_DEBUG("%s: calling user's msg_handler\n", __func__);
 
-    LSError lserror;
-    LSErrorInit(&lserror);
-
     _LSTransportClient *client = _LSTransportMessageGetClient(message);
     void *msg_context = client->transport->msg_context;
 
     LSMessageHandlerResult ret = (*client->transport->msg_handler)(message, msg_context);
 
+    _LSTransportHandleMessageHandlerResult(message, ret);
+}
+
+/**
+ *******************************************************************************
+ * @brief Act on the result of the user's message handler. If the message is
+ * of method call type and wasn't handled, send an error message in reply.
+ *
+ * Unlike the handler invocation itself, this may be called from any thread:
+ * a handler dispatched to a worker (see worker_pool.h) reports its result
+ * here once done.
+ *
+ * @param  message  IN  message
+ * @param  ret      IN  result of the message handler
+ *******************************************************************************
+ */
+void
+_LSTransportHandleMessageHandlerResult(_LSTransportMessage *message, LSMessageHandlerResult ret)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
     /*
      * We only care about whether the message was handled if the message type
      * is a method call, since we need to send a reply error message in that
@@ -2284,6 +2533,11 @@ _LSTransportHandleUserMessageHandler(_LSTransportMessage *message)
         /* success, don't need to do anything */
         break;
     }
+    case LSMessageHandlerResultDeferred:
+    {
+        /* the worker that took the message reports the result later */
+        break;
+    }
     case LSMessageHandlerResultNotHandled:
     {
         char *error_msg = g_strdup_printf("Method \"%s\" for category \"%s\" was not handled", _LSTransportMessageGetMethod(message), _LSTransportMessageGetCategory(message));
@@ -2368,7 +2622,10 @@ _LSTransportReceiveMonitorStatus(_LSTransport *transport, _LSTransportClient *cl
  *
  * @param  requested_name   IN  service name or NULL for only unique name
  * @param  client           IN  client
+ * @param  protocol_version IN  protocol version to register with
  * @param  fd               OUT fd passed from hub that we should listen on
+ *                              (-1 from protocol version 5 on, unless the
+ *                              hub created the socket before launching us)
  * @param  privileged       OUT true if the service is privileged
  * @param  lserror          OUT set on error
  *
@@ -2377,7 +2634,8 @@ _LSTransportReceiveMonitorStatus(_LSTransport *transport, _LSTransportClient *cl
  *******************************************************************************
  */
 char*
-_LSTransportRequestNameLocal(const char *requested_name, _LSTransportClient *client, int *fd, bool *privileged, LSError *lserror)
+_LSTransportRequestNameLocal(const char *requested_name, _LSTransportClient *client, int32_t protocol_version,
+                             int *fd, bool *privileged, LSError *lserror)
 {
     _LSTransportMessageIter iter;
     const char *unique_name_tmp = NULL;
@@ -2390,7 +2648,7 @@ _LSTransportRequestNameLocal(const char *requested_name, _LSTransportClient *cli
     _LSTransportMessageSetType(message, _LSTransportMessageTypeRequestNameLocal);
 
     _LSTransportMessageIterInit(message, &iter);
-    if (!_LSTransportMessageAppendInt32(&iter, LS_TRANSPORT_PROTOCOL_VERSION)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, protocol_version)) goto error;
     if (!_LSTransportMessageAppendString(&iter, requested_name)) goto error;
     if (!_LSTransportMessageAppendInvalid(&iter)) goto error;
 
@@ -2441,17 +2699,25 @@ _LSTransportRequestNameLocal(const char *requested_name, _LSTransportClient *cli
         }
 
         int message_fd = _LSTransportMessageGetConnectionFd(message);
-        LS_ASSERT(message_fd != -1);
+        LS_ASSERT(message_fd != -1 || protocol_version >= 5);
 
-        *fd = dup(message_fd);
-        if (-1 == *fd)
+        /* from protocol version 5 on, the hub hands us our connections */
+        if (message_fd == -1)
         {
-            LOG_LS_ERROR(MSGID_LS_DUP_ERR, 2,
-                         PMLOGKFV("ERROR_CODE", "%d", errno),
-                         PMLOGKS("ERROR", g_strerror(errno)),
-                         "%s: dup() failed, errno %d, \"%s\"", __func__, errno, g_strerror(errno));
+            *fd = -1;
+        }
+        else
+        {
+            *fd = dup(message_fd);
+            if (-1 == *fd)
+            {
+                LOG_LS_ERROR(MSGID_LS_DUP_ERR, 2,
+                             PMLOGKFV("ERROR_CODE", "%d", errno),
+                             PMLOGKS("ERROR", g_strerror(errno)),
+                             "%s: dup() failed, errno %d, \"%s\"", __func__, errno, g_strerror(errno));
+            }
+            LS_ASSERT(*fd != -1);
         }
-        LS_ASSERT(*fd != -1);
 
         LOG_LS_DEBUG("%s: received unique_name: %s, %sprivileged\n", __func__, unique_name, *privileged ? "" : "not ");
 
@@ -2466,6 +2732,10 @@ _LSTransportRequestNameLocal(const char *requested_name, _LSTransportClient *cli
         _LSErrorSet(lserror, MSGID_LS_REQUEST_NAME, LS_ERROR_CODE_DUPLICATE_NAME, LS_ERROR_TEXT_DUPLICATE_NAME, requested_name);
         break;
 
+    case LS_TRANSPORT_REQUEST_NAME_INVALID_PROTOCOL_VERSION:
+        _LSErrorSet(lserror, MSGID_LS_REQUEST_NAME, LS_ERROR_CODE_PROTOCOL_VERSION, LS_ERROR_TEXT_PROTOCOL_VERSION, protocol_version);
+        break;
+
     default:
         _LSErrorSet(lserror, MSGID_LS_REQUEST_NAME, LS_ERROR_CODE_UNKNOWN_ERROR, LS_ERROR_TEXT_UNKNOWN_ERROR);
         break;
@@ -2490,6 +2760,7 @@ error:
  *
  * @param  requested_name   IN  service name or NULL for only unique name
  * @param  client           IN  client
+ * @param  protocol_version IN  protocol version to register with
  * @param  privileged       OUT true if the service is privileged
  * @param  lserror          OUT set on error
  *
@@ -2498,7 +2769,8 @@ error:
  *******************************************************************************
  */
 char*
-_LSTransportRequestNameInet(const char *requested_name, _LSTransportClient *client, bool *privileged, LSError *lserror)
+_LSTransportRequestNameInet(const char *requested_name, _LSTransportClient *client, int32_t protocol_version,
+                            bool *privileged, LSError *lserror)
 {
     const char *unique_name_tmp = NULL;
     char *unique_name = NULL;
@@ -2530,7 +2802,7 @@ _LSTransportRequestNameInet(const char *requested_name, _LSTransportClient *clie
     _LSTransportMessageSetType(message, _LSTransportMessageTypeRequestNameInet);
 
     _LSTransportMessageIterInit(message, &iter);
-    if (!_LSTransportMessageAppendInt32(&iter, LS_TRANSPORT_PROTOCOL_VERSION)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, protocol_version)) goto error;
     if (!_LSTransportMessageAppendString(&iter, requested_name)) goto error;
     if (!_LSTransportMessageAppendInt32(&iter, port)) goto error;
     if (!_LSTransportMessageAppendInvalid(&iter)) goto error;
@@ -2588,7 +2860,7 @@ _LSTransportRequestNameInet(const char *requested_name, _LSTransportClient *clie
         break;
 
     case LS_TRANSPORT_REQUEST_NAME_INVALID_PROTOCOL_VERSION:
-        _LSErrorSet(lserror, MSGID_LS_REQUEST_NAME, LS_ERROR_CODE_PROTOCOL_VERSION, LS_ERROR_TEXT_PROTOCOL_VERSION, LS_TRANSPORT_PROTOCOL_VERSION);
+        _LSErrorSet(lserror, MSGID_LS_REQUEST_NAME, LS_ERROR_CODE_PROTOCOL_VERSION, LS_ERROR_TEXT_PROTOCOL_VERSION, protocol_version);
 
         break;
 
@@ -2610,16 +2882,58 @@ error:
     return unique_name;
 }
 
+/**
+ *******************************************************************************
+ * @brief Request a service name from the hub, see
+ * _LSTransportRequestNameLocal(). A hub that doesn't speak our protocol version
+ * is asked again with the oldest version we still speak.
+ *******************************************************************************
+ */
 char*
 _LSTransportRequestName(const char *requested_name, _LSTransportClient *client, int *fd, bool *privileged, LSError *lserror)
 {
-    if (client->transport->type == _LSTransportTypeLocal)
-    {
-        return _LSTransportRequestNameLocal(requested_name, client, fd, privileged, lserror);
-    }
-    else
+    int32_t protocol_version = LS_TRANSPORT_PROTOCOL_VERSION;
+    char *unique_name = NULL;
+
+    while (true)
     {
-        return _LSTransportRequestNameInet(requested_name, client, privileged, lserror);
+        LSError request_error;
+        LSErrorInit(&request_error);
+
+        if (client->transport->type == _LSTransportTypeLocal)
+        {
+            unique_name = _LSTransportRequestNameLocal(requested_name, client, protocol_version, fd, privileged, &request_error);
+        }
+        else
+        {
+            unique_name = _LSTransportRequestNameInet(requested_name, client, protocol_version, privileged, &request_error);
+        }
+
+        if (unique_name)
+        {
+            /* a hub of version 4 and later takes us as up already */
+            client->fast_register = (protocol_version >= 4);
+            return unique_name;
+        }
+
+        if (request_error.error_code == LS_ERROR_CODE_PROTOCOL_VERSION &&
+            protocol_version > LS_TRANSPORT_PROTOCOL_VERSION_MIN)
+        {
+            LOG_LS_DEBUG("%s: hub rejected protocol version %"PRId32", retrying\n", __func__, protocol_version);
+            LSErrorFree(&request_error);
+            protocol_version--;
+            continue;
+        }
+
+        if (lserror)
+        {
+            *lserror = request_error;
+        }
+        else
+        {
+            LSErrorFree(&request_error);
+        }
+        return NULL;
     }
 }
 
@@ -2883,7 +3197,7 @@ _LSTransportHandleQueryNameFailure(_LSTransportMessage *message, long err_code,
 
     /* Grab the first message on the pending queue, since the target that it is
      * destined for has failed in some manner */
-    _LSTransportMessage *failed_message = g_queue_pop_head(pending->queue);
+    _LSTransportMessage *failed_message = _LSTransportOutgoingPopHead(pending);
 
     LS_ASSERT(failed_message);
 
@@ -2899,7 +3213,7 @@ _LSTransportHandleQueryNameFailure(_LSTransportMessage *message, long err_code,
     {
         if (--failed_message->retries > 0)
         {
-            g_queue_push_head(pending->queue, failed_message);
+            _LSTransportOutgoingPushNth(pending, failed_message, 0);
             OUTGOING_UNLOCK(&pending->lock);
 
             LOG_LS_WARNING(MSGID_LS_MSG_ERR, 1,
@@ -3128,8 +3442,12 @@ _LSTransportHandleQueryNameReply(_LSTransportMessage *message)
      * before sending a reply (specifically, for monitoring the far end needs
      * to know our service name and unique name so that it can put that in
      * the message to the monitor)
+     *
+     * A hub of protocol version 4 has already written it onto the connection
+     * it passed us.
      */
-    if (!_LSTransportSendMessageClientInfo(client, transport->service_name, transport->unique_name, true, &lserror))
+    if (!(_LSTransportGetTransportType(transport) == _LSTransportTypeLocal && transport->hub->fast_register) &&
+        !_LSTransportSendMessageClientInfo(client, transport->service_name, transport->unique_name, true, &lserror))
     {
         LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
         LSErrorFree(&lserror);
@@ -3220,24 +3538,54 @@ _LSTransportConnect(_LSTransport *transport, bool local, bool public_bus, LSErro
     }
 
     /*
-     * 1. Attempt to connect to local hub.
+     * 1. Attempt to connect to local hub (abstract name, then path).
      * 2. Attempt to connect to inet hub on device.
      * 3. Attempt to connecto to inet hub on emulator.
      */
 
     transport->type = _LSTransportTypeLocal;
 
-    if (public_bus)
+    /* try to connect to the local hub; the abstract name fails right away
+     * when the hub isn't listening on it */
+    _LSTransportClient *hub = _LSTransportConnectClient(transport, HUB_NAME,
+                                                        public_bus ? HUB_ABSTRACT_ADDRESS_PUBLIC : HUB_ABSTRACT_ADDRESS_PRIVATE,
+                                                        -1, NULL, lserror);
+
+    /* anybody may bind an abstract name: it's the hub only if it runs as
+     * root (or as ourselves, e.g., on the desktop) */
+    if (hub)
     {
-        hub_addr = HUB_LOCAL_ADDRESS_PUBLIC;
+        uid_t hub_uid = _LSTransportCredGetUid(_LSTransportClientGetCred(hub));
+
+        if (hub_uid != 0 && hub_uid != geteuid())
+        {
+            LOG_LS_ERROR(MSGID_LS_SOCK_ERROR, 1,
+                         PMLOGKFV("UID", "%d", (int) hub_uid),
+                         "Abstract hub socket not owned by the hub user");
+            _LSTransportClientUnref(hub);
+            hub = NULL;
+        }
     }
-    else
+
+    if (!hub)
     {
-        hub_addr = HUB_LOCAL_ADDRESS_PRIVATE;
-    }
+        if (lserror)
+        {
+            LSErrorFree(lserror);
+            LSErrorInit(lserror);
+        }
+
+        if (public_bus)
+        {
+            hub_addr = HUB_LOCAL_ADDRESS_PUBLIC;
+        }
+        else
+        {
+            hub_addr = HUB_LOCAL_ADDRESS_PRIVATE;
+        }
 
-    /* try to connect to the local hub */
-    _LSTransportClient *hub = _LSTransportConnectClient(transport, HUB_NAME, hub_addr, -1, NULL, lserror);
+        hub = _LSTransportConnectClient(transport, HUB_NAME, hub_addr, -1, NULL, lserror);
+    }
 
 #ifndef TARGET_EMULATOR
     if (!hub)
@@ -3348,25 +3696,31 @@ _LSTransportConnect(_LSTransport *transport, bool local, bool public_bus, LSErro
         goto Done;
     }
 
-    if (transport->type == _LSTransportTypeLocal)
+    /* we've got our name and fd, so we start listening for messages; with
+     * no fd the hub passes us the connections (protocol version 5) */
+    if (transport->type == _LSTransportTypeLocal && listen_fd != -1)
     {
-        /* we've got our name and fd, so we start listening for messages */
         if (!_LSTransportSetupListenerLocalWithFd(transport, transport->unique_name, listen_fd, lserror))
         {
             goto Done;
         }
     }
 
-    /* Send the message to acknowledge we're up */
-    if (!_LSTransportNodeUp(hub, lserror))
+    /* The hub learned all of that from the name request if it speaks
+     * protocol version 4 */
+    if (!hub->fast_register)
     {
-        goto Done;
-    }
+        /* Send the message to acknowledge we're up */
+        if (!_LSTransportNodeUp(hub, lserror))
+        {
+            goto Done;
+        }
 
-    /* MONITOR: send *our* information to the client (hub in this case) */
-    if (!_LSTransportSendMessageClientInfo(hub, transport->service_name, transport->unique_name, false, lserror))
-    {
-        goto Done;
+        /* MONITOR: send *our* information to the client (hub in this case) */
+        if (!_LSTransportSendMessageClientInfo(hub, transport->service_name, transport->unique_name, false, lserror))
+        {
+            goto Done;
+        }
     }
 
     ret = true;
@@ -3430,16 +3784,136 @@ error:
 
 /**
  *******************************************************************************
- * @brief Called when watch indicates that there is data to be read from a
- * channel. This function does non-blocking reads of the incoming data and
- * processes the complete messages.
+ * @brief Check the header of an incoming message that has been read
+ * completely, and allocate the message.
  *
- * @param  source       IN  io source
- * @param  condition    IN  condition that triggered this callback
- * @param  data         IN  client
+ * @param  client   IN      client the header was read from
+ * @param  header   IN/OUT  header, brought to the current layout
+ * @param  legacy   IN      true if @ref header holds a version 1 header
  *
- * @retval TRUE when client is still alive
- * @retval FALSE when client goes away so that this watch is removed
+ * @retval  message on success
+ * @retval  NULL if the header is malformed or announces a message too large,
+ *          and the client is to be shut down
+ *******************************************************************************
+ */
+static _LSTransportMessage*
+_LSTransportIncomingMessageNewRef(_LSTransportClient *client, _LSTransportHeader *header, bool legacy)
+{
+    if (!_LSTransportHeaderReceived(client, header, legacy))
+    {
+        LOG_LS_ERROR(MSGID_LS_MSG_ERR, 2,
+                     PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                     PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                     "Received malformed message header; shutting down client");
+        return NULL;
+    }
+
+    if (header->len > MAX_MESSAGE_SIZE_BYTES)
+    {
+        const _LSTransportCred *cred = _LSTransportClientGetCred(client);
+        LOG_LS_ERROR(MSGID_LS_MSG_ERR, 4,
+                     PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                     PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                     PMLOGKS("EXE", _LSTransportCredGetExePath(cred)),
+                     PMLOGKS("CMD", _LSTransportCredGetCmdLine(cred)),
+                     "Received message of size %"PRIu64" bytes; shutting down client",
+                     header->len);
+        return NULL;
+    }
+
+    _LSTransportMessage *message = _LSTransportMessageNewRef(header->len);
+
+    /* copy header and sender */
+    _LSTransportMessageSetHeader(message, header);
+    //printf("recvd message alloc: token %d, type: %d, len: %d\n", (int)message->raw->header.token, (int)message->raw->header.type, (int)message->raw->header.len);
+
+    _LSTransportMessageSetClient(message, client);
+
+    return message;
+}
+
+/**
+ *******************************************************************************
+ * @brief Read the next record from a record based (SOCK_SEQPACKET) channel,
+ * which starts a message: the header is peeked at to allocate the message,
+ * then header and body are read in one go, without reassembling them.
+ *
+ * A message too large for one record goes on in records of the body only
+ * (see _LSTransportSendWire()), which are read into the message like the
+ * rest of a message from a stream channel.
+ *
+ * @param  client   IN  client
+ *
+ * @retval  bytes read, with the message in the client's incoming buffer
+ * @retval  0 on orderly shutdown
+ * @retval  -1 on failure (errno is set, EPROTO if the client sent something
+ *          that isn't a message)
+ *******************************************************************************
+ */
+ssize_t
+_LSTransportReceiveRecord(_LSTransportClient *client)
+{
+    _LSTransportIncoming *incoming = client->incoming;
+    _LSTransportHeader header;
+
+    ssize_t ret = recv(client->channel.fd, &header, sizeof(header), MSG_DONTWAIT | MSG_PEEK);
+
+    if (ret <= 0)
+    {
+        return ret;
+    }
+
+    bool legacy = incoming->legacy_wire && ret >= (ssize_t) sizeof(uint32_t) && _LSTransportHeaderIsV1(&header);
+    size_t header_size = legacy ? sizeof(_LSTransportHeaderV1) : sizeof(_LSTransportHeader);
+
+    if (ret < (ssize_t) header_size)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+
+    _LSTransportMessage *message = _LSTransportIncomingMessageNewRef(client, &header, legacy);
+
+    if (!message)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+
+    /* the header again, and the body straight into the message */
+    struct iovec iov[2] = {
+        { .iov_base = &header, .iov_len = header_size },
+        { .iov_base = _LSTransportMessageGetBody(message), .iov_len = message->raw->header.len }
+    };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = ARRAY_SIZE(iov) };
+
+    ret = recvmsg(client->channel.fd, &msg, MSG_DONTWAIT);
+
+    if (ret < (ssize_t) header_size || (msg.msg_flags & MSG_TRUNC))
+    {
+        _LSTransportMessageUnref(message);
+        if (ret >= 0) errno = EPROTO;
+        return -1;
+    }
+
+    incoming->tmp_msg = message;
+    incoming->tmp_msg_offset = ret - header_size;
+
+    return ret;
+}
+
+/**
+ *******************************************************************************
+ * @brief Called when watch indicates that there is data to be read from a
+ * channel. This function does non-blocking reads of the incoming data and
+ * processes the complete messages.
+ *
+ * @param  source       IN  io source
+ * @param  condition    IN  condition that triggered this callback
+ * @param  data         IN  client
+ *
+ * @retval TRUE when client is still alive
+ * @retval FALSE when client goes away so that this watch is removed
  *******************************************************************************
  */
 gboolean
@@ -3463,17 +3937,19 @@ _LSTransportReceiveClient(GIOChannel *source, GIOCondition condition,
 
     bool shutdown = false;
 
-    /*
-     * TODO: limit the number of messages that we queue up before processing
-     * them. We don't want to starve other parts of the program's operation
-     * and we don't want to use too much memory; this should be configurable
-     */
+    /* Read no more than one budget per wakeup, on top of what is left over
+     * from the previous ones. A client that sends faster than we process is
+     * left to the kernel's socket buffer, and eventually blocks */
+    _LSTransportIncomingBudget budget = client->transport->incoming_budget;
+    unsigned long bytes_read = 0;
 
-    /* TODO: review locking */
+    /* The incoming side of a client is only touched from the handle's
+     * context; method calls dispatched to workers (see worker_pool.h) carry
+     * their own message references, so no lock is needed here */
 
     //INCOMING_LOCK(&incoming->lock);
 
-    while (1)
+    while (!_LSTransportIncomingBudgetSpent(&budget, g_queue_get_length(incoming->complete_messages), bytes_read))
     {
         char* buf = (char*)&incoming->tmp_header;
 
@@ -3488,14 +3964,20 @@ _LSTransportReceiveClient(GIOChannel *source, GIOCondition condition,
         else
         {
             /* We haven't read in a complete header yet, so attempt to construct
-             * a complete header */
-            num_bytes_to_read = sizeof(client->incoming->tmp_header) - incoming->tmp_header_offset;
+             * a complete header. Until the peer has sent a version 2 header,
+             * we only ask for as much as a legacy header takes */
+            num_bytes_to_read = (incoming->legacy_wire ? sizeof(_LSTransportHeaderV1) : sizeof(_LSTransportHeader))
+                                - incoming->tmp_header_offset;
             offset = incoming->tmp_header_offset;
         }
 
+        /* a record based channel reads a message in one go */
+        bool record = client->channel.seqpacket && !incoming->tmp_msg;
+
         if (num_bytes_to_read > 0)
         {
-            int ret = recv(client->channel.fd, buf + offset, num_bytes_to_read, MSG_DONTWAIT);
+            int ret = record ? _LSTransportReceiveRecord(client)
+                             : recv(client->channel.fd, buf + offset, num_bytes_to_read, MSG_DONTWAIT);
 
             /* If there was an error or we would block, we're done reading in data */
             if (ret <= 0)
@@ -3525,16 +4007,22 @@ _LSTransportReceiveClient(GIOChannel *source, GIOCondition condition,
 
             /* ret > 0 */
             LS_ASSERT(ret > 0);
+            bytes_read += ret;
 
-            if (incoming->tmp_msg)
+            /* a record has allocated the message and accounted for the
+             * body that came with it */
+            if (!record)
             {
-                /* We're continuing an already allocated msg */
-                incoming->tmp_msg_offset += ret;
-            }
-            else
-            {
-                /* We're reading in the header */
-                incoming->tmp_header_offset += ret;
+                if (incoming->tmp_msg)
+                {
+                    /* We're continuing an already allocated msg */
+                    incoming->tmp_msg_offset += ret;
+                }
+                else
+                {
+                    /* We're reading in the header */
+                    incoming->tmp_header_offset += ret;
+                }
             }
         }
 
@@ -3573,6 +4061,8 @@ _LSTransportReceiveClient(GIOChannel *source, GIOCondition condition,
                     _LSTransportMessageSetConnectionFd(incoming->tmp_msg, recv_fd);
                 }
 
+                _LSTransportMessageParseBody(incoming->tmp_msg);
+
                 g_queue_push_tail(incoming->complete_messages, incoming->tmp_msg);
                 incoming->tmp_msg = NULL;
                 incoming->tmp_msg_offset = 0;
@@ -3582,35 +4072,35 @@ _LSTransportReceiveClient(GIOChannel *source, GIOCondition condition,
         {
             LS_ASSERT(incoming->tmp_header_offset <= sizeof(_LSTransportHeader));
 
-            if (incoming->tmp_header_offset == sizeof(incoming->tmp_header))
+            if (incoming->legacy_wire &&
+                incoming->tmp_header_offset == sizeof(_LSTransportHeaderV1) &&
+                !_LSTransportHeaderIsV1(&incoming->tmp_header))
+            {
+                /* the peer speaks version 2, the rest of its header follows */
+                incoming->legacy_wire = false;
+                continue;
+            }
+
+            if (incoming->tmp_header_offset ==
+                (incoming->legacy_wire ? sizeof(_LSTransportHeaderV1) : sizeof(_LSTransportHeader)))
             {
                 /* construct the new message */
                 LS_ASSERT(incoming->tmp_msg == NULL);
 
-                if (incoming->tmp_header.len > MAX_MESSAGE_SIZE_BYTES)
+                incoming->tmp_msg = _LSTransportIncomingMessageNewRef(client, &incoming->tmp_header,
+                                                                      incoming->legacy_wire);
+                if (!incoming->tmp_msg)
                 {
-                    const _LSTransportCred *cred = _LSTransportClientGetCred(client);
-                    LOG_LS_ERROR(MSGID_LS_MSG_ERR, 4,
-                                 PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
-                                 PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
-                                 PMLOGKS("EXE", _LSTransportCredGetExePath(cred)),
-                                 PMLOGKS("CMD", _LSTransportCredGetCmdLine(cred)),
-                                 "Received message of size %ld bytes; shutting down client",
-                                 incoming->tmp_header.len);
                     shutdown = true;
                     break;
                 }
 
-                incoming->tmp_msg = _LSTransportMessageNewRef(incoming->tmp_header.len);
-
-                /* copy header and sender */
-                _LSTransportMessageSetHeader(incoming->tmp_msg, &incoming->tmp_header);
-                //printf("recvd message alloc: token %d, type: %d, len: %d\n", (int)incoming->tmp_msg->raw->header.token, (int)incoming->tmp_msg->raw->header.type, (int)incoming->tmp_msg->raw->header.len);
-
-                _LSTransportMessageSetClient(incoming->tmp_msg, client);
-
-                /* TODO: can we fold this in better to the above code? */
-                if (_LSTransportMessageGetHeader(incoming->tmp_msg)->len == 0)
+                /* TODO: can we fold this in better to the above code?
+                 * A message without a body that passes a connection fd
+                 * (e.g., "IncomingConnection") is completed above on the
+                 * next pass instead, once the fd is read */
+                if (_LSTransportMessageGetHeader(incoming->tmp_msg)->len == 0 &&
+                    !_LSTransportMessageIsConnectionFdType(incoming->tmp_msg))
                 {
                     g_queue_push_tail(incoming->complete_messages, incoming->tmp_msg);
                     incoming->tmp_msg = NULL;
@@ -3623,27 +4113,32 @@ _LSTransportReceiveClient(GIOChannel *source, GIOCondition condition,
     }
 
     /*
-     * Call the callbacks for methods and filter function callbacks for replies
-     * TODO: should this be done in another callback (idle handler?)
-
-     * <eeh> probably.  You want watch callbacks to return quickly.  But you
-     * don't want heavy network activity to starve message handlers either.
-     * Can you schedule the incomming queue to be processed in the main loop
-     * at a higher priority than idle?  Caveate: if this function and the one
-     * to process the queue have to hold the same mutex then they're going to
-     * starve one another anyway.  To avoid that you'd have to allow
-     * _LSTransportProcessIncomingMessages to return without emptying the
-     * queue and then reschedule it.  Maybe leave things alone but be aware
-     * when evaluating bug reports and performance data that this could be an
-     * issue.
+     * Call the callbacks for methods and filter function callbacks for replies,
+     * one budget of them. The rest is processed in later turns on the
+     * incoming dispatch source, round-robin with the other clients, so that
+     * watch callbacks return quickly and heavy traffic from one client
+     * starves neither the others nor the rest of the main loop
      */
 
     //INCOMING_UNLOCK(&incoming->lock);
 
-    if (!_LSTransportProcessIncomingMessages(client, &lserror))
+    if (shutdown)
     {
-        LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
-        LSErrorFree(&lserror);
+        /* the peer is gone, finish what it sent before cleaning up */
+        if (client->transport->incoming_dispatch)
+        {
+            _LSDispatchSourceCancel(client->transport->incoming_dispatch, client);
+        }
+
+        if (!_LSTransportProcessIncomingMessages(client, &lserror))
+        {
+            LOG_LSERROR(MSGID_LS_TRANSPORT_NETWORK_ERR, &lserror);
+            LSErrorFree(&lserror);
+        }
+    }
+    else if (_LSTransportProcessIncomingBudget(client, &budget) && client->transport->incoming_dispatch)
+    {
+        _LSDispatchSourceSchedule(client->transport->incoming_dispatch, client);
     }
 
     if (shutdown)
@@ -3665,6 +4160,67 @@ _LSTransportReceiveClient(GIOChannel *source, GIOCondition condition,
     }
 }
 
+/**
+ *******************************************************************************
+ * @brief Start receiving from a client that connected to us.
+ *
+ * @param  transport    IN  transport
+ * @param  new_client   IN  client (its ref is dropped)
+ *******************************************************************************
+ */
+static void
+_LSTransportAddIncomingClient(_LSTransport *transport, _LSTransportClient *new_client)
+{
+    LOG_LS_DEBUG("%s: new_client: %p\n", __func__, new_client);
+
+    /* client ref +1 (total = 1) */
+
+    TRANSPORT_LOCK(&transport->lock);
+    /* client ref +1 (total = 2) */
+    _LSTransportAddAllConnectionHash(transport, new_client);
+    TRANSPORT_UNLOCK(&transport->lock);
+
+    /* TODO: maybe ref the client again here */
+    _LSTransportAddReceiveWatch(&new_client->channel, transport->mainloop_context, new_client);
+
+    /* client ref -1 (total = 1) */
+    LOG_LS_DEBUG("%s: unref'ing\n", __func__);
+    _LSTransportClientUnref(new_client);
+}
+
+/**
+ *******************************************************************************
+ * @brief Check whether a client accepted on our listener may talk to us.
+ *
+ * Abstract sockets have no permissions to keep anybody out. Only the hub
+ * connects to the sockets of the services, though (it hands the connections
+ * over to the clients), so on an abstract socket the peer must be the hub.
+ *
+ * @param  transport  IN  transport
+ * @param  client     IN  accepted client
+ *
+ * @retval  true if the client is allowed
+ *******************************************************************************
+ */
+static bool
+_LSTransportAcceptAllowed(const _LSTransport *transport, const _LSTransportClient *client)
+{
+    if (_LSTransportIsHub() || !_LSTransportIsAbstractName(transport->unique_name))
+    {
+        return true;
+    }
+
+    if (!transport->hub)
+    {
+        return false;
+    }
+
+    const _LSTransportCred *hub_cred = _LSTransportClientGetCred(transport->hub);
+    const _LSTransportCred *cred = _LSTransportClientGetCred(client);
+
+    return hub_cred && cred && _LSTransportCredGetPid(cred) == _LSTransportCredGetPid(hub_cred);
+}
+
 /**
  *******************************************************************************
  * @brief Callback to accept incoming connections.
@@ -3705,24 +4261,19 @@ _LSTransportAcceptConnection(GIOChannel *source, GIOCondition condition,
         {
             /* Create a new io channel and add to mainloop */
             _LSTransportClient *new_client = _LSTransportClientNewRef(transport, fd, NULL, NULL, NULL, false);
-            if (new_client)
+            if (new_client && !_LSTransportAcceptAllowed(transport, new_client))
             {
-                LOG_LS_DEBUG("%s: new_client: %p\n", __func__, new_client);
-
-                /* client ref +1 (total = 1) */
+                LOG_LS_ERROR(MSGID_LS_SOCK_ERROR, 1,
+                             PMLOGKFV("PID", "%d", (int) _LSTransportCredGetPid(_LSTransportClientGetCred(new_client))),
+                             "Connection to abstract socket not made by the hub");
 
-                TRANSPORT_LOCK(&transport->lock);
-                /* client ref +1 (total = 2) */
-                _LSTransportAddAllConnectionHash(transport, new_client);
-                TRANSPORT_UNLOCK(&transport->lock);
-
-                /* TODO: maybe ref the client again here */
-                _LSTransportAddReceiveWatch(&new_client->channel, transport->mainloop_context, new_client);
-
-                /* client ref -1 (total = 1) */
-                LOG_LS_DEBUG("%s: unref'ing\n", __func__);
+                /* the client owns the fd */
                 _LSTransportClientUnref(new_client);
             }
+            else if (new_client)
+            {
+                _LSTransportAddIncomingClient(transport, new_client);
+            }
         }
     }
     else
@@ -3734,6 +4285,198 @@ _LSTransportAcceptConnection(GIOChannel *source, GIOCondition condition,
     return TRUE;    /* FALSE means this source should be removed */
 }
 
+/**
+ *******************************************************************************
+ * @brief Handle an "IncomingConnection" message: the hub connected a client
+ * to us with a socket pair (protocol version 5), so take our end as if we
+ * had accepted it.
+ *
+ * @param  message  IN  incoming connection message
+ *******************************************************************************
+ */
+void
+_LSTransportHandleIncomingConnection(_LSTransportMessage *message)
+{
+    _LSTransportClient *client = _LSTransportMessageGetClient(message);
+    _LSTransport *transport = client->transport;
+
+    /* nobody but the hub hands out connections */
+    if (client != transport->hub)
+    {
+        LOG_LS_ERROR(MSGID_LS_SOCK_ERROR, 0, "Connection not passed by the hub");
+        return;
+    }
+
+    int fd = _LSTransportMessageGetConnectionFd(message);
+
+    if (fd == -1)
+    {
+        return;
+    }
+
+    /* the client owns the fd now, instead of the message */
+    _LSTransportMessageSetConnectionFd(message, -1);
+
+    _LSTransportClient *new_client = _LSTransportClientNewRef(transport, fd, NULL, NULL, NULL, false);
+
+    if (new_client)
+    {
+        _LSTransportAddIncomingClient(transport, new_client);
+    }
+    else
+    {
+        close(fd);
+    }
+}
+
+/* True if payloads of payload_len bytes are compressed for the client */
+static inline bool
+_LSTransportClientCompresses(const _LSTransportClient *client, unsigned long payload_len)
+{
+    size_t threshold = _LSTransportCompressGetThreshold();
+
+    return client->peer_inflates && !client->legacy_wire && threshold > 0 && payload_len >= threshold;
+}
+
+/**
+ *******************************************************************************
+ * @brief Queue a message for a client, within the client's high-water marks
+ * (see LSSetOutgoingLimits()).
+ *
+ * A client to be disconnected has its socket shut down, so that the incoming
+ * side sees it hang up and cleans up as for any other disconnect.
+ *
+ * @attention caller must hold the outgoing lock
+ *
+ * @param  client   IN  client
+ * @param  message  IN  message (the queue takes over the caller's ref)
+ *******************************************************************************
+ */
+static void
+_LSTransportClientQueueMessage(_LSTransportClient *client, _LSTransportMessage *message)
+{
+    _LSTransport *transport = client->transport;
+
+    if (!_LSTransportOutgoingPushLimited(client->outgoing, message, &transport->outgoing_limits,
+                                         client == transport->monitor) &&
+        !client->outgoing_overflow && client->channel.fd >= 0)
+    {
+        LOG_LS_WARNING(MSGID_LS_QUEUE_ERROR, 4,
+                       PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                       PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                       PMLOGKFV("MESSAGES", "%u", client->outgoing->stats.messages),
+                       PMLOGKFV("BYTES", "%lu", client->outgoing->stats.bytes),
+                       "Disconnecting client with outgoing queue past its high-water marks");
+
+        client->outgoing_overflow = true;
+        shutdown(client->channel.fd, SHUT_RDWR);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Write as much of a message that has been constructed as an io vector
+ * as the socket takes. The first vector must be the header; peers that only
+ * speak protocol version 1 get the legacy header in its place.
+ *
+ * A message that doesn't fit in one record of a record based channel gets
+ * a first record of @ref record_max bytes, header included; the caller
+ * queues the rest like any unsent rest, which then goes out in records of
+ * the body only (see _LSTransportSendWire()).
+ *
+ * @param  fd           IN  destination fd
+ * @param  record_max   IN  most bytes to write, 0 for no limit (see
+ *                          _LSTransportChannelGetRecordMax())
+ * @param  iov          IN  array of io vectors
+ * @param  iovcnt       IN  size of @ref iov array
+ * @param  total_len    IN  total size of @ref iov array
+ * @param  legacy       IN  true to write the legacy header
+ * @param  flags        IN  flags for sendmsg()
+ *
+ * @retval  bytes written
+ * @retval  -1 on failure (errno is set)
+ *******************************************************************************
+ */
+static ssize_t
+_LSTransportWriteVector(int fd, unsigned long record_max, const struct iovec *iov, int iovcnt,
+                        unsigned long total_len, bool legacy, int flags)
+{
+    LS_ASSERT(iov[0].iov_len == sizeof(_LSTransportHeader));
+
+    struct iovec iov_wire[iovcnt];
+    memcpy(iov_wire, iov, sizeof(iov_wire));
+
+    _LSTransportHeaderV1 header_v1;
+    if (legacy)
+    {
+        _LSTransportHeaderToV1(iov[0].iov_base, &header_v1);
+        iov_wire[0].iov_base = &header_v1;
+        iov_wire[0].iov_len = sizeof(header_v1);
+    }
+
+    if (record_max)
+    {
+        /* cut the vector at the end of the first record */
+        unsigned long left = record_max;
+        int i;
+        for (i = 0; i < iovcnt; i++)
+        {
+            if (iov_wire[i].iov_len >= left)
+            {
+                iov_wire[i].iov_len = left;
+                iovcnt = i + 1;
+                break;
+            }
+            left -= iov_wire[i].iov_len;
+        }
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov_wire;
+    msg.msg_iovlen = iovcnt;
+
+    return sendmsg(fd, &msg, flags);
+}
+
+/* Number of bytes _LSTransportWriteVector() writes for a whole message */
+static inline unsigned long
+_LSTransportVectorWireLen(unsigned long total_len, bool legacy)
+{
+    return legacy ? total_len - sizeof(_LSTransportHeader) + sizeof(_LSTransportHeaderV1) : total_len;
+}
+
+/**
+ *******************************************************************************
+ * @brief Build a message for the part of an io vector that
+ * _LSTransportWriteVector() didn't write.
+ *
+ * @param  iov              IN  array of io vectors
+ * @param  iovcnt           IN  size of @ref iov array
+ * @param  total_len        IN  total size of @ref iov array
+ * @param  legacy           IN  true if the legacy header was written
+ * @param  bytes_written    IN  bytes of the message written already
+ *
+ * @retval  message on success
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+static _LSTransportMessage*
+_LSTransportMessageFromVectorRest(const struct iovec *iov, int iovcnt, unsigned long total_len,
+                                  bool legacy, unsigned long bytes_written)
+{
+    _LSTransportMessage *message = _LSTransportMessageFromVectorNewRef(iov, iovcnt, total_len);
+
+    if (message)
+    {
+        /* what has been written already goes on as it started */
+        _LSTransportMessageFrame(message, legacy, false);
+        message->tx_bytes_remaining -= bytes_written;
+    }
+
+    return message;
+}
+
 /**
  *******************************************************************************
  * @brief Send a message that has been constructed as an io vector.
@@ -3768,12 +4511,15 @@ _LSTransportSendVector(const struct iovec *iov, int iovcnt, unsigned long total_
      * or we risk re-ordering the messages */
     OUTGOING_LOCK(&client->outgoing->lock);
 
+    bool legacy = client->legacy_wire;
+
     if (g_queue_is_empty(client->outgoing->queue))
     {
         //int total_bytes = 0;
 
         /* writev -- send as much of the message as possible without blocking */
-        bytes_written = writev(client->channel.fd, iov, iovcnt);
+        bytes_written = _LSTransportWriteVector(client->channel.fd, _LSTransportChannelGetRecordMax(&client->channel),
+                                                iov, iovcnt, total_len, legacy, 0);
 
         if (bytes_written < 0)
         {
@@ -3810,7 +4556,7 @@ _LSTransportSendVector(const struct iovec *iov, int iovcnt, unsigned long total_
         }
 
         //printf("writev: sent %d bytes out of %ld\n", bytes_written, total_len);
-        if (bytes_written == total_len)
+        if (bytes_written == _LSTransportVectorWireLen(total_len, legacy))
         {
             //_LSTransportHeader *header = (_LSTransportHeader*)iov[0].iov_base;
             //printf("writev: sent message: token %d, type: %d, len: %d\n", (int)header->token, (int)header->type, (int)header->len);
@@ -3821,7 +4567,7 @@ _LSTransportSendVector(const struct iovec *iov, int iovcnt, unsigned long total_
 
     /* either we don't send all the data or there is data on the queue,
      * queue up the rest of the message to be sent */
-    _LSTransportMessage *message = _LSTransportMessageFromVectorNewRef(iov, iovcnt, total_len);
+    _LSTransportMessage *message = _LSTransportMessageFromVectorRest(iov, iovcnt, total_len, legacy, bytes_written);
 
     if (!message)
     {
@@ -3832,8 +4578,6 @@ _LSTransportSendVector(const struct iovec *iov, int iovcnt, unsigned long total_
 
     _LSTransportMessageSetAppId(message, _LSTransportMessageGetBody(message) + app_id_offset);
 
-    message->tx_bytes_remaining = total_len - bytes_written;
-
     /* if the queue is empty, there's no send watch set on it, so we
      * need to add one */
     if (g_queue_is_empty(client->outgoing->queue))
@@ -3846,7 +4590,7 @@ _LSTransportSendVector(const struct iovec *iov, int iovcnt, unsigned long total_
         }
     }
 
-    g_queue_push_tail(client->outgoing->queue, message);
+    _LSTransportClientQueueMessage(client, message);
 
     OUTGOING_UNLOCK(&client->outgoing->lock);
 
@@ -3898,12 +4642,15 @@ _LSTransportSendVectorRet(const struct iovec *iov, int iovcnt, unsigned long tot
 
     _LSTransportMessageSetAppId(message, _LSTransportMessageGetBody(message) + app_id_offset);
 
+    _LSTransportMessageFrame(message, client->legacy_wire, client->peer_inflates);
+
     if (g_queue_is_empty(client->outgoing->queue))
     {
         //int total_bytes = 0;
 
         /* write -- send as much of the message as possible without blocking */
-        bytes_written = write(client->channel.fd, message->raw, total_len);
+        bytes_written = _LSTransportSendWire(client->channel.fd, _LSTransportChannelGetRecordMax(&client->channel),
+                                             message, 0);
 
         if (bytes_written < 0)
         {
@@ -3941,7 +4688,7 @@ _LSTransportSendVectorRet(const struct iovec *iov, int iovcnt, unsigned long tot
         }
 
         //printf("writev: sent %d bytes out of %ld\n", bytes_written, total_len);
-        if (bytes_written == total_len)
+        if (message->tx_bytes_remaining == 0)
         {
             //_LSTransportHeader *header = (_LSTransportHeader*)iov[0].iov_base;
             //printf("writev: sent message: token %d, type: %d, len: %d\n", (int)header->token, (int)header->type, (int)header->len);
@@ -3950,8 +4697,6 @@ _LSTransportSendVectorRet(const struct iovec *iov, int iovcnt, unsigned long tot
         }
     }
 
-    message->tx_bytes_remaining -= bytes_written;
-
     /* if the queue is empty, there's no send watch set on it, so we
      * need to add one */
     if (g_queue_is_empty(client->outgoing->queue))
@@ -3965,7 +4710,7 @@ _LSTransportSendVectorRet(const struct iovec *iov, int iovcnt, unsigned long tot
     }
 
     _LSTransportMessageRef(message);
-    g_queue_push_tail(client->outgoing->queue, message);
+    _LSTransportClientQueueMessage(client, message);
 
     OUTGOING_UNLOCK(&client->outgoing->lock);
 
@@ -4020,6 +4765,12 @@ _LSTransportSendMessageMonitor(_LSTransportMessage *message, _LSTransportClient
 
     _LSTransportMessageCopy(monitor_message, message);
 
+    if (_LSTransportMessageGetHeader(monitor_message)->flags & _LSTransportHeaderFlagFields)
+    {
+        _LSTransportHeaderSetField(_LSTransportMessageGetHeader(monitor_message), _LSTransportFieldMonitor,
+                                   orig_msg_size, dest_service_name_len - 1);
+    }
+
     char *body = _LSTransportMessageGetBody(monitor_message);
     body += orig_msg_size;
     memcpy(body, dest_service_name, dest_service_name_len);
@@ -4145,7 +4896,21 @@ _LSTransportHandleClientInfo(_LSTransportMessage *message)
         client->unique_name = g_strdup(unique_name);
     }
 
-    LOG_LS_DEBUG("%s: client: %p, service_name: %s, unique_name: %s\n", __func__, client, client->service_name, client->unique_name);
+    /* peers older than protocol version 2 don't send their version */
+    int32_t protocol_version;
+    _LSTransportMessageIterNext(&iter);
+    if (!_LSTransportMessageGetInt32(&iter, &protocol_version))
+    {
+        protocol_version = LS_TRANSPORT_PROTOCOL_VERSION_MIN;
+    }
+    client->protocol_version = protocol_version;
+    if (protocol_version >= 2)
+    {
+        client->legacy_wire = false;
+    }
+
+    LOG_LS_DEBUG("%s: client: %p, service_name: %s, unique_name: %s, protocol_version: %"PRId32"\n", __func__,
+                 client, client->service_name, client->unique_name, protocol_version);
 }
 
 /**
@@ -4180,13 +4945,14 @@ _LSTransportSendMessagePrepend(_LSTransportMessage *message, _LSTransportClient
  *
  * @param  service_name     IN  service name
  * @param  unique_name      IN  unique name
+ * @param  protocol_version IN  protocol version the named client speaks
  *
  * @retval message on success
  * @retval NULL on failure
  *******************************************************************************
  */
 _LSTransportMessage*
-_LSTransportMessageClientInfoNewRef(const char *service_name, const char *unique_name)
+_LSTransportMessageClientInfoNewRef(const char *service_name, const char *unique_name, int32_t protocol_version)
 {
     LS_ASSERT(unique_name != NULL);
     _LSTransportMessageIter iter;
@@ -4198,6 +4964,7 @@ _LSTransportMessageClientInfoNewRef(const char *service_name, const char *unique
     _LSTransportMessageIterInit(message, &iter);
     if (!_LSTransportMessageAppendString(&iter, service_name)) goto error;
     if (!_LSTransportMessageAppendString(&iter, unique_name)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, protocol_version)) goto error;
     if (!_LSTransportMessageAppendInvalid(&iter)) goto error;
 
     return message;
@@ -4230,7 +4997,8 @@ _LSTransportSendMessageClientInfo(_LSTransportClient *client, const char *servic
 
     bool ret = false;
 
-    _LSTransportMessage *message = _LSTransportMessageClientInfoNewRef(service_name, unique_name);
+    _LSTransportMessage *message = _LSTransportMessageClientInfoNewRef(service_name, unique_name,
+                                                                       LS_TRANSPORT_PROTOCOL_VERSION);
 
     if (!message)
     {
@@ -4261,6 +5029,56 @@ error:
     return ret;
 }
 
+/**
+ *******************************************************************************
+ * @brief Write a "ClientInfo" message straight onto a connected socket. The
+ * hub uses this to introduce a client to the service it has connected it
+ * to, before passing the connection on. The message is framed with the
+ * version 1 header, which the service reads regardless of its version.
+ *
+ * @param  fd                IN  connected socket
+ * @param  service_name      IN  service name of the client
+ * @param  unique_name       IN  unique name of the client
+ * @param  protocol_version  IN  protocol version the client registered with
+ * @param  lserror           OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+_LSTransportSendClientInfoFd(int fd, const char *service_name, const char *unique_name,
+                             int32_t protocol_version, LSError *lserror)
+{
+    LOG_LS_DEBUG("%s: fd: %d\n", __func__, fd);
+
+    bool ret = false;
+
+    _LSTransportMessage *message = _LSTransportMessageClientInfoNewRef(service_name, unique_name, protocol_version);
+
+    if (!message)
+    {
+        _LSErrorSet(lserror, MSGID_LS_OOM_ERR, -ENOMEM, "OOM");
+        goto error;
+    }
+
+    _LSTransportMessageFrame(message, true, false);
+
+    /* header and body in one write, which makes one record on a record
+     * based connection */
+    if (!_LSTransportSendWireComplete(fd, 0, message, lserror))
+    {
+        goto error;
+    }
+
+    ret = true;
+
+error:
+    if (message) _LSTransportMessageUnref(message);
+
+    return ret;
+}
+
 /**
  *******************************************************************************
  * @brief Send a "NodeUp" message, which tells the hub that this client is up.
@@ -4295,7 +5113,11 @@ _LSTransportSendMessageNodeUp(_LSTransportClient *client, LSError *lserror)
 
 /**
  *******************************************************************************
- * @brief Underlying message sending function.
+ * @brief Underlying message sending function. If nothing is queued for the
+ * client yet, as much of the message as the socket takes is written right
+ * away and only the rest is queued for the send watch.
+ *
+ * @attention locks the outgoing lock
  *
  * @param  message      IN  message to send
  * @param  client       IN  client
@@ -4314,14 +5136,10 @@ _LSTransportSendMessageRaw(_LSTransportMessage *message, _LSTransportClient *cli
                            bool set_token, LSMessageToken *token,
                            bool prepend, LSError *lserror)
 {
-    /* TODO: attempt fast send if queue is empty, but we can also use the vector
-     * version for that */
-
     LOG_LS_DEBUG("%s: client: %p\n", __func__, client);
 
     /* add message to outgoing queue */
     _LSTransportMessageRef(message);
-    message->tx_bytes_remaining = message->raw->header.len + sizeof(message->raw->header);
 
     /* For some messages we may not want to set the token
      * (e.g., monitor messages are clones of regular messages, so we
@@ -4341,26 +5159,46 @@ _LSTransportSendMessageRaw(_LSTransportMessage *message, _LSTransportClient *cli
     /* TODO: lock the hash table of queues as well? (or only that?) */
     OUTGOING_LOCK(&client->outgoing->lock);
 
-    /* if the queue is empty, there's no send watch set on it, so we
-     * need to add one */
+    /* the header goes out with the token, in the version the peer reads;
+     * framed under the lock like in _LSTransportSendVector(), so that the
+     * version can't change between framing and queueing */
+    _LSTransportMessageFrame(message, client->legacy_wire, client->peer_inflates);
+
     if (g_queue_is_empty(client->outgoing->queue))
     {
+        /* Nothing can be reordered, so try to write the message right away
+         * like dbus does, instead of waiting for the send watch to fire on
+         * the next mainloop iteration. Messages that pass a connection fd
+         * are left to _LSTransportSendClient() */
+        if (client->channel.fd >= 0 && !_LSTransportMessageIsConnectionFdType(message))
+        {
+            /* On any error (EAGAIN, a connect still in progress, the peer
+             * going away) queue the message as before and let the send
+             * watch and the incoming side deal with it */
+            (void)_LSTransportSendWire(client->channel.fd, _LSTransportChannelGetRecordMax(&client->channel),
+                                       message, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+            if (message->tx_bytes_remaining == 0)
+            {
+                OUTGOING_UNLOCK(&client->outgoing->lock);
+                _LSTransportMessageUnref(message);
+                return true;
+            }
+        }
+
+        /* if the queue is empty, there's no send watch set on it, so we
+         * need to add one */
+
         /* we can only do this once the mainloop has been attached with
          * LSGmainAttach */
         if (client->transport->mainloop_context)
         {
-            /* TODO */
-            /* <eeh> There's an optimization in dbus whereby IFF the socket is
-               writable and the queue is empty it tries to write immediately
-               rather than enqueue and schedule for later write.  I suspect
-               that's a really common case.  Worth considering?  I'll grant
-               this things are beautifully simple this way.  */
-
             _LSTransportAddSendWatch(&client->channel, client->transport->mainloop_context, client);
         }
-    }
 
-    if (prepend)
+        _LSTransportClientQueueMessage(client, message);
+    }
+    else if (prepend)
     {
 #if 0
         /* preserve serial order */
@@ -4390,11 +5228,21 @@ _LSTransportSendMessageRaw(_LSTransportMessage *message, _LSTransportClient *cli
          * by a caller. In our current usage, that means that we would break
          * the callmap lookups for a message.
          */
-        g_queue_push_head(client->outgoing->queue, message);
+        _LSTransportMessage *head = g_queue_peek_head(client->outgoing->queue);
+
+        /* Don't cut into a message that is already partially on the wire */
+        if (_LSTransportMessageIsSendStarted(head))
+        {
+            _LSTransportOutgoingPushNth(client->outgoing, message, 1);
+        }
+        else
+        {
+            _LSTransportOutgoingPushNth(client->outgoing, message, 0);
+        }
     }
     else
     {
-        g_queue_push_tail(client->outgoing->queue, message);
+        _LSTransportClientQueueMessage(client, message);
     }
     OUTGOING_UNLOCK(&client->outgoing->lock);
 
@@ -4437,17 +5285,21 @@ _LSTransportSendMessage(_LSTransportMessage *message, _LSTransportClient *client
  *******************************************************************************
  * @brief Underlying message reply implementation.
  *
- * @param  message  IN  message to reply to
- * @param  type     IN  reply type
- * @param  payload  IN  payload
- * @param  lserror  OUT set on error
+ * @param  message      IN  message to reply to
+ * @param  type         IN  reply type
+ * @param  payload      IN  payload
+ * @param  update_key   IN  subscription key of a subscription update, NULL otherwise
+ * @param  supersedes   IN  true if the update replaces an unsent one of the
+ *                          same subscription
+ * @param  lserror      OUT set on error
  *
  * @retval  true on success
  * @retval  false on failure
  *******************************************************************************
  */
 static bool
-_LSTransportSendReplyRaw(const _LSTransportMessage *message, _LSTransportMessageType type, const char *payload, LSError *lserror)
+_LSTransportSendReplyRaw(const _LSTransportMessage *message, _LSTransportMessageType type, const char *payload,
+                         const char *update_key, bool supersedes, LSError *lserror)
 {
     LS_ASSERT(_LSTransportMessageTypeIsReplyType(type));
 
@@ -4470,6 +5322,9 @@ _LSTransportSendReplyRaw(const _LSTransportMessage *message, _LSTransportMessage
     offset += sizeof(LSMessageToken);
     memcpy(body + offset, payload, payload_size);
 
+    reply->update_key = g_strdup(update_key);
+    reply->update_supersedes = supersedes;
+
     LOG_LS_DEBUG("sending reply reply_token %d, type: %d, len: %d\n", (int)msg_token, (int)reply->raw->header.type, (int)reply->raw->header.len);
 
     _LSTransportSendMessage(reply, message->client, NULL, NULL);
@@ -4493,29 +5348,234 @@ _LSTransportSendReplyRaw(const _LSTransportMessage *message, _LSTransportMessage
  *******************************************************************************
  */
 bool
-_LSTransportSendErrorReply(const _LSTransportMessage *message, _LSTransportMessageType error_type, const char *error_msg, LSError *lserror)
+_LSTransportSendErrorReply(const _LSTransportMessage *message, _LSTransportMessageType error_type, const char *error_msg, LSError *lserror)
+{
+    LS_ASSERT(_LSTransportMessageTypeIsErrorType(error_type));
+
+    return _LSTransportSendReplyRaw(message, error_type, error_msg, NULL, false, lserror);
+}
+
+/**
+ *******************************************************************************
+ * @brief Send a rely to a message.
+ *
+ * @param  message  IN  message to reply to
+ * @param  payload  IN  payload to send
+ * @param  lserror  OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+_LSTransportSendReply(const _LSTransportMessage *message, const char *payload, LSError *lserror)
+{
+    return _LSTransportSendReplyRaw(message, _LSTransportMessageTypeReply, payload, NULL, false, lserror);
+}
+
+/* Write a reply made of the header, the reply token and the payload pieces
+ * straight to the socket, queueing what isn't written. A queued reply
+ * references shared_payload, if given, instead of copying the payload. See
+ * _LSTransportSendReplyShared() */
+static bool
+_LSTransportSendReplyIov(const _LSTransportMessage *message, const struct iovec *payload_iov,
+                         int payload_cnt, unsigned long payload_size, GBytes **shared_payload,
+                         const char *update_key, bool supersedes)
+{
+    _LSTransportClient *client = message->client;
+
+    /* format: reply_serial + payload */
+    LSMessageToken msg_token = _LSTransportMessageGetToken(message);
+
+    _LSTransportHeader header;
+    _LSTransportHeaderInit(&header, _LSTransportMessageTypeReply, sizeof(LSMessageToken) + payload_size);
+    header.reply_token = msg_token;
+    _LSTransportHeaderSetField(&header, _LSTransportFieldPayload, sizeof(LSMessageToken), payload_size - 1);
+
+    int iovcnt = payload_cnt + 2;
+    struct iovec iov[iovcnt];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = &msg_token;
+    iov[1].iov_len = sizeof(msg_token);
+    memcpy(&iov[2], payload_iov, payload_cnt * sizeof(struct iovec));
+
+    unsigned long total_len = sizeof(header) + header.len;
+
+
+    /* LOCK -- this grabs global_token lock */
+    header.token = _LSTransportGetNextToken(client->transport);
+
+    OUTGOING_LOCK(&client->outgoing->lock);
+
+    ssize_t bytes_written = 0;
+    bool legacy = client->legacy_wire;
+
+    /* If there is anything in the queue, we can't write directly or we risk
+     * re-ordering the messages */
+    if (g_queue_is_empty(client->outgoing->queue) && client->channel.fd >= 0)
+    {
+        /* On any error queue the reply and let the send watch and the
+         * incoming side deal with it, like _LSTransportSendMessageRaw() */
+        bytes_written = _LSTransportWriteVector(client->channel.fd, _LSTransportChannelGetRecordMax(&client->channel),
+                                                iov, iovcnt, total_len, legacy, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (bytes_written < 0)
+        {
+            bytes_written = 0;
+        }
+
+        if (bytes_written == _LSTransportVectorWireLen(total_len, legacy))
+        {
+            OUTGOING_UNLOCK(&client->outgoing->lock);
+            return true;
+        }
+    }
+
+    _LSTransportMessage *reply;
+
+    if (shared_payload)
+    {
+        LS_ASSERT(payload_cnt == 1);
+
+        /* copied once for all the replies that are queued */
+        if (!*shared_payload)
+        {
+            *shared_payload = g_bytes_new(payload_iov[0].iov_base, payload_iov[0].iov_len);
+        }
+
+        reply = _LSTransportMessageFromVectorSharedNewRef(iov, 2, *shared_payload);
+        _LSTransportMessageFrame(reply, legacy, false);
+        reply->tx_bytes_remaining -= bytes_written;
+    }
+    else
+    {
+        reply = _LSTransportMessageFromVectorRest(iov, iovcnt, total_len, legacy, bytes_written);
+    }
+
+    reply->update_key = g_strdup(update_key);
+    reply->update_supersedes = supersedes;
+
+    /* if the queue is empty, there's no send watch set on it, so we
+     * need to add one */
+    if (g_queue_is_empty(client->outgoing->queue))
+    {
+        /* we can only do this once the mainloop has been attached with
+         * LSGmainAttach */
+        if (client->transport->mainloop_context)
+        {
+            _LSTransportAddSendWatch(&client->channel, client->transport->mainloop_context, client);
+        }
+    }
+
+    _LSTransportClientQueueMessage(client, reply);
+
+    OUTGOING_UNLOCK(&client->outgoing->lock);
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Send a reply whose payload is shared with replies to other messages
+ * (subscription broadcast).
+ *
+ * Unlike _LSTransportSendReply() no message is built for the reply: the
+ * header, the reply token and the caller's payload are written as an io
+ * vector straight to the socket. Only if the client has something queued
+ * already, or the socket doesn't take the whole reply, a message is queued.
+ * It holds just the header and the reply token and references a copy of the
+ * payload made once for all the replies that get queued, so a broadcast to
+ * many slow subscribers doesn't copy the payload for each of them. The
+ * payload length is computed once by the caller.
+ *
+ * @attention locks the outgoing lock
+ *
+ * @param  message         IN  message to reply to
+ * @param  payload         IN  payload to send
+ * @param  payload_size    IN  size of payload including the terminating zero
+ * @param  shared_payload  IN/OUT  copy of @ref payload referenced by queued
+ *                                 replies, made by the first of them if
+ *                                 NULL; the caller unrefs it when done
+ * @param  update_key      IN  subscription key of a subscription update, NULL otherwise
+ * @param  supersedes      IN  true if the update replaces an unsent one of the
+ *                             same subscription
+ * @param  lserror         OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+_LSTransportSendReplyShared(const _LSTransportMessage *message, const char *payload,
+                            unsigned long payload_size, GBytes **shared_payload,
+                            const char *update_key, bool supersedes, LSError *lserror)
 {
-    LS_ASSERT(_LSTransportMessageTypeIsErrorType(error_type));
+    _LSTransportClient *client = message->client;
+
+    /* the monitor needs a copy of the message anyway, and a payload that
+     * gets compressed needs a message of its own */
+    if (client->transport->monitor || _LSTransportClientCompresses(client, payload_size - 1))
+    {
+        return _LSTransportSendReplyRaw(message, _LSTransportMessageTypeReply, payload, update_key, supersedes, lserror);
+    }
+
+    struct iovec payload_iov = { .iov_base = (void*)payload, .iov_len = payload_size };
 
-    return _LSTransportSendReplyRaw(message, error_type, error_msg, lserror);
+    return _LSTransportSendReplyIov(message, &payload_iov, 1, payload_size, shared_payload, update_key, supersedes);
 }
 
 /**
  *******************************************************************************
- * @brief Send a rely to a message.
+ * @brief Send a reply whose payload is given in pieces, e.g., cached parts
+ * of a snapshot. The pieces are written as they are, without being copied
+ * into one payload first, like in _LSTransportSendReplyShared().
  *
- * @param  message  IN  message to reply to
- * @param  payload  IN  payload to send
- * @param  lserror  OUT set on error
+ * @attention locks the outgoing lock
+ *
+ * @param  message      IN  message to reply to
+ * @param  payload_iov  IN  pieces of the payload, the last one ending with
+ *                          the terminating zero
+ * @param  payload_cnt  IN  number of pieces
+ * @param  lserror      OUT set on error
  *
  * @retval  true on success
  * @retval  false on failure
  *******************************************************************************
  */
 bool
-_LSTransportSendReply(const _LSTransportMessage *message, const char *payload, LSError *lserror)
+_LSTransportSendReplyVector(const _LSTransportMessage *message, const struct iovec *payload_iov,
+                            int payload_cnt, LSError *lserror)
 {
-    return _LSTransportSendReplyRaw(message, _LSTransportMessageTypeReply, payload, lserror);
+    _LSTransportClient *client = message->client;
+
+    unsigned long payload_size = 0;
+    int i;
+    for (i = 0; i < payload_cnt; i++)
+    {
+        payload_size += payload_iov[i].iov_len;
+    }
+
+    LS_ASSERT(payload_size > 0);
+    LS_ASSERT(((const char *) payload_iov[payload_cnt - 1].iov_base)[payload_iov[payload_cnt - 1].iov_len - 1] == '\0');
+
+    /* the header and the reply token take two more entries */
+    if (client->transport->monitor || _LSTransportClientCompresses(client, payload_size - 1) ||
+        payload_cnt + 2 > IOV_MAX)
+    {
+        char *payload = g_malloc(payload_size);
+        char *pos = payload;
+        for (i = 0; i < payload_cnt; i++)
+        {
+            memcpy(pos, payload_iov[i].iov_base, payload_iov[i].iov_len);
+            pos += payload_iov[i].iov_len;
+        }
+
+        bool ret = _LSTransportSendReplyRaw(message, _LSTransportMessageTypeReply, payload, NULL, false, lserror);
+        g_free(payload);
+        return ret;
+    }
+
+    return _LSTransportSendReplyIov(message, payload_iov, payload_cnt, payload_size, NULL, NULL, false);
 }
 
 /**
@@ -4670,6 +5730,49 @@ error:
     return false;
 }
 
+/**
+ *******************************************************************************
+ * @brief Ask the hub for its traffic statistics.
+ *
+ * The message has no arguments. The hub will reply with the reply serial
+ * followed by a JSON string (see _LSHubHandleQueryHubTelemetry).
+ *
+ * @param  transport        IN  transport
+ * @param  serial           OUT serial for this query message
+ * @param  lserror          OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+LSTransportSendQueryHubTelemetry(_LSTransport *transport, LSMessageToken *serial, LSError *lserror)
+{
+    LS_ASSERT(transport != NULL);
+
+    _LSTransportMessageIter iter;
+    bool ret = false;
+
+    _LSTransportMessage *message = _LSTransportMessageNewRef(LS_TRANSPORT_MESSAGE_DEFAULT_PAYLOAD_SIZE);
+
+    _LSTransportMessageSetType(message, _LSTransportMessageTypeQueryHubTelemetry);
+    _LSTransportMessageIterInit(message, &iter);
+    if (!_LSTransportMessageAppendInvalid(&iter)) goto error;
+
+    LS_ASSERT(transport->hub != NULL);
+
+    ret = _LSTransportSendMessage(message, transport->hub, serial, lserror);
+
+    if (message) _LSTransportMessageUnref(message);
+
+    return ret;
+
+error:
+    if (message) _LSTransportMessageUnref(message);
+    _LSErrorSetOOM(lserror);
+    return false;
+}
+
 /**
  *******************************************************************************
  * @brief Add a message to the pending queue for the given service with a specified token.
@@ -4709,7 +5812,7 @@ _LSTransportAddPendingMessageWithToken(_LSTransport *transport, const char *serv
         LOG_LS_DEBUG("%s: adding message to queue: serial: %d\n", __func__, (int)msg_token);
 
         _LSTransportMessageRef(message);
-        g_queue_push_tail(pending->queue, message);
+        _LSTransportOutgoingPushTail(pending, message);
         OUTGOING_UNLOCK(&pending->lock);
         TRANSPORT_UNLOCK(&transport->lock);
     }
@@ -4737,7 +5840,7 @@ _LSTransportAddPendingMessageWithToken(_LSTransport *transport, const char *serv
 
         LOG_LS_DEBUG("%s: adding message to new pending: %p, serial: %d\n", __func__, out, (int)msg_token);
         _LSTransportMessageRef(message);
-        g_queue_push_tail(out->queue, message);
+        _LSTransportOutgoingPushTail(out, message);
 
         LOG_LS_DEBUG("%s: inserting \"%s\" into pending: %p\n", __func__, service_name, transport->pending);
         g_hash_table_insert(transport->pending, g_strdup(service_name), out);
@@ -4884,9 +5987,12 @@ LSTransportSend(_LSTransport *transport, const char *service_name,
     /* The _LSTransportMessageGetBody() function skips the header */
     app_id_offset = iov[1].iov_len + iov[2].iov_len + iov[3].iov_len;
 
-    /* TODO: use accessors */
-    header.len = category_len + method_len + payload_len + app_id_len;
-    header.type = _LSTransportMessageTypeMethodCall;
+    _LSTransportHeaderInit(&header, _LSTransportMessageTypeMethodCall,
+                           category_len + method_len + payload_len + app_id_len);
+    _LSTransportHeaderSetField(&header, _LSTransportFieldCategory, 0, category_len - 1);
+    _LSTransportHeaderSetField(&header, _LSTransportFieldMethod, category_len, method_len - 1);
+    _LSTransportHeaderSetField(&header, _LSTransportFieldPayload, category_len + method_len, payload_len - 1);
+    _LSTransportHeaderSetField(&header, _LSTransportFieldAppId, app_id_offset, app_id_len - 1);
 
     /* Look up destination and connect to it if we haven't already */
     TRANSPORT_LOCK(&transport->lock);
@@ -4982,6 +6088,7 @@ LSTransportSend(_LSTransport *transport, const char *service_name,
              *
              * Note that monitor_total_size includes the size of the header
              * itself and this doesn't */
+            _LSTransportHeaderSetField(&header, _LSTransportFieldMonitor, header.len, dest_service_name_len - 1);
             header.len += dest_service_name_len + dest_unique_name_len + padding_bytes + monitor_serial_size;
 
             iov_monitor[ARRAY_SIZE(iov)].iov_base = client->service_name;
@@ -5048,7 +6155,7 @@ _LSTransportSendClient(GIOChannel *source, GIOCondition condition,
     	}
 
         /* grab message off queue */
-        _LSTransportMessage *message = g_queue_pop_head(client->outgoing->queue);
+        _LSTransportMessage *message = _LSTransportOutgoingPopHead(client->outgoing);
 
         /* Warn and exit if we dequeue a null */
         if (!message)
@@ -5062,35 +6169,40 @@ _LSTransportSendClient(GIOChannel *source, GIOCondition condition,
 
         if (message->tx_bytes_remaining > 0)
         {
-            /* attempt to send message */
-
-            /* TODO */
-            /* <eeh> This is a lot of math.  Can you calc a ptr upfront and increment it by ret? */
-            ret = send(client->channel.fd, (char*)message->raw + message->raw->header.len + sizeof(_LSTransportHeader) - message->tx_bytes_remaining, message->tx_bytes_remaining, MSG_DONTWAIT);
-
-            if (ret >= 0)
-            {
-                message->tx_bytes_remaining -= ret;
-
-            }
-            else if (errno == EAGAIN || errno == EINTR)
+            /* Messages that waited for the connection (pending ones) haven't
+             * been framed for this peer yet. The others were framed when
+             * they were queued and are sent as they are */
+            if (!_LSTransportMessageIsSendStarted(message) &&
+                !_LSTransportMessageIsFramedFor(message, client->legacy_wire, client->peer_inflates))
             {
-                /* still have data left, so put it back on the queue
-                 * from where we took it off */
-                g_queue_push_head(client->outgoing->queue, message);
-                goto Done;
+                _LSTransportMessageFrame(message, client->legacy_wire, client->peer_inflates);
             }
-            else
+
+            /* attempt to send message */
+            ret = _LSTransportSendWire(client->channel.fd, _LSTransportChannelGetRecordMax(&client->channel),
+                                       message, MSG_DONTWAIT);
+
+            if (ret < 0)
             {
-                /* TODO: Handle better */
-                LOG_LS_ERROR(MSGID_LS_SOCK_ERROR, 4,
-                             PMLOGKFV("ERROR_CODE", "%d", errno),
-                             PMLOGKS("ERROR", g_strerror(errno)),
-                             PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
-                             PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
-                             "Error when attempting to fd: %d", client->channel.fd);
-                _LSTransportMessageUnref(message);
-                goto Done;     /* <eeh> You're going to return TRUE here.  Want that? */
+                if (errno == EAGAIN || errno == EINTR)
+                {
+                    /* still have data left, so put it back on the queue
+                     * from where we took it off */
+                    _LSTransportOutgoingPushNth(client->outgoing, message, 0);
+                    goto Done;
+                }
+                else
+                {
+                    /* TODO: Handle better */
+                    LOG_LS_ERROR(MSGID_LS_SOCK_ERROR, 4,
+                                 PMLOGKFV("ERROR_CODE", "%d", errno),
+                                 PMLOGKS("ERROR", g_strerror(errno)),
+                                 PMLOGKS("APP_ID", _LSTransportClientGetServiceName(client)),
+                                 PMLOGKS("UNIQUE_NAME", _LSTransportClientGetUniqueName(client)),
+                                 "Error when attempting to fd: %d", client->channel.fd);
+                    _LSTransportMessageUnref(message);
+                    goto Done;     /* <eeh> You're going to return TRUE here.  Want that? */
+                }
             }
         }
 
@@ -5115,7 +6227,7 @@ _LSTransportSendClient(GIOChannel *source, GIOCondition condition,
                         /* Still need to send fd, so push message back on
                          * queue where it was and wait for fd to become
                          * ready for sending */
-                        g_queue_push_head(client->outgoing->queue, message);
+                        _LSTransportOutgoingPushNth(client->outgoing, message, 0);
                         goto Done;
                     }
                     else
@@ -5146,7 +6258,7 @@ _LSTransportSendClient(GIOChannel *source, GIOCondition condition,
              * TODO: we don't actually have to exit the loop here; as long as we're
              * calling send with MSG_DONTWAIT, it won't block and we can
              * give it another shot.. we'll get EAGAIN if we would block */
-            g_queue_push_head(client->outgoing->queue, message);
+            _LSTransportOutgoingPushNth(client->outgoing, message, 0);
             goto Done;
         }
     }
@@ -5267,6 +6379,7 @@ _LSTransportInit(_LSTransport **ret_transport, const char *service_name,
      * use default glib priority; can be changed with _LSTransportGmainSetPriority
      */
     transport->source_priority = G_PRIORITY_DEFAULT;
+    transport->dispatch_priority = G_PRIORITY_DEFAULT;
 
     transport->shm = NULL;      /* Set in _LSTransportConnect */
 
@@ -5379,22 +6492,22 @@ _LSTransportFlushQueueMessages(_LSTransportClient *client, GQueue *queue, LSErro
 /**
  *******************************************************************************
  * @brief Process incoming messages by calling the appropriate message
- * handlers or user callback.
- *
- * @attention locks the incoming queue
+ * handlers or user callback, until the budget is spent.
  *
  * @param  client   IN  client
- * @param  lserror  OUT set on error
+ * @param  budget   IN  how many messages (and bytes of them) to process
  *
- * @retval  true on success
- * @retval  false on failure
+ * @retval  true if there are messages left
+ * @retval  false if the queue is empty
  *******************************************************************************
  */
-bool
-_LSTransportProcessIncomingMessages(_LSTransportClient *client, LSError *lserror)
+static bool
+_LSTransportProcessIncomingBudget(_LSTransportClient *client, const _LSTransportIncomingBudget *budget)
 {
     _LSTransportClientRef(client);
     _LSTransportIncoming *incoming = client->incoming;
+    unsigned int processed = 0;
+    unsigned long processed_bytes = 0;
 
     /* TODO: review locking, this function can be called recursively because
      * we can call out to user code, which can potentially call LSUnregister,
@@ -5402,14 +6515,21 @@ _LSTransportProcessIncomingMessages(_LSTransportClient *client, LSError *lserror
     /* <eeh> Does this (that you can't lock the queue) in turn mean you have
        to guarantee that only one thread accesses it?  socket reader and
        message dispatcher have to be same thread? */
+    /* Yes: both run on the handle's context. With worker contexts attached
+     * only the method handler moves off it, after the message has been
+     * popped from this queue */
     //INCOMING_LOCK(&incoming->lock);
 
-    while (!g_queue_is_empty(incoming->complete_messages))
+    while (!g_queue_is_empty(incoming->complete_messages) &&
+           !_LSTransportIncomingBudgetSpent(budget, processed, processed_bytes))
     {
         /* check message type and handle appropriately (method, reply, signal, etc.) */
 
         _LSTransportMessage *tmsg = (_LSTransportMessage*) g_queue_pop_head(incoming->complete_messages);
 
+        processed++;
+        processed_bytes += _LSTransportMessageGetHeader(tmsg)->len;
+
         //INCOMING_UNLOCK(&incoming->lock);
 
         /* Handle "internal" messages, otherwise, let the registered handler take over */
@@ -5446,6 +6566,10 @@ _LSTransportProcessIncomingMessages(_LSTransportClient *client, LSError *lserror
             _LSTransportHandleClientInfo(tmsg);
             break;
 
+        case _LSTransportMessageTypeIncomingConnection:
+            _LSTransportHandleIncomingConnection(tmsg);
+            break;
+
         case _LSTransportMessageTypeMethodCall:
             /* Save message serial so we know what has been processed */
             incoming->last_serial_processed = _LSTransportMessageGetToken(tmsg);
@@ -5461,13 +6585,59 @@ _LSTransportProcessIncomingMessages(_LSTransportClient *client, LSError *lserror
         //INCOMING_LOCK(&incoming->lock);
     }
 
+    bool more = !g_queue_is_empty(incoming->complete_messages);
+
     //INCOMING_UNLOCK(&incoming->lock);
 
     _LSTransportClientUnref(client);
 
+    return more;
+}
+
+/**
+ *******************************************************************************
+ * @brief Process all incoming messages by calling the appropriate message
+ * handlers or user callback.
+ *
+ * @param  client   IN  client
+ * @param  lserror  OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+_LSTransportProcessIncomingMessages(_LSTransportClient *client, LSError *lserror)
+{
+    static const _LSTransportIncomingBudget unlimited = { 0, 0 };
+
+    (void) _LSTransportProcessIncomingBudget(client, &unlimited);
+
     return true;
 }
 
+/**
+ *******************************************************************************
+ * @brief Turn of a client on the incoming dispatch source: process another
+ * budget of its incoming messages.
+ *
+ * @param  item     IN  client
+ * @param  data     IN  transport
+ *
+ * @retval  true if the client has messages left
+ * @retval  false otherwise
+ *******************************************************************************
+ */
+static bool
+_LSTransportDispatchIncoming(void *item, void *data)
+{
+    _LSTransportClient *client = (_LSTransportClient*) item;
+    _LSTransport *transport = (_LSTransport*) data;
+
+    _LSTransportIncomingBudget budget = transport->incoming_budget;
+    return _LSTransportProcessIncomingBudget(client, &budget);
+}
+
 /**
  *******************************************************************************
  * @brief Flush all messages in the outgoing queue.
@@ -5492,7 +6662,7 @@ _LSTransportFlushOutgoingMessages(_LSTransportClient *client, LSError *lserror)
 
     while (!g_queue_is_empty(client->outgoing->queue))
     {
-        _LSTransportMessage *message = g_queue_pop_head(client->outgoing->queue);
+        _LSTransportMessage *message = _LSTransportOutgoingPopHead(client->outgoing);
         if (!message)
         {
             /* LOCKED */
@@ -5690,6 +6860,10 @@ _LSTransportDisconnect(_LSTransport *transport, bool flush_and_send_shutdown)
     g_hash_table_foreach(transport->all_connections, _LSTransportSendShutdownMessages, GINT_TO_POINTER((gint)flush_and_send_shutdown));
     TRANSPORT_UNLOCK(&transport->lock);
 
+    /* no more turns; what's left over is discarded below */
+    _LSDispatchSourceFree(transport->incoming_dispatch);
+    transport->incoming_dispatch = NULL;
+
     _LSTransportDiscardAllClientIncoming(transport);
 
     _LSTransportChannelClose(&transport->listen_channel, flush_and_send_shutdown);
@@ -5745,6 +6919,9 @@ _LSTransportDeinit(_LSTransport *transport)
         if (transport->global_token) _LSTransportGlobalTokenFree(transport->global_token);
         transport->global_token = NULL;
 
+        _LSDispatchSourceFree(transport->incoming_dispatch);
+        transport->incoming_dispatch = NULL;
+
         /* unref the GMainContext */
         if (transport->mainloop_context) g_main_context_unref(transport->mainloop_context);
         transport->mainloop_context = NULL;
@@ -5863,4 +7040,176 @@ void _LSTransportSetTransportType(_LSTransport *transport, _LSTransportType type
     transport->type = type;
 }
 
+typedef struct _LSTransportOutgoingStatsCtx {
+    _LSTransportOutgoingStatsFunc func;
+    void *ctx;
+} _LSTransportOutgoingStatsCtx;
+
+static void
+_LSTransportOutgoingStatsHelper(gpointer key, gpointer value, gpointer user_data)
+{
+    _LSTransportClient *client = (_LSTransportClient*)value;
+    _LSTransportOutgoingStatsCtx *stats_ctx = (_LSTransportOutgoingStatsCtx*)user_data;
+
+    _LSTransportOutgoingStats stats;
+    _LSTransportClientGetOutgoingStats(client, &stats);
+
+    stats_ctx->func(client->service_name, client->unique_name, &stats, stats_ctx->ctx);
+}
+
+/**
+ *******************************************************************************
+ * @brief Report the counters of every connection's outgoing queue.
+ *
+ * @attention locks the transport lock and each outgoing lock in turn
+ *
+ * @param  transport    IN  transport
+ * @param  func         IN  called once per connection
+ * @param  ctx          IN  passed to @ref func
+ *******************************************************************************
+ */
+void
+_LSTransportGetOutgoingQueueStats(_LSTransport *transport, _LSTransportOutgoingStatsFunc func, void *ctx)
+{
+    LS_ASSERT(transport != NULL);
+    LS_ASSERT(func != NULL);
+
+    _LSTransportOutgoingStatsCtx stats_ctx = { func, ctx };
+
+    TRANSPORT_LOCK(&transport->lock);
+    if (transport->all_connections)
+    {
+        g_hash_table_foreach(transport->all_connections, _LSTransportOutgoingStatsHelper, &stats_ctx);
+    }
+    TRANSPORT_UNLOCK(&transport->lock);
+}
+
+/**
+ *******************************************************************************
+ * @brief Set the high-water marks of the outgoing queues of all the
+ * transport's clients, and what happens once a queue reaches them. Messages
+ * queued already are left alone.
+ *
+ * @attention locks the transport lock
+ *
+ * @param  transport    IN  transport
+ * @param  limits       IN  high-water marks and policy
+ *******************************************************************************
+ */
+void
+_LSTransportSetOutgoingLimits(_LSTransport *transport, const _LSTransportOutgoingLimits *limits)
+{
+    LS_ASSERT(transport != NULL);
+    LS_ASSERT(limits != NULL);
+
+    TRANSPORT_LOCK(&transport->lock);
+    transport->outgoing_limits = *limits;
+    TRANSPORT_UNLOCK(&transport->lock);
+}
+
+/**
+ *******************************************************************************
+ * @brief Set how much of each client's incoming traffic is read and
+ * processed per turn, and the priority of the source the turns after the
+ * first one run on.
+ *
+ * @attention locks the transport lock
+ *
+ * @param  transport    IN  transport
+ * @param  budget       IN  per-turn budget
+ * @param  priority     IN  glib priority of the incoming dispatch source
+ *******************************************************************************
+ */
+void
+_LSTransportSetIncomingBudget(_LSTransport *transport, const _LSTransportIncomingBudget *budget, int priority)
+{
+    LS_ASSERT(transport != NULL);
+    LS_ASSERT(budget != NULL);
+
+    TRANSPORT_LOCK(&transport->lock);
+    transport->incoming_budget = *budget;
+    transport->dispatch_priority = priority;
+    TRANSPORT_UNLOCK(&transport->lock);
+
+    if (transport->incoming_dispatch)
+    {
+        _LSDispatchSourceSetPriority(transport->incoming_dispatch, priority);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Check if a client's outgoing queue has reached its high-water marks,
+ * i.e., the next message would be subject to the queue's policy.
+ *
+ * @attention locks the outgoing lock
+ *
+ * @param  client   IN  client
+ *
+ * @retval  true if the client is backed up
+ * @retval  false if it isn't, or the queue has no marks
+ *******************************************************************************
+ */
+bool
+_LSTransportClientIsBackedUp(_LSTransportClient *client)
+{
+    LS_ASSERT(client != NULL);
+
+    OUTGOING_LOCK(&client->outgoing->lock);
+    bool backed_up = _LSTransportOutgoingIsOverLimits(client->outgoing, &client->transport->outgoing_limits, 1, 1);
+    OUTGOING_UNLOCK(&client->outgoing->lock);
+
+    return backed_up;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the counters of a client's outgoing queue.
+ *
+ * @attention locks the outgoing lock
+ *
+ * @param  client   IN  client
+ * @param  stats    OUT counters
+ *******************************************************************************
+ */
+void
+_LSTransportClientGetOutgoingStats(_LSTransportClient *client, _LSTransportOutgoingStats *stats)
+{
+    LS_ASSERT(client != NULL);
+    LS_ASSERT(stats != NULL);
+
+    OUTGOING_LOCK(&client->outgoing->lock);
+    *stats = client->outgoing->stats;
+    OUTGOING_UNLOCK(&client->outgoing->lock);
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the number of services we are still waiting on a QueryName
+ * reply for.
+ *
+ * @attention locks the transport lock
+ *
+ * @param  transport    IN  transport
+ *
+ * @retval  number of pending QueryName requests
+ *******************************************************************************
+ */
+unsigned int
+_LSTransportGetPendingQueryNameCount(_LSTransport *transport)
+{
+    LS_ASSERT(transport != NULL);
+
+    unsigned int count = 0;
+
+    TRANSPORT_LOCK(&transport->lock);
+    if (transport->pending)
+    {
+        count = g_hash_table_size(transport->pending);
+    }
+    TRANSPORT_UNLOCK(&transport->lock);
+
+    return count;
+}
+
 /* @} END OF LunaServiceTransport */
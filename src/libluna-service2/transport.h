@@ -79,8 +79,34 @@ _padding_bytes(unsigned int align_bytes, unsigned int size_bytes)
  * Used to determine protocol compatibility when registering with the hub.
  * The value is an integer that should be incremented whenever the low level
  * message format changes.
+ *
+ * Version 2 introduced @ref LSTransportHeader with its field table. Peers
+ * still exchange the version 1 header with those that only speak version 1.
+ *
+ * Version 3 introduced service status signals with typed fields (see
+ * @ref LSTransportMessageServiceStatusSignalNewRef()). The hub still sends
+ * them with a JSON payload to clients of older versions.
+ *
+ * Version 4 folded "NodeUp" and the "ClientInfo" to the hub into
+ * "RequestName": the hub takes the client as up once it has replied. The hub
+ * also introduces such clients to the services it connects them to, by
+ * writing their "ClientInfo" onto the connection before passing it (see
+ * _LSTransportSendClientInfoFd()).
+ *
+ * Version 5 clients don't listen for connections: the hub connects them to
+ * each other with socket pairs, and hands the service its end in an
+ * "IncomingConnection" message. A service launched with a socket created
+ * beforehand still gets that socket in the "RequestName" reply.
+ *
+ * Version 6 clients also read connections made of records (SOCK_SEQPACKET),
+ * one message per record, which the hub may connect two of them with (see
+ * _LSTransportChannelGetRecordMax()).
  */
-#define LS_TRANSPORT_PROTOCOL_VERSION   1
+#define LS_TRANSPORT_PROTOCOL_VERSION       6
+#define LS_TRANSPORT_PROTOCOL_VERSION_MIN   1   /**< oldest version still spoken */
+
+#define LS_TRANSPORT_LISTEN_FDS_START   3   /**< first descriptor passed by a socket-activating
+                                                 launcher (see _LSTransportGetInheritedListenFd()) */
 
 /* can override these with environment variable */
 #define HUB_DEFAULT_INET_ADDRESS        192.168.2.101
@@ -109,6 +135,11 @@ _padding_bytes(unsigned int align_bytes, unsigned int size_bytes)
 
 #define HUB_LOCAL_ADDRESS_PUBLIC        "/tmp/com.palm.public_hub"
 #define HUB_LOCAL_ADDRESS_PRIVATE       "/tmp/com.palm.private_hub"
+
+/** Addresses of a hub listening in the abstract namespace (see the
+ * AbstractSockets option of the hub); clients try these first */
+#define HUB_ABSTRACT_ADDRESS_PUBLIC     "@com.palm.public_hub"
+#define HUB_ABSTRACT_ADDRESS_PRIVATE    "@com.palm.private_hub"
 #define HUB_NAME                        "com.palm.hub"
 
 #define MONITOR_NAME                    "com.palm.monitor"
@@ -176,7 +207,11 @@ bool _LSTransportConnect(_LSTransport *transport, bool local, bool public_bus, L
 bool _LSTransportAppendCategory(_LSTransport *transport, const char *category, LSMethod *methods, LSError *lserror);
 _LSTransportConnectState _LSTransportConnectLocal(const char *unique_name, bool new_socket, int *fd, LSError *lserror);
 bool _LSTransportListenLocal(const char *unique_name, mode_t mode, int *fd, LSError *lserror);
+bool _LSTransportSendClientInfoFd(int fd, const char *service_name, const char *unique_name,
+                                  int32_t protocol_version, LSError *lserror);
 bool _LSTransportSetupListenerLocal(_LSTransport *transport, const char *name, mode_t mode, LSError *lserror);
+bool _LSTransportSetupListenerLocalWithFd(_LSTransport *transport, const char *name, int listen_fd, LSError *lserror);
+int _LSTransportGetInheritedListenFd(const char *name);
 bool _LSTransportSetupListenerInet(_LSTransport *transport, int port, LSError *lserror);
 bool _LSTransportSendMessage(_LSTransportMessage *message, _LSTransportClient *client,
                         LSMessageToken *token, LSError *lserror);
@@ -188,6 +223,12 @@ inline bool _LSTransportIsHub(void);
 
 bool LSTransportSend(_LSTransport *transport, const char *service_name, const char *category, const char *method, const char *payload, const char* applicationId, LSMessageToken *token, LSError *lserror);
 bool _LSTransportSendReply(const _LSTransportMessage *message, const char *payload, LSError *lserror);
+bool _LSTransportSendReplyShared(const _LSTransportMessage *message, const char *payload,
+                                 unsigned long payload_size, GBytes **shared_payload,
+                                 const char *update_key, bool supersedes, LSError *lserror);
+bool _LSTransportSendReplyVector(const _LSTransportMessage *message, const struct iovec *payload_iov,
+                                 int payload_cnt, LSError *lserror);
+void _LSTransportHandleMessageHandlerResult(_LSTransportMessage *message, LSMessageHandlerResult ret);
 
 bool LSTransportCancelMethodCall(_LSTransport *transport, const char *service_name, LSMessageToken serial, LSError *lserror);
 
@@ -200,8 +241,18 @@ bool LSTransportSendQueryServiceStatus(_LSTransport *transport, const char *serv
 bool LSTransportSendQueryServiceCategory(_LSTransport *transport,
                                          const char *service_name, const char *category,
                                          LSMessageToken *serial, LSError *lserror);
+bool LSTransportSendQueryHubTelemetry(_LSTransport *transport, LSMessageToken *serial, LSError *lserror);
 const char* _LSTransportQueryNameReplyGetUniqueName(_LSTransportMessage *message);
 
+typedef void (*_LSTransportOutgoingStatsFunc)(const char *service_name, const char *unique_name,
+                                              const _LSTransportOutgoingStats *stats, void *ctx);
+void _LSTransportGetOutgoingQueueStats(_LSTransport *transport, _LSTransportOutgoingStatsFunc func, void *ctx);
+void _LSTransportSetOutgoingLimits(_LSTransport *transport, const _LSTransportOutgoingLimits *limits);
+void _LSTransportSetIncomingBudget(_LSTransport *transport, const _LSTransportIncomingBudget *budget, int priority);
+bool _LSTransportClientIsBackedUp(_LSTransportClient *client);
+void _LSTransportClientGetOutgoingStats(_LSTransportClient *client, _LSTransportOutgoingStats *stats);
+unsigned int _LSTransportGetPendingQueryNameCount(_LSTransport *transport);
+
 #ifdef UNIT_TESTS
 void _LSTransportSetTransportType(_LSTransport *transport, _LSTransportType type);
 #endif // UNIT_TESTS
@@ -19,6 +19,7 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/socket.h>
 
 #include "error.h"
 #include "transport_utils.h"
@@ -65,6 +66,10 @@ _LSTransportChannelInit(_LSTransport *transport, _LSTransportChannel *channel, i
     channel->recv_watch = NULL;
     channel->accept_watch = NULL;
 
+    int type = 0;
+    socklen_t len = sizeof(type);
+    channel->seqpacket = getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0 && type == SOCK_SEQPACKET;
+
     return true;
 }
 
@@ -119,6 +124,24 @@ _LSTransportChannelGetFd(const _LSTransportChannel *channel)
     return channel->fd;
 }
 
+/**
+ *******************************************************************************
+ * @brief Get the most bytes to write at once to a channel. A record based
+ * channel takes each write as one record, which fails if it doesn't fit in
+ * the socket buffer; larger messages are written in several records.
+ *
+ * @param  channel  IN  channel
+ *
+ * @retval  most bytes per write
+ * @retval  0 if there is no limit (stream channel)
+ *******************************************************************************
+ */
+unsigned long
+_LSTransportChannelGetRecordMax(const _LSTransportChannel *channel)
+{
+    return channel->seqpacket ? LS_TRANSPORT_RECORD_MAX : 0;
+}
+
 /**
  *******************************************************************************
  * @brief Close a channel.
@@ -28,6 +28,10 @@
 typedef struct LSTransport _LSTransport;
 #endif
 
+#define LS_TRANSPORT_RECORD_MAX     (64 * 1024)     /**< most bytes written at once to a record based
+                                                         (SOCK_SEQPACKET) channel, well below the
+                                                         default socket buffer size */
+
 struct LSTransportChannel {
     _LSTransport *transport;    /**< transport that owns this channel */
     int fd;
@@ -36,12 +40,15 @@ struct LSTransportChannel {
     GSource *send_watch;
     GSource *recv_watch;
     GSource *accept_watch;      /**< only used on listen channel (one per transport */
+    bool seqpacket;             /**< SOCK_SEQPACKET socket: each write is a record, and
+                                     each read takes one record */
 };
 
 typedef struct LSTransportChannel _LSTransportChannel;
 
 bool _LSTransportChannelInit(_LSTransport *transport, _LSTransportChannel *channel, int fd, int priority);
 int _LSTransportChannelGetFd(const _LSTransportChannel *channel);
+unsigned long _LSTransportChannelGetRecordMax(const _LSTransportChannel *channel);
 void _LSTransportChannelDeinit(_LSTransportChannel *channel);
 void _LSTransportChannelClose(_LSTransportChannel *channel, bool flush);
 void _LSTransportChannelSetPriority(_LSTransportChannel *channel, int priority);
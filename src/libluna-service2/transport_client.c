@@ -64,6 +64,7 @@ _LSTransportClientNew(_LSTransport* transport, int fd, const char *service_name,
     new_client->is_sysmgr_app_proxy = false;
     new_client->is_dynamic = false;
     new_client->initiator = initiator;
+    new_client->legacy_wire = true;
 
     _LSTransportChannelInit(transport, &new_client->channel, fd, transport->source_priority);
 
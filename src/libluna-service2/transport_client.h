@@ -59,6 +59,26 @@ struct LSTransportClient {
                                           used by apps */
     bool is_dynamic;                    /**< true for a dynamic service */
     bool initiator;                     /**< true if this is side that initiated the connection (typically by a method call) */
+    int32_t protocol_version;           /**< protocol version the peer registered with, or
+                                             told us in its "ClientInfo" message */
+    bool legacy_wire;                   /**< true until the peer is known to speak protocol
+                                             version 2; messages are then framed with legacy
+                                             headers (see _LSTransportMessageFrame()) */
+    bool peer_inflates;                 /**< the peer decompresses the payloads we compress,
+                                             as told by the headers it sends */
+    bool typed_status;                  /**< the peer speaks protocol version 3 and reads
+                                             service status signals without JSON payloads */
+    bool fast_register;                 /**< the peer speaks protocol version 4: registering
+                                             implies "NodeUp" and "ClientInfo", and the hub
+                                             introduces registered clients to the services
+                                             they get connected to */
+    bool pair_connect;                  /**< the peer speaks protocol version 5 and takes its
+                                             connections from the hub as socket pairs instead
+                                             of listening for them */
+    bool seqpacket_connect;             /**< the peer speaks protocol version 6 and reads
+                                             connections made of records (SOCK_SEQPACKET) */
+    bool outgoing_overflow;             /**< being disconnected for an outgoing queue past its
+                                             high-water marks */
 };
 
 _LSTransportClient* _LSTransportClientNew(_LSTransport* transport, int fd, const char *service_name, const char *unique_name, _LSTransportOutgoing *outgoing, bool initiator);
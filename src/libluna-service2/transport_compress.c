@@ -0,0 +1,163 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <stdlib.h>
+#include <glib.h>
+
+#if defined(HAVE_LZ4)
+#include <lz4.h>
+#elif defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include "transport_compress.h"
+
+/**
+ * @addtogroup LunaServiceInternals
+ * @{
+ */
+
+/** zstd level; payloads are compressed on the sender's send path, so favor speed */
+#define ZSTD_LEVEL  1
+
+/**
+ *******************************************************************************
+ * @brief Get the codec the library is built with.
+ *
+ * @retval codec, _LSTransportCodecNone if payloads are never compressed
+ *******************************************************************************
+ */
+_LSTransportCodec
+_LSTransportCompressGetCodec(void)
+{
+#if defined(HAVE_LZ4)
+    return _LSTransportCodecLz4;
+#elif defined(HAVE_ZSTD)
+    return _LSTransportCodecZstd;
+#else
+    return _LSTransportCodecNone;
+#endif
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the payload size from which payloads are compressed.
+ *
+ * @retval size in bytes, 0 if payloads aren't compressed
+ *******************************************************************************
+ */
+size_t
+_LSTransportCompressGetThreshold(void)
+{
+    static gsize threshold = 0;
+
+    if (g_once_init_enter(&threshold))
+    {
+        /* g_once_init_leave() doesn't take 0, so store the threshold + 1 */
+        gsize value = LS_TRANSPORT_COMPRESS_DEFAULT_THRESHOLD;
+
+        const char *env = getenv("LS_COMPRESS_THRESHOLD");
+        if (env)
+        {
+            value = strtoul(env, NULL, 10);
+        }
+
+        if (_LSTransportCompressGetCodec() == _LSTransportCodecNone)
+        {
+            value = 0;
+        }
+
+        g_once_init_leave(&threshold, value + 1);
+    }
+
+    return threshold - 1;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the worst case size of compressed data.
+ *
+ * @param  len      IN  size of the data to compress
+ *
+ * @retval size in bytes
+ *******************************************************************************
+ */
+size_t
+_LSTransportCompressBound(size_t len)
+{
+#if defined(HAVE_LZ4)
+    return LZ4_compressBound(len);
+#elif defined(HAVE_ZSTD)
+    return ZSTD_compressBound(len);
+#else
+    return len;
+#endif
+}
+
+/**
+ *******************************************************************************
+ * @brief Compress data.
+ *
+ * @param  src          IN  data
+ * @param  len          IN  size of @ref src
+ * @param  dest         OUT compressed data
+ * @param  dest_size    IN  size of @ref dest
+ *
+ * @retval size of the compressed data
+ * @retval 0 if the data couldn't be compressed into @ref dest
+ *******************************************************************************
+ */
+size_t
+_LSTransportCompress(const char *src, size_t len, char *dest, size_t dest_size)
+{
+#if defined(HAVE_LZ4)
+    int ret = LZ4_compress_default(src, dest, len, dest_size);
+    return ret > 0 ? ret : 0;
+#elif defined(HAVE_ZSTD)
+    size_t ret = ZSTD_compress(dest, dest_size, src, len, ZSTD_LEVEL);
+    return ZSTD_isError(ret) ? 0 : ret;
+#else
+    return 0;
+#endif
+}
+
+/**
+ *******************************************************************************
+ * @brief Decompress data compressed with _LSTransportCompress() by a peer.
+ *
+ * @param  src          IN  compressed data
+ * @param  len          IN  size of @ref src
+ * @param  dest         OUT data
+ * @param  dest_len     IN  size of the data
+ *
+ * @retval true if exactly @ref dest_len bytes were decompressed
+ *******************************************************************************
+ */
+bool
+_LSTransportDecompress(const char *src, size_t len, char *dest, size_t dest_len)
+{
+#if defined(HAVE_LZ4)
+    return LZ4_decompress_safe(src, dest, len, dest_len) == (int) dest_len;
+#elif defined(HAVE_ZSTD)
+    return ZSTD_decompress(dest, dest_len, src, len) == dest_len;
+#else
+    return false;
+#endif
+}
+
+/* @} END OF LunaServiceInternals */
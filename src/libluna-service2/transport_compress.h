@@ -0,0 +1,54 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _TRANSPORT_COMPRESS_H_
+#define _TRANSPORT_COMPRESS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @addtogroup LunaServiceInternals
+ * @{
+ */
+
+/**
+ * Payload compression codec the library is built with (CMake option
+ * WEBOS_LS2_COMPRESSION). Peers only compress for each other when they
+ * were built with the same codec.
+ */
+typedef enum LSTransportCodec {
+    _LSTransportCodecNone,
+    _LSTransportCodecLz4,
+    _LSTransportCodecZstd,
+} _LSTransportCodec;
+
+/** Payloads at least this big are compressed, unless overridden with the
+ * LS_COMPRESS_THRESHOLD environment variable (0 turns compression off) */
+#define LS_TRANSPORT_COMPRESS_DEFAULT_THRESHOLD    (64 * 1024)
+
+_LSTransportCodec _LSTransportCompressGetCodec(void);
+size_t _LSTransportCompressGetThreshold(void);
+size_t _LSTransportCompressBound(size_t len);
+size_t _LSTransportCompress(const char *src, size_t len, char *dest, size_t dest_size);
+bool _LSTransportDecompress(const char *src, size_t len, char *dest, size_t dest_len);
+
+/* @} END OF LunaServiceInternals */
+
+#endif // _TRANSPORT_COMPRESS_H_
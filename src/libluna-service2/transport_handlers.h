@@ -29,6 +29,8 @@ typedef enum
     LSMessageHandlerResultHandled,          /**< message was handled */
     LSMessageHandlerResultNotHandled,       /**< message was not handled; error will be sent as reply */
     LSMessageHandlerResultUnknownMethod,    /**< method was not found; error will be sent as reply */
+    LSMessageHandlerResultDeferred,         /**< message was queued to a worker, which reports the
+                                                 result with _LSTransportHandleMessageHandlerResult() */
 } LSMessageHandlerResult;
 
 typedef LSMessageHandlerResult (*LSTransportMessageHandler)(_LSTransportMessage *message, void *context);
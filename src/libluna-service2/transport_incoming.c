@@ -52,6 +52,7 @@ _LSTransportIncoming* _LSTransportIncomingNew(void)
         goto error;
     }
     incoming->complete_messages = g_queue_new();
+    incoming->legacy_wire = true;
 
     return incoming;
 
@@ -21,6 +21,7 @@
 #define _TRANSPORT_INCOMING_H_
 
 #include <pthread.h>
+#include <stdbool.h>
 #include <glib.h>
 #include <luna-service2/lunaservice.h>
 #include "transport_message.h"
@@ -28,7 +29,10 @@
 struct LSTransportIncoming {
     pthread_mutex_t lock;
     LSMessageToken last_serial_processed;   /**< last reply processed -- see LSTransportSerial */
-    _LSTransportHeader tmp_header;          /**< temp location when reading in the header */
+    _LSTransportHeader tmp_header;          /**< temp location when reading in the header (of
+                                                 either version) */
+    bool legacy_wire;                       /**< headers are read as protocol version 1 until
+                                                 the peer sends a newer one */
     unsigned long tmp_header_offset;        /**< end of valid data in temp header */
     _LSTransportMessage *tmp_msg;           /**< temp location when building up a message */
     unsigned long tmp_msg_offset;           /**< end of data in temp message */
@@ -37,6 +41,21 @@ struct LSTransportIncoming {
 
 typedef struct LSTransportIncoming _LSTransportIncoming;
 
+/** How much of a client's incoming traffic is read and processed in one
+ * turn, before other clients get theirs. 0 means no limit */
+typedef struct LSTransportIncomingBudget {
+    unsigned int max_messages;
+    unsigned long max_bytes;
+} _LSTransportIncomingBudget;
+
+static inline bool
+_LSTransportIncomingBudgetSpent(const _LSTransportIncomingBudget *budget,
+                                unsigned int messages, unsigned long bytes)
+{
+    return (budget->max_messages && messages >= budget->max_messages) ||
+           (budget->max_bytes && bytes >= budget->max_bytes);
+}
+
 _LSTransportIncoming* _LSTransportIncomingNew(void);
 void _LSTransportIncomingFree(_LSTransportIncoming *incoming);
 
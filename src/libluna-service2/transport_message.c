@@ -19,9 +19,11 @@
 
 #include <string.h>
 #include <unistd.h>
+#include <inttypes.h>
 #include "error.h"
 #include "transport.h"
 #include "transport_message.h"
+#include "transport_compress.h"
 
 /**
  * Returns true if it is safe to dereference the specificed type with the
@@ -57,6 +59,7 @@ static _LSTransportMessageRaw EMPTY_RAW_MESSAGE =
 {
     .header =
         {
+            .magic = LS_TRANSPORT_HEADER_MAGIC,
             .len = 0,
             .token = LSMESSAGE_TOKEN_INVALID,
             .type = _LSTransportMessageTypeUnknown,
@@ -104,9 +107,7 @@ _LSTransportMessageNew(unsigned long payload_size)
 
     ret->raw = g_malloc(sizeof(_LSTransportMessageRaw) + payload_size);
 
-    ret->raw->header.len = payload_size;
-    ret->raw->header.token = LSMESSAGE_TOKEN_INVALID;
-    ret->raw->header.type = _LSTransportMessageTypeUnknown;
+    _LSTransportHeaderInit(&ret->raw->header, _LSTransportMessageTypeUnknown, payload_size);
     ret->alloc_body_size = payload_size;
     ret->tx_bytes_remaining = payload_size + sizeof(_LSTransportHeader);
     ret->connection_fd = -1;
@@ -128,6 +129,10 @@ _LSTransportMessageReset(_LSTransportMessage *message)
 {
     LS_ASSERT(message);
 
+    message->framed = false;
+    message->wire_v1 = false;
+    g_free(message->wire_raw);
+    message->wire_raw = NULL;
     message->tx_bytes_remaining = message->raw->header.len + sizeof(_LSTransportHeader);
     message->connection_fd = -1;
 }
@@ -178,6 +183,11 @@ _LSTransportMessageFree(_LSTransportMessage *message)
     message->app_id = NULL;    /* just for sanity; this points inside the raw message */
 
     g_free(message->raw);
+    g_free(message->wire_raw);
+    g_free(message->inflated_payload);
+    g_free(message->update_key);
+
+    if (message->shared_payload) g_bytes_unref(message->shared_payload);
 
 #ifdef MEMCHECK
     memset(message, 0xFF, sizeof(_LSTransportMessage));
@@ -186,11 +196,231 @@ _LSTransportMessageFree(_LSTransportMessage *message)
     g_slice_free(_LSTransportMessage, message);
 }
 
+/* Header flags telling peers which compressed payloads we decompress */
+static inline uint32_t
+_LSTransportHeaderAcceptFlags(void)
+{
+    switch (_LSTransportCompressGetCodec())
+    {
+    case _LSTransportCodecLz4:
+        return _LSTransportHeaderFlagAcceptLz4;
+    case _LSTransportCodecZstd:
+        return _LSTransportHeaderFlagAcceptZstd;
+    default:
+        return 0;
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Initialize a header with no token and without a field table.
+ *
+ * @param  header   OUT header
+ * @param  type     IN  message type
+ * @param  len      IN  size of the body
+ *******************************************************************************
+ */
+void
+_LSTransportHeaderInit(_LSTransportHeader *header, _LSTransportMessageType type, unsigned long len)
+{
+    memset(header, 0, sizeof(*header));
+
+    header->magic = LS_TRANSPORT_HEADER_MAGIC;
+    header->type = type;
+    header->len = len;
+    header->token = LSMESSAGE_TOKEN_INVALID;
+    header->flags = _LSTransportHeaderAcceptFlags();
+
+    int i;
+    for (i = 0; i < _LSTransportFieldCount; i++)
+    {
+        header->fields[i].len = LS_TRANSPORT_FIELD_ABSENT;
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Locate a field of the body in the header. Fields that aren't set
+ * are absent once any field is set.
+ *
+ * @param  header   IN  header
+ * @param  field    IN  field
+ * @param  offset   IN  offset of the field from the start of the body
+ * @param  len      IN  len of the field without the terminating NUL
+ *******************************************************************************
+ */
+void
+_LSTransportHeaderSetField(_LSTransportHeader *header, _LSTransportField field,
+                           unsigned long offset, unsigned long len)
+{
+    LS_ASSERT(field < _LSTransportFieldCount);
+
+    header->fields[field].offset = offset;
+    header->fields[field].len = len;
+    header->flags |= _LSTransportHeaderFlagFields;
+}
+
+/**
+ *******************************************************************************
+ * @brief Check the field table of a received header. Every field has to lie
+ * within the body, and the fields of the body have to follow each other in
+ * the order messages are built in, so that a field also tells where the ones
+ * before it end (see LSCategoryDispatchLookup()). Whether the fields are
+ * NUL-terminated is only known once the body is read, see
+ * _LSTransportMessageGetField().
+ *
+ * @param  header   IN  header
+ *
+ * @retval  true if the header has no field table or a valid one
+ *******************************************************************************
+ */
+bool
+_LSTransportHeaderFieldsAreValid(const _LSTransportHeader *header)
+{
+    if (!(header->flags & _LSTransportHeaderFlagFields)) return true;
+
+    int i;
+    for (i = 0; i < _LSTransportFieldCount; i++)
+    {
+        const _LSTransportFieldRange *range = &header->fields[i];
+
+        if (range->len != LS_TRANSPORT_FIELD_ABSENT &&
+            (uint64_t) range->offset + range->len >= header->len)
+        {
+            return false;
+        }
+    }
+
+    /* the first field of the body and where it starts */
+    _LSTransportField first;
+    uint64_t next = 0;
+
+    switch (header->type)
+    {
+    case _LSTransportMessageTypeReply:
+    case _LSTransportMessageTypeError:
+    case _LSTransportMessageTypeErrorUnknownMethod:
+        first = _LSTransportFieldPayload;
+        next = sizeof(LSMessageToken);
+        break;
+
+    case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeCancelMethodCall:
+    case _LSTransportMessageTypeSignal:
+    case _LSTransportMessageTypeServiceUpSignal:
+    case _LSTransportMessageTypeServiceDownSignal:
+    case _LSTransportMessageTypeSignalRegister:
+    case _LSTransportMessageTypeSignalUnregister:
+        first = _LSTransportFieldCategory;
+        break;
+
+    default:
+        first = _LSTransportFieldMonitor;
+        break;
+    }
+
+    /* present from the first field on, without gaps, back to back */
+    bool ended = false;
+    for (i = _LSTransportFieldCategory; i < _LSTransportFieldMonitor; i++)
+    {
+        const _LSTransportFieldRange *range = &header->fields[i];
+
+        if (range->len == LS_TRANSPORT_FIELD_ABSENT)
+        {
+            ended = ended || i >= first;
+            continue;
+        }
+
+        if (i < first || ended || range->offset != next)
+        {
+            return false;
+        }
+        next = (uint64_t) range->offset + range->len + 1;
+    }
+
+    /* the monitor appends behind them */
+    const _LSTransportFieldRange *monitor = &header->fields[_LSTransportFieldMonitor];
+    return monitor->len == LS_TRANSPORT_FIELD_ABSENT || monitor->offset >= next;
+}
+
+/**
+ *******************************************************************************
+ * @brief Convert a header received from a peer that speaks protocol version
+ * 1. The headers must not overlap.
+ *
+ * @param  header       OUT header
+ * @param  header_v1    IN  legacy header
+ *******************************************************************************
+ */
+void
+_LSTransportHeaderFromV1(_LSTransportHeader *header, const _LSTransportHeaderV1 *header_v1)
+{
+    _LSTransportHeaderInit(header, header_v1->type, header_v1->len);
+    header->token = header_v1->token;
+    header->flags = 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Check if the sender of a header decompresses the payloads we
+ * compress.
+ *
+ * @param  header   IN  header received from the peer
+ *
+ * @retval true if payloads for the peer may be compressed
+ *******************************************************************************
+ */
+bool
+_LSTransportHeaderPeerInflates(const _LSTransportHeader *header)
+{
+    return (header->flags & _LSTransportHeaderAcceptFlags()) != 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Build the header sent to a peer that speaks protocol version 1.
+ *
+ * @param  header       IN  header
+ * @param  header_v1    OUT legacy header
+ *******************************************************************************
+ */
+void
+_LSTransportHeaderToV1(const _LSTransportHeader *header, _LSTransportHeaderV1 *header_v1)
+{
+    memset(header_v1, 0, sizeof(*header_v1));
+
+    header_v1->len = header->len;
+    header_v1->token = header->token;
+    header_v1->type = header->type;
+}
+
+/* The body of dest starts with a copy of the body of src */
+static void
+_LSTransportMessageCopyFields(_LSTransportMessage *dest, const _LSTransportMessage *src)
+{
+    const _LSTransportHeader *src_header = &src->raw->header;
+    _LSTransportHeader *dest_header = &dest->raw->header;
+
+    if (src_header->flags & _LSTransportHeaderFlagFields)
+    {
+        dest_header->reply_token = src_header->reply_token;
+        memcpy(dest_header->fields, src_header->fields, sizeof(dest_header->fields));
+        dest_header->flags |= _LSTransportHeaderFlagFields;
+
+        /* the payload is copied as is */
+        if (src_header->flags & _LSTransportHeaderFlagCompressed)
+        {
+            dest_header->inflated_len = src_header->inflated_len;
+            dest_header->flags |= _LSTransportHeaderFlagCompressed;
+        }
+    }
+}
+
 /**
 *******************************************************************************
 * @brief Create a new message with ref count of 1 that is a copy of the passed
 * in message. Only the type, token, and body are copied, NOT tx_bytes_remaining
-* or the timeout source id.
+* or the timeout timer.
 *
 * @param  message   IN  message to copy
 *
@@ -201,6 +431,8 @@ _LSTransportMessageFree(_LSTransportMessage *message)
 INLINE _LSTransportMessage*
 _LSTransportMessageCopyNewRef(_LSTransportMessage *message)
 {
+    LS_ASSERT(message->shared_payload == NULL);
+
     int body_size = _LSTransportMessageGetBodySize(message);
     _LSTransportMessage *ret = _LSTransportMessageNewRef(body_size);
 
@@ -217,10 +449,11 @@ _LSTransportMessageCopyNewRef(_LSTransportMessage *message)
         ret->app_id = NULL;
     }
 
-    /* NOTE: does not copy timeout source id */
+    /* NOTE: does not copy timeout timer */
     _LSTransportMessageSetType(ret, _LSTransportMessageGetType(message));
     _LSTransportMessageSetToken(ret, _LSTransportMessageGetToken(message));
     _LSTransportMessageSetBody(ret, _LSTransportMessageGetBody(message), body_size);
+    _LSTransportMessageCopyFields(ret, message);
 
     return ret;
 }
@@ -230,7 +463,7 @@ _LSTransportMessageCopyNewRef(_LSTransportMessage *message)
  * @brief Copies the message type, token, and body from src to dest.
  *
  * @note assumes that dest has already been allocated and does not adjust any
- * ref count associated with dest. Also, does not copy timeout source or transmit
+ * ref count associated with dest. Also, does not copy timeout timer or transmit
  * bytes remaining.
  *
  * @param  dest  IN/OUT   destination message (already allocated to correct size)
@@ -263,6 +496,7 @@ _LSTransportMessageCopy(_LSTransportMessage *dest, const _LSTransportMessage *sr
     _LSTransportMessageSetType(dest, _LSTransportMessageGetType(src));
     _LSTransportMessageSetToken(dest, _LSTransportMessageGetToken(src));
     _LSTransportMessageSetBody(dest, _LSTransportMessageGetBody(src), src_body_size);
+    _LSTransportMessageCopyFields(dest, src);
 
     return dest;
 }
@@ -334,6 +568,43 @@ _LSTransportMessageFromVectorNewRef(const struct iovec *iov, int iovcnt, unsigne
     return message;
 }
 
+/**
+ *******************************************************************************
+ * @brief Create a new message with ref count of 1 whose body ends with a
+ * payload shared with other messages, e.g., the replies of a subscription
+ * update. Only the io vectors are copied; the payload is referenced.
+ *
+ * @param  iov              IN  array of io vectors with the header and the
+ *                              body up to the payload; the header counts the
+ *                              payload in its length
+ * @param  iovcnt           IN  number of items in @ref iov array
+ * @param  shared_payload   IN  end of the body
+ *
+ * @retval  message on success
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+_LSTransportMessage*
+_LSTransportMessageFromVectorSharedNewRef(const struct iovec *iov, int iovcnt, GBytes *shared_payload)
+{
+    unsigned long raw_len = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+    {
+        raw_len += iov[i].iov_len;
+    }
+
+    _LSTransportMessage *message = _LSTransportMessageFromVectorNewRef(iov, iovcnt, raw_len);
+
+    LS_ASSERT(message->raw->header.len == raw_len - sizeof(_LSTransportHeader) + g_bytes_get_size(shared_payload));
+
+    message->shared_payload = g_bytes_ref(shared_payload);
+    message->tx_bytes_remaining = sizeof(_LSTransportHeader) + message->raw->header.len;
+
+    return message;
+}
+
 /**
  *******************************************************************************
  * @brief Returns true if the message type is one that we're interested in
@@ -473,6 +744,7 @@ _LSTransportMessageIsConnectionFdType(const _LSTransportMessage *message)
     case _LSTransportMessageTypeQueryNameReply:
     case _LSTransportMessageTypeRequestNameLocalReply:
     case _LSTransportMessageTypeMonitorConnected:
+    case _LSTransportMessageTypeIncomingConnection:
         return true;
 
     default:
@@ -500,33 +772,19 @@ _LSTransportMessageGetError(const _LSTransportMessage *message)
 
 /**
  *******************************************************************************
- * @brief Gets the timeout source id associated with the message.
+ * @brief Gets the timeout timer embedded in the message. It's zero-filled
+ * (disarmed, no callback) until initialized with _LSTimerInit().
  *
  * @param  message  IN  message
  *
- * @retval  id (0 means no timeout source id)
- *******************************************************************************
- */
-INLINE guint
-_LSTransportMessageGetTimeoutId(const _LSTransportMessage *message)
-{
-    LS_ASSERT(message != NULL);
-    return message->timeout_id;
-}
-
-/**
- *******************************************************************************
- * @brief Set the timeout source id associated with the message.
- *
- * @param  message      IN  message
- * @param  timeout_id   IN  timeout source id (ret val from g_timeout_add())
+ * @retval  timer
  *******************************************************************************
  */
-INLINE void
-_LSTransportMessageSetTimeoutId(_LSTransportMessage *message, guint timeout_id)
+INLINE _LSTimer*
+_LSTransportMessageGetTimeout(_LSTransportMessage *message)
 {
     LS_ASSERT(message != NULL);
-    message->timeout_id = timeout_id;
+    return &message->timeout;
 }
 
 /**
@@ -731,6 +989,11 @@ _LSTransportMessageGetReplyToken(const _LSTransportMessage *message)
         return 0;
     }
 
+    if (message->raw->header.flags & _LSTransportHeaderFlagFields)
+    {
+        return message->raw->header.reply_token;
+    }
+
     int token_size = sizeof(LSMessageToken);
     char *body = _LSTransportMessageGetBody(message);
     if (body && _LSTransportMessageGetBodySize(message) >= token_size)
@@ -781,6 +1044,10 @@ _LSTransportMessageSetBody(_LSTransportMessage *message, const void *body, int b
     LS_ASSERT(message != NULL);
     LS_ASSERT(body != NULL);
 
+    message->method = NULL;
+    message->payload = NULL;
+    message->raw->header.flags &= ~(_LSTransportHeaderFlagFields | _LSTransportHeaderFlagCompressed);
+
     return memcpy(message->raw->data, body, body_len);
 }
 
@@ -820,6 +1087,9 @@ _LSTransportMessageSetRawMessage(_LSTransportMessage *message, _LSTransportMessa
     LS_ASSERT(raw != NULL);
 
     message->raw = raw;
+    message->method = NULL;
+    message->payload = NULL;
+    raw->header.flags &= ~(_LSTransportHeaderFlagFields | _LSTransportHeaderFlagCompressed);
     return raw;
 }
 
@@ -854,6 +1124,7 @@ _LSTransportMessageSetBodySize(const _LSTransportMessage *message, unsigned long
 {
     LS_ASSERT(message != NULL);
     _LSTransportMessageGetHeader(message)->len = size;
+    _LSTransportMessageGetHeader(message)->flags &= ~(_LSTransportHeaderFlagFields | _LSTransportHeaderFlagCompressed);
 }
 
 /**
@@ -974,13 +1245,26 @@ _LSTransportMessageBodyExpand(_LSTransportMessage *message, unsigned long bytes_
  * @retval  payload
  *******************************************************************************
  */
+static const char* _LSTransportMessageInflatePayload(_LSTransportMessage *message);
+
 const char*
 _LSTransportMessageGetPayload(const _LSTransportMessage *message)
 {
     //LS_ASSERT(message->raw->header.type == _LSTransportMessageTypeReply);
     const char *ret = NULL;
 
-    /* TODO: make this less expensive */
+    /* compressed by the sender, decompressed on first use */
+    if (message->raw->header.flags & _LSTransportHeaderFlagCompressed)
+    {
+        return _LSTransportMessageInflatePayload((_LSTransportMessage*) message);
+    }
+
+    /* received messages are parsed once in _LSTransportMessageParseBody() */
+    if (message->payload)
+    {
+        return message->payload;
+    }
+
     switch (_LSTransportMessageGetType(message))
     {
     case _LSTransportMessageTypeReply:
@@ -1029,6 +1313,546 @@ _LSTransportMessageGetPayload(const _LSTransportMessage *message)
     return NULL;
 }
 
+/* Returns the string following the NUL-terminated one at str, or NULL if str
+ * isn't terminated within the body (so no further string exists) */
+static inline const char*
+_LSTransportMessageNextString(const _LSTransportMessage *message, const char *str)
+{
+    const char *end = message->raw->data + _LSTransportMessageGetBodySize(message);
+
+    if (!str || str >= end) return NULL;
+
+    const char *nul = memchr(str, '\0', end - str);
+    return nul ? nul + 1 : NULL;
+}
+
+/* Returns the field located by the header, or NULL if it's absent or not a
+ * NUL-terminated string within the body */
+static inline const char*
+_LSTransportMessageGetField(const _LSTransportMessage *message, _LSTransportField field)
+{
+    const _LSTransportHeader *header = &message->raw->header;
+    const _LSTransportFieldRange *range = &header->fields[field];
+
+    if (range->len == LS_TRANSPORT_FIELD_ABSENT ||
+        (uint64_t) range->offset + range->len >= header->len ||
+        message->raw->data[range->offset + range->len] != '\0')
+    {
+        return NULL;
+    }
+    return message->raw->data + range->offset;
+}
+
+/**
+ *******************************************************************************
+ * @brief Locate the method, payload and application id of a received message
+ * once, so that the getters don't scan it again. If the sender filled in a
+ * valid field table in the header, the fields are taken from there;
+ * otherwise the body is scanned, only within its size. Fields of a malformed
+ * message are left for the getters to report.
+ *
+ * @param  message  IN  received message
+ *******************************************************************************
+ */
+void
+_LSTransportMessageParseBody(_LSTransportMessage *message)
+{
+    if ((message->raw->header.flags & _LSTransportHeaderFlagFields) &&
+        _LSTransportHeaderFieldsAreValid(&message->raw->header))
+    {
+        message->method = _LSTransportMessageGetField(message, _LSTransportFieldMethod);
+        message->payload = _LSTransportMessageGetField(message, _LSTransportFieldPayload);
+
+        const char *app_id = _LSTransportMessageGetField(message, _LSTransportFieldAppId);
+        if (app_id) message->app_id = app_id;
+        return;
+    }
+
+    const char *body = _LSTransportMessageGetBody(message);
+    const char *end = body + _LSTransportMessageGetBodySize(message);
+
+    switch (_LSTransportMessageGetType(message))
+    {
+    case _LSTransportMessageTypeReply:
+    case _LSTransportMessageTypeError:
+    case _LSTransportMessageTypeErrorUnknownMethod:
+        /* reply serial + payload */
+        if (body + sizeof(LSMessageToken) < end)
+        {
+            message->payload = body + sizeof(LSMessageToken);
+        }
+        break;
+
+    case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeCancelMethodCall:
+    case _LSTransportMessageTypeSignal:
+    case _LSTransportMessageTypeServiceUpSignal:
+    case _LSTransportMessageTypeServiceDownSignal:
+    case _LSTransportMessageTypeSignalRegister:
+    case _LSTransportMessageTypeSignalUnregister:
+    {
+        /* category + method [+ payload [+ app id]] */
+        const char *method = _LSTransportMessageNextString(message, body);
+        const char *payload = _LSTransportMessageNextString(message, method);
+
+        if (method && method < end) message->method = method;
+
+        if (payload && payload < end &&
+            _LSTransportMessageGetType(message) != _LSTransportMessageTypeSignalRegister &&
+            _LSTransportMessageGetType(message) != _LSTransportMessageTypeSignalUnregister)
+        {
+            message->payload = payload;
+
+            if (_LSTransportMessageGetType(message) == _LSTransportMessageTypeMethodCall)
+            {
+                const char *app_id = _LSTransportMessageNextString(message, payload);
+                if (app_id && app_id < end) message->app_id = app_id;
+            }
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+/* Records a field found in the body in the header */
+static void
+_LSTransportMessageSealField(_LSTransportMessage *message, _LSTransportField field, const char *str)
+{
+    const char *body = message->raw->data;
+    const char *end = body + _LSTransportMessageGetBodySize(message);
+
+    if (!str || str >= end) return;
+
+    const char *nul = memchr(str, '\0', end - str);
+    if (!nul) return;
+
+    _LSTransportHeaderSetField(&message->raw->header, field, str - body, nul - str);
+}
+
+/**
+ *******************************************************************************
+ * @brief Fill in the field table of the header of a message that is about to
+ * be sent, unless its builder already did. Sent once, the table saves every
+ * receiver (and the hub routing it) from scanning the body.
+ *
+ * @param  message  IN  message
+ *******************************************************************************
+ */
+static void
+_LSTransportMessageSealFields(_LSTransportMessage *message)
+{
+    _LSTransportHeader *header = &message->raw->header;
+
+    if (header->flags & _LSTransportHeaderFlagFields) return;
+    if (_LSTransportMessageGetBodySize(message) == 0) return;
+
+    /* only the types that have the fields */
+    switch (_LSTransportMessageGetType(message))
+    {
+    case _LSTransportMessageTypeReply:
+    case _LSTransportMessageTypeError:
+    case _LSTransportMessageTypeErrorUnknownMethod:
+        header->reply_token = _LSTransportMessageGetReplyToken(message);
+        /* fall through */
+    case _LSTransportMessageTypeMethodCall:
+    case _LSTransportMessageTypeCancelMethodCall:
+    case _LSTransportMessageTypeSignal:
+    case _LSTransportMessageTypeServiceUpSignal:
+    case _LSTransportMessageTypeServiceDownSignal:
+    case _LSTransportMessageTypeSignalRegister:
+    case _LSTransportMessageTypeSignalUnregister:
+        break;
+
+    default:
+        return;
+    }
+
+    if (!message->method && !message->payload)
+    {
+        _LSTransportMessageParseBody(message);
+    }
+
+    if (message->method)
+    {
+        _LSTransportMessageSealField(message, _LSTransportFieldCategory, message->raw->data);
+        _LSTransportMessageSealField(message, _LSTransportFieldMethod, message->method);
+    }
+    _LSTransportMessageSealField(message, _LSTransportFieldPayload, message->payload);
+    if (_LSTransportMessageGetType(message) == _LSTransportMessageTypeMethodCall)
+    {
+        _LSTransportMessageSealField(message, _LSTransportFieldAppId, message->app_id);
+    }
+
+    /* a table, even an empty one, means the body has been looked at */
+    header->flags |= _LSTransportHeaderFlagFields;
+}
+
+/**
+ *******************************************************************************
+ * @brief Build a copy of the raw message with another payload.
+ *
+ * @param  message      IN  message with a field table that locates its payload
+ * @param  payload      IN  new payload
+ * @param  payload_len  IN  len of @ref payload (its terminating NUL is added)
+ *
+ * @retval  raw message
+ *******************************************************************************
+ */
+static _LSTransportMessageRaw*
+_LSTransportMessageRawReplacePayload(const _LSTransportMessage *message, const char *payload,
+                                     unsigned long payload_len)
+{
+    const _LSTransportHeader *header = &message->raw->header;
+    const _LSTransportFieldRange *range = &header->fields[_LSTransportFieldPayload];
+    const char *body = message->raw->data;
+
+    unsigned long head_len = range->offset;
+    unsigned long tail_offset = range->offset + range->len + 1;
+    unsigned long tail_len = header->len - tail_offset;
+    unsigned long len = head_len + payload_len + 1 + tail_len;
+
+    _LSTransportMessageRaw *raw = g_malloc(sizeof(_LSTransportMessageRaw) + len);
+
+    raw->header = *header;
+    raw->header.len = len;
+
+    memcpy(raw->data, body, head_len);
+    memcpy(raw->data + head_len, payload, payload_len);
+    raw->data[head_len + payload_len] = '\0';
+    memcpy(raw->data + head_len + payload_len + 1, body + tail_offset, tail_len);
+
+    /* the fields behind the payload move */
+    int i;
+    for (i = 0; i < _LSTransportFieldCount; i++)
+    {
+        _LSTransportFieldRange *field = &raw->header.fields[i];
+
+        if (field->len != LS_TRANSPORT_FIELD_ABSENT && field->offset > range->offset)
+        {
+            field->offset = field->offset - range->len + payload_len;
+        }
+    }
+    raw->header.fields[_LSTransportFieldPayload].len = payload_len;
+
+    return raw;
+}
+
+/* Only plain messages are compressed: the monitor serial appended to monitor
+ * copies is aligned relative to the start of the body, and a shared payload
+ * isn't in the raw message */
+static inline bool
+_LSTransportMessageIsPayloadReplaceable(const _LSTransportMessage *message)
+{
+    const _LSTransportHeader *header = &message->raw->header;
+
+    return !message->shared_payload &&
+           (header->flags & _LSTransportHeaderFlagFields) &&
+           header->fields[_LSTransportFieldMonitor].len == LS_TRANSPORT_FIELD_ABSENT &&
+           _LSTransportMessageGetField(message, _LSTransportFieldPayload) != NULL;
+}
+
+/**
+ *******************************************************************************
+ * @brief Compress the payload of a message for a peer, if it's big enough
+ * and compresses.
+ *
+ * @param  message  IN  message
+ *
+ * @retval  raw message with the compressed payload
+ * @retval  NULL if the message is sent as it is
+ *******************************************************************************
+ */
+static _LSTransportMessageRaw*
+_LSTransportMessageRawDeflate(const _LSTransportMessage *message)
+{
+    size_t threshold = _LSTransportCompressGetThreshold();
+    const _LSTransportFieldRange *range = &message->raw->header.fields[_LSTransportFieldPayload];
+
+    if (threshold == 0 || !_LSTransportMessageIsPayloadReplaceable(message) || range->len < threshold)
+    {
+        return NULL;
+    }
+
+    size_t bound = _LSTransportCompressBound(range->len);
+    char *compressed = g_malloc(bound);
+    size_t compressed_len = _LSTransportCompress(message->raw->data + range->offset, range->len, compressed, bound);
+
+    _LSTransportMessageRaw *raw = NULL;
+
+    /* incompressible payloads aren't worth the peer's time */
+    if (compressed_len > 0 && compressed_len < range->len)
+    {
+        raw = _LSTransportMessageRawReplacePayload(message, compressed, compressed_len);
+        raw->header.inflated_len = range->len;
+        raw->header.flags |= _LSTransportHeaderFlagCompressed;
+    }
+
+    g_free(compressed);
+    return raw;
+}
+
+/**
+ *******************************************************************************
+ * @brief Decompress the payload of a received message once. The message
+ * keeps the result for later calls.
+ *
+ * @param  message  IN  message with a compressed payload
+ *
+ * @retval  payload
+ * @retval  NULL if the payload can't be decompressed
+ *******************************************************************************
+ */
+static const char*
+_LSTransportMessageInflatePayload(_LSTransportMessage *message)
+{
+    char *inflated = g_atomic_pointer_get(&message->inflated_payload);
+    if (inflated)
+    {
+        return inflated;
+    }
+
+    const _LSTransportHeader *header = &message->raw->header;
+    const char *compressed = _LSTransportMessageGetField(message, _LSTransportFieldPayload);
+    if (!compressed)
+    {
+        return NULL;
+    }
+
+    /* the sender may claim anything */
+    if (header->inflated_len > MAX_MESSAGE_SIZE_BYTES)
+    {
+        LOG_LS_ERROR(MSGID_LS_MSG_ERR, 0, "Compressed payload claims %"PRIu32" bytes",
+                     header->inflated_len);
+        return NULL;
+    }
+
+    inflated = g_malloc(header->inflated_len + 1);
+    if (!_LSTransportDecompress(compressed, header->fields[_LSTransportFieldPayload].len,
+                                inflated, header->inflated_len))
+    {
+        LOG_LS_ERROR(MSGID_LS_MSG_ERR, 0, "Unable to decompress payload of %"PRIu32" bytes",
+                     header->inflated_len);
+        g_free(inflated);
+        return NULL;
+    }
+    inflated[header->inflated_len] = '\0';
+
+    /* the message may be looked at from more than one thread */
+    if (!g_atomic_pointer_compare_and_exchange(&message->inflated_payload, NULL, inflated))
+    {
+        g_free(inflated);
+    }
+
+    return message->inflated_payload;
+}
+
+/**
+ *******************************************************************************
+ * @brief Decompress the payload of a message for a peer that doesn't take it
+ * compressed.
+ *
+ * @param  message  IN  message with a compressed payload
+ *
+ * @retval  raw message with the decompressed payload
+ * @retval  NULL if the message has to be sent as it is
+ *******************************************************************************
+ */
+static _LSTransportMessageRaw*
+_LSTransportMessageRawInflate(_LSTransportMessage *message)
+{
+    if (!_LSTransportMessageIsPayloadReplaceable(message))
+    {
+        return NULL;
+    }
+
+    const char *payload = _LSTransportMessageInflatePayload(message);
+    if (!payload)
+    {
+        return NULL;
+    }
+
+    _LSTransportMessageRaw *raw = _LSTransportMessageRawReplacePayload(message, payload, message->raw->header.inflated_len);
+    raw->header.inflated_len = 0;
+    raw->header.flags &= ~_LSTransportHeaderFlagCompressed;
+
+    return raw;
+}
+
+/* The raw message as it goes on the wire */
+static inline const _LSTransportMessageRaw*
+_LSTransportMessageGetWireRaw(const _LSTransportMessage *message)
+{
+    return message->wire_raw ? message->wire_raw : message->raw;
+}
+
+/**
+ *******************************************************************************
+ * @brief Prepare a message for writing it to a peer from its first byte.
+ *
+ * Peers that speak protocol version 1 get the legacy header; the others get
+ * the raw header with its field table filled in. The payload is compressed
+ * for peers that decompress it, and decompressed for those that don't.
+ *
+ * @param  message          IN  message
+ * @param  wire_v1          IN  true if the peer only speaks protocol version 1
+ * @param  peer_inflates    IN  true if the peer decompresses our payloads
+ *                              (see _LSTransportHeaderPeerInflates())
+ *******************************************************************************
+ */
+void
+_LSTransportMessageFrame(_LSTransportMessage *message, bool wire_v1, bool peer_inflates)
+{
+    _LSTransportHeader *header = &message->raw->header;
+
+    message->framed = true;
+    message->wire_v1 = wire_v1;
+    message->wire_inflates = peer_inflates;
+    g_free(message->wire_raw);
+    message->wire_raw = NULL;
+
+    if (!wire_v1)
+    {
+        _LSTransportMessageSealFields(message);
+
+        /* what the peer may compress for us; forwarded messages carry the
+         * flags of their sender */
+        header->flags = (header->flags & ~LS_TRANSPORT_HEADER_FLAGS_ACCEPT) | _LSTransportHeaderAcceptFlags();
+    }
+
+    if (header->flags & _LSTransportHeaderFlagCompressed)
+    {
+        if (wire_v1 || !peer_inflates)
+        {
+            message->wire_raw = _LSTransportMessageRawInflate(message);
+        }
+    }
+    else if (!wire_v1 && peer_inflates)
+    {
+        message->wire_raw = _LSTransportMessageRawDeflate(message);
+    }
+
+    if (wire_v1)
+    {
+        _LSTransportHeaderToV1(&_LSTransportMessageGetWireRaw(message)->header, &message->wire_header_v1);
+    }
+
+    message->tx_bytes_remaining = _LSTransportMessageGetWireSize(message);
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the number of bytes the message takes on the wire.
+ *
+ * @param  message  IN  message
+ *
+ * @retval size in bytes
+ *******************************************************************************
+ */
+unsigned long
+_LSTransportMessageGetWireSize(const _LSTransportMessage *message)
+{
+    return _LSTransportMessageGetWireRaw(message)->header.len +
+           (message->wire_v1 ? sizeof(_LSTransportHeaderV1) : sizeof(_LSTransportHeader));
+}
+
+/**
+ *******************************************************************************
+ * @brief Check if a part of the message has been written already, so that
+ * it can't be framed again.
+ *
+ * @param  message  IN  message
+ *
+ * @retval true if the message is partially (or entirely) sent
+ *******************************************************************************
+ */
+bool
+_LSTransportMessageIsSendStarted(const _LSTransportMessage *message)
+{
+    return message->tx_bytes_remaining < _LSTransportMessageGetWireSize(message);
+}
+
+/**
+ *******************************************************************************
+ * @brief Check if a message is framed for a peer already, so that a queued
+ * message isn't compressed again every time the send watch retries it.
+ *
+ * @param  message          IN  message
+ * @param  wire_v1          IN  true if the peer only speaks protocol version 1
+ * @param  peer_inflates    IN  true if the peer decompresses our payloads
+ *
+ * @retval true if _LSTransportMessageFrame() was called with the same peer
+ *******************************************************************************
+ */
+bool
+_LSTransportMessageIsFramedFor(const _LSTransportMessage *message, bool wire_v1, bool peer_inflates)
+{
+    return message->framed && message->wire_v1 == wire_v1 && message->wire_inflates == peer_inflates;
+}
+
+/**
+ *******************************************************************************
+ * @brief Describe the bytes of the message that are still to be sent.
+ *
+ * @param  message  IN  message
+ * @param  iov      OUT io vectors; the legacy header and a shared payload
+ *                      take one of their own
+ *
+ * @retval number of io vectors used
+ *******************************************************************************
+ */
+int
+_LSTransportMessageGetWireVector(_LSTransportMessage *message, struct iovec iov[3])
+{
+    _LSTransportMessageRaw *raw = (_LSTransportMessageRaw*) _LSTransportMessageGetWireRaw(message);
+    unsigned long remaining = message->tx_bytes_remaining;
+
+    gsize shared_len = 0;
+    const char *shared = message->shared_payload ? g_bytes_get_data(message->shared_payload, &shared_len) : NULL;
+
+    /* the raw header is right in front of the body, the legacy one isn't */
+    const char *own = (const char*)raw;
+    unsigned long own_len = sizeof(_LSTransportHeader) + raw->header.len - shared_len;
+    int iovcnt = 0;
+
+    if (message->wire_v1)
+    {
+        own = raw->data;
+        own_len -= sizeof(_LSTransportHeader);
+
+        if (remaining > raw->header.len)
+        {
+            unsigned long header_remaining = remaining - raw->header.len;
+
+            iov[iovcnt].iov_base = (char*)&message->wire_header_v1 + sizeof(_LSTransportHeaderV1) - header_remaining;
+            iov[iovcnt].iov_len = header_remaining;
+            iovcnt++;
+            remaining -= header_remaining;
+        }
+    }
+
+    if (remaining > shared_len)
+    {
+        unsigned long own_remaining = remaining - shared_len;
+
+        iov[iovcnt].iov_base = (char*)own + own_len - own_remaining;
+        iov[iovcnt].iov_len = own_remaining;
+        iovcnt++;
+        remaining -= own_remaining;
+    }
+
+    if (remaining > 0)
+    {
+        iov[iovcnt].iov_base = (char*)shared + shared_len - remaining;
+        iov[iovcnt].iov_len = remaining;
+        iovcnt++;
+    }
+
+    return iovcnt;
+}
+
 /**
  *******************************************************************************
  * @brief Save a reference to the appId. This will *NOT* copy an memory; the
@@ -1121,7 +1945,11 @@ _LSTransportMessageGetAppId(_LSTransportMessage *message)
 const char*
 _LSTransportMessageGetMethod(const _LSTransportMessage *message)
 {
-    /* TODO: make this less expensive */
+    if (message->method)
+    {
+        return message->method;
+    }
+
     /* skip over category and the method is after the NUL */
     switch (_LSTransportMessageGetType(message))
     {
@@ -1222,6 +2050,13 @@ _LSTransportMessageGetSenderUniqueName(const _LSTransportMessage *message)
 const char*
 _LSTransportMessageGetDestServiceName(_LSTransportMessage *message)
 {
+    /* located by the sender of the monitor copy */
+    const char *dest_service_name = _LSTransportMessageGetField(message, _LSTransportFieldMonitor);
+    if (dest_service_name)
+    {
+        return dest_service_name;
+    }
+
     switch (_LSTransportMessageGetType(message))
     {
     case _LSTransportMessageTypeMethodCall:
@@ -2003,6 +2838,35 @@ _LSTransportMessageIterInit(_LSTransportMessage *message, _LSTransportMessageIte
     iter->valid = true;
 }
 
+/**
+ *******************************************************************************
+ * @brief Initialize an iterator for the arguments that follow other content
+ * of the message body (e.g., the category, method and payload strings of a
+ * service status signal).
+ *
+ * @param  message  IN      message
+ * @param  iter     IN/OUT  iterator
+ * @param  offset   IN      offset of the first argument in the body, aligned
+ *                          the way @ref _LSTransportMessageAppendString()
+ *                          pads strings
+ *******************************************************************************
+ */
+void
+_LSTransportMessageIterInitAt(_LSTransportMessage *message, _LSTransportMessageIter *iter,
+                              unsigned long offset)
+{
+    _LSTransportMessageIterInit(message, iter);
+
+    if (offset > _LSTransportMessageGetBodySize(message))
+    {
+        iter->actual_iter = iter->iter_end;
+        _LSTransportMessageIterInvalidate(iter);
+        return;
+    }
+
+    iter->actual_iter += offset;
+}
+
 /**
  *******************************************************************************
  * @brief Initialize an argument header.
@@ -25,6 +25,7 @@
 //#include "transport_client.h"
 
 #include "transport_shm.h"
+#include "timer_wheel.h"
 
 #ifdef LUNA_SERVICE_UNIT_TEST
 #define INLINE
@@ -78,6 +79,9 @@ typedef enum LSTransportMessageType
     _LSTransportMessageTypeAppendCategory,           /**< message to the hub to update category tables */
     _LSTransportMessageTypeQueryServiceCategory,     /**< message from client to hub to get list of registered categories */
     _LSTransportMessageTypeQueryServiceCategoryReply,/**< reply from hub to client with list of registered categories */
+    _LSTransportMessageTypeQueryHubTelemetry,        /**< message from client to hub to get hub-wide traffic statistics */
+    _LSTransportMessageTypeQueryHubTelemetryReply,   /**< reply from hub to client with traffic statistics (JSON) */
+    _LSTransportMessageTypeIncomingConnection,       /**< connection passed by the hub to a service, which takes it as if accepted */
 } _LSTransportMessageType;
 
 /**
@@ -135,15 +139,85 @@ typedef enum LSTransportConnectState {
 } _LSTransportConnectState;
 
 /**
- * Header for the raw message.
+ * Fields of the body located by the header. Offsets are from the start of
+ * the body, lengths don't include the terminating NUL.
+ */
+typedef enum LSTransportField {
+    _LSTransportFieldCategory,
+    _LSTransportFieldMethod,
+    _LSTransportFieldPayload,
+    _LSTransportFieldAppId,
+    _LSTransportFieldMonitor,   /**< destination names and serial appended for the monitor */
+    _LSTransportFieldCount
+} _LSTransportField;
+
+#define LS_TRANSPORT_FIELD_ABSENT   UINT32_MAX  /**< len of a field the message doesn't have */
+
+typedef struct LSTransportFieldRange {
+    uint32_t offset;
+    uint32_t len;
+} _LSTransportFieldRange;
+
+/** Header flags */
+typedef enum LSTransportHeaderFlags {
+    _LSTransportHeaderFlagFields = 1 << 0,      /**< the field table is filled in */
+    _LSTransportHeaderFlagCompressed = 1 << 1,  /**< the payload field is compressed with the codec
+                                                     both peers accept, see transport_compress.h */
+    _LSTransportHeaderFlagAcceptLz4 = 1 << 2,   /**< the sender decompresses LZ4 payloads */
+    _LSTransportHeaderFlagAcceptZstd = 1 << 3,  /**< the sender decompresses zstd payloads */
+} _LSTransportHeaderFlags;
+
+#define LS_TRANSPORT_HEADER_FLAGS_ACCEPT    (_LSTransportHeaderFlagAcceptLz4 | _LSTransportHeaderFlagAcceptZstd)
+
+/**
+ * Marks a header of protocol version 2 or later. A legacy header starts with
+ * its len (at most MAX_MESSAGE_SIZE_BYTES, or zero on big endian), so the
+ * two can be told apart by the first 32 bits.
+ */
+#define LS_TRANSPORT_HEADER_MAGIC   0x3254534cU    /**< "LST2" */
+
+/**
+ * Header for the raw message. Its layout doesn't depend on the architecture
+ * and it locates the fields of the body, so that they can be reached without
+ * scanning it. Peers that speak protocol version 1 only get
+ * @ref _LSTransportHeaderV1 on the wire (see _LSTransportMessageFrame()).
  */
 struct LSTransportHeader {
+    uint32_t magic;               /**< LS_TRANSPORT_HEADER_MAGIC */
+    uint32_t type;                /**< signal, method call, reply, etc. (_LSTransportMessageType) */
+    uint64_t len;                 /**< len of the data portion of the message (doesn't include size of header itself) */
+    uint64_t token;               /**< serial associated with message */
+    uint64_t reply_token;         /**< serial of the call replied to (reply types only) */
+    uint32_t flags;               /**< _LSTransportHeaderFlags */
+    uint32_t inflated_len;        /**< len of the compressed payload once decompressed */
+    _LSTransportFieldRange fields[_LSTransportFieldCount];
+};
+
+typedef struct LSTransportHeader _LSTransportHeader;
+
+/**
+ * Header of protocol version 1.
+ */
+struct LSTransportHeaderV1 {
     unsigned long len;            /**< len of the data portion of the message (doesn't include size of header itself) */
     LSMessageToken token;         /**< serial associated with message */
     _LSTransportMessageType type; /**< signal, method call, reply, etc. */
 };
 
-typedef struct LSTransportHeader _LSTransportHeader;
+typedef struct LSTransportHeaderV1 _LSTransportHeaderV1;
+
+void _LSTransportHeaderInit(_LSTransportHeader *header, _LSTransportMessageType type, unsigned long len);
+void _LSTransportHeaderSetField(_LSTransportHeader *header, _LSTransportField field, unsigned long offset, unsigned long len);
+bool _LSTransportHeaderFieldsAreValid(const _LSTransportHeader *header);
+void _LSTransportHeaderFromV1(_LSTransportHeader *header, const _LSTransportHeaderV1 *header_v1);
+void _LSTransportHeaderToV1(const _LSTransportHeader *header, _LSTransportHeaderV1 *header_v1);
+bool _LSTransportHeaderPeerInflates(const _LSTransportHeader *header);
+
+static inline bool
+_LSTransportHeaderIsV1(const void *header)
+{
+    return *(const uint32_t*)header != LS_TRANSPORT_HEADER_MAGIC;
+}
 
 /**
  * Underlying message that is sent across the wire. You shouldn't use this
@@ -163,7 +237,7 @@ struct LSTransportMessage {
     int ref;
     _LSTransportClient *client;         /**< only valid for received messages -- client from which a message came */
     unsigned long tx_bytes_remaining;   /**< bytes of raw message left to transmit */
-    guint timeout_id;                   /**< timeout source id (currently only used by hub) */
+    _LSTimer timeout;                   /**< timeout timer (currently only used by hub) */
     unsigned long alloc_body_size;      /**< size of allocated memory for the body of
                                              the message (not including header). This
                                              can be larger than the actual len of the
@@ -173,8 +247,28 @@ struct LSTransportMessage {
                                              connected to the far side. This is only
                                              set for certain messages (-1 otherwise) */
     const char *app_id;                 /**< cached app id -- points inside the raw message */
+    const char *method;                 /**< method located by _LSTransportMessageParseBody()
+                                             -- points inside the raw message */
+    const char *payload;                /**< payload located by _LSTransportMessageParseBody()
+                                             -- points inside the raw message */
     _LSTransportMessageRaw *raw;        /**< raw bytes sent over the wire */
     int retries;                        /**< remaining send retries */
+    bool framed;                        /**< wire_v1, wire_inflates and wire_raw are set up
+                                             by _LSTransportMessageFrame() */
+    bool wire_v1;                       /**< framed with wire_header_v1 instead of raw->header */
+    bool wire_inflates;                 /**< framed for a peer that decompresses payloads */
+    _LSTransportHeaderV1 wire_header_v1;
+    _LSTransportMessageRaw *wire_raw;   /**< sent instead of raw when the payload is (de)compressed
+                                             for the peer */
+    GBytes *shared_payload;             /**< end of the body that isn't in raw but shared with
+                                             other messages, NULL if raw holds all of it */
+    char *inflated_payload;             /**< decompressed payload of a received message */
+    char *update_key;                   /**< subscription key if the message is a subscription
+                                             update, NULL otherwise */
+    bool update_supersedes;             /**< only the latest update of the subscription matters;
+                                             replaces an unsent one when queued */
+    unsigned long queued_bytes;         /**< bytes accounted to the outgoing queue holding
+                                             the message */
     _LSTransportConnectState connect_state;   /**< state of connect() -- e.g., if we fail to connect()
                                                    due to non-blocking sockets we save the state here */
 };
@@ -197,9 +291,16 @@ INLINE _LSTransportMessage* _LSTransportMessageCopyNewRef(_LSTransportMessage *m
 INLINE _LSTransportMessage* _LSTransportMessageCopy(_LSTransportMessage *dest, const _LSTransportMessage *src);
 
 _LSTransportMessage* _LSTransportMessageFromVectorNewRef(const struct iovec *iov, int iovcnt, unsigned long total_len);
+_LSTransportMessage* _LSTransportMessageFromVectorSharedNewRef(const struct iovec *iov, int iovcnt, GBytes *shared_payload);
+void _LSTransportMessageParseBody(_LSTransportMessage *message);
+
+void _LSTransportMessageFrame(_LSTransportMessage *message, bool wire_v1, bool peer_inflates);
+unsigned long _LSTransportMessageGetWireSize(const _LSTransportMessage *message);
+bool _LSTransportMessageIsSendStarted(const _LSTransportMessage *message);
+bool _LSTransportMessageIsFramedFor(const _LSTransportMessage *message, bool wire_v1, bool peer_inflates);
+int _LSTransportMessageGetWireVector(_LSTransportMessage *message, struct iovec iov[3]);
 
-INLINE guint _LSTransportMessageGetTimeoutId(const _LSTransportMessage *message);
-INLINE void _LSTransportMessageSetTimeoutId(_LSTransportMessage *message, guint timeout_id);
+INLINE _LSTimer* _LSTransportMessageGetTimeout(_LSTransportMessage *message);
 INLINE _LSTransportConnectState _LSTransportMessageGetConnectState(const _LSTransportMessage * message);
 INLINE void _LSTransportMessageSetConnectState(_LSTransportMessage *message, _LSTransportConnectState state);
 INLINE int _LSTransportMessageGetConnectionFd(const _LSTransportMessage *message);
@@ -258,6 +359,7 @@ typedef struct _LSTransportMessageIter
 } _LSTransportMessageIter;
 
 void _LSTransportMessageIterInit(_LSTransportMessage *message, _LSTransportMessageIter *iter);
+void _LSTransportMessageIterInitAt(_LSTransportMessage *message, _LSTransportMessageIter *iter, unsigned long offset);
 bool _LSTransportMessageIterHasNext(_LSTransportMessageIter *iter);
 _LSTransportMessageIter* _LSTransportMessageIterNext(_LSTransportMessageIter *iter);
 bool _LSTransportMessageAppendString(_LSTransportMessageIter *iter, const char *str);
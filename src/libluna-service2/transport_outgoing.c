@@ -101,4 +101,257 @@ _LSTransportOutgoingFree(_LSTransportOutgoing *outgoing)
     g_slice_free(_LSTransportOutgoing, outgoing);
 }
 
+static inline void
+_LSTransportOutgoingAccount(_LSTransportOutgoing *outgoing, _LSTransportMessage *message)
+{
+    _LSTransportOutgoingStats *stats = &outgoing->stats;
+
+    message->queued_bytes = message->tx_bytes_remaining;
+
+    stats->messages++;
+    stats->bytes += message->queued_bytes;
+
+    if (stats->messages > stats->peak_messages)
+        stats->peak_messages = stats->messages;
+    if (stats->bytes > stats->peak_bytes)
+        stats->peak_bytes = stats->bytes;
+}
+
+static inline void
+_LSTransportOutgoingUnaccount(_LSTransportOutgoing *outgoing, _LSTransportMessage *message)
+{
+    _LSTransportOutgoingStats *stats = &outgoing->stats;
+
+    LS_ASSERT(stats->messages > 0);
+    LS_ASSERT(stats->bytes >= message->queued_bytes);
+
+    stats->messages--;
+    stats->bytes -= message->queued_bytes;
+    message->queued_bytes = 0;
+}
+
+/**
+ *******************************************************************************
+ * @brief Append a message to an outgoing queue and count it.
+ *
+ * @attention caller must hold the outgoing lock
+ *
+ * @param  outgoing     IN  outgoing queue
+ * @param  message      IN  message (the queue takes over the caller's ref)
+ *******************************************************************************
+ */
+void
+_LSTransportOutgoingPushTail(_LSTransportOutgoing *outgoing, _LSTransportMessage *message)
+{
+    _LSTransportOutgoingAccount(outgoing, message);
+    g_queue_push_tail(outgoing->queue, message);
+}
+
+/**
+ *******************************************************************************
+ * @brief Insert a message into an outgoing queue at a given position and
+ * count it.
+ *
+ * @attention caller must hold the outgoing lock
+ *
+ * @param  outgoing     IN  outgoing queue
+ * @param  message      IN  message (the queue takes over the caller's ref)
+ * @param  n            IN  position, 0 for the head
+ *******************************************************************************
+ */
+void
+_LSTransportOutgoingPushNth(_LSTransportOutgoing *outgoing, _LSTransportMessage *message, int n)
+{
+    _LSTransportOutgoingAccount(outgoing, message);
+    g_queue_push_nth(outgoing->queue, message, n);
+}
+
+/**
+ *******************************************************************************
+ * @brief Remove the first message of an outgoing queue.
+ *
+ * @attention caller must hold the outgoing lock
+ *
+ * @param  outgoing     IN  outgoing queue
+ *
+ * @retval  message (the caller takes over the queue's ref)
+ * @retval  NULL if the queue is empty
+ *******************************************************************************
+ */
+_LSTransportMessage*
+_LSTransportOutgoingPopHead(_LSTransportOutgoing *outgoing)
+{
+    _LSTransportMessage *message = g_queue_pop_head(outgoing->queue);
+
+    if (message)
+    {
+        _LSTransportOutgoingUnaccount(outgoing, message);
+    }
+
+    return message;
+}
+
+/**
+ *******************************************************************************
+ * @brief Check if an outgoing queue would be past its high-water marks with
+ * more queued.
+ *
+ * @attention caller must hold the outgoing lock
+ *
+ * @param  outgoing         IN  outgoing queue
+ * @param  limits           IN  high-water marks
+ * @param  extra_messages   IN  messages to be queued
+ * @param  extra_bytes      IN  bytes to be queued
+ *
+ * @retval  true if a mark would be exceeded
+ *******************************************************************************
+ */
+bool
+_LSTransportOutgoingIsOverLimits(const _LSTransportOutgoing *outgoing, const _LSTransportOutgoingLimits *limits,
+                                 unsigned int extra_messages, unsigned long extra_bytes)
+{
+    const _LSTransportOutgoingStats *stats = &outgoing->stats;
+
+    return (limits->max_messages && stats->messages + extra_messages > limits->max_messages) ||
+           (limits->max_bytes && stats->bytes + extra_bytes > limits->max_bytes);
+}
+
+/* Subscription updates (and copies queued for the monitor) may be dropped,
+ * unless they are partially on the wire already */
+static inline bool
+_LSTransportOutgoingIsDroppable(const _LSTransportMessage *message, bool monitor)
+{
+    return (message->update_key || (monitor && _LSTransportMessageIsMonitorType(message))) &&
+           !_LSTransportMessageIsSendStarted(message);
+}
+
+/* Find the unsent update to the same subscription as message */
+static GList*
+_LSTransportOutgoingFindUpdate(_LSTransportOutgoing *outgoing, const _LSTransportMessage *message)
+{
+    LSMessageToken reply_token = _LSTransportMessageGetReplyToken(message);
+    GList *iter;
+
+    for (iter = g_queue_peek_tail_link(outgoing->queue); iter != NULL; iter = g_list_previous(iter))
+    {
+        _LSTransportMessage *queued = iter->data;
+
+        if (queued->update_key && !_LSTransportMessageIsSendStarted(queued) &&
+            _LSTransportMessageGetReplyToken(queued) == reply_token &&
+            strcmp(queued->update_key, message->update_key) == 0)
+        {
+            return iter;
+        }
+    }
+
+    return NULL;
+}
+
+/* The new value takes the place of the stale one */
+static void
+_LSTransportOutgoingReplace(_LSTransportOutgoing *outgoing, GList *link, _LSTransportMessage *message)
+{
+    _LSTransportMessage *stale = link->data;
+    _LSTransportOutgoingUnaccount(outgoing, stale);
+    _LSTransportMessageUnref(stale);
+
+    _LSTransportOutgoingAccount(outgoing, message);
+    link->data = message;
+    outgoing->stats.coalesced++;
+}
+
+/**
+ *******************************************************************************
+ * @brief Append a message to an outgoing queue, applying the queue's policy
+ * if the message would take it past its high-water marks.
+ *
+ * An update that supersedes the previous ones of its subscription replaces
+ * the unsent one in place, whatever the marks. Otherwise only subscription
+ * updates (messages with an update key), and copies queued for the monitor,
+ * are ever dropped or replaced; everything else is queued regardless. With
+ * the disconnect
+ * policy the message is queued, and the caller is expected to disconnect
+ * the peer.
+ *
+ * @attention caller must hold the outgoing lock
+ *
+ * @param  outgoing     IN  outgoing queue
+ * @param  message      IN  message (the queue takes over the caller's ref)
+ * @param  limits       IN  high-water marks and policy
+ * @param  monitor      IN  true if the queue is the monitor's, whose copies
+ *                          may be dropped as well
+ *
+ * @retval  true if the queue is within its marks (or doesn't care)
+ * @retval  false if the peer should be disconnected
+ *******************************************************************************
+ */
+bool
+_LSTransportOutgoingPushLimited(_LSTransportOutgoing *outgoing, _LSTransportMessage *message,
+                                const _LSTransportOutgoingLimits *limits, bool monitor)
+{
+    unsigned long size = message->tx_bytes_remaining;
+
+    if (message->update_key && message->update_supersedes)
+    {
+        GList *link = _LSTransportOutgoingFindUpdate(outgoing, message);
+        if (link)
+        {
+            _LSTransportOutgoingReplace(outgoing, link, message);
+            return true;
+        }
+    }
+
+    if (!_LSTransportOutgoingIsOverLimits(outgoing, limits, 1, size))
+    {
+        _LSTransportOutgoingPushTail(outgoing, message);
+        return true;
+    }
+
+    switch (limits->policy)
+    {
+    case LSOutgoingPolicyCoalesce:
+        if (message->update_key)
+        {
+            GList *link = _LSTransportOutgoingFindUpdate(outgoing, message);
+            if (link)
+            {
+                _LSTransportOutgoingReplace(outgoing, link, message);
+                return true;
+            }
+        }
+        break;
+
+    case LSOutgoingPolicyDropOldest:
+        {
+            GList *iter = g_queue_peek_head_link(outgoing->queue);
+            while (iter && _LSTransportOutgoingIsOverLimits(outgoing, limits, 1, size))
+            {
+                GList *next = g_list_next(iter);
+                _LSTransportMessage *queued = iter->data;
+
+                if (_LSTransportOutgoingIsDroppable(queued, monitor))
+                {
+                    _LSTransportOutgoingUnaccount(outgoing, queued);
+                    g_queue_delete_link(outgoing->queue, iter);
+                    _LSTransportMessageUnref(queued);
+                    outgoing->stats.dropped++;
+                }
+                iter = next;
+            }
+        }
+        break;
+
+    case LSOutgoingPolicyDisconnect:
+        _LSTransportOutgoingPushTail(outgoing, message);
+        return false;
+
+    case LSOutgoingPolicyQueue:
+    default:
+        break;
+    }
+
+    _LSTransportOutgoingPushTail(outgoing, message);
+    return true;
+}
+
 /* @} END OF LunaServiceTransportOutgoing */
@@ -20,14 +20,40 @@
 #ifndef _TRANSPORT_OUTGOING_H_
 #define _TRANSPORT_OUTGOING_H_
 
+#include <stdbool.h>
 #include <pthread.h>
 #include <glib.h>
+#include <luna-service2/lunaservice.h>
+#include "transport_message.h"
 #include "transport_serial.h"
 
+/**
+ * High-water marks of an outgoing queue and what to do once a message would
+ * take the queue past them.
+ */
+typedef struct LSTransportOutgoingLimits {
+    unsigned int max_messages;      /**< 0 for no limit */
+    unsigned long max_bytes;        /**< 0 for no limit */
+    LSOutgoingPolicy policy;
+} _LSTransportOutgoingLimits;
+
+/**
+ * Counters of an outgoing queue, reported by _LSTransportGetOutgoingQueueStats()
+ */
+typedef struct LSTransportOutgoingStats {
+    unsigned int messages;          /**< messages queued */
+    unsigned long bytes;            /**< bytes queued */
+    unsigned int peak_messages;     /**< most messages ever queued */
+    unsigned long peak_bytes;       /**< most bytes ever queued */
+    unsigned int dropped;           /**< updates dropped past the high-water marks */
+    unsigned int coalesced;         /**< unsent updates replaced by newer ones */
+} _LSTransportOutgoingStats;
+
 struct LSTransportOutgoing {
-    pthread_mutex_t lock;           /**< protects queue */
+    pthread_mutex_t lock;           /**< protects queue and stats */
     GQueue *queue;                  /**< queue of LSTransportMessages that need to be sent */
     _LSTransportSerial *serial;     /**< keeps track of clean shutdown state */
+    _LSTransportOutgoingStats stats;
 };
 
 typedef struct LSTransportOutgoing _LSTransportOutgoing;
@@ -35,4 +61,12 @@ typedef struct LSTransportOutgoing _LSTransportOutgoing;
 _LSTransportOutgoing* _LSTransportOutgoingNew(void);
 void _LSTransportOutgoingFree(_LSTransportOutgoing *outgoing);
 
+void _LSTransportOutgoingPushTail(_LSTransportOutgoing *outgoing, _LSTransportMessage *message);
+void _LSTransportOutgoingPushNth(_LSTransportOutgoing *outgoing, _LSTransportMessage *message, int n);
+_LSTransportMessage* _LSTransportOutgoingPopHead(_LSTransportOutgoing *outgoing);
+bool _LSTransportOutgoingIsOverLimits(const _LSTransportOutgoing *outgoing, const _LSTransportOutgoingLimits *limits,
+                                      unsigned int extra_messages, unsigned long extra_bytes);
+bool _LSTransportOutgoingPushLimited(_LSTransportOutgoing *outgoing, _LSTransportMessage *message,
+                                     const _LSTransportOutgoingLimits *limits, bool monitor);
+
 #endif      // _TRANSPORT_OUTGOING_H_
@@ -20,6 +20,7 @@
 #ifndef _TRANSPORT_PRIV_H_
 #define _TRANSPORT_PRIV_H_
 
+#include <sys/types.h>
 #include <pthread.h>
 #include <glib.h>
 
@@ -32,6 +33,7 @@
 #include "transport_channel.h"
 #include "transport_signal.h"
 #include "transport_shm.h"
+#include "dispatch_source.h"
 
 /**
  * "Global" in this case means that the token is unique for this transport to
@@ -85,6 +87,19 @@ struct LSTransport {
     GHashTable              *pending;           /*<< hash of _LSTransportOutgoing by service name */
 
     bool                    privileged;         /*<< true if we are a privileged service */
+
+    _LSTransportOutgoingLimits outgoing_limits; /*<< high-water marks of each client's outgoing queue */
+
+    _LSTransportIncomingBudget incoming_budget; /*<< per-turn budget of each client's incoming traffic */
+    int                     dispatch_priority;  /*<< priority of incoming_dispatch */
+    _LSDispatchSource       *incoming_dispatch; /*<< turns of clients with incoming messages left over
+                                                     after their budget; NULL until attached to a context */
 };
 
+bool _LSTransportSendMessagePrepend(_LSTransportMessage *message, _LSTransportClient *client,
+                                    LSMessageToken *token, LSError *lserror);
+void _LSTransportHandleIncomingConnection(_LSTransportMessage *message);
+bool _LSTransportSendWireComplete(int fd, unsigned long record_max, _LSTransportMessage *message, LSError *lserror);
+ssize_t _LSTransportReceiveRecord(_LSTransportClient *client);
+
 #endif      // _TRANSPORT_PRIV_H_
@@ -258,6 +258,194 @@ LSTransportSendSignal(_LSTransport *transport, const char *category, const char
     return ret;
 }
 
+/**
+ *******************************************************************************
+ * @brief Create a new service status signal with ref count of 1.
+ *
+ * The signal carries its fields as arguments following an empty payload
+ * (the service name is the method, as in the JSON form), so that receivers
+ * don't parse JSON to find out which service went up or down. The JSON
+ * payload is built from them by @ref LSTransportServiceStatusSignalGetPayload()
+ * only when asked for. Only peers of protocol version 3 and later understand
+ * this form; see @ref LSTransportMessageServiceStatusSignalLegacyNewRef().
+ *
+ * @param  service_name     IN  common name of the service (e.g., com.palm.foo)
+ * @param  unique_name      IN  unique name of the service
+ * @param  pid              IN  pid of the service (0 if unknown or going down)
+ * @param  all_names        IN  JSON fragment listing all the names of the
+ *                              executable (may be NULL)
+ * @param  up               IN  true if the service is coming up, false otherwise
+ *
+ * @retval  message on success
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+_LSTransportMessage*
+LSTransportMessageServiceStatusSignalNewRef(const char *service_name, const char *unique_name,
+                                            int32_t pid, const char *all_names, bool up)
+{
+    /*
+     * format:
+     *
+     * category + NUL
+     * method (service name) + NUL
+     * NUL (empty payload)
+     * padding
+     * unique name, pid, all names (arguments)
+     */
+    int category_len = strlen(SERVICE_STATUS_CATEGORY) + 1;
+    int method_len = strlen(service_name) + 1;
+    unsigned long args_offset = category_len + method_len + 1;
+    args_offset += PADDING_BYTES_TYPE(int32_t, args_offset);
+
+    LS_ASSERT(method_len > 1);
+
+    _LSTransportMessage *message = _LSTransportMessageNewRef(args_offset);
+
+    _LSTransportMessageSetType(message, up ? _LSTransportMessageTypeServiceUpSignal
+                                           : _LSTransportMessageTypeServiceDownSignal);
+
+    char *message_body = _LSTransportMessageGetBody(message);
+
+    memset(message_body, '\0', args_offset);
+    memcpy(message_body, SERVICE_STATUS_CATEGORY, category_len);
+    memcpy(message_body + category_len, service_name, method_len);
+
+    _LSTransportMessageIter iter;
+    _LSTransportMessageIterInitAt(message, &iter, args_offset);
+
+    if (!_LSTransportMessageAppendString(&iter, unique_name)) goto error;
+    if (!_LSTransportMessageAppendInt32(&iter, pid)) goto error;
+    if (!_LSTransportMessageAppendString(&iter, all_names)) goto error;
+    if (!_LSTransportMessageAppendInvalid(&iter)) goto error;
+
+    return message;
+
+error:
+    _LSTransportMessageUnref(message);
+    return NULL;
+}
+
+/* Position the iterator at the fields of a service status signal. Fails for
+ * the JSON form */
+static bool
+_LSTransportServiceStatusSignalIterInit(_LSTransportMessage *message, _LSTransportMessageIter *iter)
+{
+    LS_ASSERT(_LSTransportMessageGetType(message) == _LSTransportMessageTypeServiceDownSignal
+              || _LSTransportMessageGetType(message) == _LSTransportMessageTypeServiceUpSignal);
+
+    const char *body = _LSTransportMessageGetBody(message);
+    const char *payload = _LSTransportMessageGetPayload(message);
+
+    if (!payload || payload < body || payload >= body + _LSTransportMessageGetBodySize(message) ||
+        payload[0] != '\0')
+    {
+        return false;
+    }
+
+    unsigned long args_offset = payload - body + 1;
+    args_offset += PADDING_BYTES_TYPE(int32_t, args_offset);
+
+    _LSTransportMessageIterInitAt(message, iter, args_offset);
+
+    return _LSTransportMessageIterHasNext(iter);
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the fields of a service status signal without parsing JSON. The
+ * strings point inside the message.
+ *
+ * @param  message  IN   message
+ * @param  status   OUT  fields
+ *
+ * @retval  true on success
+ * @retval  false if the signal is in the JSON form (sent by an older hub) or
+ *          malformed
+ *******************************************************************************
+ */
+bool
+LSTransportServiceStatusSignalGetStatus(_LSTransportMessage *message, _LSTransportServiceStatus *status)
+{
+    _LSTransportMessageIter iter;
+
+    if (!_LSTransportServiceStatusSignalIterInit(message, &iter))
+    {
+        return false;
+    }
+
+    status->service_name = _LSTransportMessageGetMethod(message);
+    status->connected = _LSTransportMessageGetType(message) == _LSTransportMessageTypeServiceUpSignal;
+
+    if (!_LSTransportMessageGetString(&iter, &status->unique_name) || !status->unique_name) return false;
+    _LSTransportMessageIterNext(&iter);
+    if (!_LSTransportMessageGetInt32(&iter, &status->pid)) return false;
+    _LSTransportMessageIterNext(&iter);
+    if (!_LSTransportMessageGetString(&iter, &status->all_names)) return false;
+
+    return status->service_name != NULL;
+}
+
+/**
+ *******************************************************************************
+ * @brief Build the JSON payload of a service status signal from its fields.
+ *
+ * @param  message  IN  message
+ *
+ * @retval  allocated payload, to be freed by the caller
+ * @retval  NULL if the signal is in the JSON form already (or malformed)
+ *******************************************************************************
+ */
+char*
+LSTransportServiceStatusSignalGetPayload(_LSTransportMessage *message)
+{
+    _LSTransportServiceStatus status;
+
+    if (!LSTransportServiceStatusSignalGetStatus(message, &status))
+    {
+        return NULL;
+    }
+
+    if (status.connected)
+    {
+        return g_strdup_printf(SERVICE_STATUS_UP_PAYLOAD, status.service_name, status.unique_name,
+                               (int) status.pid, status.all_names ? status.all_names : "");
+    }
+
+    return g_strdup_printf(SERVICE_STATUS_DOWN_PAYLOAD, status.service_name, status.unique_name);
+}
+
+/**
+ *******************************************************************************
+ * @brief Create the JSON form of a service status signal, for peers older
+ * than protocol version 3.
+ *
+ * @param  message  IN  service status signal
+ *
+ * @retval  message on success
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+_LSTransportMessage*
+LSTransportMessageServiceStatusSignalLegacyNewRef(_LSTransportMessage *message)
+{
+    char *payload = LSTransportServiceStatusSignalGetPayload(message);
+
+    if (!payload)
+    {
+        return NULL;
+    }
+
+    _LSTransportMessage *legacy = LSTransportMessageSignalNewRef(SERVICE_STATUS_CATEGORY,
+                                                                 _LSTransportMessageGetMethod(message),
+                                                                 payload);
+    _LSTransportMessageSetType(legacy, _LSTransportMessageGetType(message));
+
+    g_free(payload);
+
+    return legacy;
+}
+
 /**
  *******************************************************************************
  * @brief Get the service name from a "ServceStatus" message. The name is
@@ -272,12 +460,17 @@ LSTransportSendSignal(_LSTransport *transport, const char *category, const char
 char*
 LSTransportServiceStatusSignalGetServiceName(_LSTransportMessage *message)
 {
+    _LSTransportServiceStatus status;
+
+    if (LSTransportServiceStatusSignalGetStatus(message, &status))
+    {
+        return g_strdup(status.service_name);
+    }
+
+    /* JSON form, sent by hubs older than protocol version 3 */
     JSchemaInfo schemaInfo;
     jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
 
-    LS_ASSERT(_LSTransportMessageGetType(message) == _LSTransportMessageTypeServiceDownSignal
-              || _LSTransportMessageGetType(message) == _LSTransportMessageTypeServiceUpSignal);
-
     char *service_name = NULL;
     jvalue_ref service_name_obj = NULL;
     const char *payload = _LSTransportMessageGetPayload(message);
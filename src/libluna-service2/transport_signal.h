@@ -29,6 +29,16 @@
 
 #define SERVICE_STATUS_SERVICE_NAME     "serviceName"
 
+/** Fields of a service status signal, see @ref LSTransportServiceStatusSignalGetStatus() */
+typedef struct _LSTransportServiceStatus
+{
+    const char *service_name;   /**< common name of the service */
+    const char *unique_name;    /**< unique name of the service */
+    int32_t pid;                /**< pid of the service, 0 if unknown or going down */
+    const char *all_names;      /**< JSON fragment listing all the names of the executable (may be NULL) */
+    bool connected;             /**< true if the service came up */
+} _LSTransportServiceStatus;
+
 bool LSTransportRegisterSignal(_LSTransport *transport, const char *category, const char *method, LSMessageToken *token, LSError *lserror);
 bool LSTransportUnregisterSignal(_LSTransport *transport, const char *category, const char *method, LSMessageToken *token, LSError *lserror);
 bool LSTransportSendSignal(_LSTransport *transport, const char *category, const char *method, const char *payload, LSError *lserror);
@@ -37,6 +47,11 @@ bool LSTransportRegisterSignalServiceStatus(_LSTransport *transport, const char
 bool LSTransportUnregisterSignalServiceStatus(_LSTransport *transport, const char *service_name,  LSMessageToken *token, LSError *lserror);
 
 char* LSTransportServiceStatusSignalGetServiceName(_LSTransportMessage *message);
+bool LSTransportServiceStatusSignalGetStatus(_LSTransportMessage *message, _LSTransportServiceStatus *status);
+char* LSTransportServiceStatusSignalGetPayload(_LSTransportMessage *message);
 _LSTransportMessage* LSTransportMessageSignalNewRef(const char *category, const char *method, const char *payload);
+_LSTransportMessage* LSTransportMessageServiceStatusSignalNewRef(const char *service_name, const char *unique_name,
+                                                                 int32_t pid, const char *all_names, bool up);
+_LSTransportMessage* LSTransportMessageServiceStatusSignalLegacyNewRef(_LSTransportMessage *message);
 
 #endif      // _TRANSPORT_SIGNAL_H_
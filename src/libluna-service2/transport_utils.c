@@ -184,3 +184,58 @@ _LSTransportFdSetNonBlock(int fd, bool *prev_state_blocking)
     LS_ASSERT(fd >= 0);
     _LSTransportFdSetBlockingState(fd, false, prev_state_blocking);
 }
+
+/**
+ *******************************************************************************
+ * @brief Check whether a local socket name lives in the Linux abstract
+ * namespace. Such names start with '@' and have no file in the filesystem:
+ * they go away with the last fd, so they never need to be cleaned up.
+ *
+ * @param  name  IN  socket name
+ *
+ * @retval  true if the name is abstract
+ *******************************************************************************
+ */
+bool
+_LSTransportIsAbstractName(const char *name)
+{
+    return name && name[0] == LS_TRANSPORT_ABSTRACT_PREFIX;
+}
+
+/**
+ *******************************************************************************
+ * @brief Fill in the address of a local socket, either a path or an
+ * abstract name (see @ref _LSTransportIsAbstractName). The name is
+ * truncated if it doesn't fit.
+ *
+ * @param  name  IN   socket name
+ * @param  addr  OUT  address
+ *
+ * @retval  length of the address to pass to bind() or connect()
+ *******************************************************************************
+ */
+socklen_t
+_LSTransportSockaddrLocal(const char *name, struct sockaddr_un *addr)
+{
+    LS_ASSERT(name != NULL);
+
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+
+    if (!_LSTransportIsAbstractName(name))
+    {
+        strncpy(addr->sun_path, name, sizeof(addr->sun_path) - 1);
+        return sizeof(struct sockaddr_un);
+    }
+
+    /* abstract names are told apart by the leading zero, and their length
+     * is the length of the address: trailing zeros would be part of it */
+    size_t len = strlen(name + 1);
+    if (len > sizeof(addr->sun_path) - 1)
+    {
+        len = sizeof(addr->sun_path) - 1;
+    }
+    memcpy(addr->sun_path + 1, name + 1, len);
+
+    return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
@@ -22,13 +22,19 @@
 
 #include <signal.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <glib.h>
 
 #include "log.h"
 
 #define ARRAY_SIZE(array) (sizeof(array)/sizeof(array[0]))
 
+/** Leading character of the local socket names in the abstract namespace */
+#define LS_TRANSPORT_ABSTRACT_PREFIX    '@'
+
 extern int _ls_debug_tracing;
 
 #define DEBUG_TRACING (_ls_debug_tracing)
@@ -40,6 +46,8 @@ void DumpHashTable(GHashTable *table);
 bool _LSTransportSetupSignalHandler(int signal, void (*handler)(int));
 void _LSTransportFdSetBlock(int fd, bool *prev_state_blocking);
 void _LSTransportFdSetNonBlock(int fd, bool *prev_state_blocking);
+bool _LSTransportIsAbstractName(const char *name);
+socklen_t _LSTransportSockaddrLocal(const char *name, struct sockaddr_un *addr);
 
 /* compile-time type check */
 #define TYPECHECK(type,val)             \
@@ -0,0 +1,260 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <string.h>
+
+#include "worker_pool.h"
+#include "base.h"
+#include "message.h"
+#include "transport.h"
+
+/**
+ * @addtogroup LunaServiceInternals
+ * @{
+ */
+
+/** Method call waiting for a worker, resolved on the handle's context */
+typedef struct _LSWorkItem {
+    LSMessage       *message;
+    LSCategoryTable *category;
+    LSMethodEntry   *method;
+    const char      *service_name;  /**< owned by the message's client */
+} _LSWorkItem;
+
+/** GSource attached to a worker context. Items are queued from the handle's
+ * context and dispatched on the worker's one */
+typedef struct _LSWorker {
+    GSource         source;         /**< must be first */
+    GMainContext    *context;
+    GMutex          lock;           /**< protects items */
+    GQueue          items;          /**< _LSWorkItem* in arrival order */
+} _LSWorker;
+
+struct _LSWorkerPool {
+    LSHandle        *sh;
+    unsigned int    count;
+    _LSWorker       **workers;
+    LSDispatchKeyFunc key_func;
+    void            *key_ctx;
+};
+
+static void
+_LSWorkItemRun(LSHandle *sh, _LSWorkItem *item)
+{
+    LSMessageHandlerResult ret = LSCategoryMethodInvoke(sh, item->category, item->method,
+                                                        item->service_name, item->message);
+    _LSTransportHandleMessageHandlerResult(item->message->transport_msg, ret);
+
+    LSMessageUnref(item->message);
+    g_slice_free(_LSWorkItem, item);
+}
+
+static _LSWorkItem*
+_LSWorkerPop(_LSWorker *worker)
+{
+    g_mutex_lock(&worker->lock);
+    _LSWorkItem *item = g_queue_pop_head(&worker->items);
+    g_mutex_unlock(&worker->lock);
+    return item;
+}
+
+static bool
+_LSWorkerHasItems(_LSWorker *worker)
+{
+    g_mutex_lock(&worker->lock);
+    bool ret = !g_queue_is_empty(&worker->items);
+    g_mutex_unlock(&worker->lock);
+    return ret;
+}
+
+static gboolean
+_LSWorkerPrepare(GSource *source, gint *timeout)
+{
+    *timeout = -1;
+    return _LSWorkerHasItems((_LSWorker *) source);
+}
+
+static gboolean
+_LSWorkerCheck(GSource *source)
+{
+    return _LSWorkerHasItems((_LSWorker *) source);
+}
+
+static gboolean
+_LSWorkerDispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+    _LSWorker *worker = (_LSWorker *) source;
+    LSHandle *sh = user_data;
+
+    /* _LSWorkerPoolFree() takes over the rest once the source is destroyed */
+    _LSWorkItem *item;
+    while (!g_source_is_destroyed(source) && (item = _LSWorkerPop(worker)))
+    {
+        _LSWorkItemRun(sh, item);
+    }
+
+    return TRUE;
+}
+
+static void
+_LSWorkerFinalize(GSource *source)
+{
+    _LSWorker *worker = (_LSWorker *) source;
+
+    LS_ASSERT(g_queue_is_empty(&worker->items));
+    g_main_context_unref(worker->context);
+    g_mutex_clear(&worker->lock);
+}
+
+static GSourceFuncs _LSWorkerFuncs = {
+    .prepare  = _LSWorkerPrepare,
+    .check    = _LSWorkerCheck,
+    .dispatch = _LSWorkerDispatch,
+    .finalize = _LSWorkerFinalize,
+};
+
+/**
+ *******************************************************************************
+ * @brief Attach a worker source to each of the contexts.
+ *
+ * @param  sh        IN  handle the method calls are received on
+ * @param  contexts  IN  worker contexts
+ * @param  count     IN  number of contexts
+ * @param  key_func  IN  dispatch key of a method call, NULL to use the category
+ * @param  key_ctx   IN  context for key_func
+ *
+ * @retval  pool
+ *******************************************************************************
+ */
+_LSWorkerPool*
+_LSWorkerPoolNew(LSHandle *sh, GMainContext **contexts, unsigned int count,
+                 LSDispatchKeyFunc key_func, void *key_ctx)
+{
+    _LSWorkerPool *pool = g_new0(_LSWorkerPool, 1);
+
+    pool->sh = sh;
+    pool->key_func = key_func;
+    pool->key_ctx = key_ctx;
+    pool->workers = g_new0(_LSWorker*, count);
+
+    for (pool->count = 0; pool->count < count; pool->count++)
+    {
+        _LSWorker *worker = (_LSWorker *) g_source_new(&_LSWorkerFuncs, sizeof(_LSWorker));
+
+        g_mutex_init(&worker->lock);
+        g_queue_init(&worker->items);
+        worker->context = g_main_context_ref(contexts[pool->count]);
+
+        g_source_set_callback(&worker->source, NULL, sh, NULL);
+        g_source_attach(&worker->source, worker->context);
+
+        pool->workers[pool->count] = worker;
+    }
+
+    return pool;
+}
+
+/**
+ *******************************************************************************
+ * @brief Detach the workers. A handler may still be running on a worker, so
+ * worker loops should be stopped before the handle is unregistered.
+ *
+ * @param  pool              IN  pool (may be NULL)
+ * @param  dispatch_pending  IN  run calls that didn't reach a worker yet on
+ *                               the calling thread, otherwise drop them
+ *******************************************************************************
+ */
+void
+_LSWorkerPoolFree(_LSWorkerPool *pool, bool dispatch_pending)
+{
+    if (!pool) return;
+
+    unsigned int i;
+    for (i = 0; i < pool->count; i++)
+    {
+        _LSWorker *worker = pool->workers[i];
+
+        g_source_destroy(&worker->source);
+
+        _LSWorkItem *item;
+        while ((item = _LSWorkerPop(worker)))
+        {
+            if (dispatch_pending)
+            {
+                _LSWorkItemRun(pool->sh, item);
+            }
+            else
+            {
+                LSMessageUnref(item->message);
+                g_slice_free(_LSWorkItem, item);
+            }
+        }
+
+        g_source_unref(&worker->source);
+    }
+
+    g_free(pool->workers);
+
+#ifdef MEMCHECK
+    memset(pool, 0xFF, sizeof(_LSWorkerPool));
+#endif
+
+    g_free(pool);
+}
+
+/**
+ *******************************************************************************
+ * @brief Queue a method call to a worker. Calls with the same dispatch key go
+ * to the same worker, so they are handled in the order they were received.
+ *
+ * @param  pool          IN  pool
+ * @param  category      IN  category the method belongs to
+ * @param  method        IN  method to invoke
+ * @param  service_name  IN  name of the caller
+ * @param  message       IN  method call
+ *******************************************************************************
+ */
+void
+_LSWorkerPoolDispatch(_LSWorkerPool *pool, LSCategoryTable *category, LSMethodEntry *method,
+                      const char *service_name, LSMessage *message)
+{
+    guint key = pool->key_func
+              ? pool->key_func(pool->sh, message, pool->key_ctx)
+              : g_str_hash(LSMessageGetCategory(message));
+
+    _LSWorker *worker = pool->workers[key % pool->count];
+
+    _LSWorkItem *item = g_slice_new(_LSWorkItem);
+    item->message = message;
+    item->category = category;
+    item->method = method;
+    item->service_name = service_name;
+    LSMessageRef(message);
+
+    g_mutex_lock(&worker->lock);
+    bool wakeup = g_queue_is_empty(&worker->items);
+    g_queue_push_tail(&worker->items, item);
+    g_mutex_unlock(&worker->lock);
+
+    if (wakeup)
+    {
+        g_main_context_wakeup(worker->context);
+    }
+}
+
+/* @} END OF LunaServiceInternals */
@@ -0,0 +1,66 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+
+#include <stdbool.h>
+#include <glib.h>
+
+#include <luna-service2/lunaservice.h>
+
+#include "category.h"
+
+/**
+ * @addtogroup LunaServiceInternals
+ * @{
+ */
+
+/**
+ * Pool of worker GMainContexts a handle dispatches incoming method calls to
+ * (see LSGmainAttachWorkers()).
+ *
+ * Only handler invocation moves to the workers. Reading the socket, looking
+ * up the category and method, cancel messages, replies and signals stay on
+ * the handle's own context, and replies are written by its send watch.
+ *
+ * Locking audit for handlers running on the workers:
+ *  - _CallMap: token, signal and service maps are only touched under the
+ *    callmap lock; _Call refcounts are atomic and call timeouts are armed in
+ *    the callmap's timer wheel, which has its own lock.
+ *  - _Catalog: token and subscription maps are only touched under the
+ *    catalog lock; _Subscription refcounts are atomic. The cancel function
+ *    must be set before workers are attached.
+ *  - outgoing: the queue and the send watch are only touched under the
+ *    outgoing lock; the watch is attached to the handle's context.
+ *  - tableHandlers: only read on the handle's context; categories must be
+ *    registered before workers are attached.
+ */
+typedef struct _LSWorkerPool _LSWorkerPool;
+
+_LSWorkerPool* _LSWorkerPoolNew(LSHandle *sh, GMainContext **contexts, unsigned int count,
+                                LSDispatchKeyFunc key_func, void *key_ctx);
+void _LSWorkerPoolFree(_LSWorkerPool *pool, bool dispatch_pending);
+
+void _LSWorkerPoolDispatch(_LSWorkerPool *pool, LSCategoryTable *category, LSMethodEntry *method,
+                           const char *service_name, LSMessage *message);
+
+/* @} END OF LunaServiceInternals */
+
+#endif // _WORKER_POOL_H_
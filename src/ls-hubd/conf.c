@@ -119,6 +119,9 @@ void _ConfigFreeSettings(void);
  * PidDirectory=/path/to/some/dir
  * LogServiceStatus=false
  * ConnectTimeout=time_ms
+ * IncomingBudgetMessages=count
+ * IncomingBudgetBytes=bytes
+ * AbstractSockets=bool
  *
  * [Watchdog]
  * Timeout=time_sec
@@ -128,6 +131,11 @@ void _ConfigFreeSettings(void);
  * Directories=/path/to/some/dir;/another/path/to/some
  * ExecPrefix=/path/to/some/bin
  * LaunchTimeout=time_ms
+ * Prelaunch=bool
+ * PrelaunchMaxConcurrent=count
+ * PrelaunchMaxLoad=percent
+ * PrelaunchFile=/path/to/some/file
+ * ListenBeforeLaunch=bool
  *
  * [Security]
  * Enabled=bool
@@ -163,12 +171,36 @@ static _ConfigDOM conf_file_dom = {
                     .user_cb = (_ConfigKeyUser*)_ConfigKeySetBool,
                     .user_ctxt = &g_conf_log_service_status,
                 },
+                {
+                    .key = "AbstractSockets",
+                    .get_value = _ConfigKeyGetBool,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeySetBool,
+                    .user_ctxt = &g_conf_abstract_sockets,
+                },
+                {
+                    .key = "SeqpacketSockets",
+                    .get_value = _ConfigKeyGetBool,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeySetBool,
+                    .user_ctxt = &g_conf_seqpacket_sockets,
+                },
                 {
                     .key = "ConnectTimeout",
                     .get_value = _ConfigKeyGetInt,
                     .user_cb = (_ConfigKeyUser*)_ConfigKeySetInt,
                     .user_ctxt = &g_conf_connect_timeout_ms,
                 },
+                {
+                    .key = "IncomingBudgetMessages",
+                    .get_value = _ConfigKeyGetInt,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeySetInt,
+                    .user_ctxt = &g_conf_incoming_budget_messages,
+                },
+                {
+                    .key = "IncomingBudgetBytes",
+                    .get_value = _ConfigKeyGetInt,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeySetInt,
+                    .user_ctxt = &g_conf_incoming_budget_bytes,
+                },
                 { NULL }
             }
         },
@@ -217,6 +249,36 @@ static _ConfigDOM conf_file_dom = {
                     .user_cb = (_ConfigKeyUser*)_ConfigKeySetInt,
                     .user_ctxt = &g_conf_query_name_timeout_ms,
                 },
+                {
+                    .key = "Prelaunch",
+                    .get_value = _ConfigKeyGetBool,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeySetBool,
+                    .user_ctxt = &g_conf_prelaunch_enabled,
+                },
+                {
+                    .key = "PrelaunchMaxConcurrent",
+                    .get_value = _ConfigKeyGetInt,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeySetInt,
+                    .user_ctxt = &g_conf_prelaunch_max_concurrent,
+                },
+                {
+                    .key = "PrelaunchMaxLoad",
+                    .get_value = _ConfigKeyGetInt,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeySetInt,
+                    .user_ctxt = &g_conf_prelaunch_max_load,
+                },
+                {
+                    .key = "PrelaunchFile",
+                    .get_value = _ConfigKeyGetString,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeySetString,
+                    .user_ctxt = &g_conf_prelaunch_file,
+                },
+                {
+                    .key = "ListenBeforeLaunch",
+                    .get_value = _ConfigKeyGetBool,
+                    .user_cb = (_ConfigKeyUser*)_ConfigKeySetBool,
+                    .user_ctxt = &g_conf_listen_before_launch,
+                },
                 { NULL }
             }
         },
@@ -312,9 +374,22 @@ LSHubWatchdogFailureMode g_conf_watchdog_failure_mode = LSHubWatchdogFailureMode
 int g_conf_query_name_timeout_ms = 20000;       /**< timeout in ms for a "QueryName" message */
 bool g_conf_security_enabled = true;            /**< enable/disable security checks */
 bool g_conf_log_service_status = false;         /**< enable service status logging */
+bool g_conf_abstract_sockets = false;           /**< put the sockets of the hub and the services in the
+                                                     abstract namespace instead of the socket directory */
+bool g_conf_seqpacket_sockets = false;          /**< connect clients that read records with SOCK_SEQPACKET
+                                                     socket pairs instead of stream ones */
 char *g_conf_dynamic_service_exec_prefix = NULL; /**< prefix added to Exec in service file
                                                       when launching dynamic service */
 int g_conf_connect_timeout_ms = 20000;          /**< timeout in ms for connect() to complete */
+int g_conf_incoming_budget_messages = 64;       /**< messages of a client handled per turn (0 for no limit) */
+int g_conf_incoming_budget_bytes = 256 * 1024;  /**< bytes of a client handled per turn (0 for no limit) */
+bool g_conf_prelaunch_enabled = false;          /**< launch dynamic services predicted from the observed calls */
+int g_conf_prelaunch_max_concurrent = 2;        /**< predicted launches that may be coming up at a time */
+int g_conf_prelaunch_max_load = 50;             /**< load average per CPU, in percent, below which
+                                                     predicted services are launched */
+char *g_conf_prelaunch_file = NULL;             /**< file the observed calls are kept in across boots */
+bool g_conf_listen_before_launch = false;      /**< create the sockets of dynamic services before
+                                                     launching them */
 char *g_conf_monitor_exe_path = NULL;           /**< path to ls-monitor */
 char *g_conf_monitor_pub_exe_path = NULL;       /**< path to ls-monitor-pub */
 char *g_conf_sysmgr_exe_path = NULL;            /**< path to LunaSysMgr */
@@ -491,6 +566,9 @@ _ConfigParseFileWrapper(GIOChannel *channel, GIOCondition condition, gpointer da
             break;
     }
 
+    /* The names of the available services come from the roles */
+    LSHubServiceSnapshotRefresh();
+
     /* Send out a signal that we've completed the scanning */
     (void)LSHubSendConfScanCompleteSignal();
 
@@ -839,6 +917,12 @@ _ConfigFreeSettings(void)
         g_free(g_conf_mojo_app_exe_path);
     }
     g_conf_mojo_app_exe_path = NULL;
+
+    if (g_conf_prelaunch_file)
+    {
+        g_free(g_conf_prelaunch_file);
+    }
+    g_conf_prelaunch_file = NULL;
 }
 
 static bool
@@ -38,7 +38,16 @@ extern int g_conf_query_name_timeout_ms;
 extern char* g_conf_dynamic_service_exec_prefix;
 extern bool g_conf_security_enabled;
 extern bool g_conf_log_service_status;
+extern bool g_conf_abstract_sockets;
+extern bool g_conf_seqpacket_sockets;
 extern int g_conf_connect_timeout_ms;
+extern int g_conf_incoming_budget_messages;
+extern int g_conf_incoming_budget_bytes;
+extern bool g_conf_prelaunch_enabled;
+extern int g_conf_prelaunch_max_concurrent;
+extern int g_conf_prelaunch_max_load;
+extern char* g_conf_prelaunch_file;
+extern bool g_conf_listen_before_launch;
 extern char* g_conf_monitor_exe_path;
 extern char* g_conf_monitor_pub_exe_path;
 extern char* g_conf_sysmgr_exe_path;
@@ -28,6 +28,10 @@
 #include <arpa/inet.h>
 #include <sys/stat.h>
 #include <libgen.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <sched.h>
+#include <sys/syscall.h>
 #include <glib.h>
 #include <pbnjson.h>
 
@@ -40,10 +44,12 @@
 #include "transport_utils.h"
 #include "transport_client.h"
 #include "transport_security.h"
-#include "timersource.h"
 #include "utils.h"
 #include "pattern.h"
+#include "service_snapshot.h"
+#include "prelaunch.h"
 #include "base.h"
+#include "clock.h"
 
 /**
  * @defgroup LunaServiceHub
@@ -72,7 +78,7 @@
 /** private hub pid file */
 #define HUB_PRIVATE_LOCK_FILENAME       "ls-hubd.private.pid"
 
-#define MESSAGE_TIMEOUT_GRANULARITY_MS 100  /**< glib timer granularity for message timeouts */
+#define MESSAGE_TIMEOUT_GRANULARITY_MS 100  /**< resolution of the message timeout wheel */
 
 /** log context names. last two are configured in /etc/pmlog.d/ls-hub.conf */
 #define HUB_LOG_CONTEXT_PREFIX          "ls-hubd."
@@ -114,6 +120,23 @@ const char* service_group_names[] = {
 #define SERVICE_TYPE_DYNAMIC    "dynamic"
 #define SERVICE_TYPE_STATIC     "static"
 
+#define PRELAUNCH_MAX_QUEUED            32  /**< predicted services waiting to be launched */
+#define PRELAUNCH_SAVE_INTERVAL_SEC     60  /**< how often the observed calls are saved */
+#define PRELAUNCH_BUSY_RECHECK_SEC      2   /**< how often the load is looked at again while
+                                                 the system is too busy to pre-launch */
+
+#define UNIQUE_NAME_BIND_ATTEMPTS       8   /**< abstract names tried when others are taken */
+
+/* Linux-specific, not exposed without _GNU_SOURCE or by glibc at all */
+#ifndef SCHED_IDLE
+#define SCHED_IDLE                      5
+#endif
+#define IOPRIO_WHO_PROCESS              1
+#define IOPRIO_CLASS_SHIFT              13
+#define IOPRIO_PRIO_IDLE                (3 << IOPRIO_CLASS_SHIFT)   /**< IOPRIO_CLASS_IDLE */
+#define IOPRIO_PRIO_DEFAULT             0                           /**< IOPRIO_CLASS_NONE: follow
+                                                                         the CPU priority */
+
 typedef enum _DynamicServiceState {
     _DynamicServiceStateInvalid = -1,      /**< not a dynamic service */
     _DynamicServiceStateStopped,           /**< not running */
@@ -150,6 +173,13 @@ static _LSTransport *hub_transport = NULL;
 
 static GHashTable *pending = NULL;              /**< hash of service name to _ClientId */
 static GHashTable *available_services = NULL;   /**< hash of service name to _ClientId */
+static _LSHubServiceSnapshot *service_snapshot = NULL; /**< JSON entries of the available services */
+
+static _LSHubPrelaunch *prelaunch = NULL;       /**< observed calls of the dynamic services
+                                                     (NULL if pre-launch is disabled) */
+static GQueue prelaunch_queue = G_QUEUE_INIT;   /**< names of the services to pre-launch */
+static guint prelaunch_source = 0;              /**< idle (or busy recheck) source launching them */
+static guint prelaunch_save_source = 0;         /**< timeout saving the observed calls */
 
 static _ConnectedClients connected_clients;     /**< all connected clients
                                                      TODO: may want to build this
@@ -166,6 +196,9 @@ static GSList *waiting_for_connect = NULL;      /**< list of messages waiting fo
                                                   is useful for debugging so we can
                                                   dump out the state */
 
+static _LSTimerWheel *message_timeouts = NULL;  /**< query name and connect() timeouts
+                                                  of the messages above */
+
 /**
  * Keeps track of the state of running dynamic services
  *
@@ -205,6 +238,23 @@ typedef struct _LocalName {
 typedef struct _InetName {
 } _InetName;
 
+/**
+ * Per-client traffic statistics reported by the hub telemetry query
+ * (luna://com.palm.bus/hub/telemetry).
+ */
+typedef struct _ClientStats {
+    guint64 messages_received;  /**< messages sent by the client to the hub */
+    guint64 bytes_received;     /**< bytes sent by the client to the hub */
+    guint64 messages_routed;    /**< signals forwarded by the hub to the client */
+    guint64 bytes_routed;       /**< bytes forwarded by the hub to the client */
+    guint signals_registered;   /**< current number of signal registrations */
+    guint64 signals_sent;       /**< signals emitted by the client */
+    guint64 signal_fanout;      /**< deliveries caused by the client's signals */
+    _LSMetricsHistogram query_name_latency; /**< QueryName request -> reply latency */
+    long launch_to_up_ms;       /**< dynamic launch to NodeUp time (-1 if not
+                                     launched by the hub) */
+} _ClientStats;
+
 typedef struct _ClientId {
     int ref;                    /**< ref count */
     char *service_name;         /**< service name (or NULL if it doesn't have one */
@@ -214,6 +264,7 @@ typedef struct _ClientId {
     _InetName inet;             /**< inet name */
     bool is_monitor;            /**< true if this client is the monitor */
     GHashTable *categories;     /**< map of registered categories to method names lists */
+    _ClientStats stats;         /**< traffic statistics */
 } _ClientId;
 
 typedef struct _SignalMap {
@@ -243,12 +294,22 @@ typedef struct _LSTransportClientMap {
     GHashTable *map;
 } _LSTransportClientMap;
 
+/**
+ * Exec line of a dynamic service, parsed once when its service file is
+ * loaded and shared by every launch of the service.
+ */
+typedef struct _ServiceExec {
+    int ref;                    /**< ref count */
+    char **argv;                /**< arguments, argv[0] is the executable */
+} _ServiceExec;
+
 typedef struct _Service {
     int ref;                    /**< ref count */
     char **service_names;       /**< names of services provided (currently only
                                      support one service) */
     int num_services;           /**< number of services provided by executable */
     char *exec_path;            /**< executable path for this service */
+    _ServiceExec *exec;         /**< parsed exec_path (dynamic services only) */
     GPid pid;                   /**< pid when running (0 otherwise)  */
     _DynamicServiceState state; /**< see @ref _DynamicServiceState */
     bool respawn_on_exit;       /**< true if we should respawn the service again
@@ -259,14 +320,66 @@ typedef struct _Service {
     char *service_file_dir;     /**< directory where the service file for this service lives */
     char *service_file_name;    /**< file name of the service file for this service */
     bool from_volatile_dir;     /**< service was added from volatile directory*/
+    struct timespec launch_time;/**< time of the last dynamic launch */
+    bool replied;               /**< a client was handed the service since
+                                     its last dynamic launch */
+    bool prelaunched;           /**< launched before being requested */
+    bool prelaunch_hit;         /**< requested since it was pre-launched */
+    int listen_fd;              /**< socket created before the launch and handed
+                                     to the service when it registers (-1 if
+                                     none) */
+    char *listen_name;          /**< ... and its unique name */
 } _Service;                     /**< struct representing a dynamic service */
 
+/**
+ * Per-service statistics reported by the hub telemetry query. Kept by
+ * service name, so they survive service file rescans and restarts.
+ */
+typedef struct _ServiceStats {
+    guint64 queries;                        /**< QueryName requests for the service */
+    _LSMetricsHistogram query_name_latency; /**< QueryName request -> reply latency */
+    guint64 launches;                       /**< dynamic launches that came up */
+    _LSMetricsHistogram launch_to_up;       /**< dynamic launch -> NodeUp time */
+    _LSMetricsHistogram launch_to_reply;    /**< dynamic launch -> first client
+                                                 handed the service */
+} _ServiceStats;
+
+/**
+ * Hub-wide statistics
+ */
+static struct {
+    guint64 signals_routed;                 /**< signals handled by the hub */
+    guint64 signal_deliveries;              /**< signal copies sent to clients */
+    _LSMetricsHistogram query_name_latency; /**< QueryName request -> reply latency */
+    _LSMetricsHistogram launch_to_up;       /**< dynamic launch -> NodeUp time */
+    _LSMetricsHistogram launch_to_reply;    /**< dynamic launch -> first client
+                                                 handed the service */
+    guint64 prelaunches;                    /**< dynamic services launched ahead */
+    guint64 prelaunch_hits;                 /**< ... and requested afterwards */
+    guint64 prelaunch_wasted;               /**< ... and exited without being requested */
+    int prelaunch_in_flight;                /**< pre-launched services not up yet */
+} hub_stats;
+
+/**
+ * HASH: service name to _ServiceStats ptr
+ */
+static GHashTable *service_stats = NULL;
+
+/**
+ * QueryName messages that haven't been replied to yet. The messages are
+ * referenced, and dropped at the latest when their client disconnects.
+ *
+ * HASH: _LSTransportMessage ptr to time the request was received
+ */
+static GHashTable *query_name_start = NULL;
+
 static void _LSHubCleanupSocketLocal(const char *unique_name);
+static void _LSHubStatsQueryNamesDropped(const _LSTransportClient *client);
 static bool _LSHubRemoveClientSignals(_LSTransportClient *client);
-static void _LSHubSendSignal(_LSTransportClient *client, void *dummy, _LSTransportMessage *message);
+typedef struct _LSHubSignal _LSHubSignal;
+static void _LSHubSendSignal(_LSTransportClient *client, void *dummy, _LSHubSignal *signal);
 static void _LSHubHandleSignal(_LSTransportMessage *message, bool generated_by_hub);
-static void _LSHubSignalRegisterAllServicesItem(gpointer key, gpointer value, gpointer user_data);
-static gchar * _LSHubSignalRegisterAllServices(GHashTable *table);
+static void _LSHubServiceSnapshotRefreshItem(gpointer key, gpointer value, gpointer user_data);
 
 static void _LSHubClientIdLocalRef(_ClientId *id);
 static void _LSHubClientIdLocalUnref(_ClientId *id);
@@ -276,12 +389,124 @@ static void _LSHubSendMonitorMessage(int fd, _ClientId *id, const char *unique_n
 static bool _LSHubSendServiceWaitListReply(_ClientId *id, bool success, bool is_dynamic, LSError *lserror);
 
 static void _LSHubAddPendingConnect(_LSTransportMessage *message, _LSTransportClient *client, int fd);
-static void _LSHubAddMessageTimeout(_LSTransportMessage *message, int timeout_ms, GSourceFunc callback);
+static void _LSHubAddMessageTimeout(_LSTransportMessage *message, int timeout_ms, _LSTimerFunc callback);
 static void _LSHubRemoveMessageTimeout(_LSTransportMessage *message);
 static void _LSHubAddConnectMessageTimeout(_LSTransportMessage *message);
 static void _LSHubRemoveConnectMessageTimeout(_LSTransportMessage *message);
 
 bool _DynamicServiceLaunch(_Service *service, LSError *lserror);
+static void _DynamicServiceListenClose(_Service *service);
+static void _DynamicServicePrelaunchExit(_Service *service, bool came_up);
+static void _DynamicServicePrelaunchSchedule(void);
+
+/**
+ *******************************************************************************
+ * @brief Parse the exec line of a dynamic service.
+ *
+ * @param  exec_path  IN  path to executable (including args)
+ * @param  lserror    OUT set on error
+ *
+ * @retval exec descriptor with ref count of 1 on success
+ * @retval NULL on failure
+ *******************************************************************************
+ */
+static _ServiceExec*
+_ServiceExecNewRef(const char *exec_path, LSError *lserror)
+{
+    GError *gerror = NULL;
+    char **argv = NULL;
+
+    if (!g_shell_parse_argv(exec_path, NULL, &argv, &gerror))
+    {
+        _LSErrorSet(lserror, MSGID_LSHUB_ARGUMENT_ERR, -1, "Error parsing arguments, string: \"%s\", message: \"%s\"\n", exec_path, gerror->message);
+        g_error_free(gerror);
+        return NULL;
+    }
+
+    _ServiceExec *exec = g_new0(_ServiceExec, 1);
+    exec->ref = 1;
+    exec->argv = argv;
+
+    return exec;
+}
+
+static _ServiceExec*
+_ServiceExecRef(_ServiceExec *exec)
+{
+    LS_ASSERT(exec != NULL);
+    LS_ASSERT(exec->ref > 0);
+
+    exec->ref++;
+    return exec;
+}
+
+static void
+_ServiceExecUnref(_ServiceExec *exec)
+{
+    if (!exec) return;
+
+    LS_ASSERT(exec->ref > 0);
+
+    if (--exec->ref == 0)
+    {
+        g_strfreev(exec->argv);
+        g_free(exec);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Build the environment a dynamic service is launched with.
+ *
+ * Built for each launch: the hub's environment may change after startup
+ * (LISTEN_PID and LISTEN_FDS are dropped once consumed). The array points to
+ * the strings of the hub's environment, so it's only valid until it changes
+ * again.
+ *
+ * @param  service  IN  dynamic service
+ *
+ * @retval  NULL-terminated array; only the array and its last two strings
+ *          are owned by the caller
+ *******************************************************************************
+ */
+static char**
+_ServiceLaunchEnvNew(const _Service *service)
+{
+    GString *service_names_str = g_string_new(service->service_names[0]);
+
+    int i;
+    for (i = 1; i < service->num_services; i++)
+    {
+        g_string_append_printf(service_names_str, ";%s", service->service_names[i]);
+    }
+
+    /* Append to the hub's environment. There could be an issue if you set
+     * either of the below env variables in the hub itself (duplicate keys),
+     * but that shouldn't happen  */
+    int env_size = g_strv_length(environ);
+    char **env = g_new(char*, env_size + 3);
+    memcpy(env, environ, sizeof(char*) * env_size);
+
+    env[env_size] = g_strdup_printf("LS_SERVICE_NAMES=%s", service_names_str->str);
+    env[env_size + 1] = g_strdup_printf("LS_SERVICE_FILE_NAME=%s", service->service_file_name);
+    env[env_size + 2] = NULL;
+
+    g_string_free(service_names_str, TRUE);
+    return env;
+}
+
+static void
+_ServiceLaunchEnvFree(char **env)
+{
+    if (!env) return;
+
+    int env_size = g_strv_length(env);
+    LS_ASSERT(env_size >= 2);
+
+    g_free(env[env_size - 2]);
+    g_free(env[env_size - 1]);
+    g_free(env);
+}
 
 /**
  *******************************************************************************
@@ -324,6 +549,7 @@ _ServiceNew(const char *service_names[], int num_services, char *exec_path, bool
     ret->exec_path = g_strdup(exec_path);
 
     ret->state = _DynamicServiceStateInvalid;
+    ret->listen_fd = -1;
 
     /* LEGACY: check whether we're launching with luna-helper */
     if (strstr(ret->exec_path, LUNA_HELPER_NAME))
@@ -424,6 +650,8 @@ _ServiceFree(_Service *service)
         g_free(service->service_names);
     }
     g_free(service->exec_path);
+    _ServiceExecUnref(service->exec);
+    _DynamicServiceListenClose(service);
 
     g_free(service->service_file_dir);
     g_free(service->service_file_name);
@@ -645,6 +873,12 @@ _DynamicServiceReap(GPid pid, gint status, _Service *service)
     /* TODO: query exit status of process with WIFEXITED, WEXITSTATUS,
      * etc. See waitpid(2) */
 
+    _DynamicServicePrelaunchExit(service, service->state != _DynamicServiceStateSpawned);
+
+    /* Exited without registering: the clients queued on its socket are
+     * disconnected */
+    _DynamicServiceListenClose(service);
+
     /* See comments in _LSHubHandleDisconnect */
     if (!service->uses_launch_helper)
     {
@@ -691,189 +925,834 @@ ResetOomSettings(pid_t pid)
     char fn[24];
     int  oomf;
 
-    snprintf(fn, 23, "/proc/%d/oom_adj", pid);
-    oomf = open(fn, O_RDWR);
-    if (oomf >= 0)
+    snprintf(fn, 23, "/proc/%d/oom_adj", pid);
+    oomf = open(fn, O_RDWR);
+    if (oomf >= 0)
+    {
+        write(oomf, "0", 1);
+        close(oomf);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Move every thread of a process to the idle CPU and I/O classes, or
+ * back to the default ones. Best effort: threads may come and go meanwhile.
+ *
+ * @param  pid   IN  process
+ * @param  idle  IN  true for the idle classes
+ *******************************************************************************
+ */
+static void
+_DynamicServiceSetIdle(GPid pid, bool idle)
+{
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        return;
+    }
+
+    struct sched_param param = { .sched_priority = 0 };
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)))
+    {
+        char *end = NULL;
+        long tid = strtol(entry->d_name, &end, 10);
+
+        if (end == entry->d_name || *end)
+            continue;
+
+        if (sched_setscheduler(tid, idle ? SCHED_IDLE : SCHED_OTHER, &param) < 0 ||
+            syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, (int) tid,
+                    idle ? IOPRIO_PRIO_IDLE : IOPRIO_PRIO_DEFAULT) < 0)
+        {
+            LOG_LS_DEBUG("%s: could not change the priority of thread %ld: %s", __func__, tid, g_strerror(errno));
+        }
+    }
+    closedir(dir);
+}
+
+/**
+ *******************************************************************************
+ * @brief Spawn the process of a dynamic service.
+ *
+ * Unlike g_spawn_async(), posix_spawn() doesn't copy the hub's address space
+ * to exec the service, but it doesn't close the descriptors of the hub
+ * either -- they aren't close-on-exec, so the child is told to close them.
+ *
+ * A service launched in the background starts in the idle CPU class, so it
+ * only runs when nothing else wants to; its I/O is moved to the idle class
+ * right after the exec.
+ *
+ * @param  argv        IN  arguments, argv[0] is the executable
+ * @param  envp        IN  environment
+ * @param  background  IN  true to run the service at idle priority
+ * @param  pid         OUT pid of the child
+ * @param  lserror     OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+static bool
+_DynamicServiceSpawn(char **argv, char **envp, bool background, GPid *pid, LSError *lserror)
+{
+    posix_spawn_file_actions_t file_actions;
+    posix_spawnattr_t attr;
+
+    posix_spawn_file_actions_init(&file_actions);
+    posix_spawnattr_init(&attr);
+
+    short flags = 0;
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+
+    if (background)
+    {
+        struct sched_param param = { .sched_priority = 0 };
+        posix_spawnattr_setschedpolicy(&attr, SCHED_IDLE);
+        posix_spawnattr_setschedparam(&attr, &param);
+        flags |= POSIX_SPAWN_SETSCHEDULER;
+    }
+
+    posix_spawnattr_setflags(&attr, flags);
+
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir)
+    {
+        int dir_fd = dirfd(dir);
+        struct dirent *entry;
+
+        while ((entry = readdir(dir)))
+        {
+            char *end = NULL;
+            long fd = strtol(entry->d_name, &end, 10);
+
+            if (end == entry->d_name || *end || fd <= STDERR_FILENO || fd == dir_fd)
+                continue;
+
+            posix_spawn_file_actions_addclose(&file_actions, fd);
+        }
+        closedir(dir);
+    }
+    else
+    {
+        LOG_LS_WARNING(MSGID_LSHUB_SPAWN_ERR, 0, "Could not list descriptors to close: %s", g_strerror(errno));
+    }
+
+    int ret = posix_spawn(pid, argv[0], &file_actions, &attr, argv, envp);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&file_actions);
+
+    if (ret != 0)
+    {
+        *pid = 0;
+        _LSErrorSet(lserror, MSGID_LSHUB_SPAWN_ERR, -1, "Error attemtping to launch service: \"%s\": \"%s\"\n", argv[0], g_strerror(ret));
+        return false;
+    }
+
+    if (background)
+    {
+        _DynamicServiceSetIdle(*pid, true);
+    }
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Create a unique name for a local socket in the socket directory,
+ * or in the abstract namespace (see AbstractSockets in the configuration).
+ * Abstract names can be bound by anyone, so they end in a random number
+ * rather than anything another process could guess and take first.
+ *
+ * @retval  name on success, to be freed
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+static char*
+_LSHubUniqueNameLocalNew(void)
+{
+    if (g_conf_abstract_sockets)
+    {
+        guint64 suffix = 0;
+
+        int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+        if (fd < 0 || read(fd, &suffix, sizeof(suffix)) != sizeof(suffix))
+        {
+            suffix = ((guint64) g_random_int() << 32) | g_random_int();
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        /* nothing to create: the name goes away with the socket */
+        return g_strdup_printf("%c%s/%016" G_GINT64_MODIFIER "x", LS_TRANSPORT_ABSTRACT_PREFIX,
+                               *local_socket_path, suffix);
+    }
+
+    /* TODO: we need to make sure that we can't accidentally create
+     * or open these from another process... is there a way to use
+     * mkstemp() with a socket ? -- maybe use PID of requester */
+    char *unique_name = g_strdup_printf("%s/XXXXXX", *local_socket_path);
+
+    int temp_fd = mkstemp(unique_name);
+
+    if (temp_fd < 0)
+    {
+        /* TODO: test that this is the right error condition */
+        LOG_LS_ERROR(MSGID_LSHUB_UNAME_ERROR, 0, "Unable to create unique name");
+        g_free(unique_name);
+        return NULL;
+    }
+    close(temp_fd);
+
+    return unique_name;
+}
+
+/**
+ *******************************************************************************
+ * @brief Create a listening socket with a unique name (see
+ * _LSHubUniqueNameLocalNew()). Should another process have bound the
+ * abstract name already, another one is tried.
+ *
+ * @param  fd       OUT listening socket
+ * @param  lserror  OUT set on error
+ *
+ * @retval  name of the socket on success, to be freed
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+static char*
+_LSHubListenLocalUnique(int *fd, LSError *lserror)
+{
+    int attempt;
+
+    for (attempt = 0; attempt < UNIQUE_NAME_BIND_ATTEMPTS; attempt++)
+    {
+        char *unique_name = _LSHubUniqueNameLocalNew();
+
+        if (!unique_name)
+        {
+            _LSErrorSet(lserror, MSGID_LSHUB_UNAME_ERROR, -1, "Unable to create unique name");
+            return NULL;
+        }
+
+        LSError bind_error;
+        LSErrorInit(&bind_error);
+
+        /* read and write only by hub user (root) */
+        if (_LSTransportListenLocal(unique_name, S_IRUSR | S_IWUSR, fd, &bind_error))
+        {
+            return unique_name;
+        }
+
+        bool taken = _LSTransportIsAbstractName(unique_name) && bind_error.error_code == EADDRINUSE;
+
+        if (!_LSTransportIsAbstractName(unique_name))
+        {
+            unlink(unique_name);
+        }
+        g_free(unique_name);
+
+        if (!taken)
+        {
+            _LSErrorSet(lserror, MSGID_LSHUB_SOCK_ERR, bind_error.error_code, "%s", bind_error.message);
+            LSErrorFree(&bind_error);
+            return NULL;
+        }
+
+        LOG_LS_WARNING(MSGID_LSHUB_SOCK_ERR, 0, "Unique name taken by another process, trying another one");
+        LSErrorFree(&bind_error);
+    }
+
+    _LSErrorSet(lserror, MSGID_LSHUB_SOCK_ERR, EADDRINUSE, "Unable to bind a unique name");
+    return NULL;
+}
+
+/**
+ *******************************************************************************
+ * @brief Create the listening socket of a dynamic service before launching
+ * it. The clients asking for the service are connected to the socket right
+ * away and queue their messages while the process is starting; the service
+ * takes the socket over when it registers (see _DynamicServiceListenTake()).
+ *
+ * @param  service  IN  dynamic service about to be launched
+ *******************************************************************************
+ */
+static void
+_DynamicServiceListen(_Service *service)
+{
+    if (!g_conf_listen_before_launch || service->listen_fd != -1 ||
+        _LSTransportGetTransportType(hub_transport) != _LSTransportTypeLocal)
+    {
+        return;
+    }
+
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    char *unique_name = _LSHubListenLocalUnique(&service->listen_fd, &lserror);
+
+    if (!unique_name)
+    {
+        LOG_LSERROR(MSGID_LSHUB_SOCK_ERR, &lserror);
+        LSErrorFree(&lserror);
+        service->listen_fd = -1;
+        return;
+    }
+
+    service->listen_name = unique_name;
+}
+
+/**
+ *******************************************************************************
+ * @brief Close the socket created before the launch of a dynamic service,
+ * if the service hasn't taken it over.
+ *
+ * @param  service  IN  dynamic service
+ *******************************************************************************
+ */
+static void
+_DynamicServiceListenClose(_Service *service)
+{
+    if (service->listen_fd == -1)
+    {
+        return;
+    }
+
+    close(service->listen_fd);
+    service->listen_fd = -1;
+
+    _LSHubCleanupSocketLocal(service->listen_name);
+    g_free(service->listen_name);
+    service->listen_name = NULL;
+}
+
+/**
+ *******************************************************************************
+ * @brief Take over the socket created before the launch of a dynamic service,
+ * for the client registering the service.
+ *
+ * @param  service_name  IN   name the client registers
+ * @param  fd            OUT  listening socket
+ *
+ * @retval  unique name of the socket, to be freed
+ * @retval  NULL if there is no such socket
+ *******************************************************************************
+ */
+static char*
+_DynamicServiceListenTake(const char *service_name, int *fd)
+{
+    _Service *service = service_name ? _DynamicServiceStateMapLookup(service_name) : NULL;
+
+    if (!service || service->listen_fd == -1)
+    {
+        return NULL;
+    }
+
+    char *unique_name = service->listen_name;
+    *fd = service->listen_fd;
+
+    service->listen_name = NULL;
+    service->listen_fd = -1;
+
+    return unique_name;
+}
+
+/**
+ *******************************************************************************
+ * @brief Launch a dynamic service.
+ *
+ * The process is spawned on the main loop. posix_spawn() returns once the
+ * child has exec'd (it shares the hub's memory until then), so the hub is
+ * held up for the descriptor scan and the exec, not for the service's
+ * startup.
+ *
+ * @param  service  IN  dynamic service to launch
+ * @param  lserror  OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+_DynamicServiceLaunch(_Service *service, LSError *lserror)
+{
+    LS_ASSERT(service != NULL);
+    LS_ASSERT(service->is_dynamic == true);
+
+    /* Debug */
+    //_ServicePrint(service);
+
+    if (service->state == _DynamicServiceStateSpawned)
+    {
+        /* someone else already spawned the service, so don't do anything
+         * and wait for it to come up */
+        return true;
+    }
+    else if (service->state == _DynamicServiceStateRunningDynamic)
+    {
+        /* service requested in the time frame between when it unregistered
+         * from the bus and when we reaped the process. */
+        service->respawn_on_exit = true;
+        return true;
+    }
+    else if (service->state == _DynamicServiceStateRunning)
+    {
+        LOG_LS_ERROR(MSGID_LSHUB_SERV_RUNNING, 1,
+                     PMLOGKS("APP_ID", service->exec_path),
+                     "Service is running, but _DynamicServiceLaunch was called");
+        return false;
+    }
+
+    service->state = _DynamicServiceStateSpawned;
+
+    /* the exec string was parsed when the service file was loaded */
+    if (!service->exec)
+    {
+        _LSErrorSet(lserror, MSGID_LSHUB_ARGUMENT_ERR, -1, "No arguments to launch service, string: \"%s\"\n", service->exec_path);
+        return false;
+    }
+
+    ClockGetTime(&service->launch_time);
+    service->replied = false;
+
+    _DynamicServiceListen(service);
+
+    /* TODO: modify arguments, esp. stdin, stdout, stderr */
+    char **env = _ServiceLaunchEnvNew(service);
+    bool spawned = _DynamicServiceSpawn(service->exec->argv, env, service->prelaunched, &service->pid, lserror);
+    _ServiceLaunchEnvFree(env);
+
+    if (!spawned)
+    {
+        _DynamicServiceListenClose(service);
+        return false;
+    }
+
+    ResetOomSettings(service->pid);
+
+    /* set up child watch so we can reap the child */
+    _ServiceRef(service);
+    g_child_watch_add(service->pid, (GChildWatchFunc)_DynamicServiceReap, service);
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the state of a dynamic service, tracking it if it isn't yet.
+ *
+ * @param  service_name  IN  name of the service
+ * @param  service       IN  dynamic service from the service files
+ * @param  lserror       OUT set on error
+ *
+ * @retval  service state on success (owned by the state map)
+ * @retval  NULL on failure
+ *******************************************************************************
+ */
+static _Service*
+_DynamicServiceStateGet(const char *service_name, _Service *service, LSError *lserror)
+{
+    /* Check to see if the service state is already being tracked */
+    _Service *service_state = _DynamicServiceStateMapLookup(service_name);
+
+    if (!service_state)
+    {
+        /* Create a new service state */
+        service_state = _ServiceNewRef(&service_name, 1, service->exec_path, true,
+                                       service->service_file_dir, service->service_file_name);
+        if (service->exec)
+        {
+            service_state->exec = _ServiceExecRef(service->exec);
+        }
+        if (!_DynamicServiceStateMapAdd(service_state, lserror))
+        {
+            _ServiceUnref(service_state);
+            return NULL;
+        }
+        _ServiceUnref(service_state);
+    }
+
+    return service_state;
+}
+
+/**
+ *******************************************************************************
+ * @brief Find and launch a dynamic service given a service name.
+ *
+ * @param  service_name     IN  name of service to launch
+ * @param  client           IN  client requesting the dynamic service
+ * @param  requester_app_id IN  app id that is requesting the launch (for
+ *                              debugging bad requests from apps)
+ * @param  lserror          OUT set on error
+ *
+ * @retval  true if dynamic service was found and successfully launched
+ * @retval  false on failure
+ *******************************************************************************
+ */
+bool
+_DynamicServiceFindandLaunch(const char *service_name, const _LSTransportClient *client, const char *requester_app_id, LSError *lserror)
+{
+    /* Check to see if this dynamic service is in one of the service files */
+    _Service *service = ServiceMapLookup(service_name);
+
+    if (service)
+    {
+        LS_ASSERT(service->is_dynamic == true);
+
+        _Service *service_state = _DynamicServiceStateGet(service_name, service, lserror);
+        if (!service_state)
+        {
+            return false;
+        }
+
+        return _DynamicServiceLaunch(service_state, lserror);
+    }
+
+    const _LSTransportCred *cred = _LSTransportClientGetCred(client);
+    pid_t requester_pid = _LSTransportCredGetPid(cred);
+    const char *requester_exe = _LSTransportCredGetExePath(cred);
+
+    _LSErrorSet(lserror, MSGID_LSHUB_NO_DYNAMIC_SERVICE, -1, "service: \"%s\" not found in dynamic service set (requester pid: "LS_PID_PRINTF_FORMAT", requester exe: \"%s\", requester app id: \"%s\"\n",
+                service_name,
+                LS_PID_PRINTF_CAST(requester_pid), requester_exe ? requester_exe : "(null)",
+                requester_app_id ? requester_app_id : "(null)");
+    return false;
+}
+
+/**
+ *******************************************************************************
+ * @brief Launch a dynamic service predicted to be requested soon, unless
+ * it's running or being launched already.
+ *
+ * @param  service_name  IN  name of the service
+ *
+ * @retval  true if the service was launched
+ *******************************************************************************
+ */
+static bool
+_DynamicServicePrelaunch(const char *service_name)
+{
+    _Service *service = ServiceMapLookup(service_name);
+
+    if (!service || !service->is_dynamic)
+    {
+        return false;
+    }
+
+    if (g_hash_table_lookup(available_services, service_name) || g_hash_table_lookup(pending, service_name))
+    {
+        return false;
+    }
+
+    _Service *service_state = _DynamicServiceStateMapLookup(service_name);
+    if (service_state && service_state->state != _DynamicServiceStateStopped)
+    {
+        return false;
+    }
+
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    service_state = _DynamicServiceStateGet(service_name, service, &lserror);
+    if (!service_state)
+    {
+        LOG_LSERROR(MSGID_LSHUB_SERVICE_LAUNCH_ERR, &lserror);
+        LSErrorFree(&lserror);
+        return false;
+    }
+
+    /* launched at idle priority, see _DynamicServiceSpawn() */
+    service_state->prelaunched = true;
+    service_state->prelaunch_hit = false;
+
+    if (!_DynamicServiceLaunch(service_state, &lserror))
+    {
+        service_state->prelaunched = false;
+        LOG_LSERROR(MSGID_LSHUB_SERVICE_LAUNCH_ERR, &lserror);
+        LSErrorFree(&lserror);
+        return false;
+    }
+
+    hub_stats.prelaunches++;
+    hub_stats.prelaunch_in_flight++;
+
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Check if the system is idle enough to launch services nobody asked
+ * for yet: the load average of the last minute per online CPU is below
+ * PrelaunchMaxLoad.
+ *
+ * @retval  true if the system is idle, or the load can't be told
+ *******************************************************************************
+ */
+static bool
+_DynamicServicePrelaunchSystemIdle(void)
+{
+    double load;
+    if (getloadavg(&load, 1) != 1)
+    {
+        return true;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+    {
+        cpus = 1;
+    }
+
+    return load * 100 < (double) cpus * g_conf_prelaunch_max_load;
+}
+
+static gboolean
+_DynamicServicePrelaunchNext(gpointer user_data)
+{
+    prelaunch_source = 0;
+
+    if (!_DynamicServicePrelaunchSystemIdle())
+    {
+        /* the hub may be idle while the rest of the system isn't */
+        prelaunch_source = g_timeout_add_seconds_full(G_PRIORITY_LOW, PRELAUNCH_BUSY_RECHECK_SEC,
+                                                      _DynamicServicePrelaunchNext, NULL, NULL);
+        return FALSE;
+    }
+
+    while (!g_queue_is_empty(&prelaunch_queue))
+    {
+        if (hub_stats.prelaunch_in_flight >= g_conf_prelaunch_max_concurrent)
+        {
+            /* resumed when one of them comes up or exits */
+            break;
+        }
+
+        char *service_name = g_queue_pop_head(&prelaunch_queue);
+        bool launched = _DynamicServicePrelaunch(service_name);
+        g_free(service_name);
+
+        if (launched)
+        {
+            /* one launch per idle turn, the load is looked at again */
+            _DynamicServicePrelaunchSchedule();
+            break;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ *******************************************************************************
+ * @brief Launch the queued predicted services whenever the hub and the
+ * system are idle, a limited number of them coming up at a time.
+ *******************************************************************************
+ */
+static void
+_DynamicServicePrelaunchSchedule(void)
+{
+    if (prelaunch_source || g_queue_is_empty(&prelaunch_queue) ||
+        hub_stats.prelaunch_in_flight >= g_conf_prelaunch_max_concurrent)
+    {
+        return;
+    }
+
+    prelaunch_source = g_idle_add_full(G_PRIORITY_LOW, _DynamicServicePrelaunchNext, NULL, NULL);
+}
+
+/**
+ *******************************************************************************
+ * @brief Note that a service came up, and queue the services that usually
+ * follow it for pre-launch.
+ *
+ * @param  service_name  IN  name of the service
+ * @param  dynamic       IN  dynamic service state (NULL for a static service)
+ * @param  launched      IN  true if the service was launched by the hub
+ *******************************************************************************
+ */
+static void
+_DynamicServicePrelaunchUp(const char *service_name, _Service *dynamic, bool launched)
+{
+    if (!prelaunch) return;
+
+    if (dynamic && dynamic->prelaunched && launched)
+    {
+        hub_stats.prelaunch_in_flight--;
+    }
+
+    struct timespec now;
+    ClockGetTime(&now);
+    _LSHubPrelaunchServiceUp(prelaunch, service_name, &now);
+
+    const char **predicted = _LSHubPrelaunchPredict(prelaunch, service_name);
+    const char **name;
+    for (name = predicted; *name; name++)
     {
-        write(oomf, "0", 1);
-        close(oomf);
+        if (g_queue_get_length(&prelaunch_queue) >= PRELAUNCH_MAX_QUEUED)
+            break;
+
+        if (!g_queue_find_custom(&prelaunch_queue, *name, (GCompareFunc) strcmp))
+            g_queue_push_tail(&prelaunch_queue, g_strdup(*name));
     }
+    g_free(predicted);
+
+    _DynamicServicePrelaunchSchedule();
 }
 
 /**
  *******************************************************************************
- * @brief Launch a dynamic service.
- *
- * @param  service  IN  dynamic service to launch
- * @param  lserror  OUT set on error
+ * @brief Note that a dynamic service was requested. It counts as following
+ * the services that came up shortly before, if it had to be launched (or
+ * was pre-launched) for the request.
  *
- * @retval  true on success
- * @retval  false on failure
+ * @param  service_name  IN  name of the service
  *******************************************************************************
  */
-bool
-_DynamicServiceLaunch(_Service *service, LSError *lserror)
+static void
+_DynamicServicePrelaunchRequested(const char *service_name)
 {
-    LS_ASSERT(service != NULL);
-    LS_ASSERT(service->is_dynamic == true);
-
-    GError *gerror = NULL;
-    char **new_env = NULL;
-    char *service_names_str = NULL;
-    char *service_names_env = NULL;
-    char *service_file_name_env = NULL;
-    int argc = 0;
-    char **argv = NULL;
+    if (!prelaunch) return;
 
-    /* Debug */
-    //_ServicePrint(service);
+    _Service *service_state = _DynamicServiceStateMapLookup(service_name);
 
-    if (service->state == _DynamicServiceStateSpawned)
-    {
-        /* someone else already spawned the service, so don't do anything
-         * and wait for it to come up */
-        return true;
-    }
-    else if (service->state == _DynamicServiceStateRunningDynamic)
+    if (service_state && service_state->prelaunched)
     {
-        /* service requested in the time frame between when it unregistered
-         * from the bus and when we reaped the process. */
-        service->respawn_on_exit = true;
-        return true;
+        if (service_state->prelaunch_hit)
+            return;
+
+        service_state->prelaunch_hit = true;
+        hub_stats.prelaunch_hits++;
+
+        /* it's needed now, so it runs like the services launched on demand */
+        if (service_state->pid)
+        {
+            _DynamicServiceSetIdle(service_state->pid, false);
+        }
     }
-    else if (service->state == _DynamicServiceStateRunning)
+    else if (g_hash_table_lookup(available_services, service_name) ||
+             g_hash_table_lookup(pending, service_name) ||
+             (service_state && service_state->state != _DynamicServiceStateStopped))
     {
-        LOG_LS_ERROR(MSGID_LSHUB_SERV_RUNNING, 1,
-                     PMLOGKS("APP_ID", service->exec_path),
-                     "Service is running, but _DynamicServiceLaunch was called");
-        return false;
+        return;
     }
 
-    service->state = _DynamicServiceStateSpawned;
+    struct timespec now;
+    ClockGetTime(&now);
+    _LSHubPrelaunchServiceRequested(prelaunch, service_name, &now);
+}
 
-    /* parse the exec string into arguments */
+/**
+ *******************************************************************************
+ * @brief Account the exit of a dynamic service that might have been
+ * pre-launched.
+ *
+ * @param  service  IN  dynamic service state
+ * @param  came_up  IN  false if it exited before registering its name
+ *******************************************************************************
+ */
+static void
+_DynamicServicePrelaunchExit(_Service *service, bool came_up)
+{
+    if (!service->prelaunched) return;
 
-    bool ret = g_shell_parse_argv(service->exec_path, &argc, &argv, &gerror);
+    service->prelaunched = false;
 
-    if (!ret)
+    if (!came_up)
     {
-        _LSErrorSet(lserror, MSGID_LSHUB_ARGUMENT_ERR, -1, "Error parsing arguments, string: \"%s\", message: \"%s\"\n", service->exec_path, gerror->message);
-        goto error;
+        hub_stats.prelaunch_in_flight--;
     }
 
-    int i = 1;
-    char *tmp_service_names_str = g_strdup(service->service_names[0]);
-    service_names_str = tmp_service_names_str;
-
-    for (i = 1; i < service->num_services; i++)
+    if (!service->prelaunch_hit)
     {
-        service_names_str = g_strjoin(";", tmp_service_names_str, service->service_names[i], NULL);
-        g_free(tmp_service_names_str);
-        tmp_service_names_str = service_names_str;
+        hub_stats.prelaunch_wasted++;
     }
 
-    service_names_env = g_strdup_printf("LS_SERVICE_NAMES=%s", service_names_str);
-    service_file_name_env = g_strdup_printf("LS_SERVICE_FILE_NAME=%s", service->service_file_name);
-
-    /* Append to the hub's environment. There could be an issue if you set
-     * either of the above env variables in the hub itself (duplicate keys),
-     * but that shouldn't happen  */
-    int env_size = g_strv_length(environ);
-    new_env = g_malloc(sizeof(char*) * (env_size + 3));
-    memcpy(new_env, environ, sizeof(char*) * env_size);
-
-    int offset = env_size;
-    new_env[offset++] = service_names_env;
-    new_env[offset++] = service_file_name_env;
-    new_env[offset] = '\0';
+    _DynamicServicePrelaunchSchedule();
+}
 
-    /* TODO: modify arguments, esp. stdin, stdout, stderr */
-    ret = g_spawn_async_with_pipes(NULL,  /* inherit parent's working dir */
-                             argv, /* argv */
-                             new_env, /* environment -- NULL means inherit parent's env */
-                             G_SPAWN_DO_NOT_REAP_CHILD, /* flags */
-                             NULL, /* child_setup */
-                             NULL, /* user_data */
-                             &service->pid,    /* child_pid */
-                             NULL, /* stdin */
-                             NULL, /* stdout */
-                             NULL, /* stderr */
-                             &gerror);
-
-    if (!ret)
-    {
-        _LSErrorSet(lserror, MSGID_LSHUB_SPAWN_ERR, -1, "Error attemtping to launch service: \"%s\"\n", gerror->message);
-        goto error;
+static void
+_DynamicServicePrelaunchSave(void)
+{
+    if (!g_conf_prelaunch_file || !_LSHubPrelaunchIsDirty(prelaunch))
+    {
+        return;
     }
 
-    ResetOomSettings(service->pid);
+    LSError lserror;
+    LSErrorInit(&lserror);
 
-    /* set up child watch so we can reap the child */
-    _ServiceRef(service);
-    g_child_watch_add(service->pid, (GChildWatchFunc)_DynamicServiceReap, service);
+    if (!_LSHubPrelaunchSave(prelaunch, g_conf_prelaunch_file, &lserror))
+    {
+        LOG_LSERROR(MSGID_LSHUB_PRELAUNCH_ERR, &lserror);
+        LSErrorFree(&lserror);
+    }
+}
 
-error:
-    if (gerror) g_error_free(gerror);
-    g_free(new_env);
-    g_free(service_names_str);
-    g_free(service_names_env);
-    g_free(service_file_name_env);
-    g_strfreev(argv);
-    return ret;
+static gboolean
+_DynamicServicePrelaunchSaveTimeout(gpointer user_data)
+{
+    _DynamicServicePrelaunchSave();
+    return TRUE;
 }
 
 /**
  *******************************************************************************
- * @brief Find and launch a dynamic service given a service name.
- *
- * @param  service_name     IN  name of service to launch
- * @param  client           IN  client requesting the dynamic service
- * @param  requester_app_id IN  app id that is requesting the launch (for
- *                              debugging bad requests from apps)
- * @param  lserror          OUT set on error
- *
- * @retval  true if dynamic service was found and successfully launched
- * @retval  false on failure
+ * @brief Start observing the calls of the dynamic services, with the ones
+ * observed during the previous boots.
  *******************************************************************************
  */
-bool
-_DynamicServiceFindandLaunch(const char *service_name, const _LSTransportClient *client, const char *requester_app_id, LSError *lserror)
+static void
+_DynamicServicePrelaunchInit(void)
 {
-    /* Check to see if this dynamic service is in one of the service files */
-    _Service *service = ServiceMapLookup(service_name);
+    prelaunch = _LSHubPrelaunchNew();
 
-    if (service)
+    if (!g_conf_prelaunch_file)
     {
-        LS_ASSERT(service->is_dynamic == true);
+        return;
+    }
 
-        /* Check to see if the service state is already being tracked */
-        _Service *service_state = _DynamicServiceStateMapLookup(service_name);
+    if (g_file_test(g_conf_prelaunch_file, G_FILE_TEST_EXISTS))
+    {
+        LSError lserror;
+        LSErrorInit(&lserror);
 
-        if (!service_state)
+        if (!_LSHubPrelaunchLoad(prelaunch, g_conf_prelaunch_file, &lserror))
         {
-            /* Create a new service state */
-            service_state = _ServiceNewRef(&service_name, 1, service->exec_path, true,
-                                           service->service_file_dir, service->service_file_name);
-            if (!_DynamicServiceStateMapAdd(service_state, lserror))
-            {
-                _ServiceUnref(service_state);
-                return false;
-            }
-            _ServiceUnref(service_state);
+            LOG_LSERROR(MSGID_LSHUB_PRELAUNCH_ERR, &lserror);
+            LSErrorFree(&lserror);
         }
-
-        return _DynamicServiceLaunch(service_state, lserror);
     }
 
-    const _LSTransportCred *cred = _LSTransportClientGetCred(client);
-    pid_t requester_pid = _LSTransportCredGetPid(cred);
-    const char *requester_exe = _LSTransportCredGetExePath(cred);
+    prelaunch_save_source = g_timeout_add_seconds(PRELAUNCH_SAVE_INTERVAL_SEC,
+                                                  _DynamicServicePrelaunchSaveTimeout, NULL);
+}
 
-    _LSErrorSet(lserror, MSGID_LSHUB_NO_DYNAMIC_SERVICE, -1, "service: \"%s\" not found in dynamic service set (requester pid: "LS_PID_PRINTF_FORMAT", requester exe: \"%s\", requester app id: \"%s\"\n",
-                service_name,
-                LS_PID_PRINTF_CAST(requester_pid), requester_exe ? requester_exe : "(null)",
-                requester_app_id ? requester_app_id : "(null)");
-    return false;
+static void
+_DynamicServicePrelaunchDeinit(void)
+{
+    if (!prelaunch) return;
+
+    _DynamicServicePrelaunchSave();
+
+    if (prelaunch_save_source) g_source_remove(prelaunch_save_source);
+    if (prelaunch_source) g_source_remove(prelaunch_source);
+    prelaunch_save_source = prelaunch_source = 0;
+
+    g_queue_foreach(&prelaunch_queue, (GFunc) g_free, NULL);
+    g_queue_clear(&prelaunch_queue);
+
+    _LSHubPrelaunchFree(prelaunch);
+    prelaunch = NULL;
 }
 
 /**
@@ -1232,7 +2111,24 @@ _ParseServiceFile(const char *service_file_dir, const char *service_file_name, L
 
     LOG_LS_DEBUG("%s: service file: \"%s\", exec string: \"%s\"\n", __func__, path, exec_str_with_prefix);
 
+    /* parse the exec string into arguments once, not on every launch */
+    _ServiceExec *exec = NULL;
+    if (is_dynamic)
+    {
+        exec = _ServiceExecNewRef(exec_str_with_prefix, lserror);
+        if (!exec)
+            goto error;
+    }
+
     new_service = _ServiceNewRef((const char**)provided_services, provided_services_len, exec_str_with_prefix, is_dynamic, (char*)service_file_dir, (char*)service_file_name);
+    if (new_service)
+    {
+        new_service->exec = exec;
+    }
+    else
+    {
+        _ServiceExecUnref(exec);
+    }
 
 error:
     /* free up memory */
@@ -1358,33 +2254,20 @@ _LSHubSendServiceUpDownSignal(const char *service_name, const char *unique_name,
     LS_ASSERT(service_name != NULL);
     LS_ASSERT(unique_name != NULL);
 
-    char *payload = NULL;
-
-    if (up)
-    {
-        payload = g_strdup_printf(SERVICE_STATUS_UP_PAYLOAD, service_name, unique_name, service_pid, all_names ? all_names : "");
-    }
-    else
+    /* typed fields; the clients parse them instead of a JSON payload, which
+     * is built only for those older than protocol version 3 */
+    _LSTransportMessage *message = LSTransportMessageServiceStatusSignalNewRef(service_name, unique_name,
+                                                                               up ? service_pid : 0,
+                                                                               up ? all_names : NULL, up);
+    if (!message)
     {
-        payload = g_strdup_printf(SERVICE_STATUS_DOWN_PAYLOAD, service_name, unique_name);
+        LOG_LS_ERROR(MSGID_LSHUB_MEMORY_ERR, 0, "Unable to create service status signal");
+        return;
     }
 
-    _LSTransportMessage *message = LSTransportMessageSignalNewRef(SERVICE_STATUS_CATEGORY, service_name, payload);
-
     /* send out this "special" status signal to registered clients */
-    if (up)
-    {
-        _LSTransportMessageSetType(message, _LSTransportMessageTypeServiceUpSignal);
-    }
-    else
-    {
-        _LSTransportMessageSetType(message, _LSTransportMessageTypeServiceDownSignal);
-    }
-
     _LSHubHandleSignal(message, true);
     _LSTransportMessageUnref(message);
-
-    g_free(payload);
 }
 
 /**
@@ -1431,6 +2314,9 @@ _LSHubHandleDisconnect(_LSTransportClient *client, _LSTransportDisconnectType ty
     LSError lserror;
     LSErrorInit(&lserror);
 
+    /* its queries won't be replied to */
+    _LSHubStatsQueryNamesDropped(client);
+
     /* look up _ClientId */
     _ClientId *id = g_hash_table_lookup(connected_clients.by_fd, GINT_TO_POINTER(client->channel.fd));
 
@@ -1472,6 +2358,7 @@ _LSHubHandleDisconnect(_LSTransportClient *client, _LSTransportDisconnectType ty
 
         g_hash_table_remove(pending, id->service_name);
         g_hash_table_remove(available_services, id->service_name);
+        _LSHubServiceSnapshotRemove(service_snapshot, id->service_name);
 
         /* Send a failure QueryNameReply to any service that is still
          * waiting for this service */
@@ -1573,6 +2460,7 @@ _LSHubClientIdLocalNew(const char *service_name, const char *unique_name, _LSTra
     _LSTransportClientRef(client);
     id->client = client;
     id->is_monitor = false;
+    id->stats.launch_to_up_ms = -1;
 
     return id;
 }
@@ -1669,9 +2557,201 @@ _LSHubClientIdLocalUnref(_ClientId *id)
 }
 
 static void
-_LSHubClientIdLocalUnrefVoid(void *id)
+_LSHubClientIdLocalUnrefVoid(void *id)
+{
+    _LSHubClientIdLocalUnref((_ClientId*) id);
+}
+
+/**
+ *******************************************************************************
+ * @brief Look up the client id of a connected transport client.
+ *
+ * @param  client   IN  transport client
+ *
+ * @retval  client id on success
+ * @retval  NULL if the client hasn't requested a name yet
+ *******************************************************************************
+ */
+static _ClientId*
+_LSHubClientIdLookup(const _LSTransportClient *client)
+{
+    return g_hash_table_lookup(connected_clients.by_fd, GINT_TO_POINTER(client->channel.fd));
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the statistics of a service, creating them if necessary.
+ *
+ * @param  service_name     IN  service name
+ *
+ * @retval  service statistics
+ *******************************************************************************
+ */
+static _ServiceStats*
+_LSHubServiceStatsGet(const char *service_name)
+{
+    _ServiceStats *stats = g_hash_table_lookup(service_stats, service_name);
+
+    if (!stats)
+    {
+        stats = g_new0(_ServiceStats, 1);
+        g_hash_table_insert(service_stats, g_strdup(service_name), stats);
+    }
+
+    return stats;
+}
+
+/**
+ *******************************************************************************
+ * @brief Account a message received from a client.
+ *
+ * @param  message  IN  incoming message
+ *******************************************************************************
+ */
+static void
+_LSHubStatsMessageReceived(const _LSTransportMessage *message)
+{
+    _ClientId *id = _LSHubClientIdLookup(_LSTransportMessageGetClient(message));
+
+    if (id)
+    {
+        id->stats.messages_received++;
+        id->stats.bytes_received += sizeof(_LSTransportHeader) + _LSTransportMessageGetHeader(message)->len;
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Remember when a "QueryName" message was received.
+ *
+ * @param  message  IN  query name message
+ *******************************************************************************
+ */
+static void
+_LSHubStatsQueryNameReceived(_LSTransportMessage *message)
+{
+    struct timespec *start = g_new(struct timespec, 1);
+
+    ClockGetTime(start);
+    g_hash_table_replace(query_name_start, _LSTransportMessageRef(message), start);
+}
+
+static gboolean
+_LSHubStatsQueryNameIsFrom(gpointer key, gpointer value, gpointer user_data)
+{
+    return _LSTransportMessageGetClient(key) == user_data;
+}
+
+/**
+ *******************************************************************************
+ * @brief Forget the "QueryName" messages of a client that is going away,
+ * which are not going to be replied to.
+ *
+ * @param  client  IN  client
+ *******************************************************************************
+ */
+static void
+_LSHubStatsQueryNamesDropped(const _LSTransportClient *client)
+{
+    g_hash_table_foreach_remove(query_name_start, _LSHubStatsQueryNameIsFrom, (gpointer) client);
+}
+
+/**
+ *******************************************************************************
+ * @brief Account the latency of a "QueryName" message that is being replied
+ * to.
+ *
+ * @param  message       IN  query name message
+ * @param  service_name  IN  requested service name
+ *******************************************************************************
+ */
+static void
+_LSHubStatsQueryNameReplied(const _LSTransportMessage *message, const char *service_name)
+{
+    struct timespec *start = g_hash_table_lookup(query_name_start, message);
+
+    if (!start)
+    {
+        return;
+    }
+
+    struct timespec now, latency;
+    ClockGetTime(&now);
+    ClockDiff(&latency, &now, start);
+    g_hash_table_remove(query_name_start, message);
+
+    _LSMetricsHistogramAdd(&hub_stats.query_name_latency, &latency);
+
+    /* don't let bogus names grow the table -- only track services that
+     * are listed in the service files */
+    if (ServiceMapLookup(service_name))
+    {
+        _ServiceStats *stats = _LSHubServiceStatsGet(service_name);
+        stats->queries++;
+        _LSMetricsHistogramAdd(&stats->query_name_latency, &latency);
+    }
+
+    _ClientId *id = _LSHubClientIdLookup(_LSTransportMessageGetClient(message));
+    if (id)
+    {
+        _LSMetricsHistogramAdd(&id->stats.query_name_latency, &latency);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Account the time it took a dynamically launched service to come up.
+ *
+ * @param  id       IN  client id of the service that came up
+ * @param  service  IN  dynamic service state
+ *******************************************************************************
+ */
+static void
+_LSHubStatsServiceUp(_ClientId *id, const _Service *service)
+{
+    struct timespec now, elapsed;
+    ClockGetTime(&now);
+    ClockDiff(&elapsed, &now, &service->launch_time);
+
+    _LSMetricsHistogramAdd(&hub_stats.launch_to_up, &elapsed);
+
+    _ServiceStats *stats = _LSHubServiceStatsGet(id->service_name);
+    stats->launches++;
+    _LSMetricsHistogramAdd(&stats->launch_to_up, &elapsed);
+
+    id->stats.launch_to_up_ms = ClockGetMs(&elapsed);
+}
+
+/**
+ *******************************************************************************
+ * @brief Account the time it took a dynamically launched service until the
+ * first client was handed it. Replies of the service itself don't pass the
+ * hub, so the first QueryName reply connecting a client to it is the closest
+ * the hub sees. With ListenBeforeLaunch that may precede NodeUp.
+ *
+ * @param  service_name  IN  name of the service a client was handed
+ *******************************************************************************
+ */
+static void
+_LSHubStatsServiceReplied(const char *service_name)
 {
-    _LSHubClientIdLocalUnref((_ClientId*) id);
+    _Service *service = _DynamicServiceStateMapLookup(service_name);
+
+    if (!service || service->replied) return;
+
+    _DynamicServiceState state = _DynamicServiceGetState(service);
+    if (state != _DynamicServiceStateSpawned && state != _DynamicServiceStateRunningDynamic) return;
+
+    service->replied = true;
+
+    struct timespec now, elapsed;
+    ClockGetTime(&now);
+    ClockDiff(&elapsed, &now, &service->launch_time);
+
+    _LSMetricsHistogramAdd(&hub_stats.launch_to_reply, &elapsed);
+
+    _ServiceStats *stats = _LSHubServiceStatsGet(service_name);
+    _LSMetricsHistogramAdd(&stats->launch_to_reply, &elapsed);
 }
 
 /**
@@ -1722,6 +2802,9 @@ error:
  * @param  message      IN  request name message
  * @param  err_code     IN  numeric error code (0 means success)
  * @param  ret_str      IN  return string
+ * @param  listen_fd    IN  socket already listening on @ref ret_str, or -1
+ *                          to create it (local transport only, and not for
+ *                          clients that take their connections from us)
  * @param  lserror      OUT set on error
  *
  * @retval  true on success
@@ -1730,9 +2813,9 @@ error:
  */
 static bool
 _LSHubSendRequestNameReply(_LSTransportMessage *message, _LSTransportType transport_type,
-                           long err_code, char* ret_str, LSError *lserror)
+                           long err_code, char* ret_str, int listen_fd, LSError *lserror)
 {
-    int fd = -1;
+    int fd = listen_fd;
 
     _LSTransportClient *client = _LSTransportMessageGetClient(message);
 
@@ -1748,8 +2831,8 @@ _LSHubSendRequestNameReply(_LSTransportMessage *message, _LSTransportType transp
         message_type = _LSTransportMessageTypeRequestNameLocalReply;
 
         /* tdh -- if replying with success, then go ahead and set up socket for
-         * listening */
-        if (err_code == 0)
+         * listening, unless we're to pass the client its connections */
+        if (err_code == 0 && fd == -1 && !client->pair_connect)
         {
             /* read and write only by hub user (root) */
             if (!_LSTransportListenLocal(ret_str, S_IRUSR | S_IWUSR, &fd, lserror))
@@ -1767,6 +2850,10 @@ _LSHubSendRequestNameReply(_LSTransportMessage *message, _LSTransportType transp
 
     if (!reply_message)
     {
+        if (fd != -1)
+        {
+            close(fd);
+        }
         return false;
     }
 
@@ -1789,6 +2876,12 @@ _LSHubSendRequestNameReply(_LSTransportMessage *message, _LSTransportType transp
 static void
 _LSHubCleanupSocketLocal(const char *unique_name)
 {
+    /* abstract sockets have no file */
+    if (_LSTransportIsAbstractName(unique_name))
+    {
+        return;
+    }
+
     int ret = unlink(unique_name);
 
     if (ret != 0)
@@ -1806,19 +2899,21 @@ _LSHubCleanupSocketLocal(const char *unique_name)
  * connection or inet connection.
  *
  * @param  message  IN  request name message
+ *
+ * @retval  true if the client registered with protocol version 4 or later,
+ *          which means that it's up
  *******************************************************************************
  */
-static void
+static bool
 _LSHubHandleRequestName(_LSTransportMessage *message)
 {
-    /* TODO: we need to make sure that we can't accidentally create
-     * or open these from another process... is there a way to use
-     * mkstemp() with a socket ? -- maybe use PID of requester */
     LSError lserror;
     LSErrorInit(&lserror);
 
     _LSTransportMessageIter iter;
     char *unique_name = NULL;
+    int listen_fd = -1;
+    bool up = false;
 
     _LSTransportClient *client = _LSTransportMessageGetClient(message);
 
@@ -1835,18 +2930,51 @@ _LSHubHandleRequestName(_LSTransportMessage *message)
     int32_t protocol_version = 0;
     _LSTransportMessageGetInt32(&iter, &protocol_version);
 
-    if (protocol_version != LS_TRANSPORT_PROTOCOL_VERSION)
+    if (protocol_version < LS_TRANSPORT_PROTOCOL_VERSION_MIN || protocol_version > LS_TRANSPORT_PROTOCOL_VERSION)
     {
         LOG_LS_ERROR(MSGID_LSHUB_WRONG_PROTOCOL, 0,
                      "Transport protocol mismatch. Client version: %d. Hub version: %d",
                      protocol_version, LS_TRANSPORT_PROTOCOL_VERSION);
 
-        if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_INVALID_PROTOCOL_VERSION, NULL, &lserror))
+        if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_INVALID_PROTOCOL_VERSION, NULL, -1, &lserror))
         {
             LOG_LSERROR(MSGID_LSHUB_SENDMSG_ERROR, &lserror);
             LSErrorFree(&lserror);
         }
-        return;
+        return false;
+    }
+
+    client->protocol_version = protocol_version;
+
+    /* Clients of protocol version 2 and later read the current header,
+     * starting with the reply */
+    if (protocol_version >= 2)
+    {
+        client->legacy_wire = false;
+    }
+
+    /* ... and of version 3 and later the typed service status signals */
+    if (protocol_version >= 3)
+    {
+        client->typed_status = true;
+    }
+
+    /* ... and of version 4 and later are up once registered */
+    if (protocol_version >= 4)
+    {
+        client->fast_register = true;
+    }
+
+    /* ... and of version 5 and later take their connections from us */
+    if (protocol_version >= 5 && transport_type == _LSTransportTypeLocal)
+    {
+        client->pair_connect = true;
+    }
+
+    /* ... and of version 6 and later read connections made of records */
+    if (protocol_version >= 6 && transport_type == _LSTransportTypeLocal)
+    {
+        client->seqpacket_connect = true;
     }
 
     /* get service name */
@@ -1861,12 +2989,12 @@ _LSHubHandleRequestName(_LSTransportMessage *message)
         /* Check security permissions */
         if (!LSHubIsClientAllowedToRequestName(client, service_name))
         {
-            if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_PERMISSION_DENIED, NULL, &lserror))
+            if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_PERMISSION_DENIED, NULL, -1, &lserror))
             {
                 LOG_LSERROR(MSGID_LSHUB_SENDMSG_ERROR, &lserror);
                 LSErrorFree(&lserror);
             }
-            return;
+            return false;
         }
     }
     else
@@ -1880,29 +3008,37 @@ _LSHubHandleRequestName(_LSTransportMessage *message)
         if (g_hash_table_lookup(pending, service_name) || g_hash_table_lookup(available_services, service_name))
         {
             /* construct and send error reply */
-            if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_NAME_ALREADY_REGISTERED, NULL, &lserror))
+            if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_NAME_ALREADY_REGISTERED, NULL, -1, &lserror))
             {
                 LOG_LSERROR(MSGID_LSHUB_SENDMSG_ERROR, &lserror);
                 LSErrorFree(&lserror);
             }
-            return;
+            return false;
         }
     }
 
     if (transport_type == _LSTransportTypeLocal)
     {
-        /* generate a unique name */
-        unique_name = g_strdup_printf("%s/XXXXXX", *local_socket_path);
+        /* a dynamic service gets the socket created before its launch, which
+         * its clients may be queued on already */
+        unique_name = _DynamicServiceListenTake(service_name, &listen_fd);
 
-        int temp_fd = mkstemp(unique_name);
+        /* otherwise generate a unique name, and listen on it unless the
+         * client takes its connections from us */
+        if (!unique_name && client->pair_connect)
+        {
+            unique_name = _LSHubUniqueNameLocalNew();
+        }
+        else if (!unique_name && !(unique_name = _LSHubListenLocalUnique(&listen_fd, &lserror)))
+        {
+            LOG_LSERROR(MSGID_LSHUB_SOCK_ERR, &lserror);
+            LSErrorFree(&lserror);
+        }
 
-        if (temp_fd < 0)
+        if (!unique_name)
         {
-            /* TODO: test that this is the right error condition */
-            LOG_LS_ERROR(MSGID_LSHUB_UNAME_ERROR, 0, "Unable to create unique name");
             goto error;
         }
-        close(temp_fd);
     }
     else
     {
@@ -1954,16 +3090,25 @@ _LSHubHandleRequestName(_LSTransportMessage *message)
     _LSHubClientIdLocalUnref(id);
 
     /* send reply with name */
-    if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_SUCCESS, unique_name, &lserror))
+    if (!_LSHubSendRequestNameReply(message, transport_type, LS_TRANSPORT_REQUEST_NAME_SUCCESS, unique_name, listen_fd, &lserror))
     {
         LOG_LSERROR(MSGID_LSHUB_SENDMSG_ERROR, &lserror);
         LSErrorFree(&lserror);
 
         /* TODO: can we do anything else if there's an error ? */
     }
+    else if (client->fast_register)
+    {
+        /* what its "ClientInfo" would have told us */
+        LS_ASSERT(client->unique_name == NULL);
+        client->service_name = g_strdup(service_name);
+        client->unique_name = g_strdup(unique_name);
+        up = true;
+    }
 
 error:
     g_free(unique_name);
+    return up;
 }
 
 static void
@@ -1976,6 +3121,99 @@ _LSHubQueryNameReplyReplaceErrorCode(_LSTransportMessage *reply_message, long er
     _LSTransportMessageAppendInt32(&iter, err_code);
 }
 
+/**
+ *******************************************************************************
+ * @brief Introduce a client to the service that it has just been connected
+ * to, so that the service knows who's calling before the client writes
+ * anything. Clients older than protocol version 4 introduce themselves.
+ *
+ * @param  client   IN  client that queried the service
+ * @param  fd       IN  connection to the service
+ * @param  lserror  OUT set on error
+ *
+ * @retval  true on success
+ * @retval  false on failure
+ *******************************************************************************
+ */
+static bool
+_LSHubIntroduceClient(const _LSTransportClient *client, int fd, LSError *lserror)
+{
+    if (!client->fast_register)
+    {
+        return true;
+    }
+
+    return _LSTransportSendClientInfoFd(fd, client->service_name, client->unique_name,
+                                        client->protocol_version, lserror);
+}
+
+/**
+ *******************************************************************************
+ * @brief Connect to a client, for another client to talk to it.
+ *
+ * A client that speaks protocol version 5 doesn't listen: it gets one end
+ * of a socket pair over its connection to us, and the other end is
+ * returned. That never blocks, so there's no connect to retry or to time
+ * out. Other clients are connected to on their listening socket.
+ *
+ * If both clients speak protocol version 6 and SeqpacketSockets is set,
+ * the pair is made of records (SOCK_SEQPACKET), so that they read each
+ * message in one go.
+ *
+ * @param  client       IN   client the connection is for
+ * @param  unique_name  IN   unique name of the client to connect to
+ * @param  fd           OUT  connection on success
+ * @param  lserror      OUT  set on error
+ *
+ * @retval  state of the connection, as for _LSTransportConnectLocal()
+ *******************************************************************************
+ */
+static _LSTransportConnectState
+_LSHubConnectLocal(const _LSTransportClient *client, const char *unique_name, int *fd, LSError *lserror)
+{
+    _ClientId *id = g_hash_table_lookup(connected_clients.by_unique_name, unique_name);
+
+    if (!id || !id->client || !id->client->pair_connect)
+    {
+        return _LSTransportConnectLocal(unique_name, true, fd, lserror);
+    }
+
+    int type = SOCK_STREAM;
+    if (g_conf_seqpacket_sockets && client->seqpacket_connect && id->client->seqpacket_connect)
+    {
+        type = SOCK_SEQPACKET;
+    }
+
+    int pair[2];
+
+    if (socketpair(AF_UNIX, type | SOCK_CLOEXEC, 0, pair) != 0)
+    {
+        _LSErrorSetFromErrno(lserror, MSGID_LSHUB_SOCK_ERR, errno);
+        return _LSTransportConnectStateOtherFailure;
+    }
+
+    _LSTransportMessage *message = _LSTransportMessageNewRef(0);
+
+    _LSTransportMessageSetType(message, _LSTransportMessageTypeIncomingConnection);
+
+    /* closed with the message, once sent */
+    _LSTransportMessageSetConnectionFd(message, pair[1]);
+
+    bool sent = _LSTransportSendMessage(message, id->client, NULL, lserror);
+
+    _LSTransportMessageUnref(message);
+
+    if (!sent)
+    {
+        close(pair[0]);
+        return _LSTransportConnectStateOtherFailure;
+    }
+
+    *fd = pair[0];
+
+    return _LSTransportConnectStateNoError;
+}
+
 static gboolean
 _LSHubHandleConnectReady(GIOChannel *channel, GIOCondition cond, _LSTransportMessage *message)
 {
@@ -2069,6 +3307,16 @@ _LSHubHandleConnectReady(GIOChannel *channel, GIOCondition cond, _LSTransportMes
         LS_ASSERT(0);
     }
 
+    if (connected && type == _LSTransportMessageTypeQueryNameReply &&
+        !_LSHubIntroduceClient(_LSTransportMessageGetClient(message), fd, &lserror))
+    {
+        LOG_LSERROR(MSGID_LSHUB_SENDMSG_ERROR, &lserror);
+        LSErrorFree(&lserror);
+
+        _LSHubQueryNameReplyReplaceErrorCode(message, LS_TRANSPORT_QUERY_NAME_SERVICE_NOT_AVAILABLE);
+        connected = false;
+    }
+
     if (connected)
     {
         /* make sure message has connected fd set */
@@ -2140,6 +3388,8 @@ _LSHubSendQueryNameReply(const _LSTransportMessage *message, long err_code,
         LS_ASSERT(0);
     }
 
+    _LSHubStatsQueryNameReplied(message, service_name);
+
     _LSTransportMessage *reply_message = _LSTransportMessageNewRef(LS_TRANSPORT_MESSAGE_DEFAULT_PAYLOAD_SIZE);
 
     _LSTransportMessageSetType(reply_message, _LSTransportMessageTypeQueryNameReply);
@@ -2157,7 +3407,7 @@ _LSHubSendQueryNameReply(const _LSTransportMessage *message, long err_code,
     if (err_code >= 0 &&
         _LSTransportGetTransportType(_LSTransportClientGetTransport(client)) == _LSTransportTypeLocal)
     {
-        connect_state = _LSTransportConnectLocal(unique_name, true, &fd, lserror);
+        connect_state = _LSHubConnectLocal(client, unique_name, &fd, lserror);
 
         _LSTransportMessageSetConnectState(reply_message, connect_state);
 
@@ -2165,6 +3415,15 @@ _LSHubSendQueryNameReply(const _LSTransportMessage *message, long err_code,
         {
         case _LSTransportConnectStateNoError:
             /* success */
+            if (!_LSHubIntroduceClient(client, fd, lserror))
+            {
+                close(fd);
+                fd = -1;
+                ret = false;
+
+                err_code = LS_TRANSPORT_QUERY_NAME_SERVICE_NOT_AVAILABLE;
+                _LSHubQueryNameReplyReplaceErrorCode(reply_message, err_code);
+            }
             break;
         case _LSTransportConnectStateEagain:
         case _LSTransportConnectStateEinprogress:
@@ -2205,6 +3464,10 @@ _LSHubSendQueryNameReply(const _LSTransportMessage *message, long err_code,
     {
         ret = false;
     }
+    else if (send && err_code >= 0)
+    {
+        _LSHubStatsServiceReplied(service_name);
+    }
 
     _LSTransportMessageUnref(reply_message);
 
@@ -2371,6 +3634,7 @@ _LSHubHandleNodeUp(_LSTransportMessage *message)
     }
 
     /* if it's a dynamic service, update its state to running */
+    bool launched = false;
     _Service *dynamic = _DynamicServiceStateMapLookup(id->service_name);
     if (dynamic)
     {
@@ -2380,6 +3644,8 @@ _LSHubHandleNodeUp(_LSTransportMessage *message)
         {
             /* launched dynamically */
             _DynamicServiceSetState(dynamic, _DynamicServiceStateRunningDynamic);
+            _LSHubStatsServiceUp(id, dynamic);
+            launched = true;
         }
         else if (state == _DynamicServiceStateStopped)
         {
@@ -2412,6 +3678,12 @@ _LSHubHandleNodeUp(_LSTransportMessage *message)
     /* Let registered clients know that this service is up */
     _LSHubSendServiceUpSignal(id->service_name, id->local.name, pid, allowed_names);
 
+    /* ... and those that register later */
+    _LSHubServiceSnapshotSet(service_snapshot, id->service_name, pid, allowed_names);
+
+    /* Launch what usually follows it */
+    _DynamicServicePrelaunchUp(id->service_name, dynamic, launched);
+
     g_free(allowed_names);
 
     if (g_conf_log_service_status)
@@ -2469,11 +3741,9 @@ _LSHubAddPendingConnect(_LSTransportMessage *message, _LSTransportClient *client
  * @brief Send a failure response to a query name message that timed out.
  *
  * @param  message  IN  query name message that timed out
- *
- * @retval FALSE always so the timer does not fire again
  *******************************************************************************
  */
-gboolean
+void
 _LSHubHandleQueryNameTimeout(_LSTransportMessage *message)
 {
     LSError lserror;
@@ -2502,8 +3772,6 @@ exit:
     _LSTransportMessageUnref(message);
 
     _LSHubRemoveMessageTimeout(message);
-
-    return FALSE;   /* don't fire the timer again */
 }
 
 /**
@@ -2511,11 +3779,9 @@ exit:
  * @brief Send a failure response for a query name connect() that has timed out
  *
  * @param  message  IN  the reply to the original query name message
- *
- * @retval FALSE always so the timer does not fire again
  *******************************************************************************
  */
-gboolean
+void
 _LSHubHandleConnectTimeout(_LSTransportMessage *message)
 {
     LSError lserror;
@@ -2554,9 +3820,6 @@ _LSHubHandleConnectTimeout(_LSTransportMessage *message)
 
     /* refcount associated with the list */
     _LSTransportMessageUnref(message);
-
-
-    return FALSE;   /* don't fire the timer again */
 }
 
 /**
@@ -2569,16 +3832,21 @@ _LSHubHandleConnectTimeout(_LSTransportMessage *message)
  *******************************************************************************
  */
 static void
-_LSHubAddMessageTimeout(_LSTransportMessage *message, int timeout_ms, GSourceFunc callback)
+_LSHubAddMessageTimeout(_LSTransportMessage *message, int timeout_ms, _LSTimerFunc callback)
 {
     _LSTransportMessageRef(message);
 
-    GTimerSource *source = g_timer_source_new (timeout_ms, MESSAGE_TIMEOUT_GRANULARITY_MS);
+    /* all the message timeouts share one wheel (and one GSource) */
+    if (!message_timeouts)
+    {
+        message_timeouts = _LSTimerWheelNew(NULL, MESSAGE_TIMEOUT_GRANULARITY_MS);
+    }
 
-    g_source_set_callback ((GSource*)source, callback, message, NULL);
-    guint timeout_id = g_source_attach ((GSource*)source, NULL);
+    _LSTimer *timer = _LSTransportMessageGetTimeout(message);
+    LS_ASSERT(timer->pprev == NULL);
 
-    _LSTransportMessageSetTimeoutId(message, timeout_id);
+    _LSTimerInit(timer, callback, NULL, message);
+    _LSTimerWheelArm(message_timeouts, timer, timeout_ms);
 }
 
 /**
@@ -2591,17 +3859,8 @@ _LSHubAddMessageTimeout(_LSTransportMessage *message, int timeout_ms, GSourceFun
 static void
 _LSHubRemoveMessageTimeout(_LSTransportMessage *message)
 {
-    /* remove timeout source from mainloop */
-    GSource *timeout_source = g_main_context_find_source_by_id(NULL, _LSTransportMessageGetTimeoutId(message));
-
-    if (timeout_source)
-    {
-        g_source_destroy(timeout_source);
-        g_source_unref(timeout_source);
-    }
-
-    /* clear timeout id */
-    _LSTransportMessageSetTimeoutId(message, 0);
+    /* disarm the timer (nothing to do if it has just expired) */
+    _LSTimerWheelCancel(message_timeouts, _LSTransportMessageGetTimeout(message));
 
     _LSTransportMessageUnref(message);
 }
@@ -2619,7 +3878,7 @@ _LSHubAddConnectMessageTimeout(_LSTransportMessage *message)
 {
     _LSTransportMessageRef(message);
     waiting_for_connect = g_slist_prepend(waiting_for_service, message);
-    _LSHubAddMessageTimeout(message, g_conf_connect_timeout_ms, (GSourceFunc)_LSHubHandleConnectTimeout);
+    _LSHubAddMessageTimeout(message, g_conf_connect_timeout_ms, (_LSTimerFunc)_LSHubHandleConnectTimeout);
 }
 
 /**
@@ -2649,7 +3908,7 @@ _LSHubAddQueryNameMessageTimeout(_LSTransportMessage *message)
 {
     _LSTransportMessageRef(message);
     waiting_for_service = g_slist_prepend(waiting_for_service, message);
-    _LSHubAddMessageTimeout(message, g_conf_query_name_timeout_ms, (GSourceFunc)_LSHubHandleQueryNameTimeout);
+    _LSHubAddMessageTimeout(message, g_conf_query_name_timeout_ms, (_LSTimerFunc)_LSHubHandleQueryNameTimeout);
 }
 
 /**
@@ -2676,6 +3935,8 @@ _LSHubHandleQueryName(_LSTransportMessage *message)
 
     LS_ASSERT(service_name != NULL);
 
+    _LSHubStatsQueryNameReceived(message);
+
     /* If the message originated from a mojo app, we will get a non-NULL appId
      * from this call. */
     const char *app_id = _LSTransportMessageTypeQueryNameGetAppId(message);
@@ -2717,6 +3978,11 @@ _LSHubHandleQueryName(_LSTransportMessage *message)
         return;
     }
 
+    if (service_is_dynamic)
+    {
+        _DynamicServicePrelaunchRequested(service_name);
+    }
+
     _ClientId *id = g_hash_table_lookup(available_services, service_name);
 
     if (!id)
@@ -2745,6 +4011,21 @@ _LSHubHandleQueryName(_LSTransportMessage *message)
                     }
                     return;
                 }
+
+                /* If its socket was created before the launch, connect
+                 * the client now; its messages wait in the socket until
+                 * the service is up */
+                _Service *service_state = _DynamicServiceStateMapLookup(service_name);
+
+                if (service_state && service_state->listen_fd != -1)
+                {
+                    if (!_LSHubSendQueryNameReply(message, LS_TRANSPORT_QUERY_NAME_SUCCESS, service_name, service_state->listen_name, true, &lserror))
+                    {
+                        LOG_LSERROR(MSGID_LSHUB_SENDMSG_ERROR, &lserror);
+                        LSErrorFree(&lserror);
+                    }
+                    return;
+                }
             }
             /* !service->is_dynamic */
         }
@@ -2948,31 +4229,58 @@ _LSTransportClientMapIsEmpty(_LSTransportClientMap *map)
  *
  * @param  map      IN  map
  * @param  func     IN  callback
- * @param  message  IN  message to pass as data to callback
+ * @param  data     IN  data to pass to callback
  *******************************************************************************
  */
 static void
-_LSTransportClientMapForEach(_LSTransportClientMap *map, GHFunc func, _LSTransportMessage *message)
+_LSTransportClientMapForEach(_LSTransportClientMap *map, GHFunc func, void *data)
 {
-    g_hash_table_foreach(map->map, func, message);
+    g_hash_table_foreach(map->map, func, data);
 }
 
+/** A signal being forwarded to the interested clients */
+struct _LSHubSignal
+{
+    _LSTransportMessage *message;   /**< signal as sent or generated */
+    _LSTransportMessage *legacy;    /**< JSON form of a service status signal, created
+                                         for the first client older than protocol
+                                         version 3 */
+};
+
 /**
  *******************************************************************************
  * @brief Send a signal message to a client.
  *
  * @param  client   IN  client to which signal should be sent
  * @param  dummy    IN  unused
- * @param  message  IN  message to forward as the signal
+ * @param  signal   IN  signal to forward
  *******************************************************************************
  */
 static void
-_LSHubSendSignal(_LSTransportClient *client, void *dummy, _LSTransportMessage *message)
+_LSHubSendSignal(_LSTransportClient *client, void *dummy, _LSHubSignal *signal)
 {
     LSError lserror;
     LSErrorInit(&lserror);
     LSMessageToken token;
 
+    _LSTransportMessage *message = signal->message;
+
+    _LSTransportMessageType type = _LSTransportMessageGetType(message);
+    if (!client->typed_status &&
+        (type == _LSTransportMessageTypeServiceUpSignal || type == _LSTransportMessageTypeServiceDownSignal))
+    {
+        if (!signal->legacy)
+        {
+            signal->legacy = LSTransportMessageServiceStatusSignalLegacyNewRef(message);
+            if (!signal->legacy)
+            {
+                LOG_LS_ERROR(MSGID_LSHUB_SENDMSG_ERROR, 0, "Unable to create the JSON form of a service status signal");
+                return;
+            }
+        }
+        message = signal->legacy;
+    }
+
     /* Need to make a copy of the message, since this function gets called
      * multiple times with the same message.
      *
@@ -2988,6 +4296,15 @@ _LSHubSendSignal(_LSTransportClient *client, void *dummy, _LSTransportMessage *m
         LOG_LSERROR(MSGID_LSHUB_SENDMSG_ERROR, &lserror);
         LSErrorFree(&lserror);
     }
+    else
+    {
+        _ClientId *id = _LSHubClientIdLookup(client);
+        if (id)
+        {
+            id->stats.messages_routed++;
+            id->stats.bytes_routed += sizeof(_LSTransportHeader) + _LSTransportMessageGetHeader(msg_copy)->len;
+        }
+    }
 
 #if 0
     _LSTransportMessageType type = _LSTransportMessageGetType(message);
@@ -3153,6 +4470,8 @@ _LSHubHandleSignalUnregister(_LSTransportMessage *message)
 
     LS_ASSERT(category != NULL);
 
+    bool removed = false;
+
     /* if method, remove from category/method hash */
     if (strlen(method) > 0)
     {
@@ -3172,7 +4491,8 @@ _LSHubHandleSignalUnregister(_LSTransportMessage *message)
         }
 #endif
 
-        if (!_LSHubRemoveSignal(signal_map->method_map, full_path, client))
+        removed = _LSHubRemoveSignal(signal_map->method_map, full_path, client);
+        if (!removed)
         {
             const _LSTransportCred *cred = _LSTransportClientGetCred(client);
             LOG_LS_ERROR(MSGID_LSHUB_SIGNAL_ERR, 4,
@@ -3187,7 +4507,8 @@ _LSHubHandleSignalUnregister(_LSTransportMessage *message)
     else
     {
         /* remove from category hash */
-        if (!_LSHubRemoveSignal(signal_map->category_map, category, client))
+        removed = _LSHubRemoveSignal(signal_map->category_map, category, client);
+        if (!removed)
         {
             const _LSTransportCred *cred = _LSTransportClientGetCred(client);
             LOG_LS_ERROR(MSGID_LSHUB_SIGNAL_ERR, 4,
@@ -3199,6 +4520,12 @@ _LSHubHandleSignalUnregister(_LSTransportMessage *message)
         }
     }
 
+    _ClientId *id = _LSHubClientIdLookup(client);
+    if (removed && id && id->stats.signals_registered > 0)
+    {
+        id->stats.signals_registered--;
+    }
+
     /* TODO: remove from reverse lookup */
 }
 
@@ -3239,17 +4566,16 @@ _LSHubAddSignal(GHashTable *map, const char *path, _LSTransportClient *client)
 
 /**
  *******************************************************************************
- * @brief Utility routine used by _LSHubSignalRegisterAllServices, for iteration.
+ * @brief Utility routine used by LSHubServiceSnapshotRefresh, for iteration.
  *
  * @param  key    IN  service name
  * @param  value  IN  _ClientId pointer
- * @param  user_data IN  GString * where results will be accumulated
+ * @param  user_data IN  unused
  *******************************************************************************
  */
 static void
-_LSHubSignalRegisterAllServicesItem(gpointer key, gpointer value, gpointer user_data)
+_LSHubServiceSnapshotRefreshItem(gpointer key, gpointer value, gpointer user_data)
 {
-    GString * str = (GString*)user_data;
     _ClientId * client = (_ClientId*)value;
 
     const char *exe_path = NULL;
@@ -3274,38 +4600,27 @@ _LSHubSignalRegisterAllServicesItem(gpointer key, gpointer value, gpointer user_
     if (exe_path)
         allowed_names = LSHubRoleAllowedNamesForExe(exe_path);
 
-    g_string_append_printf(str, "{\"serviceName\":\"%s\",\"pid\":%d,\"allNames\":[%s]},",
-      client->service_name ? client->service_name : "",
-      pid,
-      allowed_names ? allowed_names : "");
-}
+    _LSHubServiceSnapshotSet(service_snapshot, client->service_name ? client->service_name : "",
+                             pid, allowed_names);
 
+    g_free(allowed_names);
+}
 
 /**
  *******************************************************************************
- * @brief Generate payload for service subscription response listing all available services and their pids.
- *
- * @param  table  IN  available_services table
- * @retval            allocated gchar*
+ * @brief Rebuild the entries of all the available services listed to the
+ * clients registering for their status. Called after the roles, which give
+ * the names of the services, are reloaded.
  *******************************************************************************
  */
-static gchar *
-_LSHubSignalRegisterAllServices(GHashTable *table)
+void
+LSHubServiceSnapshotRefresh(void)
 {
-    LS_ASSERT(table != NULL);
-    GString * str = g_string_new("{\"returnValue\":true,\"services\":[");
-
-    g_hash_table_foreach(table, _LSHubSignalRegisterAllServicesItem, str);
-
-    // trim off last comma
-    g_string_truncate(str, str->len-1);
-
-    g_string_append_printf(str, "]}");
+    if (!available_services) return;
 
-    return g_string_free(str, FALSE);
+    g_hash_table_foreach(available_services, _LSHubServiceSnapshotRefreshItem, NULL);
 }
 
-
 /**
  *******************************************************************************
  * @brief Process a signal register message.
@@ -3365,6 +4680,12 @@ _LSHubHandleSignalRegister(_LSTransportMessage* message)
         g_free(path);
     }
 
+    _ClientId *id = _LSHubClientIdLookup(client);
+    if (id)
+    {
+        id->stats.signals_registered++;
+    }
+
     /* FIXME: we need to create a new "signal reply" function, so that we can
      * differentiate between method call replies and signal registration replies
      * for the shutdown logic */
@@ -3377,10 +4698,11 @@ _LSHubHandleSignalRegister(_LSTransportMessage* message)
         strlen(method) == 0)
     {
         /* ACK signal registration for methodless serviceStatus with current
-         * status of all services */
-        gchar * payload = _LSHubSignalRegisterAllServices(available_services);
+         * status of all services, gathered from their cached entries */
+        int count = 0;
+        struct iovec *payload = _LSHubServiceSnapshotGetVector(service_snapshot, &count);
 
-        if (!_LSTransportSendReply(message, payload, &lserror))
+        if (!_LSTransportSendReplyVector(message, payload, count, &lserror))
         {
             LOG_LSERROR(MSGID_LSHUB_REG_REPLY_ERR, &lserror);
             LSErrorFree(&lserror);
@@ -3420,12 +4742,16 @@ _LSHubHandleSignal(_LSTransportMessage *message, bool generated_by_hub)
         return;
     }
 
+    guint fanout = 0;
+    _LSHubSignal signal = { .message = message };
+
     /* look up all clients that handle this category */
     _LSTransportClientMap *category_client_map = g_hash_table_lookup(signal_map->category_map, category);
 
     if (category_client_map)
     {
-        _LSTransportClientMapForEach(category_client_map, (GHFunc)_LSHubSendSignal, message);
+        fanout += g_hash_table_size(category_client_map->map);
+        _LSTransportClientMapForEach(category_client_map, (GHFunc)_LSHubSendSignal, &signal);
     }
 
     /* look up all clients that handle this category/method */
@@ -3435,10 +4761,29 @@ _LSHubHandleSignal(_LSTransportMessage *message, bool generated_by_hub)
 
     if (method_client_map)
     {
-        _LSTransportClientMapForEach(method_client_map, (GHFunc)_LSHubSendSignal, message);
+        fanout += g_hash_table_size(method_client_map->map);
+        _LSTransportClientMapForEach(method_client_map, (GHFunc)_LSHubSendSignal, &signal);
     }
 
     g_free(category_method);
+
+    if (signal.legacy)
+    {
+        _LSTransportMessageUnref(signal.legacy);
+    }
+
+    hub_stats.signals_routed++;
+    hub_stats.signal_deliveries += fanout;
+
+    if (!generated_by_hub)
+    {
+        _ClientId *id = _LSHubClientIdLookup(_LSTransportMessageGetClient(message));
+        if (id)
+        {
+            id->stats.signals_sent++;
+            id->stats.signal_fanout += fanout;
+        }
+    }
 }
 
 /**
@@ -3494,7 +4839,7 @@ _LSHubSendMonitorMessage(int ignored_fd, _ClientId *id, const char *unique_name)
         _LSTransportGetTransportType(_LSTransportClientGetTransport(id->client)) == _LSTransportTypeLocal)
     {
         int fd = -1;
-        _LSTransportConnectState connect_state = _LSTransportConnectLocal(unique_name, true, &fd, &lserror);
+        _LSTransportConnectState connect_state = _LSHubConnectLocal(id->client, unique_name, &fd, &lserror);
 
         _LSTransportMessageSetConnectState(monitor_message, connect_state);
 
@@ -3695,11 +5040,12 @@ _LSHubHandleQueryServiceStatus(const _LSTransportMessage *message)
     _LSTransportMessageUnref(reply);
 }
 
-static void send_service_category_reply(const _LSTransportMessage *message, const char *payload)
+static void send_json_reply(const _LSTransportMessage *message, _LSTransportMessageType type,
+                            const char *payload)
 {
     /* construct the reply -- reply_serial + payload */
     _LSTransportMessage *reply = _LSTransportMessageNewRef(LS_TRANSPORT_MESSAGE_DEFAULT_PAYLOAD_SIZE);
-    _LSTransportMessageSetType(reply, _LSTransportMessageTypeQueryServiceCategoryReply);
+    _LSTransportMessageSetType(reply, type);
 
     _LSTransportMessageIter iter;
     _LSTransportMessageIterInit(reply, &iter);
@@ -3805,13 +5151,14 @@ _LSHubHandleQueryServiceCategory(const _LSTransportMessage *message)
     /* look up service name in available list */
     _ClientId *id = g_hash_table_lookup(available_services, service_name);
     if (!id || !id->categories)
-        send_service_category_reply(message, "{}");
+        send_json_reply(message, _LSTransportMessageTypeQueryServiceCategoryReply, "{}");
     else
     {
         jvalue_ref payload = DumpCategories(id, category);
         if (payload)
         {
-            send_service_category_reply(message, jvalue_tostring_simple(payload));
+            send_json_reply(message, _LSTransportMessageTypeQueryServiceCategoryReply,
+                            jvalue_tostring_simple(payload));
             j_release(&payload);
         }
     }
@@ -3907,6 +5254,132 @@ error:
     if (reply) _LSTransportMessageUnref(reply);
 }
 
+/**
+ *******************************************************************************
+ * @brief Dump the traffic statistics of a client.
+ *
+ * @param  id   IN  client id
+ *
+ * @retval  JSON object
+ *******************************************************************************
+ */
+static jvalue_ref
+_LSHubClientStatsToJson(const _ClientId *id)
+{
+    const _ClientStats *stats = &id->stats;
+    const _LSTransportCred *cred = _LSTransportClientGetCred(id->client);
+
+    jvalue_ref obj = jobject_create();
+
+    jobject_put(obj, J_CSTR_TO_JVAL("uniqueName"), jstring_create(id->local.name));
+    if (id->service_name)
+        jobject_put(obj, J_CSTR_TO_JVAL("serviceName"), jstring_create(id->service_name));
+    jobject_put(obj, J_CSTR_TO_JVAL("pid"), jnumber_create_i32(_LSTransportCredGetPid(cred)));
+    jobject_put(obj, J_CSTR_TO_JVAL("messagesReceived"), jnumber_create_i64(stats->messages_received));
+    jobject_put(obj, J_CSTR_TO_JVAL("bytesReceived"), jnumber_create_i64(stats->bytes_received));
+    jobject_put(obj, J_CSTR_TO_JVAL("messagesRouted"), jnumber_create_i64(stats->messages_routed));
+    jobject_put(obj, J_CSTR_TO_JVAL("bytesRouted"), jnumber_create_i64(stats->bytes_routed));
+    jobject_put(obj, J_CSTR_TO_JVAL("signalsRegistered"), jnumber_create_i32(stats->signals_registered));
+    jobject_put(obj, J_CSTR_TO_JVAL("signalsSent"), jnumber_create_i64(stats->signals_sent));
+    jobject_put(obj, J_CSTR_TO_JVAL("signalFanout"), jnumber_create_i64(stats->signal_fanout));
+    jobject_put(obj, J_CSTR_TO_JVAL("queryNameLatencyUs"), _LSMetricsHistogramToJson(&stats->query_name_latency));
+    if (stats->launch_to_up_ms >= 0)
+        jobject_put(obj, J_CSTR_TO_JVAL("launchToUpMs"), jnumber_create_i64(stats->launch_to_up_ms));
+
+    return obj;
+}
+
+/**
+ *******************************************************************************
+ * @brief Process a "QueryHubTelemetry" message and reply with the traffic
+ * statistics of every connected client and every service queried since the
+ * hub started.
+ *
+ * Reply payload:
+ * {"returnValue": true, "signalsRouted": 3, "signalDeliveries": 12,
+ *  "queryNameLatencyUs": [...], "launchToUpUs": [...],
+ *  "clients": [{"uniqueName": ..., "serviceName": ..., "pid": ...,
+ *               "messagesReceived": ..., "bytesReceived": ...,
+ *               "messagesRouted": ..., "bytesRouted": ...,
+ *               "signalsRegistered": ..., "signalsSent": ...,
+ *               "signalFanout": ..., "queryNameLatencyUs": [...],
+ *               "launchToUpMs": ...}, ...],
+ *  "services": [{"serviceName": ..., "queries": ...,
+ *                "queryNameLatencyUs": [...], "launches": ...,
+ *                "launchToUpUs": [...]}, ...]}
+ *
+ * Histograms are arrays of @ref LS_METRICS_HISTOGRAM_BUCKETS log2 buckets
+ * in microseconds.
+ *
+ * @param  message  IN  query hub telemetry message
+ *******************************************************************************
+ */
+static void
+_LSHubHandleQueryHubTelemetry(const _LSTransportMessage *message)
+{
+    LS_ASSERT(_LSTransportMessageGetType(message) == _LSTransportMessageTypeQueryHubTelemetry);
+
+    GHashTableIter hash_iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+
+    jvalue_ref payload = jobject_create();
+    if (!payload)
+    {
+        LOG_LS_ERROR(MSGID_LSHUB_OOM_ERR, 0, "Out of memory");
+        return;
+    }
+
+    jvalue_ref clients = jarray_create(0);
+    g_hash_table_iter_init(&hash_iter, connected_clients.by_unique_name);
+    while (g_hash_table_iter_next(&hash_iter, &key, &value))
+    {
+        jarray_append(clients, _LSHubClientStatsToJson(value));
+    }
+
+    jvalue_ref services = jarray_create(0);
+    g_hash_table_iter_init(&hash_iter, service_stats);
+    while (g_hash_table_iter_next(&hash_iter, &key, &value))
+    {
+        const _ServiceStats *stats = value;
+        jvalue_ref obj = jobject_create();
+
+        jobject_put(obj, J_CSTR_TO_JVAL("serviceName"), jstring_create(key));
+        jobject_put(obj, J_CSTR_TO_JVAL("queries"), jnumber_create_i64(stats->queries));
+        jobject_put(obj, J_CSTR_TO_JVAL("queryNameLatencyUs"), _LSMetricsHistogramToJson(&stats->query_name_latency));
+        jobject_put(obj, J_CSTR_TO_JVAL("launches"), jnumber_create_i64(stats->launches));
+        jobject_put(obj, J_CSTR_TO_JVAL("launchToUpUs"), _LSMetricsHistogramToJson(&stats->launch_to_up));
+        jobject_put(obj, J_CSTR_TO_JVAL("launchToReplyUs"), _LSMetricsHistogramToJson(&stats->launch_to_reply));
+
+        jarray_append(services, obj);
+    }
+
+    jobject_put(payload, J_CSTR_TO_JVAL("returnValue"), jboolean_create(true));
+    jobject_put(payload, J_CSTR_TO_JVAL("signalsRouted"), jnumber_create_i64(hub_stats.signals_routed));
+    jobject_put(payload, J_CSTR_TO_JVAL("signalDeliveries"), jnumber_create_i64(hub_stats.signal_deliveries));
+    jobject_put(payload, J_CSTR_TO_JVAL("queryNameLatencyUs"), _LSMetricsHistogramToJson(&hub_stats.query_name_latency));
+    jobject_put(payload, J_CSTR_TO_JVAL("launchToUpUs"), _LSMetricsHistogramToJson(&hub_stats.launch_to_up));
+    jobject_put(payload, J_CSTR_TO_JVAL("launchToReplyUs"), _LSMetricsHistogramToJson(&hub_stats.launch_to_reply));
+    jobject_put(payload, J_CSTR_TO_JVAL("clients"), clients);
+    jobject_put(payload, J_CSTR_TO_JVAL("services"), services);
+
+    if (prelaunch)
+    {
+        jvalue_ref obj = jobject_create();
+
+        jobject_put(obj, J_CSTR_TO_JVAL("launches"), jnumber_create_i64(hub_stats.prelaunches));
+        jobject_put(obj, J_CSTR_TO_JVAL("hits"), jnumber_create_i64(hub_stats.prelaunch_hits));
+        jobject_put(obj, J_CSTR_TO_JVAL("wasted"), jnumber_create_i64(hub_stats.prelaunch_wasted));
+        jobject_put(obj, J_CSTR_TO_JVAL("inFlight"), jnumber_create_i64(hub_stats.prelaunch_in_flight));
+
+        jobject_put(payload, J_CSTR_TO_JVAL("prelaunch"), obj);
+    }
+
+    send_json_reply(message, _LSTransportMessageTypeQueryHubTelemetryReply, jvalue_tostring_simple(payload));
+
+    j_release(&payload);
+}
+
 static void
 _LSHubHandlePushRole(_LSTransportMessage *message)
 {
@@ -4101,11 +5574,19 @@ _LSHubHandleMessage(_LSTransportMessage* message, void *context)
     {
     case _LSTransportMessageTypeRequestNameLocal:
     case _LSTransportMessageTypeRequestNameInet:
-        _LSHubHandleRequestName(message);
+    {
+        bool up = _LSHubHandleRequestName(message);
 
         /* tell the connecting client whether we have a monitor */
         _LSHubSendMonitorStatus(message);
+
+        /* clients of protocol version 4 and later don't send "NodeUp" */
+        if (up)
+        {
+            _LSHubHandleNodeUp(message);
+        }
         break;
+    }
 
     case _LSTransportMessageTypeNodeUp:
         _LSHubHandleNodeUp(message);
@@ -4151,6 +5632,10 @@ _LSHubHandleMessage(_LSTransportMessage* message, void *context)
         _LSHubHandleAppendCategory(message);
         break;
 
+    case _LSTransportMessageTypeQueryHubTelemetry:
+        _LSHubHandleQueryHubTelemetry(message);
+        break;
+
     case _LSTransportMessageTypeMethodCall:
     case _LSTransportMessageTypeReply:
     default:
@@ -4158,6 +5643,8 @@ _LSHubHandleMessage(_LSTransportMessage* message, void *context)
         break;
     }
 
+    _LSHubStatsMessageReceived(message);
+
     return LSMessageHandlerResultHandled;
 }
 
@@ -4385,12 +5872,22 @@ int main(int argc, char *argv[])
     /* init data structures */
     pending = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _LSHubClientIdLocalUnrefVoid);
     available_services = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _LSHubClientIdLocalUnrefVoid);
+    service_snapshot = _LSHubServiceSnapshotNew();
+
+    if (g_conf_prelaunch_enabled)
+    {
+        _DynamicServicePrelaunchInit();
+    }
 
     connected_clients.by_fd = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, _LSHubClientIdLocalUnrefVoid);
     connected_clients.by_unique_name = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _LSHubClientIdLocalUnrefVoid);
 
     signal_map = _SignalMapNew();
 
+    service_stats = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    query_name_start = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                             (GDestroyNotify) _LSTransportMessageUnref, g_free);
+
     _LSHubHandler.msg_handler = _LSHubHandleMessage;
     _LSHubHandler.msg_context = NULL;
     _LSHubHandler.disconnect_handler = _LSHubHandleDisconnect;
@@ -4429,23 +5926,40 @@ int main(int argc, char *argv[])
     {
         const char *hub_local_addr = NULL;
 
+        /* the clients of this version try the abstract address first and
+         * fall back to the path, older ones know only the path */
         if (public)
         {
-            hub_local_addr = HUB_LOCAL_ADDRESS_PUBLIC;
+            hub_local_addr = g_conf_abstract_sockets ? HUB_ABSTRACT_ADDRESS_PUBLIC : HUB_LOCAL_ADDRESS_PUBLIC;
         }
         else
         {
-            hub_local_addr = HUB_LOCAL_ADDRESS_PRIVATE;
+            hub_local_addr = g_conf_abstract_sockets ? HUB_ABSTRACT_ADDRESS_PRIVATE : HUB_LOCAL_ADDRESS_PRIVATE;
         }
 
+        /* a socket passed by our launcher is bound already, and clients may
+         * be queued on it (socket activation); one bound elsewhere is left
+         * alone and we create ours */
+        int listen_fd = _LSTransportGetInheritedListenFd(hub_local_addr);
+
         /* everyone needs to be able to talk to the hub */
-        if (!_LSTransportSetupListenerLocal(hub_transport, hub_local_addr, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, &lserror))
+        if (listen_fd != -1
+            ? !_LSTransportSetupListenerLocalWithFd(hub_transport, hub_local_addr, listen_fd, &lserror)
+            : !_LSTransportSetupListenerLocal(hub_transport, hub_local_addr, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, &lserror))
         {
             LOG_LSERROR(MSGID_LSHUB_LOCAL_LISTENER_ERROR, &lserror);
             LSErrorFree(&lserror);
         }
     }
 
+    /* a client flooding the hub mustn't hold up everyone else's
+     * registrations, QueryNames and signals */
+    _LSTransportIncomingBudget incoming_budget = {
+        .max_messages = MAX(g_conf_incoming_budget_messages, 0),
+        .max_bytes = MAX(g_conf_incoming_budget_bytes, 0),
+    };
+    _LSTransportSetIncomingBudget(hub_transport, &incoming_budget, G_PRIORITY_DEFAULT);
+
     _LSTransportGmainAttach(hub_transport, g_main_loop_get_context(mainloop));
 
 #if !defined(TARGET_DESKTOP)
@@ -4515,13 +6029,18 @@ int main(int argc, char *argv[])
     _LSTransportDeinit(hub_transport);
     _SignalMapFree(signal_map);
 
+    _DynamicServicePrelaunchDeinit();
+
     if (pending) g_hash_table_destroy(pending);
     if (available_services) g_hash_table_destroy(available_services);
+    _LSHubServiceSnapshotFree(service_snapshot);
     if (wildcard_services) g_tree_destroy(wildcard_services);
     if (all_services) g_hash_table_destroy(all_services);
     if (dynamic_service_states) g_hash_table_destroy(dynamic_service_states);
     if (connected_clients.by_fd) g_hash_table_destroy(connected_clients.by_fd);
     if (connected_clients.by_unique_name) g_hash_table_destroy(connected_clients.by_unique_name);
+    if (service_stats) g_hash_table_destroy(service_stats);
+    if (query_name_start) g_hash_table_destroy(query_name_start);
 
     RolesCleanup();
     ConfigCleanup();
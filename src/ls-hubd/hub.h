@@ -30,6 +30,7 @@ bool ServiceInitMap(LSError *lserror, bool volatile_dirs);
 bool ParseServiceDirectory(const char *path, LSError *lserror, bool isVolatileDir);
 bool SetupSignalHandler(int signal, void (*handler)(int));
 bool LSHubSendConfScanCompleteSignal(void);
+void LSHubServiceSnapshotRefresh(void);
 
 typedef struct _Service _Service;
 _Service* ServiceMapLookup(const char *service_name);
@@ -0,0 +1,450 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "prelaunch.h"
+#include "clock.h"
+#include "error.h"
+
+#define PRELAUNCH_WINDOW_MS         3000    /**< requests this long after a service came up follow it */
+#define PRELAUNCH_RECENT_UPS        4       /**< services that came up last, that requests may follow */
+#define PRELAUNCH_MAX_SERVICES      128     /**< services whose followers are tracked */
+#define PRELAUNCH_MAX_FOLLOWERS     8       /**< followers tracked per service */
+#define PRELAUNCH_MAX_COUNT         64      /**< counts are halved past this */
+#define PRELAUNCH_MIN_COUNT         2       /**< times a follower must have been seen to be predicted */
+
+typedef struct _LSHubPrelaunchFollower {
+    char *service_name;
+    unsigned int count;
+} _LSHubPrelaunchFollower;
+
+/* A service and the services requested after it came up */
+typedef struct _LSHubPrelaunchNode {
+    char *service_name;
+    unsigned int total;         /**< sum of the counts */
+    unsigned int len;           /**< followers in use */
+    _LSHubPrelaunchFollower followers[PRELAUNCH_MAX_FOLLOWERS];
+} _LSHubPrelaunchNode;
+
+typedef struct _LSHubPrelaunchUp {
+    char *service_name;
+    struct timespec time;
+} _LSHubPrelaunchUp;
+
+struct _LSHubPrelaunch {
+    GHashTable *nodes;          /**< service name to node */
+    _LSHubPrelaunchUp recent[PRELAUNCH_RECENT_UPS]; /**< ring of the last services up */
+    unsigned int recent_next;
+    bool dirty;                 /**< changed since loaded or saved */
+};
+
+static void
+_LSHubPrelaunchNodeFree(_LSHubPrelaunchNode *node)
+{
+    unsigned int i;
+    for (i = 0; i < node->len; i++)
+    {
+        g_free(node->followers[i].service_name);
+    }
+    g_free(node->service_name);
+    g_slice_free(_LSHubPrelaunchNode, node);
+}
+
+_LSHubPrelaunch*
+_LSHubPrelaunchNew(void)
+{
+    _LSHubPrelaunch *prelaunch = g_slice_new0(_LSHubPrelaunch);
+
+    prelaunch->nodes = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                             (GDestroyNotify) _LSHubPrelaunchNodeFree);
+
+    return prelaunch;
+}
+
+void
+_LSHubPrelaunchFree(_LSHubPrelaunch *prelaunch)
+{
+    if (!prelaunch) return;
+
+    int i;
+    for (i = 0; i < PRELAUNCH_RECENT_UPS; i++)
+    {
+        g_free(prelaunch->recent[i].service_name);
+    }
+
+    g_hash_table_destroy(prelaunch->nodes);
+    g_slice_free(_LSHubPrelaunch, prelaunch);
+}
+
+/* Get the node of the service, making room for it if needed */
+static _LSHubPrelaunchNode*
+_LSHubPrelaunchNodeGet(_LSHubPrelaunch *prelaunch, const char *service_name)
+{
+    _LSHubPrelaunchNode *node = g_hash_table_lookup(prelaunch->nodes, service_name);
+    if (node) return node;
+
+    if (g_hash_table_size(prelaunch->nodes) >= PRELAUNCH_MAX_SERVICES)
+    {
+        /* the least followed service goes */
+        _LSHubPrelaunchNode *least = NULL;
+
+        GHashTableIter iter;
+        gpointer value;
+        g_hash_table_iter_init(&iter, prelaunch->nodes);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+        {
+            _LSHubPrelaunchNode *candidate = value;
+            if (!least || candidate->total < least->total)
+                least = candidate;
+        }
+        g_hash_table_remove(prelaunch->nodes, least->service_name);
+    }
+
+    node = g_slice_new0(_LSHubPrelaunchNode);
+    node->service_name = g_strdup(service_name);
+    g_hash_table_insert(prelaunch->nodes, node->service_name, node);
+
+    return node;
+}
+
+/* Halve the counts (or take one off), forgetting the followers that drop
+ * to zero */
+static void
+_LSHubPrelaunchNodeReduce(_LSHubPrelaunchNode *node, bool halve)
+{
+    unsigned int i, len = 0;
+
+    node->total = 0;
+    for (i = 0; i < node->len; i++)
+    {
+        _LSHubPrelaunchFollower *follower = &node->followers[i];
+
+        follower->count = halve ? follower->count / 2 : follower->count - 1;
+        if (!follower->count)
+        {
+            g_free(follower->service_name);
+            continue;
+        }
+
+        node->followers[len++] = *follower;
+        node->total += follower->count;
+    }
+    node->len = len;
+}
+
+/* Count the follower of the service, by count more */
+static void
+_LSHubPrelaunchRecord(_LSHubPrelaunch *prelaunch, const char *service_name,
+                      const char *follower_name, unsigned int count)
+{
+    _LSHubPrelaunchNode *node = _LSHubPrelaunchNodeGet(prelaunch, service_name);
+    _LSHubPrelaunchFollower *follower = NULL;
+
+    unsigned int i;
+    for (i = 0; i < node->len; i++)
+    {
+        if (!strcmp(node->followers[i].service_name, follower_name))
+        {
+            follower = &node->followers[i];
+            break;
+        }
+    }
+
+    prelaunch->dirty = true;
+
+    if (!follower)
+    {
+        if (node->len == PRELAUNCH_MAX_FOLLOWERS)
+        {
+            /* every follower loses a sighting, those left with none make room:
+             * followers that are seen often stay, the ones seen once in a
+             * while don't push them out */
+            _LSHubPrelaunchNodeReduce(node, false);
+
+            if (node->len == PRELAUNCH_MAX_FOLLOWERS)
+                return;
+        }
+
+        follower = &node->followers[node->len++];
+        follower->service_name = g_strdup(follower_name);
+        follower->count = 0;
+    }
+
+    follower->count += count;
+    node->total += count;
+
+    if (follower->count > PRELAUNCH_MAX_COUNT)
+    {
+        _LSHubPrelaunchNodeReduce(node, true);
+    }
+}
+
+/**
+ *******************************************************************************
+ * @brief Note that a service came up. Services requested within a short
+ * window after it are counted as its followers.
+ *
+ * @param  prelaunch     IN  pre-launch graph
+ * @param  service_name  IN  service that came up
+ * @param  now           IN  current time
+ *******************************************************************************
+ */
+void
+_LSHubPrelaunchServiceUp(_LSHubPrelaunch *prelaunch, const char *service_name,
+                         const struct timespec *now)
+{
+    LS_ASSERT(service_name != NULL);
+
+    _LSHubPrelaunchUp *up = &prelaunch->recent[prelaunch->recent_next];
+    prelaunch->recent_next = (prelaunch->recent_next + 1) % PRELAUNCH_RECENT_UPS;
+
+    g_free(up->service_name);
+    up->service_name = g_strdup(service_name);
+    up->time = *now;
+}
+
+/**
+ *******************************************************************************
+ * @brief Note that a dynamic service was requested while it wasn't running.
+ *
+ * @param  prelaunch     IN  pre-launch graph
+ * @param  service_name  IN  requested service
+ * @param  now           IN  current time
+ *******************************************************************************
+ */
+void
+_LSHubPrelaunchServiceRequested(_LSHubPrelaunch *prelaunch, const char *service_name,
+                                const struct timespec *now)
+{
+    LS_ASSERT(service_name != NULL);
+
+    int i;
+    for (i = 0; i < PRELAUNCH_RECENT_UPS; i++)
+    {
+        const _LSHubPrelaunchUp *up = &prelaunch->recent[i];
+
+        if (!up->service_name || !strcmp(up->service_name, service_name))
+            continue;
+
+        struct timespec elapsed;
+        ClockDiff(&elapsed, now, &up->time);
+
+        long elapsed_ms = ClockGetMs(&elapsed);
+        if (elapsed_ms < 0 || elapsed_ms > PRELAUNCH_WINDOW_MS)
+            continue;
+
+        _LSHubPrelaunchRecord(prelaunch, up->service_name, service_name, 1);
+    }
+}
+
+static gint
+_LSHubPrelaunchFollowerCompare(gconstpointer a, gconstpointer b)
+{
+    const _LSHubPrelaunchFollower *fa = *(const _LSHubPrelaunchFollower **) a;
+    const _LSHubPrelaunchFollower *fb = *(const _LSHubPrelaunchFollower **) b;
+
+    return (fb->count > fa->count) - (fb->count < fa->count);
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the services likely to be requested after the service came up,
+ * the likeliest first.
+ *
+ * @param  prelaunch     IN  pre-launch graph
+ * @param  service_name  IN  service that came up
+ *
+ * @retval  NULL-terminated array of service names, valid until the graph
+ *          changes; the array is freed with g_free()
+ *******************************************************************************
+ */
+const char**
+_LSHubPrelaunchPredict(_LSHubPrelaunch *prelaunch, const char *service_name)
+{
+    _LSHubPrelaunchNode *node = g_hash_table_lookup(prelaunch->nodes, service_name);
+    unsigned int len = node ? node->len : 0;
+
+    _LSHubPrelaunchFollower *likely[PRELAUNCH_MAX_FOLLOWERS];
+    unsigned int i, count = 0;
+    for (i = 0; i < len; i++)
+    {
+        if (node->followers[i].count >= PRELAUNCH_MIN_COUNT)
+            likely[count++] = &node->followers[i];
+    }
+
+    qsort(likely, count, sizeof(likely[0]), _LSHubPrelaunchFollowerCompare);
+
+    const char **names = g_new(const char*, count + 1);
+    for (i = 0; i < count; i++)
+    {
+        names[i] = likely[i]->service_name;
+    }
+    names[count] = NULL;
+
+    return names;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get how often a service was followed by another one.
+ *
+ * @param  prelaunch      IN  pre-launch graph
+ * @param  service_name   IN  service
+ * @param  follower_name  IN  follower
+ *
+ * @retval  count, 0 if the follower isn't tracked
+ *******************************************************************************
+ */
+unsigned int
+_LSHubPrelaunchGetCount(_LSHubPrelaunch *prelaunch, const char *service_name,
+                        const char *follower_name)
+{
+    _LSHubPrelaunchNode *node = g_hash_table_lookup(prelaunch->nodes, service_name);
+    if (!node) return 0;
+
+    unsigned int i;
+    for (i = 0; i < node->len; i++)
+    {
+        if (!strcmp(node->followers[i].service_name, follower_name))
+            return node->followers[i].count;
+    }
+
+    return 0;
+}
+
+bool
+_LSHubPrelaunchIsDirty(const _LSHubPrelaunch *prelaunch)
+{
+    return prelaunch->dirty;
+}
+
+/**
+ *******************************************************************************
+ * @brief Load the graph saved by _LSHubPrelaunchSave(), adding it to what
+ * was observed so far.
+ *
+ * File format is a key file with a group per service, listing its
+ * followers and their counts:
+ *
+ * [com.palm.service]
+ * com.palm.follower=count
+ *
+ * @param  prelaunch  IN   pre-launch graph
+ * @param  path       IN   file path
+ * @param  lserror    OUT  set on error
+ *
+ * @retval  true on success
+ *******************************************************************************
+ */
+bool
+_LSHubPrelaunchLoad(_LSHubPrelaunch *prelaunch, const char *path, LSError *lserror)
+{
+    GError *gerror = NULL;
+    GKeyFile *key_file = g_key_file_new();
+
+    if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, &gerror))
+    {
+        _LSErrorSet(lserror, MSGID_LSHUB_PRELAUNCH_ERR, -1, "Error loading pre-launch graph: \"%s\", message: \"%s\"",
+                    path, gerror->message);
+        g_error_free(gerror);
+        g_key_file_free(key_file);
+        return false;
+    }
+
+    bool dirty = prelaunch->dirty;
+
+    gchar **groups = g_key_file_get_groups(key_file, NULL);
+    gchar **group;
+    for (group = groups; *group; group++)
+    {
+        gchar **keys = g_key_file_get_keys(key_file, *group, NULL, NULL);
+        if (!keys) continue;
+
+        gchar **key;
+        for (key = keys; *key; key++)
+        {
+            int count = g_key_file_get_integer(key_file, *group, *key, NULL);
+            if (count > 0)
+            {
+                _LSHubPrelaunchRecord(prelaunch, *group, *key, MIN(count, PRELAUNCH_MAX_COUNT));
+            }
+        }
+        g_strfreev(keys);
+    }
+    g_strfreev(groups);
+
+    g_key_file_free(key_file);
+
+    /* nothing new to save */
+    prelaunch->dirty = dirty;
+    return true;
+}
+
+/**
+ *******************************************************************************
+ * @brief Save the graph.
+ *
+ * @param  prelaunch  IN   pre-launch graph
+ * @param  path       IN   file path
+ * @param  lserror    OUT  set on error
+ *
+ * @retval  true on success
+ *******************************************************************************
+ */
+bool
+_LSHubPrelaunchSave(_LSHubPrelaunch *prelaunch, const char *path, LSError *lserror)
+{
+    GError *gerror = NULL;
+    GKeyFile *key_file = g_key_file_new();
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, prelaunch->nodes);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        const _LSHubPrelaunchNode *node = value;
+
+        unsigned int i;
+        for (i = 0; i < node->len; i++)
+        {
+            g_key_file_set_integer(key_file, node->service_name, node->followers[i].service_name,
+                                   node->followers[i].count);
+        }
+    }
+
+    gsize length = 0;
+    gchar *data = g_key_file_to_data(key_file, &length, NULL);
+    g_key_file_free(key_file);
+
+    /* replaced atomically, a crash can't leave half a file behind */
+    bool ret = g_file_set_contents(path, data, length, &gerror);
+    g_free(data);
+
+    if (!ret)
+    {
+        _LSErrorSet(lserror, MSGID_LSHUB_PRELAUNCH_ERR, -1, "Error saving pre-launch graph: \"%s\", message: \"%s\"",
+                    path, gerror->message);
+        g_error_free(gerror);
+        return false;
+    }
+
+    prelaunch->dirty = false;
+    return true;
+}
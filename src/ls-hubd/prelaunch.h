@@ -0,0 +1,60 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _PRELAUNCH_H
+#define _PRELAUNCH_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <glib.h>
+
+#include <luna-service2/lunaservice.h>
+
+/**
+ * Observed call graph of the dynamic services, used to launch them before
+ * they are asked for.
+ *
+ * Every dynamic service requested shortly after another service came up is
+ * counted as following that service. Once a service has been followed by
+ * the same one often enough, the follower is predicted the next time the
+ * service comes up.
+ *
+ * Memory is bounded: a limited number of services is tracked, each with a
+ * limited number of followers; the least followed ones make room for new
+ * ones, and counts are halved as they saturate, so that the graph keeps
+ * adapting.
+ */
+typedef struct _LSHubPrelaunch _LSHubPrelaunch;
+
+_LSHubPrelaunch* _LSHubPrelaunchNew(void);
+void _LSHubPrelaunchFree(_LSHubPrelaunch *prelaunch);
+
+void _LSHubPrelaunchServiceUp(_LSHubPrelaunch *prelaunch, const char *service_name,
+                              const struct timespec *now);
+void _LSHubPrelaunchServiceRequested(_LSHubPrelaunch *prelaunch, const char *service_name,
+                                     const struct timespec *now);
+const char** _LSHubPrelaunchPredict(_LSHubPrelaunch *prelaunch, const char *service_name);
+unsigned int _LSHubPrelaunchGetCount(_LSHubPrelaunch *prelaunch, const char *service_name,
+                                     const char *follower_name);
+
+bool _LSHubPrelaunchIsDirty(const _LSHubPrelaunch *prelaunch);
+bool _LSHubPrelaunchLoad(_LSHubPrelaunch *prelaunch, const char *path, LSError *lserror);
+bool _LSHubPrelaunchSave(_LSHubPrelaunch *prelaunch, const char *path, LSError *lserror);
+
+#endif //_PRELAUNCH_H
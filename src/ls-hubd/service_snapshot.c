@@ -0,0 +1,215 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+#include <string.h>
+
+#include "service_snapshot.h"
+#include "error.h"
+
+#define SNAPSHOT_HEAD   "{\"returnValue\":true,\"services\":["
+#define SNAPSHOT_TAIL   "]}"
+
+/* Entry of a service. The JSON starts with the separator, which is skipped
+ * for the first entry of a reply */
+typedef struct _LSHubServiceSnapshotEntry {
+    char *service_name;
+    char *json;                 /**< ",{...}" */
+    gsize len;                  /**< length of json */
+    guint index;                /**< position in the entries array */
+} _LSHubServiceSnapshotEntry;
+
+struct _LSHubServiceSnapshot {
+    GHashTable *by_name;        /**< service name to entry */
+    GPtrArray *entries;         /**< entries, in no particular order */
+};
+
+static void
+_LSHubServiceSnapshotEntryFree(_LSHubServiceSnapshotEntry *entry)
+{
+    g_free(entry->service_name);
+    g_free(entry->json);
+    g_slice_free(_LSHubServiceSnapshotEntry, entry);
+}
+
+_LSHubServiceSnapshot*
+_LSHubServiceSnapshotNew(void)
+{
+    _LSHubServiceSnapshot *snapshot = g_slice_new0(_LSHubServiceSnapshot);
+
+    snapshot->by_name = g_hash_table_new(g_str_hash, g_str_equal);
+    snapshot->entries = g_ptr_array_new_with_free_func((GDestroyNotify) _LSHubServiceSnapshotEntryFree);
+
+    return snapshot;
+}
+
+void
+_LSHubServiceSnapshotFree(_LSHubServiceSnapshot *snapshot)
+{
+    if (!snapshot) return;
+
+    g_hash_table_destroy(snapshot->by_name);
+    g_ptr_array_free(snapshot->entries, TRUE);
+    g_slice_free(_LSHubServiceSnapshot, snapshot);
+}
+
+/**
+ *******************************************************************************
+ * @brief Add the entry of a service, or rebuild it if it's there already
+ * (e.g., its names changed with the roles).
+ *
+ * @param  snapshot      IN  snapshot
+ * @param  service_name  IN  service name
+ * @param  pid           IN  pid of the service
+ * @param  all_names     IN  JSON fragment listing all the names of its
+ *                           executable (may be NULL)
+ *******************************************************************************
+ */
+void
+_LSHubServiceSnapshotSet(_LSHubServiceSnapshot *snapshot, const char *service_name,
+                         pid_t pid, const char *all_names)
+{
+    LS_ASSERT(service_name != NULL);
+
+    _LSHubServiceSnapshotEntry *entry = g_hash_table_lookup(snapshot->by_name, service_name);
+
+    if (!entry)
+    {
+        entry = g_slice_new0(_LSHubServiceSnapshotEntry);
+        entry->service_name = g_strdup(service_name);
+        entry->index = snapshot->entries->len;
+        g_ptr_array_add(snapshot->entries, entry);
+        g_hash_table_insert(snapshot->by_name, entry->service_name, entry);
+    }
+
+    g_free(entry->json);
+    entry->json = g_strdup_printf(",{\"serviceName\":\"%s\",\"pid\":%d,\"allNames\":[%s]}",
+                                  service_name, (int) pid, all_names ? all_names : "");
+    entry->len = strlen(entry->json);
+}
+
+/**
+ *******************************************************************************
+ * @brief Remove the entry of a service.
+ *
+ * @param  snapshot      IN  snapshot
+ * @param  service_name  IN  service name
+ *
+ * @retval  true if the service had an entry
+ *******************************************************************************
+ */
+bool
+_LSHubServiceSnapshotRemove(_LSHubServiceSnapshot *snapshot, const char *service_name)
+{
+    _LSHubServiceSnapshotEntry *entry = g_hash_table_lookup(snapshot->by_name, service_name);
+
+    if (!entry) return false;
+
+    g_hash_table_remove(snapshot->by_name, service_name);
+
+    /* the last entry takes the place of the removed one */
+    guint last = snapshot->entries->len - 1;
+    if (entry->index != last)
+    {
+        _LSHubServiceSnapshotEntry *moved = g_ptr_array_index(snapshot->entries, last);
+        moved->index = entry->index;
+    }
+    g_ptr_array_remove_index_fast(snapshot->entries, entry->index);
+
+    return true;
+}
+
+unsigned int
+_LSHubServiceSnapshotGetCount(const _LSHubServiceSnapshot *snapshot)
+{
+    return snapshot->entries->len;
+}
+
+/**
+ *******************************************************************************
+ * @brief Gather the reply payload. The vector points into the snapshot and
+ * is valid until the snapshot changes; the last element ends with the
+ * terminating zero.
+ *
+ * @param  snapshot  IN   snapshot
+ * @param  count     OUT  number of elements
+ *
+ * @retval  allocated vector, to be freed with g_free()
+ *******************************************************************************
+ */
+struct iovec*
+_LSHubServiceSnapshotGetVector(const _LSHubServiceSnapshot *snapshot, int *count)
+{
+    static const char head[] = SNAPSHOT_HEAD;
+    static const char tail[] = SNAPSHOT_TAIL;
+
+    guint len = snapshot->entries->len;
+    struct iovec *iov = g_new(struct iovec, len + 2);
+
+    iov[0].iov_base = (void *) head;
+    iov[0].iov_len = sizeof(head) - 1;
+
+    guint i;
+    for (i = 0; i < len; i++)
+    {
+        const _LSHubServiceSnapshotEntry *entry = g_ptr_array_index(snapshot->entries, i);
+
+        /* no separator before the first entry */
+        iov[i + 1].iov_base = entry->json + (i == 0 ? 1 : 0);
+        iov[i + 1].iov_len = entry->len - (i == 0 ? 1 : 0);
+    }
+
+    iov[len + 1].iov_base = (void *) tail;
+    iov[len + 1].iov_len = sizeof(tail);
+
+    *count = len + 2;
+    return iov;
+}
+
+/**
+ *******************************************************************************
+ * @brief Get the reply payload as one string.
+ *
+ * @param  snapshot  IN  snapshot
+ *
+ * @retval  allocated payload, to be freed with g_free()
+ *******************************************************************************
+ */
+char*
+_LSHubServiceSnapshotGetPayload(const _LSHubServiceSnapshot *snapshot)
+{
+    int count = 0;
+    struct iovec *iov = _LSHubServiceSnapshotGetVector(snapshot, &count);
+
+    gsize size = 0;
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        size += iov[i].iov_len;
+    }
+
+    char *payload = g_malloc(size);
+    char *pos = payload;
+    for (i = 0; i < count; i++)
+    {
+        memcpy(pos, iov[i].iov_base, iov[i].iov_len);
+        pos += iov[i].iov_len;
+    }
+
+    g_free(iov);
+    return payload;
+}
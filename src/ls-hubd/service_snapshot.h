@@ -0,0 +1,49 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#ifndef _SERVICE_SNAPSHOT_H
+#define _SERVICE_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <glib.h>
+
+/**
+ * Materialized list of the available services, as replied to a client that
+ * registers for the status of all of them.
+ *
+ * Every service has its JSON entry built once, when it comes up (and again
+ * when the roles that give its names are reloaded). A reply is then only
+ * gathered out of the entries as an io vector, without formatting anything.
+ */
+typedef struct _LSHubServiceSnapshot _LSHubServiceSnapshot;
+
+_LSHubServiceSnapshot* _LSHubServiceSnapshotNew(void);
+void _LSHubServiceSnapshotFree(_LSHubServiceSnapshot *snapshot);
+
+void _LSHubServiceSnapshotSet(_LSHubServiceSnapshot *snapshot, const char *service_name,
+                              pid_t pid, const char *all_names);
+bool _LSHubServiceSnapshotRemove(_LSHubServiceSnapshot *snapshot, const char *service_name);
+unsigned int _LSHubServiceSnapshotGetCount(const _LSHubServiceSnapshot *snapshot);
+
+struct iovec* _LSHubServiceSnapshotGetVector(const _LSHubServiceSnapshot *snapshot, int *count);
+char* _LSHubServiceSnapshotGetPayload(const _LSHubServiceSnapshot *snapshot);
+
+#endif //_SERVICE_SNAPSHOT_H
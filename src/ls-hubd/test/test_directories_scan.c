@@ -28,6 +28,9 @@ static void test_LSHubScanServiceDirectories(void *fixture, gconstpointer user_d
     g_assert(ServiceMapLookup("volatile.service3_") == NULL);
     g_assert(ServiceMapLookup("volatile.service4_") == NULL);
 
+    // a dynamic service whose Exec line can't be parsed is rejected
+    g_assert(ServiceMapLookup("steady.service5") == NULL);
+
     // load services from volatile directories
     g_assert(ConfigKeyProcessDynamicServiceDirs(volatile_services, GINT_TO_POINTER(VOLATILE_DIRS), &lserror));
 
@@ -0,0 +1,171 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include "../prelaunch.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+static struct timespec
+test_time(long ms)
+{
+    struct timespec time = { .tv_sec = 1000 + ms / 1000, .tv_nsec = (ms % 1000) * 1000000 };
+    return time;
+}
+
+/* a comes up, then b is requested after delay_ms */
+static void
+test_observe(_LSHubPrelaunch *prelaunch, const char *a, const char *b, long at_ms, long delay_ms)
+{
+    struct timespec up = test_time(at_ms);
+    struct timespec requested = test_time(at_ms + delay_ms);
+
+    _LSHubPrelaunchServiceUp(prelaunch, a, &up);
+    _LSHubPrelaunchServiceRequested(prelaunch, b, &requested);
+}
+
+static void
+test_LSHubPrelaunchPredict(void)
+{
+    _LSHubPrelaunch *prelaunch = _LSHubPrelaunchNew();
+
+    const char **predicted = _LSHubPrelaunchPredict(prelaunch, "com.palm.a");
+    g_assert(predicted[0] == NULL);
+    g_free(predicted);
+
+    /* seen once isn't enough */
+    test_observe(prelaunch, "com.palm.a", "com.palm.b", 0, 100);
+    g_assert(_LSHubPrelaunchIsDirty(prelaunch));
+    g_assert_cmpuint(_LSHubPrelaunchGetCount(prelaunch, "com.palm.a", "com.palm.b"), ==, 1);
+
+    predicted = _LSHubPrelaunchPredict(prelaunch, "com.palm.a");
+    g_assert(predicted[0] == NULL);
+    g_free(predicted);
+
+    test_observe(prelaunch, "com.palm.a", "com.palm.b", 10000, 100);
+    test_observe(prelaunch, "com.palm.a", "com.palm.c", 20000, 100);
+    test_observe(prelaunch, "com.palm.a", "com.palm.c", 30000, 100);
+    test_observe(prelaunch, "com.palm.a", "com.palm.c", 40000, 100);
+
+    /* the likeliest first */
+    predicted = _LSHubPrelaunchPredict(prelaunch, "com.palm.a");
+    g_assert_cmpstr(predicted[0], ==, "com.palm.c");
+    g_assert_cmpstr(predicted[1], ==, "com.palm.b");
+    g_assert(predicted[2] == NULL);
+    g_free(predicted);
+
+    /* nothing follows what came up too long ago */
+    test_observe(prelaunch, "com.palm.d", "com.palm.e", 50000, 10000);
+    g_assert_cmpuint(_LSHubPrelaunchGetCount(prelaunch, "com.palm.d", "com.palm.e"), ==, 0);
+
+    /* nor does a service follow itself */
+    test_observe(prelaunch, "com.palm.d", "com.palm.d", 70000, 100);
+    g_assert_cmpuint(_LSHubPrelaunchGetCount(prelaunch, "com.palm.d", "com.palm.d"), ==, 0);
+
+    _LSHubPrelaunchFree(prelaunch);
+}
+
+static void
+test_LSHubPrelaunchBounded(void)
+{
+    _LSHubPrelaunch *prelaunch = _LSHubPrelaunchNew();
+
+    /* many followers seen once each push each other out, not the one seen
+     * every time */
+    int i;
+    for (i = 0; i < 100; i++)
+    {
+        char *name = g_strdup_printf("com.palm.rare%d", i);
+        test_observe(prelaunch, "com.palm.a", "com.palm.frequent", i * 20000, 100);
+        test_observe(prelaunch, "com.palm.a", name, i * 20000 + 10000, 100);
+        g_free(name);
+    }
+
+    g_assert_cmpuint(_LSHubPrelaunchGetCount(prelaunch, "com.palm.a", "com.palm.frequent"), >, 1);
+    g_assert_cmpuint(_LSHubPrelaunchGetCount(prelaunch, "com.palm.a", "com.palm.rare0"), ==, 0);
+
+    const char **predicted = _LSHubPrelaunchPredict(prelaunch, "com.palm.a");
+    g_assert_cmpstr(predicted[0], ==, "com.palm.frequent");
+    g_assert(predicted[1] == NULL);
+    g_free(predicted);
+
+    /* counts keep adapting instead of growing */
+    for (i = 0; i < 1000; i++)
+    {
+        test_observe(prelaunch, "com.palm.b", "com.palm.c", i * 10000, 100);
+    }
+    g_assert_cmpuint(_LSHubPrelaunchGetCount(prelaunch, "com.palm.b", "com.palm.c"), <=, 64);
+
+    _LSHubPrelaunchFree(prelaunch);
+}
+
+static void
+test_LSHubPrelaunchSaveLoad(void)
+{
+    char *path = g_build_filename(g_get_tmp_dir(), "test_prelaunch.XXXXXX", NULL);
+    int fd = g_mkstemp(path);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    _LSHubPrelaunch *prelaunch = _LSHubPrelaunchNew();
+    test_observe(prelaunch, "com.palm.a", "com.palm.b", 0, 100);
+    test_observe(prelaunch, "com.palm.a", "com.palm.b", 10000, 100);
+    test_observe(prelaunch, "com.palm.c", "com.palm.d", 20000, 100);
+
+    g_assert(_LSHubPrelaunchSave(prelaunch, path, &lserror));
+    g_assert(!_LSHubPrelaunchIsDirty(prelaunch));
+    _LSHubPrelaunchFree(prelaunch);
+
+    prelaunch = _LSHubPrelaunchNew();
+    g_assert(_LSHubPrelaunchLoad(prelaunch, path, &lserror));
+    g_assert(!_LSHubPrelaunchIsDirty(prelaunch));
+    g_assert_cmpuint(_LSHubPrelaunchGetCount(prelaunch, "com.palm.a", "com.palm.b"), ==, 2);
+    g_assert_cmpuint(_LSHubPrelaunchGetCount(prelaunch, "com.palm.c", "com.palm.d"), ==, 1);
+
+    const char **predicted = _LSHubPrelaunchPredict(prelaunch, "com.palm.a");
+    g_assert_cmpstr(predicted[0], ==, "com.palm.b");
+    g_free(predicted);
+    _LSHubPrelaunchFree(prelaunch);
+
+    g_unlink(path);
+
+    prelaunch = _LSHubPrelaunchNew();
+    g_assert(!_LSHubPrelaunchLoad(prelaunch, path, &lserror));
+    g_assert(LSErrorIsSet(&lserror));
+    LSErrorFree(&lserror);
+    _LSHubPrelaunchFree(prelaunch);
+
+    g_free(path);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/luna-service2/LSHubPrelaunchPredict", test_LSHubPrelaunchPredict);
+    g_test_add_func("/luna-service2/LSHubPrelaunchBounded", test_LSHubPrelaunchBounded);
+    g_test_add_func("/luna-service2/LSHubPrelaunchSaveLoad", test_LSHubPrelaunchSaveLoad);
+
+    return g_test_run();
+}
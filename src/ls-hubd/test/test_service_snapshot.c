@@ -0,0 +1,201 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2014 LG Electronics, Inc.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+* LICENSE@@@ */
+
+
+#include "../service_snapshot.h"
+
+#include <glib.h>
+#include <string.h>
+
+#define TEST_SERVICES       300
+#define TEST_REGISTRATIONS  500
+
+static void
+test_LSHubServiceSnapshotEmpty(void)
+{
+    _LSHubServiceSnapshot *snapshot = _LSHubServiceSnapshotNew();
+
+    char *payload = _LSHubServiceSnapshotGetPayload(snapshot);
+    g_assert_cmpstr(payload, ==, "{\"returnValue\":true,\"services\":[]}");
+    g_free(payload);
+
+    g_assert(!_LSHubServiceSnapshotRemove(snapshot, "com.palm.a"));
+
+    _LSHubServiceSnapshotFree(snapshot);
+}
+
+static void
+test_LSHubServiceSnapshotSetRemove(void)
+{
+    _LSHubServiceSnapshot *snapshot = _LSHubServiceSnapshotNew();
+
+    _LSHubServiceSnapshotSet(snapshot, "com.palm.a", 10, "\"com.palm.a\"");
+    _LSHubServiceSnapshotSet(snapshot, "com.palm.b", 20, NULL);
+    _LSHubServiceSnapshotSet(snapshot, "com.palm.c", 30, "\"com.palm.c\",\"com.palm.d\"");
+    g_assert_cmpuint(_LSHubServiceSnapshotGetCount(snapshot), ==, 3);
+
+    char *payload = _LSHubServiceSnapshotGetPayload(snapshot);
+    g_assert_cmpstr(payload, ==, "{\"returnValue\":true,\"services\":["
+                                 "{\"serviceName\":\"com.palm.a\",\"pid\":10,\"allNames\":[\"com.palm.a\"]},"
+                                 "{\"serviceName\":\"com.palm.b\",\"pid\":20,\"allNames\":[]},"
+                                 "{\"serviceName\":\"com.palm.c\",\"pid\":30,\"allNames\":[\"com.palm.c\",\"com.palm.d\"]}"
+                                 "]}");
+    g_free(payload);
+
+    /* rebuilt in place */
+    _LSHubServiceSnapshotSet(snapshot, "com.palm.b", 21, "\"com.palm.b\"");
+    g_assert_cmpuint(_LSHubServiceSnapshotGetCount(snapshot), ==, 3);
+
+    /* the last entry moves into the place of the first one */
+    g_assert(_LSHubServiceSnapshotRemove(snapshot, "com.palm.a"));
+    g_assert(!_LSHubServiceSnapshotRemove(snapshot, "com.palm.a"));
+    g_assert_cmpuint(_LSHubServiceSnapshotGetCount(snapshot), ==, 2);
+
+    payload = _LSHubServiceSnapshotGetPayload(snapshot);
+    g_assert_cmpstr(payload, ==, "{\"returnValue\":true,\"services\":["
+                                 "{\"serviceName\":\"com.palm.c\",\"pid\":30,\"allNames\":[\"com.palm.c\",\"com.palm.d\"]},"
+                                 "{\"serviceName\":\"com.palm.b\",\"pid\":21,\"allNames\":[\"com.palm.b\"]}"
+                                 "]}");
+    g_free(payload);
+
+    /* the moved entry can still be removed */
+    g_assert(_LSHubServiceSnapshotRemove(snapshot, "com.palm.c"));
+    g_assert(_LSHubServiceSnapshotRemove(snapshot, "com.palm.b"));
+    g_assert_cmpuint(_LSHubServiceSnapshotGetCount(snapshot), ==, 0);
+
+    payload = _LSHubServiceSnapshotGetPayload(snapshot);
+    g_assert_cmpstr(payload, ==, "{\"returnValue\":true,\"services\":[]}");
+    g_free(payload);
+
+    _LSHubServiceSnapshotFree(snapshot);
+}
+
+static void
+test_LSHubServiceSnapshotVector(void)
+{
+    _LSHubServiceSnapshot *snapshot = _LSHubServiceSnapshotNew();
+
+    _LSHubServiceSnapshotSet(snapshot, "com.palm.a", 10, NULL);
+    _LSHubServiceSnapshotSet(snapshot, "com.palm.b", 20, NULL);
+
+    int count = 0;
+    struct iovec *iov = _LSHubServiceSnapshotGetVector(snapshot, &count);
+    g_assert_cmpint(count, ==, 4);
+
+    /* the payload is terminated by the last element */
+    g_assert_cmpint(((char *) iov[count - 1].iov_base)[iov[count - 1].iov_len - 1], ==, '\0');
+
+    GString *str = g_string_new(NULL);
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        g_string_append_len(str, iov[i].iov_base, iov[i].iov_len);
+    }
+
+    char *payload = _LSHubServiceSnapshotGetPayload(snapshot);
+    g_assert_cmpuint(str->len, ==, strlen(payload) + 1);
+    g_assert_cmpstr(str->str, ==, payload);
+
+    g_free(payload);
+    g_string_free(str, TRUE);
+    g_free(iov);
+    _LSHubServiceSnapshotFree(snapshot);
+}
+
+/* The way the hub used to reply: every service formatted for every registration */
+static char*
+test_format_all_services(GHashTable *services)
+{
+    GString *str = g_string_new("{\"returnValue\":true,\"services\":[");
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, services);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        g_string_append_printf(str, "{\"serviceName\":\"%s\",\"pid\":%d,\"allNames\":[\"%s\"]},",
+                               (char *) key, GPOINTER_TO_INT(value), (char *) key);
+    }
+
+    g_string_truncate(str, str->len - 1);
+    g_string_append(str, "]}");
+
+    return g_string_free(str, FALSE);
+}
+
+static void
+test_LSHubServiceSnapshotPerf(void)
+{
+    if (!g_test_perf()) return;
+
+    _LSHubServiceSnapshot *snapshot = _LSHubServiceSnapshotNew();
+    GHashTable *services = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    int i;
+    for (i = 0; i < TEST_SERVICES; i++)
+    {
+        char *name = g_strdup_printf("com.palm.service%d", i);
+        char *all_names = g_strdup_printf("\"%s\"", name);
+
+        g_hash_table_insert(services, name, GINT_TO_POINTER(1000 + i));
+        _LSHubServiceSnapshotSet(snapshot, name, 1000 + i, all_names);
+
+        g_free(all_names);
+    }
+
+    gsize bytes = 0;
+
+    g_test_timer_start();
+    for (i = 0; i < TEST_REGISTRATIONS; i++)
+    {
+        char *payload = test_format_all_services(services);
+        bytes += strlen(payload);
+        g_free(payload);
+    }
+    double formatted = g_test_timer_elapsed();
+
+    g_test_timer_start();
+    for (i = 0; i < TEST_REGISTRATIONS; i++)
+    {
+        int count = 0;
+        struct iovec *iov = _LSHubServiceSnapshotGetVector(snapshot, &count);
+        bytes += iov[count - 1].iov_len;
+        g_free(iov);
+    }
+    double gathered = g_test_timer_elapsed();
+
+    g_test_message("%d registrations against %d services: formatted %.3f ms, gathered %.3f ms (%" G_GSIZE_FORMAT " bytes)",
+                   TEST_REGISTRATIONS, TEST_SERVICES, formatted * 1000, gathered * 1000, bytes);
+    g_test_minimized_result(gathered, "gathered %d replies in %.3f ms", TEST_REGISTRATIONS, gathered * 1000);
+
+    g_hash_table_destroy(services);
+    _LSHubServiceSnapshotFree(snapshot);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/luna-service2/LSHubServiceSnapshotEmpty", test_LSHubServiceSnapshotEmpty);
+    g_test_add_func("/luna-service2/LSHubServiceSnapshotSetRemove", test_LSHubServiceSnapshotSetRemove);
+    g_test_add_func("/luna-service2/LSHubServiceSnapshotVector", test_LSHubServiceSnapshotVector);
+    g_test_add_func("/luna-service2/LSHubServiceSnapshotPerf", test_LSHubServiceSnapshotPerf);
+
+    return g_test_run();
+}